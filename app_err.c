@@ -61,6 +61,10 @@ errtostr (int err)
     "Error in updating the category list",
     "Error in loading flat category list",
     "Invalid program state",
+    "Error in upgrading the category list",
+    "Category list upgrade does not start from the DB version",
+    "No SDE response after all retransmissions",
+    "Too many outstanding SDE requests",
   };
 
   return errstr[err];
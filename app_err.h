@@ -80,6 +80,10 @@ enum err
     ERR_UPDATE_CATEGORY_LIST, /**< Error in updating the category list. */
     ERR_LOAD_FLAT_CATEGORY_LIST, /**< Error in loading flat category list. */
     ERR_INVALID_STATE, /**< The state should never been entered. */
+    ERR_UPGRADE_CATEGORY_LIST, /**< Error in upgrading the category list. */
+    ERR_CATEGORY_VERSION, /**< The upgrade is not for the DB version. */
+    ERR_SDE_TIMEOUT, /**< No SDE response after all retransmissions. */
+    ERR_SDE_BUSY, /**< Too many outstanding SDE requests. */
   };
 
 /**
@@ -0,0 +1,198 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file bench.c
+ * @brief The implementation of the micro-benchmark harness.
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "sde_stats.h"
+
+volatile uintptr_t bench_sink;
+
+/** Non-zero if the allocations are being counted. */
+static int is_counting = 0;
+
+/** The number of allocations counted since the run started. */
+static uint64_t alloc_count;
+
+/** The number of bytes allocated since the run started. */
+static uint64_t alloc_bytes;
+
+/** The time the timer was last started or 0 if it is stopped. */
+static uint64_t timer_start;
+
+/** The time accumulated by the timer since the run started. */
+static uint64_t timer_elapsed;
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t nmemb, size_t size);
+void *__real_realloc (void *ptr, size_t size);
+
+void *
+__wrap_malloc (size_t size)
+{
+  if (is_counting)
+    {
+      alloc_count++;
+      alloc_bytes += size;
+    }
+  return __real_malloc (size);
+}
+
+void *
+__wrap_calloc (size_t nmemb, size_t size)
+{
+  if (is_counting)
+    {
+      alloc_count++;
+      alloc_bytes += nmemb * size;
+    }
+  return __real_calloc (nmemb, size);
+}
+
+void *
+__wrap_realloc (void *ptr, size_t size)
+{
+  if (is_counting)
+    {
+      alloc_count++;
+      alloc_bytes += size;
+    }
+  return __real_realloc (ptr, size);
+}
+
+void
+stop_bench_timer (void)
+{
+  if (timer_start != 0)
+    {
+      timer_elapsed += get_sde_stats_time () - timer_start;
+      timer_start = 0;
+    }
+  is_counting = 0;
+}
+
+void
+start_bench_timer (void)
+{
+  is_counting = 1;
+  if (timer_start == 0)
+    {
+      timer_start = get_sde_stats_time ();
+    }
+}
+
+void
+die_bench (const char *what, int rc)
+{
+  fprintf (stderr, "%s failed (%d)\n", what, rc);
+  exit (EXIT_FAILURE);
+}
+
+/**
+ * Runs a benchmark with an increasing number of operations until a run takes
+ * at least the given time and prints the result of that run.
+ *
+ * @param [in] b the benchmark to run.
+ * @param [in] min_ns the minimum duration of the reported run.
+ */
+static void
+run_bench (const struct bench *b, uint64_t min_ns)
+{
+  uint64_t n = 1;
+
+  if (b->setup != NULL)
+    {
+      b->setup (b);
+    }
+
+  /* Warms up the caches. */
+  b->run (b, 1);
+
+  while (1)
+    {
+      uint64_t next;
+
+      alloc_count = 0;
+      alloc_bytes = 0;
+      timer_elapsed = 0;
+      start_bench_timer ();
+      b->run (b, n);
+      stop_bench_timer ();
+
+      if (timer_elapsed >= min_ns || n >= 1000000000ULL)
+	{
+	  break;
+	}
+
+      next = (timer_elapsed == 0
+	      ? n * 100 : (double) n * min_ns / timer_elapsed * 1.2);
+      if (next > n * 100)
+	{
+	  next = n * 100;
+	}
+      n = (next > n ? next : n + 1);
+    }
+
+  if (b->teardown != NULL)
+    {
+      b->teardown (b);
+    }
+
+  printf ("Benchmark%s\t%llu\t%.1f ns/op\t%.0f B/op\t%.2f allocs/op\n",
+	  b->name, (unsigned long long) n, (double) timer_elapsed / n,
+	  (double) alloc_bytes / n, (double) alloc_count / n);
+  fflush (stdout);
+}
+
+void
+run_benches (const struct bench *benches, size_t count,
+	     int argc, char **argv)
+{
+  double min_seconds = 0.5;
+  const char *filter = NULL;
+  size_t i;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "t:")) != -1)
+    {
+      switch (opt)
+	{
+	case 't':
+	  min_seconds = atof (optarg);
+	  break;
+	default:
+	  fprintf (stderr, "Usage: %s [-t MIN_SECONDS] [FILTER]\n", argv[0]);
+	  exit (EXIT_FAILURE);
+	}
+    }
+  if (optind < argc)
+    {
+      filter = argv[optind];
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      if (filter == NULL || strstr (benches[i].name, filter) != NULL)
+	{
+	  run_bench (&benches[i], min_seconds * 1e9);
+	}
+    }
+}
@@ -0,0 +1,94 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file bench.h
+ * @brief The micro-benchmark harness. A benchmark runs an increasing number
+ *        of operations until a run takes long enough and prints one line in
+ *        the Go benchmark format (name, iterations, ns/op, B/op and
+ *        allocs/op) so that the results of two builds can be compared with
+ *        tools like benchstat. The allocations are counted by wrapping
+ *        malloc(), calloc() and realloc() at link time (i.e., a benchmark
+ *        executable must be linked with
+ *        <code>-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc</code>), and so
+ *        allocations made inside shared libraries are not counted.
+ ****************************************************************************/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** A micro-benchmark. */
+struct bench
+{
+  const char *name; /**< The name without the "Benchmark" prefix. */
+  void (*setup) (const struct bench *b); /**< The preparation or NULL. */
+  void (*run) (const struct bench *b, uint64_t n); /**< Runs n operations. */
+  size_t arg1; /**< The first parameter. */
+  size_t arg2; /**< The second parameter. */
+  int variant; /**< A benchmark-specific variant. */
+  void (*teardown) (const struct bench *b); /**< The clean up or NULL. */
+};
+
+/** A value that the optimizer cannot discard. */
+extern volatile uintptr_t bench_sink;
+
+/**
+ * Stops timing and counting allocations so that a benchmark can exclude the
+ * work that prepares or undoes its operation.
+ */
+void
+stop_bench_timer (void);
+
+/**
+ * Resumes timing and counting allocations stopped by stop_bench_timer().
+ */
+void
+start_bench_timer (void);
+
+/**
+ * Runs the benchmarks selected by the command line arguments
+ * <code>[-t MIN_SECONDS] [FILTER]</code> in which FILTER is a substring of
+ * the names of the benchmarks to run. The program exits if the arguments are
+ * invalid.
+ *
+ * @param [in] benches the benchmarks.
+ * @param [in] count the number of benchmarks.
+ * @param [in] argc the argument count of main().
+ * @param [in] argv the argument vector of main().
+ */
+void
+run_benches (const struct bench *benches, size_t count,
+	     int argc, char **argv);
+
+/**
+ * Reports a fatal error in a benchmark and exits.
+ *
+ * @param [in] what the failing operation.
+ * @param [in] rc the error code.
+ */
+void
+die_bench (const char *what, int rc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCH_H */
@@ -0,0 +1,98 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file cat_gen.c
+ * @brief The tool that prints the SQL statements of a synthetic category DB
+ *        to be loaded with, for example,
+ *        <code>cat_gen -n 5000 | sqlite3 category_list.db</code>, or the
+ *        equivalent delta file for upgrade_cat_list().
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "app_err.h"
+#include "logger.h"
+#include "service_category_gen.h"
+
+GLOBAL_LOGGER;
+
+static void
+print_usage (const char *prog)
+{
+  fprintf (stderr,
+	   "Usage: %s [-d] [-n CATEGORIES] [-f FANOUT] [-s SHARED_PERCENT]\n"
+	   "  Prints to stdout the SQL statements replacing the content of a"
+	   " category DB\n"
+	   "  with CATEGORIES categories (default: 1000) in which every"
+	   " non-leaf category\n"
+	   "  has FANOUT subcategories (default: 8) and SHARED_PERCENT of the"
+	   " subcategories\n"
+	   "  (default: 10) have a second parent. -d prints a delta file"
+	   " upgrading an empty\n"
+	   "  DB from version 0 to version 1 instead.\n",
+	   prog);
+}
+
+int
+main (int argc, char **argv, char **envp)
+{
+  struct cat_gen_param p = {
+    .count = 1000,
+    .fanout = 8,
+    .shared_percent = 10,
+  };
+  int is_delta = 0;
+  int opt;
+
+  SETUP_LOGGER ("/dev/stderr", errtostr);
+
+  while ((opt = getopt (argc, argv, "dn:f:s:")) != -1)
+    {
+      switch (opt)
+	{
+	case 'd':
+	  is_delta = 1;
+	  break;
+	case 'n':
+	  p.count = strtoul (optarg, NULL, 10);
+	  break;
+	case 'f':
+	  p.fanout = strtoul (optarg, NULL, 10);
+	  break;
+	case 's':
+	  p.shared_percent = atoi (optarg);
+	  break;
+	default:
+	  print_usage (argv[0]);
+	  exit (EXIT_FAILURE);
+	}
+    }
+  if (optind != argc || p.count == 0 || p.fanout == 0
+      || p.shared_percent > 100)
+    {
+      print_usage (argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  if ((is_delta ? write_cat_list_delta (stdout, &p)
+       : write_cat_list_sql (stdout, &p))
+      || fflush (stdout))
+    {
+      exit (EXIT_FAILURE);
+    }
+
+  exit (EXIT_SUCCESS);
+}
@@ -16,17 +16,18 @@
  *****************************************************************************/
 
 #include <errno.h>
+#include <poll.h>
 #include <signal.h>
-#include <sys/types.h>
-#include <sys/socket.h>
 #include <arpa/inet.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
+#include <time.h>
+#include "app_err.h"
 #include "logger.h"
 #include "sde.h"
+#include "sde_client.h"
 #include "tlv.h"
 
 GLOBAL_LOGGER;
@@ -139,299 +140,230 @@ display_user_choice_prompt (const char *prompt_msg, unsigned char last_option)
   return (unsigned char) num;
 }
 
-static int sock = -1;
-static void *packet_buffer = NULL;
-static size_t packet_buffer_len = 1024 * 1024;
+static sde_session *session = NULL;
+
+/** The buffer receiving the response packets of the session. */
+static char recv_buffer[SDE_RECV_BUFFER_SIZE];
 
 static void
 clean_up (void)
 {
-  if (packet_buffer)
-    {
-      free (packet_buffer);
-      packet_buffer = NULL;
-    }
-  if (sock != -1)
-    {
-      if (close (sock) == -1)
-	{
-	  l->SYS_ERR ("Cannot close socket");
-	}
-      sock = -1;
-    }
+  destroy_sde_session (&session);
 }
 
-static struct sockaddr *ap_addr = NULL;
-static socklen_t ap_addr_len;
-
-static uint32_t packet_seq = 0;
+static volatile sig_atomic_t is_interrupted = 0;
 
 static void
-get_metadata (void)
+print_metadata_data (const struct sde_metadata_data *d)
 {
-  struct sde_get_metadata m = {
-    .c = {
-      .type = htonl (GET_METADATA),
-      .seq = htonl (packet_seq),
-    },
-  };
+  int i;
 
-  if (sendto (sock, &m, sizeof (m), 0, ap_addr, ap_addr_len) == -1)
+  printf ("Metadata data (%u)\n", ntohl (d->c.seq));
+  printf ("\tCount: %u\n", ntohl (d->count));
+  printf ("\tData:\n");
+  for (i = 0; i < ntohl (d->count); i++)
     {
-      l->SYS_ERR ("Cannot send get_metadata");
-      return;
+      printf ("\t\t[%d] %llu\n", i,
+	      (unsigned long long) ntohll (d->data[i].ts));
     }
-
-  l->INFO ("get_metadata sent");
 }
 
-static void
-get_service_description (struct position *pos, size_t count)
-{  struct sde_get_service_desc s = {
-    .c = {
-      .type = htonl (GET_SERVICE_DESC),
-      .seq = htonl (packet_seq),
-    },
-    .count = htonl (count),
-    };
-  size_t d_size = (sizeof (struct sde_get_service_desc_data)
-		   + sizeof (*pos) * count);
-  struct sde_get_service_desc_data *d = malloc (d_size);
-
-  if (d == NULL)
-    {
-      return;
-    }
+/** The progress of printing service descriptions as they are parsed. */
+struct service_desc_printer
+{
+  int i; /**< The index of the service description being printed. */
+  int is_in_desc; /**< Non-zero if a service description is being printed. */
+};
+
+static int
+is_desc_nested (uint32_t type, unsigned int depth, void *arg)
+{
+  return (depth == 0 && type == DESCRIPTION);
+}
 
-  d->c.type = htonl (GET_SERVICE_DESC_DATA);
-  d->c.seq = htonl (packet_seq);
-  d->count = htonl (count);
-  memcpy (d->data, pos, sizeof (*pos) * count);
+static int
+print_desc_chunk (uint32_t type, uint32_t length, const void *value,
+		  unsigned int depth, void *arg)
+{
+  struct service_desc_printer *printer = arg;
+  uint64_t ts;
+  uint32_t cat_id;
 
-  if (sendto (sock, &s, sizeof (s), 0, ap_addr, ap_addr_len) == -1)
+  if (depth == 0)
     {
-      l->SYS_ERR ("Cannot send get_service_desc");
-      free (d);
-      return;
+      if (type != DESCRIPTION)
+	{
+	  l->ERR ("Not a description %d", ++printer->i);
+	}
+      printer->is_in_desc = 0;
+      return 0;
     }
-  if (sendto (sock, d, d_size, 0, ap_addr, ap_addr_len) == -1)
+
+  if (!printer->is_in_desc)
     {
-      l->SYS_ERR ("Cannot send get_service_desc_data");
+      printer->is_in_desc = 1;
+      printf ("\t\t[Service %d]\n", ++printer->i);
     }
-  free (d);
-}
 
-static void
-print_metadata (struct sde_metadata *m, ssize_t size)
-{
-  if (size < 0)
+  switch (type)
     {
-      return;
+    case SERVICE_POS:
+      printf ("\t\tPosition: %hhu\n", *((unsigned char *) value));
+      break;
+    case SERVICE_TS:
+      memcpy (&ts, value, sizeof (ts));
+      printf ("\t\tMod time: %llu\n", (unsigned long long) ntohll (ts));
+      break;
+    case SERVICE_CAT_ID:
+      memcpy (&cat_id, value, sizeof (cat_id));
+      printf ("\t\tCategory ID: %u\n", ntohl (cat_id));
+      break;
+    case SERVICE_SHORT_DESC:
+      printf ("\t\tDesc: %.*s\n", (int) length, (const char *) value);
+      break;
+    case SERVICE_LONG_DESC:
+      printf ("\t\tLong desc: %.*s\n", (int) length, (const char *) value);
+      break;
+    case SERVICE_URI:
+      printf ("\t\tURI: %.*s\n", (int) length, (const char *) value);
+      break;
     }
 
-  printf ("Metadata (%u)\n", ntohl (m->c.seq));
-  printf ("\tCount: %u\n", ntohl (m->count));
+  return 0;
 }
 
 static void
-print_metadata_data (struct sde_metadata_data *d, ssize_t size)
+print_service_desc_data (const struct sde_service_desc_data *d)
 {
-  int i;
+  struct service_desc_printer printer = {
+    .i = -1,
+  };
+  tlv_parser *parser;
+  uint32_t data_len;
+
+  data_len = ntohl (d->size) - sizeof (*d);
+
+  printf ("Service desc data (%u)\n", ntohl (d->c.seq));
+  printf ("\tData size: %u\n", data_len);
+  printf ("\tData:\n");
 
-  if (size < 0)
+  /* A UDP datagram always arrives whole, so the push parser is fed the whole
+   * data at once instead of piece by piece as it is received. */
+  if (create_tlv_parser (&parser, data_len, data_len, is_desc_nested,
+			 print_desc_chunk, &printer))
     {
+      l->ERR ("Not enough memory");
       return;
     }
-
-  printf ("Metadata data (%u)\n", ntohl (d->c.seq));
-  printf ("\tCount: %u\n", ntohl (d->count));
-  printf ("\tData:\n");
-  for (i = 0; i < ntohl (d->count); i++)
+  switch (feed_tlv_parser (parser, d->data, data_len))
     {
-      printf ("\t\t[%d] %llu\n", i, ntohll (d->data[i].ts));
+    case TLV_PARSER_DONE:
+      break;
+    case TLV_PARSER_NEED_MORE:
+      if (!is_tlv_parser_at_boundary (parser))
+	{
+	  l->ERR ("Truncated service description data");
+	}
+      break;
+    default:
+      l->ERR ("Corrupted service description data");
+      break;
     }
-
-  packet_seq++;
+  destroy_tlv_parser (&parser);
 }
 
 static void
-print_service_desc (struct sde_service_desc *s, ssize_t size)
+print_stats (const struct sde_stats *s)
 {
-  if (size < 0)
-    {
-      return;
-    }
-
-  printf ("Service desc (%u)\n", ntohl (s->c.seq));
-  printf ("\tSize: %u\n", ntohl (s->size));
+  printf ("Stats (%u)\n", ntohl (s->c.seq));
+  printf ("%.*s", (int) ntohl (s->size), s->data);
 }
 
+/**
+ * Prints the outcome of a request as the callback of the SDE session.
+ *
+ * @param [in] r the outcome of the request.
+ * @param [in] arg unused.
+ */
 static void
-print_service_desc_data (struct sde_service_desc_data *d, ssize_t size)
+print_reply (const struct sde_reply *r, void *arg)
 {
-  char buffer[1024];
-  const struct tlv_chunk *itr = NULL;
-  int i = -1;
-  size_t data_len;
+  struct timespec now;
 
-  if (size < 0)
+  if (r->rc)
     {
+      l->APP_ERR (r->rc, "SDE request failed");
       return;
     }
-
-  data_len = ntohl (d->size) - sizeof (*d);
-
-  printf ("Service desc data (%u)\n", ntohl (d->c.seq));
-  printf ("\tData size: %u\n", data_len);
-  printf ("\tData:\n");
-  while ((itr = read_chunk (d->data, data_len, itr)))
+  if (r->packet == NULL)
     {
-      const struct tlv_chunk *itr2 = NULL;
-      size_t desc_len = ntohl (itr->length);
-      ++i;
-
-      if (ntohl (itr->type) != DESCRIPTION)
-	{
-	  l->ERR ("Not a description %d", i);
-	  continue;
-	}
-
-      printf ("\t\t[Service %d]\n", i);
-      while ((itr2 = read_chunk (itr->value, desc_len, itr2)))
-	{
-	  switch (ntohl (itr2->type))
-	    {
-	    case SERVICE_POS:
-	      printf ("\t\tPosition: %hhu\n", *((unsigned char *) itr2->value));
-	      break;
-	    case SERVICE_TS:
-	      printf ("\t\tMod time: %llu\n",
-		      ntohll (*((unsigned long long *) itr2->value)));
-	      break;
-	    case SERVICE_CAT_ID:
-	      printf ("\t\tCategory ID: %u\n",
-		      ntohl (*((uint32_t *) itr2->value)));
-	      break;
-	    case SERVICE_SHORT_DESC:
-	      memset (buffer, 0, sizeof (buffer));
-	      memcpy (buffer, itr2->value, ntohl (itr2->length));
-	      printf ("\t\tDesc: %s\n", buffer);
-	      break;
-	    case SERVICE_LONG_DESC:
-	      memset (buffer, 0, sizeof (buffer));
-	      memcpy (buffer, itr2->value, ntohl (itr2->length));
-	      printf ("\t\tLong desc: %s\n", buffer);
-	      break;
-	    case SERVICE_URI:
-	      memset (buffer, 0, sizeof (buffer));
-	      memcpy (buffer, itr2->value, ntohl (itr2->length));
-	      printf ("\t\tURI: %s\n", buffer);
-	      break;
-	    }
-	}
+      printf ("All service descriptions fetched\n");
+      return;
     }
 
-  packet_seq++;
-}
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  printf ("[%.3f ms, %d retransmission(s)] ",
+	  (now.tv_sec * 1000000000ULL + now.tv_nsec - r->sent) / 1e6,
+	  r->retransmissions);
 
-static ssize_t
-wait_for (enum sde_packet_type expected_type, uint32_t expected_seq,
-	  struct sde_packet *p, size_t p_len)
-{
-  ssize_t bytes_rcvd;
-
-  printf ("Waiting for");
-  switch (expected_type)
+  switch (ntohl (r->packet->type))
     {
-    case METADATA:
-      printf (" METADATA (%u)", expected_seq);
-      break;
     case METADATA_DATA:
-      printf (" METADATA_DATA (%u)", expected_seq);
-      break;
-    case SERVICE_DESC:
-      printf (" SERVICE_DESC (%u)", expected_seq);
+      print_metadata_data ((const struct sde_metadata_data *) r->packet);
       break;
     case SERVICE_DESC_DATA:
-      printf (" SERVICE_DESC_DATA (%u)", expected_seq);
+      print_service_desc_data ((const struct sde_service_desc_data *)
+			       r->packet);
+      break;
+    case STATS:
+      print_stats ((const struct sde_stats *) r->packet);
       break;
-    default:
-      l->ERR ("Invalid expected type");
-      return -1;
     }
-  printf (" (Give SIGINT to stop waiting)\n");
+}
 
-  do
+/**
+ * Runs the SDE session until its outstanding requests are over or SIGINT
+ * arrives.
+ */
+static void
+wait_for_replies (void)
+{
+  struct pollfd fd = {
+    .fd = get_sde_session_fd (session),
+    .events = POLLIN,
+  };
+
+  printf ("Waiting (Give SIGINT to stop waiting)\n");
+
+  is_interrupted = 0;
+  while (is_sde_session_busy (session))
     {
-      int is_size_invalid = 0;
-      struct sde_metadata_data *md = NULL;
-      struct sde_service_desc_data *sd = NULL;
-
-      if ((bytes_rcvd = recvfrom (sock,
-				  p,
-				  p_len,
-				  0,
-				  NULL,
-				  NULL)) == -1)
+      if (poll (&fd, 1, get_sde_session_timeout (session)) == -1)
 	{
-	  if (errno == EINTR)
+	  if (errno != EINTR)
+	    {
+	      l->SYS_ERR ("Cannot poll SDE session");
+	      return;
+	    }
+	  if (is_interrupted)
 	    {
 	      printf ("Interrupted\n");
-	      return -1;
+	      return;
 	    }
-	  l->SYS_ERR ("Cannot retrieve packet");
-	  continue;
 	}
 
-      switch (expected_type)
+      if (process_sde_session (session, recv_buffer, sizeof (recv_buffer)))
 	{
-	case METADATA:
-	  is_size_invalid = (bytes_rcvd < sizeof (struct sde_metadata));
-	  break;
-	case METADATA_DATA:
-	  md = (struct sde_metadata_data *) p;
-	  is_size_invalid = (bytes_rcvd < sizeof (*md)
-			     + sizeof (*md->data) * ntohl (md->count));
-	  break;
-	case SERVICE_DESC:
-	  is_size_invalid = (bytes_rcvd < sizeof (struct sde_service_desc));
-	  break;
-	case SERVICE_DESC_DATA:
-	  sd = (struct sde_service_desc_data *) p;
-	  is_size_invalid = (bytes_rcvd < ntohl (sd->size));
-	  break;
-	default:
-	  is_size_invalid = 1;
-	  break;
+	  l->SYS_ERR ("Cannot receive SDE responses");
+	  return;
 	}
-      if (is_size_invalid)
-	{
-	  l->ERR ("Invalid size for %u packet (%d)", expected_type, bytes_rcvd);
-	  continue;
-	}
-      if (ntohl (p->type) != expected_type)
-	{
-	  l->ERR ("ntohl (p->type): %lu != expected_type: %lu",
-		  ntohl (p->type), expected_type);
-	  continue;
-	}
-      if (ntohl (p->seq) != expected_seq)
-	{
-	  l->ERR ("ntohl (p->seq): %lu != expected_seq: %lu",
-		  ntohl (p->seq), expected_seq);
-	  continue;
-	}
-
-      break;
     }
-  while (1);
-
-  return bytes_rcvd;
 }
 
 void
 terminate_wait (int signum)
 {
+  is_interrupted = 1;
 }
 
 int
@@ -445,13 +377,10 @@ main (int argc, char **argv, char **envp)
     .sin_family = AF_INET,
     .sin_port = htons (SDE_PORT),
   };
-  ssize_t bytes_rcvd;
   struct sigaction sigact = {
     .sa_handler = terminate_wait,
   };
-
-  ap_addr = (struct sockaddr *) &ap_ip_addr;
-  ap_addr_len = sizeof (ap_ip_addr);
+  int rc;
 
   if (argc != 2)
     {
@@ -466,23 +395,15 @@ main (int argc, char **argv, char **envp)
       l->SYS_ERR ("Cannot install signal handler");
     }
 
-  sock = socket (AF_INET, SOCK_DGRAM, 0);
-  if (sock == -1)
-    {
-      l->SYS_ERR ("Cannot open socket");
-      exit (EXIT_FAILURE);
-    }
-
-  packet_buffer = malloc (packet_buffer_len);
-  if (packet_buffer == NULL)
+  if (inet_pton (AF_INET, argv[1], &ap_ip_addr.sin_addr) != 1)
     {
-      l->ERR ("Not enough memory");
+      l->SYS_ERR ("Cannot resolve AP IP address");
       exit (EXIT_FAILURE);
     }
 
-  if (inet_pton (AF_INET, argv[1], &ap_ip_addr.sin_addr) != 1)
+  if ((rc = create_sde_session (&session, &ap_ip_addr)))
     {
-      l->SYS_ERR ("Cannot resolve AP IP address");
+      l->APP_ERR (rc, "Cannot create SDE session");
       exit (EXIT_FAILURE);
     }
 
@@ -496,31 +417,20 @@ main (int argc, char **argv, char **envp)
     {
       printf ("[Menu]\n"
 	      "1. Get metadata\n"
-	      "2. Only wait for metadata\n"
-	      "3. Get service description\n"
-	      "4. Only wait for service description\n"
+	      "2. Get service description\n"
+	      "3. Fetch all service descriptions\n"
+	      "4. Get statistics\n"
 	      "\n"
 	      "5. Quit\n"
 	      "\n");
 
+      rc = ERR_SUCCESS;
       switch (display_user_choice_prompt ("Choice (1-5)? ", 5))
 	{
 	case 1:
-	  get_metadata ();
-	case 2:
-	  print_metadata (packet_buffer,
-			  (bytes_rcvd = wait_for (METADATA, packet_seq,
-						  packet_buffer,
-						  packet_buffer_len)));
-	  if (bytes_rcvd == -1)
-	    {
-	      break;
-	    }
-	  print_metadata_data (packet_buffer,
-			       wait_for (METADATA_DATA, packet_seq,
-					 packet_buffer, packet_buffer_len));
+	  rc = request_metadata (session, print_reply, NULL);
 	  break;
-	case 3:
+	case 2:
 	  pos = NULL;
 	  pos_count = 0;
 	  display_user_prompt ("Position (0-based) to retrieve"
@@ -545,20 +455,15 @@ main (int argc, char **argv, char **envp)
 	    {
 	      break;
 	    }
-	  get_service_description (pos, pos_count);
+	  rc = request_service_desc (session, pos, pos_count,
+				     print_reply, NULL);
 	  free (pos);
+	  break;
+	case 3:
+	  rc = fetch_all_service_desc (session, print_reply, NULL);
+	  break;
 	case 4:
-	  print_service_desc (packet_buffer,
-			      (bytes_rcvd = wait_for (SERVICE_DESC, packet_seq,
-						      packet_buffer,
-						      packet_buffer_len)));
-	  if (bytes_rcvd == -1)
-	    {
-	      break;
-	    }
-	  print_service_desc_data (packet_buffer,
-				   wait_for (SERVICE_DESC_DATA, packet_seq,
-					     packet_buffer, packet_buffer_len));
+	  rc = request_stats (session, print_reply, NULL);
 	  break;
 	case 5:
 	  is_terminated = 1;
@@ -567,9 +472,17 @@ main (int argc, char **argv, char **envp)
 	  l->ERR ("Unexpected choice");
 	  exit (EXIT_FAILURE);
 	}
+
+      if (rc)
+	{
+	  l->APP_ERR (rc, "Cannot send SDE request");
+	}
+      else if (!is_terminated)
+	{
+	  wait_for_replies ();
+	}
     }
   while (!is_terminated);
 
   exit (EXIT_SUCCESS);
 }
-
@@ -0,0 +1,589 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file log_decoder.c
+ * @brief Turns a binary log written in LOGGER_BINARY mode back into the text
+ *        format of the asynchronous logger. With option -s, the timestamps
+ *        are stripped so that the output is in the text format of the
+ *        synchronous logger. The binary log is read from the given file or
+ *        from the standard input.
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "logger.h"
+#include "logger_binary.h"
+
+GLOBAL_LOGGER;
+
+/** A call site as defined by a site record. */
+struct site
+{
+  char *tag; /**< The message tag. */
+  char *file; /**< The file of the call site. */
+  unsigned int line; /**< The line of the call site. */
+  char *msg; /**< The message format. */
+};
+
+/** A cursor over a part of the binary log. */
+struct reader
+{
+  const unsigned char *data; /**< The data to read. */
+  size_t len; /**< The length of the data. */
+  size_t offset; /**< The position of the next byte to read. */
+};
+
+static int
+get_u8 (struct reader *r, uint8_t *v)
+{
+  if (r->len - r->offset < 1)
+    {
+      return -1;
+    }
+  *v = r->data[r->offset++];
+  return 0;
+}
+
+static int
+get_u16 (struct reader *r, uint16_t *v)
+{
+  if (r->len - r->offset < sizeof (*v))
+    {
+      return -1;
+    }
+  memcpy (v, r->data + r->offset, sizeof (*v));
+  *v = ntohs (*v);
+  r->offset += sizeof (*v);
+  return 0;
+}
+
+static int
+get_u32 (struct reader *r, uint32_t *v)
+{
+  if (r->len - r->offset < sizeof (*v))
+    {
+      return -1;
+    }
+  memcpy (v, r->data + r->offset, sizeof (*v));
+  *v = ntohl (*v);
+  r->offset += sizeof (*v);
+  return 0;
+}
+
+static int
+get_u64 (struct reader *r, uint64_t *v)
+{
+  uint32_t hi, lo;
+
+  if (r->len - r->offset < sizeof (*v)
+      || get_u32 (r, &hi) || get_u32 (r, &lo))
+    {
+      return -1;
+    }
+  *v = ((uint64_t) hi << 32) | lo;
+  return 0;
+}
+
+/**
+ * Reads a string as a dynamically allocated NUL-terminated string.
+ *
+ * @return 0 if there is no error or -1 if the data are too short or there is
+ *         not enough memory.
+ */
+static int
+get_str (struct reader *r, char **str)
+{
+  uint16_t len;
+
+  if (get_u16 (r, &len) || r->len - r->offset < len)
+    {
+      return -1;
+    }
+
+  *str = malloc (len + 1);
+  if (*str == NULL)
+    {
+      return -1;
+    }
+  memcpy (*str, r->data + r->offset, len);
+  (*str)[len] = '\0';
+  r->offset += len;
+
+  return 0;
+}
+
+/**
+ * Reads the header of the next record and positions the payload reader.
+ *
+ * @return 0 if there is a record, 1 if there is no more record or -1 if the
+ *         record is corrupted.
+ */
+static int
+next_record (struct reader *r, uint8_t *type, struct reader *payload)
+{
+  uint16_t len;
+
+  if (r->offset == r->len)
+    {
+      return 1;
+    }
+
+  if (get_u8 (r, type) || get_u16 (r, &len) || r->len - r->offset < len)
+    {
+      l->ERR ("Corrupted record at offset %lu", (unsigned long) r->offset);
+      return -1;
+    }
+
+  payload->data = r->data + r->offset;
+  payload->len = len;
+  payload->offset = 0;
+  r->offset += len;
+
+  return 0;
+}
+
+static void
+destroy_site (struct site **s)
+{
+  if (*s == NULL)
+    {
+      return;
+    }
+
+  free ((*s)->tag);
+  free ((*s)->file);
+  free ((*s)->msg);
+  free (*s);
+  *s = NULL;
+}
+
+static int
+read_site (struct reader *payload, uint16_t *id, struct site **s)
+{
+  uint32_t line;
+
+  *s = calloc (1, sizeof (**s));
+  if (*s == NULL)
+    {
+      return -1;
+    }
+
+  if (get_u16 (payload, id) || get_u32 (payload, &line)
+      || get_str (payload, &(*s)->tag)
+      || get_str (payload, &(*s)->file)
+      || get_str (payload, &(*s)->msg))
+    {
+      destroy_site (s);
+      return -1;
+    }
+  (*s)->line = line;
+
+  return 0;
+}
+
+/** Prints literal text of a format in which `%%' stands for `%'. */
+static void
+print_literal (FILE *out, const char *text, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      fputc (text[i], out);
+      if (text[i] == '%' && i + 1 < len && text[i + 1] == '%')
+	{
+	  i++;
+	}
+    }
+}
+
+/**
+ * Prints a conversion with its argument read from the message record.
+ *
+ * @return 0 if there is no error or -1 if the argument is missing.
+ */
+static int
+print_conversion (FILE *out, const struct log_conversion *c,
+		  struct reader *args)
+{
+  char spec[128];
+  size_t i, len = 0;
+  uint64_t v;
+  double d;
+  char *str;
+
+  /* The `*' are replaced by the stored width and precision */
+  for (i = 0; i < c->spec_len && len < sizeof (spec) - 24; i++)
+    {
+      if (c->spec[i] != '*')
+	{
+	  spec[len++] = c->spec[i];
+	  continue;
+	}
+      if (get_u64 (args, &v))
+	{
+	  return -1;
+	}
+      len += sprintf (spec + len, "%d", (int) (int64_t) v);
+    }
+  spec[len] = '\0';
+
+  switch (c->type)
+    {
+    case LOG_ARG_NONE:
+    case LOG_ARG_COUNT:
+      return 0;
+    case LOG_ARG_STR:
+      if (get_str (args, &str))
+	{
+	  return -1;
+	}
+      fprintf (out, spec, str);
+      free (str);
+      return 0;
+    default:
+      break;
+    }
+
+  if (get_u64 (args, &v))
+    {
+      return -1;
+    }
+
+  switch (c->type)
+    {
+    case LOG_ARG_LONG:
+      if (c->is_signed)
+	fprintf (out, spec, (long) (int64_t) v);
+      else
+	fprintf (out, spec, (unsigned long) v);
+      break;
+    case LOG_ARG_LLONG:
+      if (c->is_signed)
+	fprintf (out, spec, (long long) (int64_t) v);
+      else
+	fprintf (out, spec, (unsigned long long) v);
+      break;
+    case LOG_ARG_SIZE:
+      fprintf (out, spec, (size_t) v);
+      break;
+    case LOG_ARG_PTRDIFF:
+      fprintf (out, spec, (ptrdiff_t) v);
+      break;
+    case LOG_ARG_INTMAX:
+      if (c->is_signed)
+	fprintf (out, spec, (intmax_t) (int64_t) v);
+      else
+	fprintf (out, spec, (uintmax_t) v);
+      break;
+    case LOG_ARG_DOUBLE:
+      memcpy (&d, &v, sizeof (d));
+      fprintf (out, spec, d);
+      break;
+    case LOG_ARG_LDOUBLE:
+      memcpy (&d, &v, sizeof (d));
+      fprintf (out, spec, (long double) d);
+      break;
+    case LOG_ARG_PTR:
+      fprintf (out, spec, (void *) (uintptr_t) v);
+      break;
+    default:
+      if (c->is_signed)
+	fprintf (out, spec, (int) (int64_t) v);
+      else
+	fprintf (out, spec, (unsigned int) v);
+      break;
+    }
+
+  return 0;
+}
+
+static int
+print_message (FILE *out, struct reader *payload, struct site **sites,
+	       const struct site *overflow_site, int with_timestamp)
+{
+  const struct site *s;
+  struct log_conversion c;
+  const char *fmt, *next;
+  uint16_t id;
+  uint8_t flags;
+  uint32_t sec, usec;
+  char *suffix;
+
+  if (get_u16 (payload, &id) || get_u8 (payload, &flags)
+      || get_u32 (payload, &sec) || get_u32 (payload, &usec)
+      || get_str (payload, &suffix))
+    {
+      l->ERR ("Corrupted message record");
+      return -1;
+    }
+
+  s = (id == LOG_SITE_OVERFLOW ? overflow_site : sites[id]);
+
+  if (with_timestamp)
+    {
+      fprintf (out, "[%lu.%06lu] ", (unsigned long) sec, (unsigned long) usec);
+    }
+
+  if (s == NULL)
+    {
+      fprintf (out, "[LOGGER] unknown call site %u\n", id);
+      free (suffix);
+      return 0;
+    }
+
+  fprintf (out, "[%s] %s:%u: ", s->tag, s->file, s->line);
+
+  fmt = s->msg;
+  while ((next = next_log_conversion (fmt, &c)) != NULL)
+    {
+      print_literal (out, fmt, (c.spec != NULL ? c.spec : next) - fmt);
+      if (c.spec != NULL && print_conversion (out, &c, payload))
+	{
+	  fprintf (out, "...");
+	  break;
+	}
+      fmt = next;
+    }
+
+  fprintf (out, "%s\n", suffix);
+  free (suffix);
+
+  return 0;
+}
+
+/**
+ * Decodes the records of a session. The site records are read first because
+ * a message can precede its site record.
+ *
+ * @return 0 if there is no error or -1 if the session is corrupted.
+ */
+static int
+decode_session (const struct reader *session, FILE *out, int with_timestamp)
+{
+  static struct site *sites[LOG_SITE_OVERFLOW];
+  struct site *s, *overflow_site = NULL;
+  struct reader r = *session, payload;
+  uint16_t id;
+  uint32_t dropped;
+  uint8_t type;
+  int rc;
+
+  while ((rc = next_record (&r, &type, &payload)) == 0)
+    {
+      if (type != LOG_RECORD_SITE)
+	{
+	  continue;
+	}
+      if (read_site (&payload, &id, &s))
+	{
+	  l->ERR ("Corrupted site record");
+	  rc = -1;
+	  goto out;
+	}
+      if (id == LOG_SITE_OVERFLOW || sites[id] != NULL)
+	{
+	  destroy_site (&s);
+	  continue;
+	}
+      sites[id] = s;
+    }
+  if (rc < 0)
+    {
+      goto out;
+    }
+
+  r = *session;
+  while ((rc = next_record (&r, &type, &payload)) == 0)
+    {
+      switch (type)
+	{
+	case LOG_RECORD_SITE:
+	  if (payload.len >= 2 && get_u16 (&payload, &id) == 0
+	      && id == LOG_SITE_OVERFLOW)
+	    {
+	      payload.offset = 0;
+	      destroy_site (&overflow_site);
+	      if (read_site (&payload, &id, &overflow_site))
+		{
+		  rc = -1;
+		  goto out;
+		}
+	    }
+	  break;
+	case LOG_RECORD_MESSAGE:
+	  if (print_message (out, &payload, sites, overflow_site,
+			     with_timestamp))
+	    {
+	      rc = -1;
+	      goto out;
+	    }
+	  break;
+	case LOG_RECORD_DROPPED:
+	  if (get_u32 (&payload, &dropped) == 0)
+	    {
+	      fprintf (out, "[LOGGER] %lu messages dropped\n",
+		       (unsigned long) dropped);
+	    }
+	  break;
+	default:
+	  l->ERR ("Unknown record type %u", type);
+	  break;
+	}
+    }
+  rc = (rc < 0 ? -1 : 0);
+
+ out:
+  destroy_site (&overflow_site);
+  for (id = 0; id < LOG_SITE_OVERFLOW; id++)
+    {
+      destroy_site (&sites[id]);
+    }
+
+  return rc;
+}
+
+/**
+ * Decodes a whole binary log session by session.
+ *
+ * @return 0 if there is no error or -1 if the log is corrupted.
+ */
+static int
+decode_log (const unsigned char *data, size_t len, FILE *out,
+	    int with_timestamp)
+{
+  struct reader r = {
+    .data = data,
+    .len = len,
+    .offset = LOG_BINARY_MAGIC_LEN,
+  };
+  struct reader session = r, payload;
+  uint8_t type;
+  int rc;
+
+  if (len < LOG_BINARY_MAGIC_LEN
+      || memcmp (data, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_LEN))
+    {
+      l->ERR ("Not a binary log");
+      return -1;
+    }
+
+  while ((rc = next_record (&r, &type, &payload)) == 0)
+    {
+      if (type != LOG_RECORD_SESSION)
+	{
+	  continue;
+	}
+      session.len = r.offset - LOG_RECORD_HDR_LEN - payload.len;
+      if (decode_session (&session, out, with_timestamp))
+	{
+	  return -1;
+	}
+      session.offset = r.offset;
+    }
+  if (rc < 0)
+    {
+      return -1;
+    }
+
+  session.len = r.len;
+  return decode_session (&session, out, with_timestamp);
+}
+
+static int
+read_all (FILE *in, unsigned char **data, size_t *len)
+{
+  size_t size = 64 * 1024;
+  unsigned char *p;
+
+  *len = 0;
+  *data = NULL;
+  do
+    {
+      size *= 2;
+      p = realloc (*data, size);
+      if (p == NULL)
+	{
+	  l->ERR ("Not enough memory to read the log");
+	  free (*data);
+	  return -1;
+	}
+      *data = p;
+      *len += fread (*data + *len, 1, size - *len, in);
+    }
+  while (*len == size);
+
+  if (ferror (in))
+    {
+      l->SYS_ERR ("Cannot read the log");
+      free (*data);
+      return -1;
+    }
+
+  return 0;
+}
+
+int
+main (int argc, char **argv, char **envp)
+{
+  FILE *in = stdin;
+  unsigned char *data;
+  size_t len;
+  int with_timestamp = 1;
+  int opt, rc;
+
+  SETUP_LOGGER ("/dev/stderr", NULL);
+  set_log_rate (0, LOG_RATE_INTERVAL, 0);
+
+  while ((opt = getopt (argc, argv, "s")) != -1)
+    {
+      switch (opt)
+	{
+	case 's':
+	  with_timestamp = 0;
+	  break;
+	default:
+	  fprintf (stderr, "Usage: %s [-s] [LOG_FILE]\n", argv[0]);
+	  exit (EXIT_FAILURE);
+	}
+    }
+
+  if (optind < argc && (in = fopen (argv[optind], "r")) == NULL)
+    {
+      l->SYS_ERR ("Cannot open %s", argv[optind]);
+      exit (EXIT_FAILURE);
+    }
+
+  rc = read_all (in, &data, &len);
+  if (in != stdin)
+    {
+      fclose (in);
+    }
+  if (rc)
+    {
+      exit (EXIT_FAILURE);
+    }
+
+  rc = decode_log (data, len, stdout, with_timestamp);
+  free (data);
+
+  exit (rc ? EXIT_FAILURE : EXIT_SUCCESS);
+}
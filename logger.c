@@ -20,7 +20,71 @@
 #include <stdarg.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <sys/time.h>
 #include "logger.h"
+#include "logger_binary.h"
+
+#ifndef LOGGER_RING_SIZE
+/** The number of messages the asynchronous ring can hold (a power of 2). */
+#define LOGGER_RING_SIZE 256
+#endif
+
+#ifndef LOGGER_LINE_MAX
+/** The longest line in bytes that an asynchronous message can occupy. */
+#define LOGGER_LINE_MAX 256
+#endif
+
+#ifndef LOGGER_SITE_TABLE_SIZE
+/** The number of call sites that can have a binary ID (a power of 2). */
+#define LOGGER_SITE_TABLE_SIZE 1024
+#endif
+
+/** The largest binary record written synchronously. */
+#define LOGGER_RECORD_MAX 1024
+
+/** The stdio buffer size used by the drainer to write in batches. */
+#define LOGGER_BATCH_SIZE (16 * 1024)
+
+/** How long the drainer sleeps when the ring is empty. */
+#define LOGGER_DRAIN_INTERVAL_NS 20000000L
+
+/** A message in the asynchronous ring. */
+struct logger_slot
+{
+  volatile unsigned long seq; /**<
+			       * Equals the enqueue position when the slot is
+			       * free and the enqueue position + 1 when the
+			       * slot holds a message to drain.
+			       */
+  struct timeval ts; /**< When the message was logged. */
+  int len; /**< The length of the line. */
+  char line[LOGGER_LINE_MAX]; /**<
+			       * The formatted line ended by a newline or the
+			       * binary records.
+			       */
+};
+
+/**
+ * A bounded lock-free multi-producer single-consumer ring of messages. Any
+ * thread (even a signal handler) may log into the ring while a single drainer
+ * thread writes the messages out.
+ */
+struct logger_ring
+{
+  struct logger_slot *slots; /**< The slots of the ring. */
+  volatile unsigned long enqueue_pos; /**< The next slot to claim. */
+  unsigned long dequeue_pos; /**< The next slot to drain. */
+  volatile unsigned long dropped; /**< Messages lost to a full ring. */
+  unsigned long reported_dropped; /**< The dropped value already logged. */
+  volatile int is_stopped; /**< Set to tell the drainer to exit. */
+  pthread_t drainer; /**< The thread writing the ring out. */
+};
 
 /** Logger's private data. */
 struct logger_data
@@ -30,29 +94,914 @@ struct logger_data
 				    * string translator.
 				    */
   FILE *out; /**< The file stream into which messages will be logged. */
+  struct logger_ring *ring; /**< The ring in asynchronous mode or NULL. */
+  struct log_site_entry *site_table; /**< The call site IDs or NULL. */
+};
+
+/** A call site that has an ID in the binary log. */
+struct log_site_entry
+{
+  volatile int state; /**< 0 if free, 1 if being filled or 2 if used. */
+  volatile int is_emitted; /**< Whether the site record has been written. */
+  const char *tag; /**< The message tag. */
+  const char *file; /**< The file of the call site. */
+  unsigned int line; /**< The line of the call site. */
+  const char *msg; /**< The message format. */
+};
+
+/** A buffer into which a binary record is encoded. */
+struct log_buf
+{
+  char *data; /**< The buffer. */
+  size_t len; /**< The number of bytes encoded. */
+  size_t size; /**< The size of the buffer. */
 };
 
+/** The rate limit applied to every call site. */
+static struct
+{
+  volatile unsigned long burst; /**< Messages per interval or 0 for no limit. */
+  volatile unsigned int interval; /**< The interval in seconds. */
+  volatile unsigned long sample; /**< Every n-th suppressed message passes. */
+} rate = {
+  .burst = LOG_RATE_BURST,
+  .interval = LOG_RATE_INTERVAL,
+  .sample = LOG_RATE_SAMPLE,
+};
+
+/** All call sites that have logged something. */
+static struct log_site *volatile sites = NULL;
+
+/** The last interval in which pass_log_site() summarized the quiet sites. */
+static volatile long summarized_window = 0;
+
+/**
+ * Claims the next free slot of the ring to be published with publish_slot().
+ *
+ * @return the claimed slot or NULL if the ring is full.
+ */
+static struct logger_slot *
+claim_slot (struct logger_ring *r, unsigned long *pos)
+{
+  struct logger_slot *slot;
+  long diff;
+
+  *pos = r->enqueue_pos;
+  for (;;)
+    {
+      slot = &r->slots[*pos & (LOGGER_RING_SIZE - 1)];
+      diff = (long) (slot->seq - *pos);
+      if (diff == 0)
+	{
+	  if (__sync_bool_compare_and_swap (&r->enqueue_pos, *pos, *pos + 1))
+	    {
+	      return slot;
+	    }
+	}
+      else if (diff < 0)
+	{
+	  __sync_fetch_and_add (&r->dropped, 1);
+	  return NULL;
+	}
+      *pos = r->enqueue_pos;
+    }
+}
+
+static void
+publish_slot (struct logger_slot *slot, unsigned long pos)
+{
+  __sync_synchronize ();
+  slot->seq = pos + 1;
+}
+
+static void
+enqueue_line (struct logger_ring *r, const char *tag,
+	      const char *file, unsigned int line,
+	      const char *msg, va_list ap, const char *suffix)
+{
+  struct logger_slot *slot;
+  unsigned long pos;
+  int len;
+
+  if ((slot = claim_slot (r, &pos)) == NULL)
+    {
+      return;
+    }
+
+  gettimeofday (&slot->ts, NULL);
+
+  len = snprintf (slot->line, LOGGER_LINE_MAX, "[%s] %s:%u: ",
+		  tag, file, line);
+  if (len < LOGGER_LINE_MAX)
+    {
+      len += vsnprintf (slot->line + len, LOGGER_LINE_MAX - len, msg, ap);
+    }
+  if (len < LOGGER_LINE_MAX)
+    {
+      len += snprintf (slot->line + len, LOGGER_LINE_MAX - len, "%s", suffix);
+    }
+  if (len > LOGGER_LINE_MAX - 1)
+    {
+      len = LOGGER_LINE_MAX - 1;
+    }
+  slot->line[len++] = '\n';
+  slot->len = len;
+
+  publish_slot (slot, pos);
+}
+
+static void
+put_u8 (struct log_buf *b, uint8_t v)
+{
+  if (b->len + 1 <= b->size)
+    {
+      b->data[b->len] = v;
+    }
+  b->len += 1;
+}
+
+static void
+put_u16 (struct log_buf *b, uint16_t v)
+{
+  v = htons (v);
+  if (b->len + sizeof (v) <= b->size)
+    {
+      memcpy (b->data + b->len, &v, sizeof (v));
+    }
+  b->len += sizeof (v);
+}
+
+static void
+put_u32 (struct log_buf *b, uint32_t v)
+{
+  v = htonl (v);
+  if (b->len + sizeof (v) <= b->size)
+    {
+      memcpy (b->data + b->len, &v, sizeof (v));
+    }
+  b->len += sizeof (v);
+}
+
+static void
+put_u64 (struct log_buf *b, uint64_t v)
+{
+  put_u32 (b, v >> 32);
+  put_u32 (b, v & 0xFFFFFFFF);
+}
+
+static void
+put_str (struct log_buf *b, const char *str, size_t len)
+{
+  if (len > 0xFFFF)
+    {
+      len = 0xFFFF;
+    }
+  put_u16 (b, len);
+  if (b->len + len <= b->size)
+    {
+      memcpy (b->data + b->len, str, len);
+    }
+  b->len += len;
+}
+
+/** Writes the payload length of a record that starts at start. */
+static void
+end_record (struct log_buf *b, size_t start)
+{
+  uint16_t len = htons (b->len - start - LOG_RECORD_HDR_LEN);
+
+  if (b->len <= b->size)
+    {
+      memcpy (b->data + start + 1, &len, sizeof (len));
+    }
+}
+
+/** Encodes an integer or pointer argument of a binary message. */
+static int64_t
+get_int_arg (const struct log_conversion *c, va_list *ap)
+{
+  switch (c->type)
+    {
+    case LOG_ARG_LONG:
+      return (c->is_signed
+	      ? (int64_t) va_arg (*ap, long)
+	      : (int64_t) va_arg (*ap, unsigned long));
+    case LOG_ARG_LLONG:
+      return (c->is_signed
+	      ? (int64_t) va_arg (*ap, long long)
+	      : (int64_t) va_arg (*ap, unsigned long long));
+    case LOG_ARG_SIZE:
+      return (c->is_signed
+	      ? (int64_t) va_arg (*ap, ssize_t)
+	      : (int64_t) va_arg (*ap, size_t));
+    case LOG_ARG_PTRDIFF:
+      return (int64_t) va_arg (*ap, ptrdiff_t);
+    case LOG_ARG_INTMAX:
+      return (c->is_signed
+	      ? (int64_t) va_arg (*ap, intmax_t)
+	      : (int64_t) va_arg (*ap, uintmax_t));
+    case LOG_ARG_PTR:
+      return (int64_t) (uintptr_t) va_arg (*ap, void *);
+    default:
+      return (c->is_signed
+	      ? (int64_t) va_arg (*ap, int)
+	      : (int64_t) va_arg (*ap, unsigned int));
+    }
+}
+
+/**
+ * Encodes the arguments of a binary message as described by the format. The
+ * encoding stops at the first argument that does not fit.
+ *
+ * @return 0 if all arguments fit or LOG_MESSAGE_TRUNCATED if not.
+ */
+static int
+put_args (struct log_buf *b, const char *msg, va_list ap)
+{
+  struct log_conversion c;
+  va_list aq;
+  double d;
+  uint64_t bits;
+  const char *str;
+  size_t len;
+  int i, rc = 0;
+
+  va_copy (aq, ap);
+  while (rc == 0 && (msg = next_log_conversion (msg, &c)) != NULL)
+    {
+      for (i = 0; i < c.star_count; i++)
+	{
+	  put_u64 (b, (int64_t) va_arg (aq, int));
+	}
+
+      switch (c.type)
+	{
+	case LOG_ARG_NONE:
+	  break;
+	case LOG_ARG_COUNT:
+	  va_arg (aq, void *);
+	  break;
+	case LOG_ARG_DOUBLE:
+	case LOG_ARG_LDOUBLE:
+	  d = (c.type == LOG_ARG_DOUBLE
+	       ? va_arg (aq, double) : (double) va_arg (aq, long double));
+	  memcpy (&bits, &d, sizeof (bits));
+	  put_u64 (b, bits);
+	  break;
+	case LOG_ARG_STR:
+	  str = va_arg (aq, const char *);
+	  if (str == NULL)
+	    {
+	      str = "(null)";
+	    }
+	  len = strlen (str);
+	  if (b->len + 2 + len > b->size && b->len + 2 <= b->size)
+	    {
+	      len = b->size - b->len - 2;
+	      put_str (b, str, len);
+	      rc = LOG_MESSAGE_TRUNCATED;
+	      continue;
+	    }
+	  put_str (b, str, len);
+	  break;
+	default:
+	  put_u64 (b, get_int_arg (&c, &aq));
+	  break;
+	}
+
+      if (b->len > b->size)
+	{
+	  rc = LOG_MESSAGE_TRUNCATED;
+	}
+    }
+  va_end (aq);
+
+  return rc;
+}
+
+/**
+ * Finds the ID of a call site, giving it a new one if it has none.
+ *
+ * @return the site table entry or NULL if the table is full.
+ */
+static struct log_site_entry *
+find_log_site (struct log_site_entry *table, const char *tag,
+	       const char *file, unsigned int line, const char *msg)
+{
+  unsigned long hash = (((unsigned long) file ^ (unsigned long) msg) >> 3)
+    ^ (line * 2654435761UL);
+  struct log_site_entry *e;
+  unsigned long i;
+
+  for (i = 0; i < LOGGER_SITE_TABLE_SIZE; i++)
+    {
+      e = &table[(hash + i) & (LOGGER_SITE_TABLE_SIZE - 1)];
+
+      if (e->state == 0 && __sync_bool_compare_and_swap (&e->state, 0, 1))
+	{
+	  e->tag = tag;
+	  e->file = file;
+	  e->line = line;
+	  e->msg = msg;
+	  __sync_synchronize ();
+	  e->state = 2;
+	  return e;
+	}
+
+      /* An entry being filled is skipped rather than waited for because the
+       * filler may be the very thread interrupted by this signal handler */
+      if (e->state == 2 && e->msg == msg && e->file == file
+	  && e->line == line && e->tag == tag)
+	{
+	  return e;
+	}
+    }
+
+  return NULL;
+}
+
+/**
+ * Encodes a message as a binary message record preceded by the site record if
+ * the site has not been emitted.
+ *
+ * @return 0 if the records fit or -1 if not even the site record fits.
+ */
+static int
+encode_binary (struct log_buf *b, const char *tag,
+	       const char *file, unsigned int line,
+	       const char *msg, va_list ap, const char *suffix,
+	       struct log_site_entry **site)
+{
+  struct log_site_entry *table = l->private->site_table;
+  struct timeval ts;
+  uint16_t id;
+  size_t start;
+  int flags;
+
+  *site = find_log_site (table, tag, file, line, msg);
+  id = (*site == NULL ? LOG_SITE_OVERFLOW : *site - table);
+
+  if (*site == NULL || !(*site)->is_emitted)
+    {
+      start = b->len;
+      put_u8 (b, LOG_RECORD_SITE);
+      put_u16 (b, 0);
+      put_u16 (b, id);
+      put_u32 (b, line);
+      put_str (b, tag, strlen (tag));
+      put_str (b, file, strlen (file));
+      put_str (b, msg, strlen (msg));
+      end_record (b, start);
+    }
+
+  gettimeofday (&ts, NULL);
+
+  start = b->len;
+  put_u8 (b, LOG_RECORD_MESSAGE);
+  put_u16 (b, 0);
+  put_u16 (b, id);
+  put_u8 (b, 0);
+  put_u32 (b, ts.tv_sec);
+  put_u32 (b, ts.tv_usec);
+  put_str (b, suffix, strlen (suffix));
+  if (b->len > b->size)
+    {
+      return -1;
+    }
+
+  flags = put_args (b, msg, ap);
+  if (b->len > b->size)
+    {
+      b->len = b->size;
+    }
+  b->data[start + LOG_RECORD_HDR_LEN + 2] = flags;
+  end_record (b, start);
+
+  return 0;
+}
+
+static void
+log_binary (const char *tag, const char *file, unsigned int line,
+	    const char *msg, va_list ap, const char *suffix)
+{
+  FILE *out = l->private->out;
+  struct logger_ring *r = l->private->ring;
+  struct log_site_entry *site;
+  struct logger_slot *slot = NULL;
+  unsigned long pos;
+  char record[LOGGER_RECORD_MAX];
+  struct log_buf b = {
+    .data = record,
+    .len = 0,
+    .size = sizeof (record),
+  };
+
+  if (r != NULL)
+    {
+      if ((slot = claim_slot (r, &pos)) == NULL)
+	{
+	  return;
+	}
+      b.data = slot->line;
+      b.size = sizeof (slot->line);
+    }
+
+  if (encode_binary (&b, tag, file, line, msg, ap, suffix, &site))
+    {
+      b.len = 0;
+    }
+
+  if (slot != NULL)
+    {
+      slot->len = b.len;
+      publish_slot (slot, pos);
+      if (b.len == 0)
+	{
+	  __sync_fetch_and_add (&r->dropped, 1);
+	}
+    }
+  else if (b.len != 0)
+    {
+      flockfile (out);
+      fwrite (b.data, 1, b.len, out);
+      funlockfile (out);
+    }
+
+  if (b.len != 0 && site != NULL)
+    {
+      site->is_emitted = 1;
+    }
+}
+
+/** Writes the start of a session of a binary log. */
+static void
+begin_binary_session (FILE *out)
+{
+  char record[LOG_BINARY_MAGIC_LEN + LOG_RECORD_HDR_LEN + 4];
+  struct log_buf b = {
+    .data = record,
+    .len = 0,
+    .size = sizeof (record),
+  };
+
+  fseek (out, 0, SEEK_END);
+  if (ftell (out) == 0)
+    {
+      memcpy (record, LOG_BINARY_MAGIC, LOG_BINARY_MAGIC_LEN);
+      b.len = LOG_BINARY_MAGIC_LEN;
+    }
+
+  put_u8 (&b, LOG_RECORD_SESSION);
+  put_u16 (&b, 4);
+  put_u32 (&b, getpid ());
+
+  fwrite (b.data, 1, b.len, out);
+}
+
+const char *
+next_log_conversion (const char *fmt, struct log_conversion *c)
+{
+  const char *p = fmt, *spec;
+
+  c->spec = NULL;
+  c->spec_len = 0;
+  c->star_count = 0;
+  c->is_signed = 0;
+  c->type = LOG_ARG_NONE;
+
+  if (*fmt == '\0')
+    {
+      return NULL;
+    }
+
+  while ((p = strchr (p, '%')) != NULL)
+    {
+      spec = p++;
+
+      if (*p == '%')
+	{
+	  p++;
+	  continue;
+	}
+
+      p += strspn (p, "-+ #0'");
+      if (*p == '*')
+	{
+	  c->star_count++;
+	  p++;
+	}
+      else
+	{
+	  p += strspn (p, "0123456789");
+	}
+      if (*p == '.')
+	{
+	  p++;
+	  if (*p == '*')
+	    {
+	      c->star_count++;
+	      p++;
+	    }
+	  else
+	    {
+	      p += strspn (p, "0123456789");
+	    }
+	}
+
+      c->type = LOG_ARG_INT;
+      switch (*p)
+	{
+	case 'h':
+	  p += (p[1] == 'h' ? 2 : 1);
+	  break;
+	case 'l':
+	  c->type = (p[1] == 'l' ? LOG_ARG_LLONG : LOG_ARG_LONG);
+	  p += (p[1] == 'l' ? 2 : 1);
+	  break;
+	case 'q':
+	  c->type = LOG_ARG_LLONG;
+	  p++;
+	  break;
+	case 'L':
+	  c->type = LOG_ARG_LDOUBLE;
+	  p++;
+	  break;
+	case 'j':
+	  c->type = LOG_ARG_INTMAX;
+	  p++;
+	  break;
+	case 'z':
+	  c->type = LOG_ARG_SIZE;
+	  p++;
+	  break;
+	case 't':
+	  c->type = LOG_ARG_PTRDIFF;
+	  p++;
+	  break;
+	}
+
+      switch (*p)
+	{
+	case 'd':
+	case 'i':
+	  c->is_signed = 1;
+	  /* Fall through */
+	case 'o':
+	case 'u':
+	case 'x':
+	case 'X':
+	  if (c->type == LOG_ARG_LDOUBLE)
+	    {
+	      c->type = LOG_ARG_LLONG;
+	    }
+	  break;
+	case 'c':
+	  c->type = LOG_ARG_INT;
+	  c->is_signed = 1;
+	  break;
+	case 'e':
+	case 'E':
+	case 'f':
+	case 'F':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+	  c->type = (c->type == LOG_ARG_LDOUBLE
+		     ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE);
+	  break;
+	case 's':
+	  c->type = LOG_ARG_STR;
+	  break;
+	case 'p':
+	  c->type = LOG_ARG_PTR;
+	  break;
+	case 'n':
+	  c->type = LOG_ARG_COUNT;
+	  break;
+	default:
+	  /* Not a conversion so it is treated as literal text */
+	  c->type = LOG_ARG_NONE;
+	  c->star_count = 0;
+	  c->is_signed = 0;
+	  p = spec + 1;
+	  continue;
+	}
+
+      c->spec = spec;
+      c->spec_len = ++p - spec;
+      return p;
+    }
+
+  return fmt + strlen (fmt);
+}
+
+/**
+ * Writes out all messages available in the ring followed by the number of
+ * messages dropped since the last drain if any.
+ *
+ * @return non-zero if anything is written or 0 if the ring is idle.
+ */
+static int
+drain_ring (struct logger_data *data)
+{
+  struct logger_ring *r = data->ring;
+  FILE *out = data->out;
+  struct logger_slot *slot;
+  unsigned long dropped;
+  int is_written = 0;
+
+  for (;;)
+    {
+      slot = &r->slots[r->dequeue_pos & (LOGGER_RING_SIZE - 1)];
+      if (slot->seq != r->dequeue_pos + 1)
+	{
+	  break;
+	}
+      __sync_synchronize ();
+
+      if (data->site_table == NULL)
+	{
+	  fprintf (out, "[%ld.%06ld] ",
+		   (long) slot->ts.tv_sec, (long) slot->ts.tv_usec);
+	}
+      fwrite (slot->line, 1, slot->len, out);
+
+      __sync_synchronize ();
+      slot->seq = r->dequeue_pos + LOGGER_RING_SIZE;
+      r->dequeue_pos++;
+      is_written = 1;
+    }
+
+  dropped = r->dropped;
+  if (dropped != r->reported_dropped && data->site_table != NULL)
+    {
+      fputc (LOG_RECORD_DROPPED, out);
+      fputc (0, out);
+      fputc (4, out);
+      fputc ((dropped - r->reported_dropped) >> 24 & 0xFF, out);
+      fputc ((dropped - r->reported_dropped) >> 16 & 0xFF, out);
+      fputc ((dropped - r->reported_dropped) >> 8 & 0xFF, out);
+      fputc ((dropped - r->reported_dropped) & 0xFF, out);
+      r->reported_dropped = dropped;
+      is_written = 1;
+    }
+  else if (dropped != r->reported_dropped)
+    {
+      fprintf (out, "[LOGGER] %lu messages dropped\n",
+	       dropped - r->reported_dropped);
+      r->reported_dropped = dropped;
+      is_written = 1;
+    }
+
+  if (is_written)
+    {
+      fflush (out);
+    }
+
+  return is_written;
+}
+
+static void
+summarize_quiet_log_sites (void);
+
+static void *
+drainer (void *arg)
+{
+  struct logger_data *data = arg;
+  const struct timespec interval = {
+    .tv_sec = 0,
+    .tv_nsec = LOGGER_DRAIN_INTERVAL_NS,
+  };
+  int is_stopped;
+
+  do
+    {
+      is_stopped = data->ring->is_stopped;
+      __sync_synchronize ();
+
+      if (!drain_ring (data) && !is_stopped)
+	{
+	  summarize_quiet_log_sites ();
+	}
+
+      if (!is_stopped)
+	{
+	  nanosleep (&interval, NULL);
+	}
+    }
+  while (!is_stopped);
+
+  return NULL;
+}
+
+static void
+destroy_ring (struct logger_ring **r)
+{
+  if (*r == NULL)
+    {
+      return;
+    }
+
+  free ((*r)->slots);
+  free (*r);
+  *r = NULL;
+}
+
+static int
+create_ring (struct logger_data *data)
+{
+  sigset_t all_signals, old_signals;
+  unsigned long i;
+  int rc;
+
+  data->ring = calloc (1, sizeof (*data->ring));
+  if (data->ring == NULL)
+    {
+      return -1;
+    }
+
+  data->ring->slots = malloc (LOGGER_RING_SIZE * sizeof (struct logger_slot));
+  if (data->ring->slots == NULL)
+    {
+      destroy_ring (&data->ring);
+      return -1;
+    }
+  for (i = 0; i < LOGGER_RING_SIZE; i++)
+    {
+      data->ring->slots[i].seq = i;
+    }
+
+  setvbuf (data->out, NULL, _IOFBF, LOGGER_BATCH_SIZE);
+
+  /* Signals must interrupt the application threads and not the drainer */
+  sigfillset (&all_signals);
+  pthread_sigmask (SIG_SETMASK, &all_signals, &old_signals);
+  rc = pthread_create (&data->ring->drainer, NULL, drainer, data);
+  pthread_sigmask (SIG_SETMASK, &old_signals, NULL);
+
+  if (rc)
+    {
+      destroy_ring (&data->ring);
+      return -1;
+    }
+
+  return 0;
+}
+
+/**
+ * Logs a message as "[tag] file:line: msg suffix" either right away or through
+ * the ring.
+ */
+static void
+log_line (const char *tag, const char *file, unsigned int line,
+	  const char *msg, va_list ap, const char *suffix)
+{
+  FILE *out = l->private->out;
+
+  if (l->private->site_table != NULL)
+    {
+      log_binary (tag, file, line, msg, ap, suffix);
+      return;
+    }
+
+  if (l->private->ring != NULL)
+    {
+      enqueue_line (l->private->ring, tag, file, line, msg, ap, suffix);
+      return;
+    }
+
+  flockfile (out);
+  fprintf (out, "[%s] %s:%d: ", tag, file, line);
+  vfprintf (out, msg, ap);
+  fprintf (out, "%s\n", suffix);
+  funlockfile (out);
+}
+
+static void
+log_logger_line (const char *file, unsigned int line, const char *msg, ...)
+{
+  va_list ap;
+
+  va_start (ap, msg);
+  log_line ("LOGGER", file, line, msg, ap, "");
+  va_end (ap);
+}
+
+/** Logs the summary of the messages suppressed at a call site if any. */
+static void
+summarize_log_site (struct log_site *site)
+{
+  unsigned long suppressed = __sync_fetch_and_and (&site->suppressed, 0);
+  int error_num = errno;
+
+  if (suppressed)
+    {
+      log_logger_line (site->file, site->line, "suppressed %lu messages",
+		       suppressed);
+      errno = error_num;
+    }
+}
+
+/**
+ * Logs the summaries of the call sites whose suppressed messages belong to an
+ * interval that has ended so that a burst is summarized even if its call site
+ * then goes quiet.
+ */
+static void
+summarize_quiet_log_sites (void)
+{
+  long window = time (NULL) / rate.interval;
+  struct log_site *site;
+
+  for (site = sites; site != NULL; site = site->next)
+    {
+      if (site->suppressed && site->window != window)
+	{
+	  summarize_log_site (site);
+	}
+    }
+}
+
+int
+pass_log_site (struct log_site *site, const char *file, unsigned int line)
+{
+  unsigned long burst = rate.burst, sample = rate.sample, count;
+  long window;
+  struct log_site *next;
+
+  if (burst == 0)
+    {
+      return 1;
+    }
+
+  if (!site->is_registered
+      && __sync_bool_compare_and_swap (&site->is_registered, 0, 1))
+    {
+      site->file = file;
+      site->line = line;
+      do
+	{
+	  next = sites;
+	  site->next = next;
+	}
+      while (!__sync_bool_compare_and_swap (&sites, next, site));
+    }
+
+  window = time (NULL) / rate.interval;
+  if (window != site->window)
+    {
+      long last = summarized_window;
+
+      /* Without a drainer, nothing else summarizes the quiet sites */
+      if (last != window
+	  && __sync_bool_compare_and_swap (&summarized_window, last, window))
+	{
+	  summarize_quiet_log_sites ();
+	}
+      site->window = window;
+      site->count = 0;
+    }
+
+  count = __sync_add_and_fetch (&site->count, 1);
+  if (count <= burst || (sample && (count - burst) % sample == 0))
+    {
+      summarize_log_site (site);
+      return 1;
+    }
+
+  __sync_fetch_and_add (&site->suppressed, 1);
+  __sync_fetch_and_add (&site->total_suppressed, 1);
+  return 0;
+}
+
+void
+set_log_rate (unsigned long burst, unsigned int interval, unsigned long sample)
+{
+  rate.burst = burst;
+  rate.interval = (interval ? interval : 1);
+  rate.sample = sample;
+}
+
 static void
 sys_err (const char *file, unsigned int line, const char *msg, ...)
 {
   int error_num = errno;
   va_list ap;
   char buffer[128];
-
-  fprintf (l->private->out, "[SYS ERR] %s:%d: ", file, line);
-
-  va_start (ap, msg);
-  vfprintf (l->private->out, msg, ap);
+  char suffix[sizeof (buffer) + 3] = "";
 
 #if (_POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600) && ! _GNU_SOURCE
-  if (strerror_r (error_num, buffer, sizeof (buffer)) == -1)
-    fprintf (l->private->out, "\n");
-  else
-    fprintf (l->private->out, " (%s)\n", buffer);
+  if (strerror_r (error_num, buffer, sizeof (buffer)) != -1)
+    snprintf (suffix, sizeof (suffix), " (%s)", buffer);
 #else
-  fprintf (l->private->out, " (%s)\n",
-	   strerror_r (error_num, buffer, sizeof (buffer)));
+  snprintf (suffix, sizeof (suffix), " (%s)",
+	    strerror_r (error_num, buffer, sizeof (buffer)));
 #endif
+
+  va_start (ap, msg);
+  log_line ("SYS ERR", file, line, msg, ap, suffix);
+  va_end (ap);
 }
 
 static void
@@ -60,22 +1009,21 @@ app_err (const char *file, unsigned int line, int error_num,
 	 const char *msg, ...)
 {
   va_list ap;
+  char suffix[128];
 
-  fprintf (l->private->out, "[APP ERR] %s:%d: ", file, line);
-
-  va_start (ap, msg);
-  vfprintf (l->private->out, msg, ap);
-
-  fprintf (l->private->out, " (");
   if (l->private->app_err2str)
     {
-      fprintf (l->private->out, "%s", l->private->app_err2str (error_num));
+      snprintf (suffix, sizeof (suffix), " (%s)",
+		l->private->app_err2str (error_num));
     }
   else
     {
-      fprintf (l->private->out, "%d", error_num);
+      snprintf (suffix, sizeof (suffix), " (%d)", error_num);
     }
-  fprintf (l->private->out, ")\n");
+
+  va_start (ap, msg);
+  log_line ("APP ERR", file, line, msg, ap, suffix);
+  va_end (ap);
 }
 
 static void
@@ -83,12 +1031,9 @@ err (const char *file, unsigned int line, const char *msg, ...)
 {
   va_list ap;
 
-  fprintf (l->private->out, "[ERR] %s:%d: ", file, line);
-
   va_start (ap, msg);
-  vfprintf (l->private->out, msg, ap);
-
-  fprintf (l->private->out, "\n");
+  log_line ("ERR", file, line, msg, ap, "");
+  va_end (ap);
 }
 
 static void
@@ -96,16 +1041,14 @@ info (const char *file, unsigned int line, const char *msg, ...)
 {
   va_list ap;
 
-  fprintf (l->private->out, "[INFO] %s:%d: ", file, line);
-
   va_start (ap, msg);
-  vfprintf (l->private->out, msg, ap);
-
-  fprintf (l->private->out, "\n");
+  log_line ("INFO", file, line, msg, ap, "");
+  va_end (ap);
 }
 
 int
-init_logger (const char *log_output, const char *(*err2str) (int))
+init_logger (const char *log_output, const char *(*err2str) (int),
+	     enum logger_mode mode)
 {
   FILE *out = fopen (log_output, "a");
 
@@ -121,20 +1064,69 @@ init_logger (const char *log_output, const char *(*err2str) (int))
       return -1;
     }
   l->private->app_err2str = err2str;
-   l->private->out = out;
+  l->private->out = out;
+  l->private->ring = NULL;
+  l->private->site_table = NULL;
+
+  if (mode & LOGGER_BINARY)
+    {
+      l->private->site_table = calloc (LOGGER_SITE_TABLE_SIZE,
+				       sizeof (struct log_site_entry));
+      if (l->private->site_table == NULL)
+	{
+	  fclose (out);
+	  free (l->private);
+	  l->private = NULL;
+	  return -1;
+	}
+      begin_binary_session (out);
+    }
+
+  if ((mode & LOGGER_ASYNC) && create_ring (l->private))
+    {
+      free (l->private->site_table);
+      fclose (out);
+      free (l->private);
+      l->private = NULL;
+      return -1;
+    }
 
   l->sys_err = sys_err;
   l->app_err = app_err;
   l->err = err;
   l->info = info;
+  set_log_level (LOG_LEVEL_DEFAULT);
  
   return 0;
 }
 
+void
+set_log_level (int level)
+{
+  l->level = (level > LOG_LEVEL_MAX ? LOG_LEVEL_MAX : level);
+}
+
 void
 destroy_logger (void)
 {
+  struct log_site *site;
+
+  l->level = LOG_LEVEL_NONE;
+
+  for (site = sites; site != NULL; site = site->next)
+    {
+      summarize_log_site (site);
+    }
+
+  if (l->private->ring != NULL)
+    {
+      l->private->ring->is_stopped = 1;
+      pthread_join (l->private->ring->drainer, NULL);
+      destroy_ring (&l->private->ring);
+    }
+
   fclose (l->private->out);
+  free (l->private->site_table);
   free (l->private);
   l->private = NULL;
 }
@@ -20,19 +20,67 @@
  *        USE_GLOBAL_LOGGER, initializes it with init_logger() and register
  *        destroy_logger() with atexit() so that destroy_logger() will be
  *        called last by atexit().
+ *        Messages are filtered by severity twice. At compile time, a call site
+ *        whose level is above LOG_LEVEL_MAX is compiled out. At run time, a
+ *        call site whose level is above logger::level is skipped. In both
+ *        cases the message arguments are not evaluated at all.
+ *        Messages are also rate limited per call site (see set_log_rate()) so
+ *        that a flood of the same message cannot flood the log.
  ****************************************************************************/
 
 #ifndef LOGGER_H
 #define LOGGER_H
 
 #include <stdio.h>
+#include <signal.h>
 
 #ifdef __cpluplus
 extern "C" {
 #endif
 
+/** No message is logged. */
+#define LOG_LEVEL_NONE 0
+
+/** Only SYS_ERR, APP_ERR and ERR messages are logged. */
+#define LOG_LEVEL_ERR 1
+
+/** INFO messages are logged in addition to the error messages. */
+#define LOG_LEVEL_INFO 2
+
+#ifndef LOG_LEVEL_MAX
+/** The most verbose level compiled in (define it through CFLAGS). */
+#define LOG_LEVEL_MAX LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_LEVEL_DEFAULT
+/** The level set by init_logger() (define it through CFLAGS). */
+#define LOG_LEVEL_DEFAULT LOG_LEVEL_MAX
+#endif
+
 struct logger_data;
 
+/** How the logger writes messages out. */
+enum logger_mode
+  {
+    LOGGER_SYNC = 0, /**< Each message is written by the logging thread. */
+    LOGGER_ASYNC = 1, /**<
+		       * Each message is formatted into a lock-free ring with
+		       * its timestamp and written in batches by a background
+		       * thread. Since a line may be written well after it was
+		       * logged, each text line is prefixed with
+		       * "[seconds.microseconds] " while ::LOGGER_SYNC lines
+		       * are not. Messages logged while the ring is full are
+		       * dropped and counted. A message longer than the ring
+		       * slot is truncated.
+		       */
+    LOGGER_BINARY = 2, /**<
+			* OR-ed with LOGGER_SYNC or LOGGER_ASYNC, each message
+			* is written as a compact binary record (see
+			* logger_binary.h) that log_decoder turns back into
+			* text.
+			*/
+  };
+
 /** The logger object used to log messages. */
 struct logger
 {
@@ -47,20 +95,108 @@ struct logger
 	       const char *msg, ...); /**< Log a custom error message. */
   void (*info) (const char *file, unsigned int line,
 		const char *msg, ...); /**< Log an info message. */
+  volatile sig_atomic_t level; /**<
+				* The most verbose level currently logged
+				* (changed with set_log_level()).
+				*/
 };
 
+/**
+ * The state of a call site for rate limiting. Each call site has its own
+ * instance so that a repetitive message does not suppress other messages.
+ */
+struct log_site
+{
+  const char *file; /**< The file of the call site. */
+  unsigned int line; /**< The line of the call site. */
+  volatile long window; /**< The current rate limiting interval. */
+  volatile unsigned long count; /**< Messages seen in the current interval. */
+  volatile unsigned long suppressed; /**< Messages not yet summarized. */
+  volatile unsigned long total_suppressed; /**< All suppressed messages. */
+  volatile int is_registered; /**< Whether the site is in the site list. */
+  struct log_site *next; /**< The next site in the site list. */
+};
+
+/**
+ * Decides whether a message at a call site should be logged according to the
+ * limit set with set_log_rate(). When a message passes after some messages
+ * have been suppressed, a summary of the suppressed messages is logged first.
+ * The first message of each interval at any call site also summarizes the
+ * call sites that went quiet. The asynchronous logger does it on its own as
+ * soon as an interval ends, while the synchronous logger has no thread of its
+ * own and defers such summaries until something else is logged.
+ *
+ * @param [in] site the state of the call site.
+ * @param [in] file the file of the call site.
+ * @param [in] line the line of the call site.
+ *
+ * @return non-zero if the message should be logged or zero if it is
+ *         suppressed.
+ */
+int
+pass_log_site (struct log_site *site, const char *file, unsigned int line);
+
+#ifndef LOG_RATE_LIMIT
+/** Define this to 0 through CFLAGS to compile rate limiting out. */
+#define LOG_RATE_LIMIT 1
+#endif
+
+#if LOG_RATE_LIMIT
+
+/**
+ * Expands the call site of a message at a particular level. The expansion
+ * follows the `l->' of the call site. A call site above LOG_LEVEL_MAX becomes
+ * an expression whose arguments are only type-checked and never evaluated.
+ * Each call site is rate limited with its own static log_site.
+ */
+#define LOG_AT(lvl, fn, ...)						\
+  level < (lvl) ? (void) 0 : ({						\
+      static struct log_site log_site_;					\
+      if (pass_log_site (&log_site_, __FILE__, __LINE__))		\
+	l->fn (__FILE__, __LINE__, __VA_ARGS__);			\
+    })
+
+#else
+
+#define LOG_AT(lvl, fn, ...)						\
+  level < (lvl) ? (void) 0 : l->fn (__FILE__, __LINE__, __VA_ARGS__)
+
+#endif
+
+/** Expands a call site that is compiled out (see LOG_AT). */
+#define LOG_OFF(msg, ...)						\
+  private ? (void) 0 : (void) sizeof (printf (msg , ## __VA_ARGS__))
+
+#if LOG_LEVEL_MAX >= LOG_LEVEL_ERR
+
 /** Convenient wrapper for calling logger::sys_err. */
-#define SYS_ERR(msg, ...) sys_err (__FILE__, __LINE__, msg , ## __VA_ARGS__)
+#define SYS_ERR(msg, ...) LOG_AT (LOG_LEVEL_ERR, sys_err, msg , ## __VA_ARGS__)
 
 /** Convenient wrapper for calling logger::app_err. */
-#define APP_ERR(error_num, msg, ...) app_err (__FILE__, __LINE__, error_num, \
-					      msg , ## __VA_ARGS__)
+#define APP_ERR(error_num, msg, ...) LOG_AT (LOG_LEVEL_ERR, app_err,	\
+					     error_num, msg , ## __VA_ARGS__)
 
 /** Convenient wrapper for calling logger::err. */
-#define ERR(msg, ...) err (__FILE__, __LINE__, msg , ## __VA_ARGS__)
+#define ERR(msg, ...) LOG_AT (LOG_LEVEL_ERR, err, msg , ## __VA_ARGS__)
+
+#else
+
+#define SYS_ERR(msg, ...) LOG_OFF (msg , ## __VA_ARGS__)
+#define APP_ERR(error_num, msg, ...) LOG_OFF (msg , ## __VA_ARGS__)
+#define ERR(msg, ...) LOG_OFF (msg , ## __VA_ARGS__)
+
+#endif
+
+#if LOG_LEVEL_MAX >= LOG_LEVEL_INFO
 
 /** Convenient wrapper for calling logger::info. */
-#define INFO(msg, ...) info (__FILE__, __LINE__, msg , ## __VA_ARGS__)
+#define INFO(msg, ...) LOG_AT (LOG_LEVEL_INFO, info, msg , ## __VA_ARGS__)
+
+#else
+
+#define INFO(msg, ...) LOG_OFF (msg , ## __VA_ARGS__)
+
+#endif
 
 /** The global pointer to the global logger of an application. */
 extern struct logger *l;
@@ -75,11 +211,14 @@ extern struct logger *l;
  * @param [in] err2str the function used to translate application error code
  *             to its meaning. If this is NULL, the application-specific error
  *             code will be logged as it is.
+ * @param [in] mode whether messages are written synchronously or by a
+ *             background thread.
  *
  * @return zero if the installation is successful or non-zero if it is not.
  */
 int
-init_logger (const char *log_output, const char *(*err2str) (int));
+init_logger (const char *log_output, const char *(*err2str) (int),
+	     enum logger_mode mode);
 
 /**
  * Destroys the global logger by freeing up its resources. It is convenient to
@@ -88,19 +227,62 @@ init_logger (const char *log_output, const char *(*err2str) (int));
 void
 destroy_logger (void);
 
+/**
+ * Changes the most verbose level logged by the global logger. A level above
+ * LOG_LEVEL_MAX is lowered to LOG_LEVEL_MAX. This is async-signal-safe so that
+ * it can be called from a signal handler.
+ *
+ * @param [in] level one of the LOG_LEVEL_* values.
+ */
+void
+set_log_level (int level);
+
+#ifndef LOG_RATE_BURST
+/** The default number of messages a call site may log per interval. */
+#define LOG_RATE_BURST 10
+#endif
+
+#ifndef LOG_RATE_INTERVAL
+/** The default rate limiting interval in seconds. */
+#define LOG_RATE_INTERVAL 5
+#endif
+
+#ifndef LOG_RATE_SAMPLE
+/** By default, every n-th suppressed message is still logged (0 for none). */
+#define LOG_RATE_SAMPLE 0
+#endif
+
+/**
+ * Changes the rate limit applied to every call site of the global logger. The
+ * initial values are LOG_RATE_BURST, LOG_RATE_INTERVAL and LOG_RATE_SAMPLE.
+ *
+ * @param [in] burst the number of messages a call site may log per interval
+ *                   or 0 to disable rate limiting.
+ * @param [in] interval the interval in seconds (must be positive).
+ * @param [in] sample once a call site is over its limit, every sample-th
+ *                    message is still logged, or 0 to log none.
+ */
+void
+set_log_rate (unsigned long burst, unsigned int interval, unsigned long sample);
+
 /**
  * Convenient way to setup an application to use and destroy the global
  * logger. This should be put as the first executable line in main() and must
  * only be called once. If the logger needs to be modified, use
  * destroy_logger() and then init_logger() instead of this macro.
  */
-#define SETUP_LOGGER(log_output, err2str) do {				\
-    if (!atexit (destroy_logger) && !init_logger (log_output, err2str))	\
+#define SETUP_LOGGER_MODE(log_output, err2str, mode) do {		\
+    if (!atexit (destroy_logger)					\
+	&& !init_logger (log_output, err2str, mode))			\
       break;								\
     fprintf (stderr, "Cannot setup logger\n");				\
     exit (EXIT_FAILURE);						\
   } while (0)
 
+/** Works like SETUP_LOGGER_MODE() with LOGGER_SYNC mode. */
+#define SETUP_LOGGER(log_output, err2str)				\
+  SETUP_LOGGER_MODE (log_output, err2str, LOGGER_SYNC)
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,124 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file logger_binary.h
+ * @brief The binary log format written by the logger in LOGGER_BINARY mode and
+ *        read back by log_decoder. A binary log starts with LOG_BINARY_MAGIC
+ *        followed by records. Each record has a one-byte type, a two-byte
+ *        payload length and the payload. All integers are in network byte
+ *        order. A string is a two-byte length followed by the bytes.
+ *        Every time a logger is initialized, a session record is written.
+ *        Call site IDs are only valid within the session that defines them.
+ *        A call site is defined by a site record that is written together
+ *        with the first message of the site. Because asynchronous producers
+ *        race, a message can precede its site record within a session.
+ ****************************************************************************/
+
+#ifndef LOGGER_BINARY_H
+#define LOGGER_BINARY_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The first bytes of a binary log. */
+#define LOG_BINARY_MAGIC "SDEBLOG1"
+
+/** The length of LOG_BINARY_MAGIC. */
+#define LOG_BINARY_MAGIC_LEN 8
+
+/** The length of the type and the payload length of a record. */
+#define LOG_RECORD_HDR_LEN 3
+
+/**
+ * The site ID used when the site table is full. A site record with this ID
+ * always immediately precedes the message record that uses it.
+ */
+#define LOG_SITE_OVERFLOW 0xFFFF
+
+/** The flag of a message record whose arguments do not all fit. */
+#define LOG_MESSAGE_TRUNCATED 0x01
+
+/** The types of the records. */
+enum log_record_type
+  {
+    LOG_RECORD_SESSION = 'B', /**< Process ID (4 bytes). */
+    LOG_RECORD_SITE = 'S', /**<
+			    * Site ID (2 bytes), line (4 bytes), tag, file and
+			    * format strings.
+			    */
+    LOG_RECORD_MESSAGE = 'M', /**<
+			       * Site ID (2 bytes), flags (1 byte), seconds
+			       * and microseconds (4 bytes each), the suffix
+			       * string and the arguments. An integer, a
+			       * pointer or a floating-point number (as IEEE
+			       * double bits) takes 8 bytes, and a string is a
+			       * string. A `*' width or precision is stored as
+			       * an integer before the value.
+			       */
+    LOG_RECORD_DROPPED = 'D', /**< Number of messages dropped (4 bytes). */
+  };
+
+/** The argument types of printf conversions. */
+enum log_arg_type
+  {
+    LOG_ARG_NONE, /**< No conversion (only literal text). */
+    LOG_ARG_INT, /**< %d, %i, %o, %u, %x, %X, %c with hh, h or no length. */
+    LOG_ARG_LONG, /**< Integer conversions with l length. */
+    LOG_ARG_LLONG, /**< Integer conversions with ll or q length. */
+    LOG_ARG_SIZE, /**< Integer conversions with z length. */
+    LOG_ARG_PTRDIFF, /**< Integer conversions with t length. */
+    LOG_ARG_INTMAX, /**< Integer conversions with j length. */
+    LOG_ARG_DOUBLE, /**< Floating-point conversions. */
+    LOG_ARG_LDOUBLE, /**< Floating-point conversions with L length. */
+    LOG_ARG_STR, /**< %s. */
+    LOG_ARG_PTR, /**< %p. */
+    LOG_ARG_COUNT, /**< %n whose argument is skipped and never written. */
+  };
+
+/** A printf conversion specification. */
+struct log_conversion
+{
+  const char *spec; /**< The start of the specification or NULL if none. */
+  size_t spec_len; /**< The length of the specification. */
+  int star_count; /**< The number of `*' width and precision arguments. */
+  int is_signed; /**< Whether an integer conversion is signed. */
+  enum log_arg_type type; /**< The type of the converted argument. */
+};
+
+/**
+ * Scans a printf format up to and including its next conversion
+ * specification. The text between fmt and log_conversion::spec is literal
+ * text in which `%%' stands for `%'.
+ *
+ * @param [in] fmt the format to scan.
+ * @param [out] c the conversion found. If there is no more conversion,
+ *                log_conversion::spec is NULL and log_conversion::type is
+ *                LOG_ARG_NONE.
+ *
+ * @return the position right after the scanned part or NULL if fmt is at the
+ *         end of the format.
+ */
+const char *
+next_log_conversion (const char *fmt, struct log_conversion *c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOGGER_BINARY_H */
@@ -22,14 +22,20 @@ void
 sqlite3_err (const char *file, unsigned int line, sqlite3 *db,
 	     const char *msg, ...)
 {
-  l->err (file, line, "[SQLITE3] %s (%s)", msg, sqlite3_errmsg (db));
+  if (l->level >= LOG_LEVEL_ERR)
+    {
+      l->err (file, line, "[SQLITE3] %s (%s)", msg, sqlite3_errmsg (db));
+    }
 }
 
 void
 sqlite3_err_str (const char *file, unsigned int line, char **err_str,
 		 const char *msg, ...)
 {
-  l->err (file, line, "[SQLITE3] %s (%s)\n", msg, *err_str);
+  if (l->level >= LOG_LEVEL_ERR)
+    {
+      l->err (file, line, "[SQLITE3] %s (%s)\n", msg, *err_str);
+    }
   sqlite3_free (*err_str);
   *err_str = NULL;
 }
@@ -17,6 +17,11 @@
 
 #include <stdlib.h>
 #include <errno.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "logger.h"
 
 GLOBAL_LOGGER;
@@ -29,6 +34,15 @@ enum err
     ERR_MEM, /**< Insufficient memory. */
   };
 
+static int evaluation_count = 0;
+
+static const char *
+counted (const char *msg)
+{
+  evaluation_count++;
+  return msg;
+}
+
 static const char *
 errtostr (int err)
 {
@@ -41,6 +55,276 @@ errtostr (int err)
   return errstr[err];
 }
 
+#define ASYNC_LOG "./logger_test.log"
+#define ASYNC_THREADS 4
+#define ASYNC_MESSAGES 500
+
+static void *
+log_async (void *arg)
+{
+  long id = (long) arg;
+  int i;
+
+  for (i = 0; i < ASYNC_MESSAGES; i++)
+    {
+      l->INFO ("Thread %ld message %d", id, i);
+    }
+
+  return NULL;
+}
+
+static void
+test_async (void)
+{
+  pthread_t threads[ASYNC_THREADS];
+  int next_msg_no[ASYNC_THREADS] = {0};
+  unsigned long written = 0, dropped = 0, n;
+  long sec, usec, id;
+  int i, line_no, msg_no;
+  char line[256];
+  FILE *in;
+
+  unlink (ASYNC_LOG);
+  assert (init_logger (ASYNC_LOG, errtostr, LOGGER_ASYNC) == 0);
+  set_log_rate (0, LOG_RATE_INTERVAL, 0);
+
+  for (i = 0; i < ASYNC_THREADS; i++)
+    {
+      assert (pthread_create (&threads[i], NULL, log_async, (void *) (long) i)
+	      == 0);
+    }
+  for (i = 0; i < ASYNC_THREADS; i++)
+    {
+      pthread_join (threads[i], NULL);
+    }
+  l->APP_ERR (ERR_SOCK, "Last message");
+
+  destroy_logger ();
+
+  /* Ensuring that each message is either written whole or counted dropped */
+  assert ((in = fopen (ASYNC_LOG, "r")) != NULL);
+  while (fgets (line, sizeof (line), in) != NULL)
+    {
+      if (sscanf (line, "[LOGGER] %lu messages dropped", &n) == 1)
+	{
+	  dropped += n;
+	}
+      else if (sscanf (line, "[%ld.%ld] [INFO] logger_test.c:%d: "
+		       "Thread %ld message %d", &sec, &usec, &line_no,
+		       &id, &msg_no) == 5)
+	{
+	  assert (id >= 0 && id < ASYNC_THREADS);
+	  assert (msg_no >= next_msg_no[id]);
+	  next_msg_no[id] = msg_no + 1;
+	  assert (line[strlen (line) - 1] == '\n');
+	  written++;
+	}
+      else
+	{
+	  assert (strstr (line, "] [APP ERR] logger_test.c:") != NULL);
+	  assert (strstr (line, ": Last message (Socket error)\n") != NULL);
+	  written++;
+	}
+    }
+  fclose (in);
+  unlink (ASYNC_LOG);
+
+  assert (written + dropped == ASYNC_THREADS * ASYNC_MESSAGES + 1);
+
+  set_log_rate (LOG_RATE_BURST, LOG_RATE_INTERVAL, LOG_RATE_SAMPLE);
+}
+
+#define RATE_LOG "./logger_test_rate.log"
+#define RATE_MESSAGES 20
+
+/** Each expansion is a distinct call site with its own rate limit state. */
+#define LOG_REPETITIVELY() do {						\
+    int i;								\
+    for (i = 0; i < RATE_MESSAGES; i++)					\
+      l->INFO ("Repetitive message %d", i);				\
+  } while (0)
+
+static void
+start_rate_limit (unsigned long burst, unsigned long sample)
+{
+  unlink (RATE_LOG);
+  assert (init_logger (RATE_LOG, errtostr, LOGGER_SYNC) == 0);
+  set_log_rate (burst, 3600, sample);
+}
+
+static void
+check_rate_limit (unsigned long expected_written)
+{
+  unsigned long written = 0, suppressed = 0, n;
+  char line[256];
+  FILE *in;
+
+  destroy_logger ();
+
+#if !LOG_RATE_LIMIT
+  expected_written = RATE_MESSAGES;
+#endif
+
+  assert ((in = fopen (RATE_LOG, "r")) != NULL);
+  while (fgets (line, sizeof (line), in) != NULL)
+    {
+      if (strstr (line, "[LOGGER] logger_test.c:") == line)
+	{
+	  assert (sscanf (strstr (line, ": ") + 2, "suppressed %lu messages",
+			  &n) == 1);
+	  suppressed += n;
+	}
+      else
+	{
+	  assert (strstr (line, "[INFO] logger_test.c:") == line);
+	  written++;
+	}
+    }
+  fclose (in);
+  unlink (RATE_LOG);
+
+  /* Crossing an interval boundary during the test may let more through */
+  assert (written >= expected_written && written <= 2 * expected_written);
+  assert (written + suppressed == RATE_MESSAGES);
+
+  set_log_rate (LOG_RATE_BURST, LOG_RATE_INTERVAL, LOG_RATE_SAMPLE);
+}
+
+/**
+ * Ensures that a burst is summarized once its interval ends even if the call
+ * site logs nothing more: on its own in asynchronous mode and as soon as
+ * another call site logs in synchronous mode.
+ */
+static void
+test_quiet_summary (int mode)
+{
+  const struct timespec drain_wait = {
+    .tv_sec = 0,
+    .tv_nsec = 200000000,
+  };
+  unsigned long suppressed = 0, n;
+  const char *summary;
+  char line[256];
+  time_t start;
+  FILE *in;
+
+  unlink (RATE_LOG);
+  assert (init_logger (RATE_LOG, errtostr, mode) == 0);
+  set_log_rate (1, 1, 0);
+
+  start = time (NULL);
+  LOG_REPETITIVELY ();
+  while (time (NULL) == start)
+    {
+      nanosleep (&drain_wait, NULL);
+    }
+  nanosleep (&drain_wait, NULL);
+
+  if (mode == LOGGER_SYNC)
+    {
+      l->INFO ("Another call site");
+      destroy_logger ();
+    }
+
+  /*
+   * Read before destroy_logger () summarizes whatever is left or, in
+   * synchronous mode, stop at the message that should have summarized it.
+   */
+  assert ((in = fopen (RATE_LOG, "r")) != NULL);
+  while (fgets (line, sizeof (line), in) != NULL
+	 && strstr (line, ": Another call site\n") == NULL)
+    {
+      summary = strstr (line, "[LOGGER] logger_test.c:");
+      if (summary != NULL)
+	{
+	  assert (sscanf (strstr (summary, ": ") + 2,
+			  "suppressed %lu messages", &n) == 1);
+	  suppressed += n;
+	}
+    }
+  fclose (in);
+  assert (suppressed > 0);
+
+  if (mode == LOGGER_ASYNC)
+    {
+      destroy_logger ();
+    }
+  unlink (RATE_LOG);
+
+  set_log_rate (LOG_RATE_BURST, LOG_RATE_INTERVAL, LOG_RATE_SAMPLE);
+}
+
+#define TEXT_LOG "./logger_test_text.log"
+#define BINARY_LOG "./logger_test_binary.log"
+#define DECODED_LOG "./logger_test_decoded.log"
+
+/** Logs the same call sites whatever the logger mode is. */
+static void
+log_various (void)
+{
+  errno = ENOENT;
+  l->SYS_ERR ("System error on %s", "/nowhere");
+  l->APP_ERR (ERR_SOCK, "Application error %d", -3);
+  l->ERR ("Unsigned %u, %lu and %hu with 100%% %x", 4000000000U,
+	  123456789UL, (unsigned short) 65535, 0xbeef);
+  l->INFO ("Padded [%-6s] [%*d] [%.*s] [%5.2f] [%c]", "ab", 5, 42, 3,
+	   "abcdef", 3.14159, 'z');
+  l->INFO ("Sizes %zu %lld %s", (size_t) 7, -9LL, (const char *) NULL);
+  l->INFO ("No conversion at all");
+}
+
+static void
+compare_files (const char *path1, const char *path2)
+{
+  FILE *f1, *f2;
+  char line1[256], line2[256];
+  char *p1, *p2;
+
+  assert ((f1 = fopen (path1, "r")) != NULL);
+  assert ((f2 = fopen (path2, "r")) != NULL);
+  do
+    {
+      p1 = fgets (line1, sizeof (line1), f1);
+      p2 = fgets (line2, sizeof (line2), f2);
+      assert ((p1 == NULL) == (p2 == NULL));
+      assert (p1 == NULL || strcmp (line1, line2) == 0);
+    }
+  while (p1 != NULL);
+  fclose (f1);
+  fclose (f2);
+}
+
+static void
+test_binary (enum logger_mode mode)
+{
+  unlink (TEXT_LOG);
+  unlink (BINARY_LOG);
+
+  assert (init_logger (TEXT_LOG, errtostr, LOGGER_SYNC) == 0);
+  log_various ();
+  destroy_logger ();
+
+  /* Two sessions ensure that the site IDs of each session are used */
+  assert (init_logger (BINARY_LOG, errtostr, mode | LOGGER_BINARY) == 0);
+  log_various ();
+  destroy_logger ();
+  assert (init_logger (BINARY_LOG, errtostr, mode | LOGGER_BINARY) == 0);
+  log_various ();
+  destroy_logger ();
+
+  assert (system ("./log_decoder -s " BINARY_LOG " > " DECODED_LOG) == 0);
+
+  assert (init_logger (TEXT_LOG, errtostr, LOGGER_SYNC) == 0);
+  log_various ();
+  destroy_logger ();
+
+  compare_files (TEXT_LOG, DECODED_LOG);
+
+  unlink (TEXT_LOG);
+  unlink (BINARY_LOG);
+  unlink (DECODED_LOG);
+}
+
 int
 main (int argc, char **argv, char **envp)
 {
@@ -56,10 +340,60 @@ main (int argc, char **argv, char **envp)
 
   l->INFO ("Information 1: %s", "Great is the Lord!");
 
+  /* Ensuring that a filtered message does not evaluate its arguments */
+  set_log_level (LOG_LEVEL_ERR);
+  l->INFO ("Information 2: %s", counted ("Filtered"));
+  assert (evaluation_count == 0);
+  l->ERR ("Custom error %s", counted ("[ERROR]"));
+  assert (evaluation_count == (LOG_LEVEL_MAX >= LOG_LEVEL_ERR));
+
+  evaluation_count = 0;
+  set_log_level (LOG_LEVEL_NONE);
+  l->APP_ERR (ERR_MEM, "Application error %s", counted ("Filtered"));
+  assert (evaluation_count == 0);
+
+  /* Ensuring that the level cannot exceed the compiled-in level */
+  set_log_level (LOG_LEVEL_MAX + 1);
+  assert (l->level == LOG_LEVEL_MAX);
+  l->INFO ("Information 3: %s", counted ("Logged"));
+  assert (evaluation_count == (LOG_LEVEL_MAX >= LOG_LEVEL_INFO));
+
+  /* Ensuring that if statements without braces still parse */
+  if (evaluation_count)
+    l->INFO ("Information 4");
+  else
+    l->ERR ("Unreachable");
+
   destroy_logger ();
 
+  /* These tests count the INFO messages written */
+  if (LOG_LEVEL_MAX >= LOG_LEVEL_INFO)
+    {
+      test_async ();
+
+      test_binary (LOGGER_SYNC);
+      test_binary (LOGGER_ASYNC);
+
+      start_rate_limit (3, 0);
+      LOG_REPETITIVELY ();
+      check_rate_limit (3);
+
+      start_rate_limit (2, 4);
+      LOG_REPETITIVELY ();
+      check_rate_limit (6);
+
+      start_rate_limit (0, 0);
+      LOG_REPETITIVELY ();
+      check_rate_limit (RATE_MESSAGES);
+
+#if LOG_RATE_LIMIT
+      test_quiet_summary (LOGGER_SYNC);
+      test_quiet_summary (LOGGER_ASYNC);
+#endif
+    }
+
   /* Ensuring that passing NULL is okay */
-  init_logger ("/dev/null", NULL);
+  init_logger ("/dev/null", NULL, LOGGER_SYNC);
 
   l->APP_ERR (ERR_MEM, "Error code logged as it is");
 
@@ -114,6 +114,12 @@
  * <strong>[CAUTION]</strong> GET_METADATA and the corresponding METADATA
  * reply communication session can be skipped (i.e., GET_SERVICE_DESCRIPTION
  * can be issued without issuing GET_METADATA first).
+ * <h1>Statistics</h1>
+ * A GET_STATS packet sent from the AP itself (i.e., from a loopback address)
+ * is replied with a single STATS packet carrying the statistics counters of
+ * the AP in the Prometheus text exposition format. A GET_STATS packet from
+ * any other address is dropped. No announcement packet is used since the
+ * local scraper can use ioctl (..., FIONREAD, ...).
  * <h1>Why duplicated "count" and "size" fields in sde_metadata_data,
  * sde_get_service_desc_data and sde_service_desc_data?</h1>
  * The duplicated count and size fields are there so that an AP or a gadget
@@ -234,6 +240,8 @@ enum sde_packet_type
     GET_SERVICE_DESC_DATA, /**< The service description request data. */
     SERVICE_DESC, /**< The service description response. */
     SERVICE_DESC_DATA, /**< The service description response data. */
+    GET_STATS, /**< A local-only statistics request. */
+    STATS, /**< The statistics response. */
   };
 
 /** The common data of all Service Description Exchange packets. */
@@ -330,6 +338,29 @@ struct sde_service_desc_data
   struct tlv_chunk data[0]; /**< The service description data. */
 } __attribute__ ((packed));
 
+/**
+ * The SDE GET_STATS packet.
+ * The sde_packet::type is ::GET_STATS.
+ * The sde_packet::seq should be set and tracked by the sender.
+ */
+struct sde_get_stats
+{
+  struct sde_packet c; /**< The common part of an SDE packet. */
+} __attribute__ ((packed));
+
+/**
+ * The SDE STATS packet.
+ * The sde_packet::type is ::STATS.
+ * The sde_packet::seq is as the same as the one in the sde_get_stats that is
+ * replied.
+ */
+struct sde_stats
+{
+  struct sde_packet c; /**< The common part of an SDE packet. */
+  uint32_t size; /**< The size in bytes of the text. */
+  char data[0]; /**< The statistics text that is not NUL-terminated. */
+} __attribute__ ((packed));
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,256 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file sde_bench.c
+ * @brief The micro-benchmarks of the SDE encode path: the TLV primitives and
+ *        the response builders run against synthetic dummy service lists.
+ *        A benchmark whose variant is non-zero marks the service list as
+ *        modified before each operation to measure cache rebuilds.
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "app_err.h"
+#include "bench.h"
+#include "logger.h"
+#include "sde.h"
+#include "service_inquiry.h"
+#include "service_list_dummy.h"
+#include "tlv.h"
+
+GLOBAL_LOGGER;
+
+/** The value of the chunks created and read. */
+static char chunk_value[4096];
+
+/** The chunks read by bench_read_chunk(). */
+static void *chunks = NULL;
+
+/** The size of chunks in bytes. */
+static uint32_t chunks_len;
+
+/** The positions requested from the synthetic service list. */
+static struct position positions[DUMMY_SERVICE_MAX];
+
+static void
+bench_create_chunk (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      void *data = NULL;
+      uint32_t data_len;
+
+      bench_sink = (uintptr_t) create_chunk (1, b->arg1, chunk_value, NULL,
+				       &data, &data_len);
+      free (data);
+    }
+}
+
+static void
+setup_read_chunk (const struct bench *b)
+{
+  const struct tlv_chunk *itr = NULL;
+  size_t i;
+
+  free (chunks);
+  chunks = NULL;
+  for (i = 0; i < b->arg2; i++)
+    {
+      if ((itr = create_chunk (i, b->arg1, chunk_value, itr,
+			       &chunks, &chunks_len)) == NULL)
+	{
+	  die_bench ("create_chunk", ERR_MEM);
+	}
+    }
+}
+
+static void
+bench_read_chunk (const struct bench *b, uint64_t n)
+{
+  const struct tlv_chunk *itr = NULL;
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((itr = read_chunk (chunks, chunks_len, itr)) == NULL)
+	{
+	  itr = read_chunk (chunks, chunks_len, NULL);
+	}
+      bench_sink = (uintptr_t) itr;
+    }
+}
+
+static void
+bench_get_padded_length (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+  uint32_t sum = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      sum += get_padded_length (i & 0xFFF, b->arg1);
+    }
+  bench_sink = sum;
+}
+
+static void
+setup_service_list (const struct bench *b)
+{
+  int rc;
+
+  if ((rc = set_dummy_service_list (b->arg1, b->arg2)))
+    {
+      die_bench ("set_dummy_service_list", rc);
+    }
+}
+
+static void
+bench_get_metadata_response (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      struct sde_metadata *m;
+      struct sde_metadata_data *d;
+      size_t m_size, d_size;
+      int rc;
+
+      if (b->variant)
+	{
+	  touch_dummy_service_list ();
+	}
+      if ((rc = get_metadata_response (i, &m, &m_size, &d, &d_size)))
+	{
+	  die_bench ("get_metadata_response", rc);
+	}
+      free (m);
+      free (d);
+    }
+}
+
+static void
+bench_get_service_desc_response (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      struct sde_service_desc *s;
+      struct sde_service_desc_data *d;
+      size_t s_size, d_size;
+      int rc;
+
+      if (b->variant)
+	{
+	  touch_dummy_service_list ();
+	}
+      if ((rc = get_service_desc_response (i, &s, &s_size, &d, &d_size,
+					   positions, b->arg1)))
+	{
+	  die_bench ("get_service_desc_response", rc);
+	}
+      free (s);
+      free (d);
+    }
+}
+
+static void
+bench_get_service_desc_vec_response (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      struct sde_service_desc *s;
+      struct tlv_vec d;
+      size_t s_size;
+      int rc;
+
+      if ((rc = get_service_desc_vec_response (i, &s, &s_size, &d,
+					       positions, b->arg1)))
+	{
+	  die_bench ("get_service_desc_vec_response", rc);
+	}
+      free (s);
+      destroy_vec (&d);
+    }
+}
+
+/** The benchmarks. */
+static const struct bench benches[] = {
+  {"CreateChunk/len=8", NULL, bench_create_chunk, 8},
+  {"CreateChunk/len=64", NULL, bench_create_chunk, 64},
+  {"CreateChunk/len=1024", NULL, bench_create_chunk, 1024},
+  {"ReadChunk/len=8", setup_read_chunk, bench_read_chunk, 8, 64},
+  {"ReadChunk/len=1024", setup_read_chunk, bench_read_chunk, 1024, 64},
+  {"GetPaddedLength/align=4", NULL, bench_get_padded_length, 4},
+  {"GetPaddedLength/align=8", NULL, bench_get_padded_length, 8},
+  {"GetMetadataResponse/services=1", setup_service_list,
+   bench_get_metadata_response, 1, 32},
+  {"GetMetadataResponse/services=16", setup_service_list,
+   bench_get_metadata_response, 16, 32},
+  {"GetMetadataResponse/services=255", setup_service_list,
+   bench_get_metadata_response, 255, 32},
+  {"GetMetadataResponse/services=255/rebuild", setup_service_list,
+   bench_get_metadata_response, 255, 32, 1},
+  {"GetServiceDescResponse/services=1/desc=short", setup_service_list,
+   bench_get_service_desc_response, 1, 32},
+  {"GetServiceDescResponse/services=16/desc=short", setup_service_list,
+   bench_get_service_desc_response, 16, 32},
+  {"GetServiceDescResponse/services=255/desc=short", setup_service_list,
+   bench_get_service_desc_response, 255, 32},
+  {"GetServiceDescResponse/services=255/desc=short/rebuild",
+   setup_service_list, bench_get_service_desc_response, 255, 32, 1},
+  {"GetServiceDescVecResponse/services=255/desc=short", setup_service_list,
+   bench_get_service_desc_vec_response, 255, 32},
+  {"GetServiceDescResponse/services=1/desc=long", setup_service_list,
+   bench_get_service_desc_response, 1, 1024},
+  {"GetServiceDescResponse/services=16/desc=long", setup_service_list,
+   bench_get_service_desc_response, 16, 1024},
+  {"GetServiceDescResponse/services=255/desc=long", setup_service_list,
+   bench_get_service_desc_response, 255, 1024},
+  {"GetServiceDescResponse/services=255/desc=long/rebuild", setup_service_list,
+   bench_get_service_desc_response, 255, 1024, 1},
+  {"GetServiceDescVecResponse/services=255/desc=long", setup_service_list,
+   bench_get_service_desc_vec_response, 255, 1024},
+};
+
+int
+main (int argc, char **argv, char **envp)
+{
+  size_t i;
+
+  SETUP_LOGGER ("/dev/stderr", errtostr);
+  set_log_level (LOG_LEVEL_ERR);
+
+  memset (chunk_value, 'V', sizeof (chunk_value));
+  for (i = 0; i < DUMMY_SERVICE_MAX; i++)
+    {
+      positions[i].pos = i;
+    }
+
+  run_benches (benches, sizeof (benches) / sizeof (*benches), argc, argv);
+
+  free (chunks);
+  set_dummy_service_list (0, 0);
+  destroy_sde_handler_cache ();
+
+  exit (EXIT_SUCCESS);
+}
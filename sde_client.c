@@ -0,0 +1,772 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file sde_client.c
+ * @brief The implementation of the gadget side of an SDE session.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "app_err.h"
+#include "sde_client.h"
+
+/** The retransmission timeout before the first RTT sample in nanoseconds. */
+#define SDE_RTO_INITIAL 500000000ULL
+
+/** The lower bound of the retransmission timeout in nanoseconds. */
+#define SDE_RTO_MIN 50000000ULL
+
+/** The upper bound of the retransmission timeout in nanoseconds. */
+#define SDE_RTO_MAX 4000000000ULL
+
+/** The default number of times a request is resent. */
+#define SDE_MAX_RETRANSMISSIONS 4
+
+/** The number of positions that an SDE position can address. */
+#define SDE_POSITIONS_MAX 256
+
+/** A request waiting for its response. */
+struct sde_request
+{
+  int is_pending; /**< Non-zero if the request is outstanding. */
+  uint32_t seq; /**< The sequence number of the request. */
+  uint32_t expected; /**< The type of the data packet answering the request. */
+  sde_callback cb; /**< The callback of the request. */
+  void *arg; /**< The argument of the callback. */
+  uint64_t sent; /**< The time the request was first sent. */
+  uint64_t deadline; /**< The time the request is resent or given up. */
+  int retransmissions; /**< The number of times the request was resent. */
+  union
+  {
+    struct sde_get_metadata m;
+    struct sde_get_service_desc s;
+    struct sde_get_stats g;
+  } head; /**< The first packet of the request. */
+  size_t head_size; /**< The size of head in bytes. */
+  struct sde_get_service_desc_data *data; /**<
+					   * The second packet of the request
+					   * or NULL if there is none.
+					   */
+  size_t data_size; /**< The size of data in bytes. */
+};
+
+/** The progress of fetch_all_service_desc(). */
+struct sde_fetch
+{
+  int is_active; /**< Non-zero if a fetch is in progress. */
+  sde_callback cb; /**< The callback of the fetch. */
+  void *arg; /**< The argument of the callback. */
+  int rc; /**< The first error of the fetch. */
+  int pending; /**< The number of outstanding requests of the fetch. */
+  size_t next_pos; /**< The next position to be requested. */
+  size_t count; /**< The number of positions to be requested. */
+};
+
+struct sde_session_impl
+{
+  int sock; /**< The socket connected to the AP. */
+  uint32_t next_seq; /**< The sequence number of the next request. */
+  struct sde_request window[SDE_SESSION_WINDOW]; /**< The requests by seq. */
+  int max_retransmissions; /**< The times a request is resent. */
+  uint64_t fixed_rto; /**< The fixed timeout or 0 if it is adaptive. */
+  uint64_t srtt; /**< The smoothed round-trip time or 0 without a sample. */
+  uint64_t rttvar; /**< The round-trip time variation. */
+  uint64_t rto; /**< The adaptive retransmission timeout. */
+  struct sde_session_stats stats; /**< The counters of the session. */
+  struct sde_fetch fetch; /**< The progress of fetch_all_service_desc(). */
+};
+
+void
+craft_get_metadata (struct sde_get_metadata *m, uint32_t seq)
+{
+  m->c.type = htonl (GET_METADATA);
+  m->c.seq = htonl (seq);
+}
+
+int
+craft_get_service_desc (struct sde_get_service_desc *s,
+			struct sde_get_service_desc_data **d, size_t *d_size,
+			uint32_t seq, const struct position *pos, size_t count)
+{
+  size_t size = sizeof (**d) + sizeof (*pos) * count;
+  struct sde_get_service_desc_data *ptr = malloc (size);
+
+  if (ptr == NULL)
+    {
+      return ERR_MEM;
+    }
+
+  s->c.type = htonl (GET_SERVICE_DESC);
+  s->c.seq = htonl (seq);
+  s->count = htonl (count);
+
+  ptr->c.type = htonl (GET_SERVICE_DESC_DATA);
+  ptr->c.seq = s->c.seq;
+  ptr->count = s->count;
+  memcpy (ptr->data, pos, sizeof (*pos) * count);
+
+  *d = ptr;
+  *d_size = size;
+
+  return ERR_SUCCESS;
+}
+
+void
+craft_get_stats (struct sde_get_stats *g, uint32_t seq)
+{
+  g->c.type = htonl (GET_STATS);
+  g->c.seq = htonl (seq);
+}
+
+int
+is_sde_response_complete (const struct sde_packet *p, size_t bytes_rcvd)
+{
+  const struct sde_metadata_data *md;
+  const struct sde_service_desc_data *sd;
+  const struct sde_stats *st;
+
+  if (bytes_rcvd < sizeof (*p))
+    {
+      return 0;
+    }
+
+  switch (ntohl (p->type))
+    {
+    case METADATA:
+      return bytes_rcvd >= sizeof (struct sde_metadata);
+    case METADATA_DATA:
+      md = (const struct sde_metadata_data *) p;
+      return (bytes_rcvd >= sizeof (*md)
+	      && (bytes_rcvd - sizeof (*md)) / sizeof (*md->data)
+	      >= ntohl (md->count));
+    case SERVICE_DESC:
+      return bytes_rcvd >= sizeof (struct sde_service_desc);
+    case SERVICE_DESC_DATA:
+      sd = (const struct sde_service_desc_data *) p;
+      return bytes_rcvd >= sizeof (*sd) && bytes_rcvd >= ntohl (sd->size);
+    case STATS:
+      st = (const struct sde_stats *) p;
+      return (bytes_rcvd >= sizeof (*st)
+	      && bytes_rcvd - sizeof (*st) >= ntohl (st->size));
+    default:
+      return 0;
+    }
+}
+
+/**
+ * Gets the current time.
+ *
+ * @return the time in nanoseconds as given by clock_gettime() with
+ *         CLOCK_MONOTONIC.
+ */
+static uint64_t
+get_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int
+create_sde_session (sde_session **ss, const struct sockaddr_in *ap_addr)
+{
+  sde_session *ptr = calloc (1, sizeof (*ptr));
+
+  if (ptr == NULL)
+    {
+      return ERR_MEM;
+    }
+
+  ptr->max_retransmissions = SDE_MAX_RETRANSMISSIONS;
+  ptr->rto = SDE_RTO_INITIAL;
+
+  ptr->sock = socket (AF_INET, SOCK_DGRAM, 0);
+  if (ptr->sock == -1)
+    {
+      free (ptr);
+      return ERR_SOCK;
+    }
+
+  if (connect (ptr->sock, (const struct sockaddr *) ap_addr,
+	       sizeof (*ap_addr)) == -1)
+    {
+      close (ptr->sock);
+      free (ptr);
+      return ERR_SOCK;
+    }
+
+  *ss = ptr;
+
+  return ERR_SUCCESS;
+}
+
+void
+destroy_sde_session (sde_session **ss)
+{
+  int i;
+
+  if (ss == NULL || *ss == NULL)
+    {
+      return;
+    }
+
+  for (i = 0; i < SDE_SESSION_WINDOW; i++)
+    {
+      free ((*ss)->window[i].data);
+    }
+  close ((*ss)->sock);
+  free (*ss);
+  *ss = NULL;
+}
+
+void
+set_sde_session_retransmission (sde_session *ss, int max_retransmissions,
+				uint64_t timeout)
+{
+  ss->max_retransmissions = max_retransmissions;
+  ss->fixed_rto = timeout;
+}
+
+int
+get_sde_session_fd (const sde_session *ss)
+{
+  return ss->sock;
+}
+
+int
+get_sde_session_timeout (const sde_session *ss)
+{
+  uint64_t now, deadline = UINT64_MAX;
+  int i;
+
+  for (i = 0; i < SDE_SESSION_WINDOW; i++)
+    {
+      if (ss->window[i].is_pending && ss->window[i].deadline < deadline)
+	{
+	  deadline = ss->window[i].deadline;
+	}
+    }
+
+  if (deadline == UINT64_MAX)
+    {
+      return -1;
+    }
+
+  now = get_time ();
+  if (deadline <= now)
+    {
+      return 0;
+    }
+
+  /* Rounding up avoids waking up just before the deadline. */
+  return (deadline - now + 999999) / 1000000;
+}
+
+int
+is_sde_session_busy (const sde_session *ss)
+{
+  int i;
+
+  for (i = 0; i < SDE_SESSION_WINDOW; i++)
+    {
+      if (ss->window[i].is_pending)
+	{
+	  return 1;
+	}
+    }
+
+  return 0;
+}
+
+void
+get_sde_session_stats (const sde_session *ss, struct sde_session_stats *stats)
+{
+  *stats = ss->stats;
+}
+
+/**
+ * Gets the time to wait for the response of a request before resending it.
+ * The adaptive timeout is doubled for every retransmission as in RFC 6298.
+ *
+ * @param [in] ss the session of the request.
+ * @param [in] retransmissions the times the request has been resent.
+ *
+ * @return the timeout in nanoseconds.
+ */
+static uint64_t
+get_rto (const sde_session *ss, int retransmissions)
+{
+  uint64_t rto;
+
+  if (ss->fixed_rto)
+    {
+      return ss->fixed_rto;
+    }
+
+  rto = ss->rto;
+  while (retransmissions-- > 0 && rto < SDE_RTO_MAX)
+    {
+      rto *= 2;
+    }
+
+  return rto < SDE_RTO_MAX ? rto : SDE_RTO_MAX;
+}
+
+/**
+ * Updates the adaptive retransmission timeout with a round-trip time sample
+ * as in RFC 6298.
+ *
+ * @param [in] ss the session whose timeout is updated.
+ * @param [in] rtt the round-trip time sample in nanoseconds.
+ */
+static void
+sample_rtt (sde_session *ss, uint64_t rtt)
+{
+  uint64_t delta;
+
+  if (ss->srtt == 0)
+    {
+      ss->srtt = rtt ? rtt : 1;
+      ss->rttvar = rtt / 2;
+    }
+  else
+    {
+      delta = ss->srtt > rtt ? ss->srtt - rtt : rtt - ss->srtt;
+      ss->rttvar = ss->rttvar - ss->rttvar / 4 + delta / 4;
+      ss->srtt = ss->srtt - ss->srtt / 8 + rtt / 8;
+    }
+
+  ss->rto = ss->srtt + 4 * ss->rttvar;
+  if (ss->rto < SDE_RTO_MIN)
+    {
+      ss->rto = SDE_RTO_MIN;
+    }
+  else if (ss->rto > SDE_RTO_MAX)
+    {
+      ss->rto = SDE_RTO_MAX;
+    }
+}
+
+/**
+ * Sends the packets of a request.
+ *
+ * @param [in] ss the session through which the request is sent.
+ * @param [in] r the request to be sent.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+send_request (sde_session *ss, const struct sde_request *r)
+{
+  if (send (ss->sock, &r->head, r->head_size, 0) == -1)
+    {
+      return ERR_SOCK;
+    }
+  if (r->data != NULL && send (ss->sock, r->data, r->data_size, 0) == -1)
+    {
+      return ERR_SOCK;
+    }
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Takes the window slot of the next sequence number for a new request.
+ *
+ * @param [in] ss the session of the request.
+ * @param [out] r the slot whose sequence number is assigned.
+ *
+ * @return 0 if there is no error or ERR_SDE_BUSY if the slot is taken.
+ */
+static int
+take_slot (sde_session *ss, struct sde_request **r)
+{
+  struct sde_request *ptr = &ss->window[ss->next_seq % SDE_SESSION_WINDOW];
+
+  if (ptr->is_pending)
+    {
+      return ERR_SDE_BUSY;
+    }
+
+  memset (ptr, 0, sizeof (*ptr));
+  ptr->seq = ss->next_seq;
+  *r = ptr;
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Sends a request whose slot has been filled in and makes it outstanding.
+ *
+ * @param [in] ss the session through which the request is sent.
+ * @param [in] r the request.
+ * @param [in] cb the callback of the request.
+ * @param [in] arg the argument of the callback.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+start_request (sde_session *ss, struct sde_request *r,
+	       sde_callback cb, void *arg)
+{
+  int rc;
+
+  r->cb = cb;
+  r->arg = arg;
+  r->sent = get_time ();
+  r->deadline = r->sent + get_rto (ss, 0);
+
+  if ((rc = send_request (ss, r)))
+    {
+      free (r->data);
+      r->data = NULL;
+      return rc;
+    }
+
+  r->is_pending = 1;
+  ss->next_seq++;
+  ss->stats.sent++;
+
+  return ERR_SUCCESS;
+}
+
+int
+request_metadata (sde_session *ss, sde_callback cb, void *arg)
+{
+  struct sde_request *r;
+  int rc;
+
+  if ((rc = take_slot (ss, &r)))
+    {
+      return rc;
+    }
+
+  craft_get_metadata (&r->head.m, r->seq);
+  r->head_size = sizeof (r->head.m);
+  r->expected = METADATA_DATA;
+
+  return start_request (ss, r, cb, arg);
+}
+
+int
+request_service_desc (sde_session *ss, const struct position *pos,
+		      size_t count, sde_callback cb, void *arg)
+{
+  struct sde_request *r;
+  int rc;
+
+  if ((rc = take_slot (ss, &r)))
+    {
+      return rc;
+    }
+
+  if ((rc = craft_get_service_desc (&r->head.s, &r->data, &r->data_size,
+				    r->seq, pos, count)))
+    {
+      return rc;
+    }
+  r->head_size = sizeof (r->head.s);
+  r->expected = SERVICE_DESC_DATA;
+
+  return start_request (ss, r, cb, arg);
+}
+
+int
+request_stats (sde_session *ss, sde_callback cb, void *arg)
+{
+  struct sde_request *r;
+  int rc;
+
+  if ((rc = take_slot (ss, &r)))
+    {
+      return rc;
+    }
+
+  craft_get_stats (&r->head.g, r->seq);
+  r->head_size = sizeof (r->head.g);
+  r->expected = STATS;
+
+  return start_request (ss, r, cb, arg);
+}
+
+/**
+ * Ends an outstanding request and calls its callback. The slot is released
+ * before the callback so that the callback can send new requests.
+ *
+ * @param [in] r the request to be ended.
+ * @param [in] rc the outcome of the request.
+ * @param [in] p the packet answering the request or NULL if it fails.
+ * @param [in] size the size of p in bytes.
+ */
+static void
+end_request (struct sde_request *r, int rc,
+	     const struct sde_packet *p, size_t size)
+{
+  struct sde_reply reply = {
+    .rc = rc,
+    .packet = p,
+    .size = size,
+    .sent = r->sent,
+    .retransmissions = r->retransmissions,
+  };
+
+  r->is_pending = 0;
+  free (r->data);
+  r->data = NULL;
+
+  if (r->cb != NULL)
+    {
+      r->cb (&reply, r->arg);
+    }
+}
+
+/**
+ * Matches a received packet with the outstanding request it answers.
+ *
+ * @param [in] ss the session receiving the packet.
+ * @param [in] p the received packet.
+ * @param [in] size the size of p in bytes.
+ */
+static void
+take_response (sde_session *ss, const struct sde_packet *p, size_t size)
+{
+  struct sde_request *r;
+  uint32_t type, seq;
+
+  if (!is_sde_response_complete (p, size))
+    {
+      ss->stats.invalid++;
+      return;
+    }
+
+  type = ntohl (p->type);
+  if (type == METADATA || type == SERVICE_DESC)
+    {
+      /* The announcement is of no use with a large enough buffer. */
+      return;
+    }
+
+  seq = ntohl (p->seq);
+  r = &ss->window[seq % SDE_SESSION_WINDOW];
+  if (!r->is_pending || r->seq != seq)
+    {
+      ss->stats.stale++;
+      return;
+    }
+  if (type != r->expected)
+    {
+      ss->stats.invalid++;
+      return;
+    }
+
+  /* Karn's algorithm: a retransmitted request gives an ambiguous sample. */
+  if (r->retransmissions == 0)
+    {
+      sample_rtt (ss, get_time () - r->sent);
+    }
+
+  ss->stats.completed++;
+  end_request (r, ERR_SUCCESS, p, size);
+}
+
+int
+process_sde_session (sde_session *ss, void *buffer, size_t size)
+{
+  ssize_t bytes_rcvd;
+  uint64_t now;
+  int i;
+
+  while ((bytes_rcvd = recv (ss->sock, buffer, size, MSG_DONTWAIT)) != -1
+	 || errno == ECONNREFUSED || errno == EINTR)
+    {
+      /* An ICMP port unreachable is left to the retransmission timer. */
+      if (bytes_rcvd != -1)
+	{
+	  take_response (ss, buffer, bytes_rcvd);
+	}
+    }
+  if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      return ERR_SOCK;
+    }
+
+  now = get_time ();
+  for (i = 0; i < SDE_SESSION_WINDOW; i++)
+    {
+      struct sde_request *r = &ss->window[i];
+
+      if (!r->is_pending || r->deadline > now)
+	{
+	  continue;
+	}
+
+      if (r->retransmissions >= ss->max_retransmissions)
+	{
+	  ss->stats.timed_out++;
+	  end_request (r, ERR_SDE_TIMEOUT, NULL, 0);
+	  continue;
+	}
+
+      /* A failed resend is retried when the doubled timeout passes. */
+      send_request (ss, r);
+      r->retransmissions++;
+      r->deadline = now + get_rto (ss, r->retransmissions);
+      ss->stats.retransmitted++;
+    }
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Ends fetch_all_service_desc() with a final call to its callback once its
+ * outstanding requests are over.
+ *
+ * @param [in] ss the session of the fetch.
+ */
+static void
+end_fetch (sde_session *ss)
+{
+  struct sde_reply reply = {
+    .rc = ss->fetch.rc,
+  };
+
+  if (ss->fetch.pending
+      || (ss->fetch.rc == ERR_SUCCESS && ss->fetch.next_pos < ss->fetch.count))
+    {
+      return;
+    }
+
+  ss->fetch.is_active = 0;
+  ss->fetch.cb (&reply, ss->fetch.arg);
+}
+
+static void
+take_fetch_reply (const struct sde_reply *r, void *arg);
+
+/**
+ * Sends the sde_get_service_desc of the positions that
+ * fetch_all_service_desc() has yet to request until the window is full.
+ *
+ * @param [in] ss the session of the fetch.
+ */
+static void
+continue_fetch (sde_session *ss)
+{
+  struct position pos[SDE_FETCH_BATCH];
+  size_t i, count;
+  int rc;
+
+  while (ss->fetch.rc == ERR_SUCCESS && ss->fetch.next_pos < ss->fetch.count)
+    {
+      count = ss->fetch.count - ss->fetch.next_pos;
+      if (count > SDE_FETCH_BATCH)
+	{
+	  count = SDE_FETCH_BATCH;
+	}
+      for (i = 0; i < count; i++)
+	{
+	  pos[i].pos = ss->fetch.next_pos + i;
+	}
+
+      rc = request_service_desc (ss, pos, count, take_fetch_reply, ss);
+      if (rc == ERR_SDE_BUSY && ss->fetch.pending)
+	{
+	  /* The rest is sent as the outstanding requests are answered. */
+	  break;
+	}
+      if (rc)
+	{
+	  ss->fetch.rc = rc;
+	  break;
+	}
+
+      ss->fetch.pending++;
+      ss->fetch.next_pos += count;
+    }
+}
+
+/**
+ * Passes a reply to a request of fetch_all_service_desc() to its callback and
+ * requests the service descriptions once the metadata arrives.
+ *
+ * @param [in] r the reply.
+ * @param [in] arg the session of the fetch.
+ */
+static void
+take_fetch_reply (const struct sde_reply *r, void *arg)
+{
+  sde_session *ss = arg;
+  const struct sde_metadata_data *md;
+
+  ss->fetch.pending--;
+
+  if (r->rc)
+    {
+      if (ss->fetch.rc == ERR_SUCCESS)
+	{
+	  ss->fetch.rc = r->rc;
+	}
+    }
+  else
+    {
+      ss->fetch.cb (r, ss->fetch.arg);
+
+      if (ntohl (r->packet->type) == METADATA_DATA)
+	{
+	  md = (const struct sde_metadata_data *) r->packet;
+	  ss->fetch.count = ntohl (md->count);
+	  if (ss->fetch.count > SDE_POSITIONS_MAX)
+	    {
+	      ss->fetch.count = SDE_POSITIONS_MAX;
+	    }
+	}
+    }
+
+  continue_fetch (ss);
+  end_fetch (ss);
+}
+
+int
+fetch_all_service_desc (sde_session *ss, sde_callback cb, void *arg)
+{
+  int rc;
+
+  if (ss->fetch.is_active)
+    {
+      return ERR_SDE_BUSY;
+    }
+
+  memset (&ss->fetch, 0, sizeof (ss->fetch));
+  ss->fetch.cb = cb;
+  ss->fetch.arg = arg;
+
+  if ((rc = request_metadata (ss, take_fetch_reply, ss)))
+    {
+      return rc;
+    }
+
+  ss->fetch.is_active = 1;
+  ss->fetch.pending = 1;
+
+  return ERR_SUCCESS;
+}
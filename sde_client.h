@@ -0,0 +1,309 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file sde_client.h
+ * @brief The gadget side of an SDE session that is shared by the interactive
+ *        gadget and the load generator: crafting the request packets,
+ *        checking the size of the response packets and running an
+ *        asynchronous sde_session. An sde_session keeps up to
+ *        SDE_SESSION_WINDOW requests outstanding, matches their responses by
+ *        sequence number and retransmits a request whose response does not
+ *        come within a retransmission timeout adapted to the measured
+ *        round-trip time. It never blocks: the application polls the
+ *        descriptor given by get_sde_session_fd() for POLLIN with the timeout
+ *        given by get_sde_session_timeout() in its own event loop and calls
+ *        process_sde_session() afterwards, which calls back the requesters.
+ ****************************************************************************/
+
+#ifndef SDE_CLIENT_H
+#define SDE_CLIENT_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sde.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Crafts an sde_get_metadata packet.
+ *
+ * @param [out] m the packet to be crafted.
+ * @param [in] seq the sequence number of the packet.
+ */
+void
+craft_get_metadata (struct sde_get_metadata *m, uint32_t seq);
+
+/**
+ * Crafts an sde_get_service_desc packet and its sde_get_service_desc_data
+ * packet.
+ *
+ * @param [out] s the announcement packet to be crafted.
+ * @param [out] d a pointer to a dynamically allocated memory space containing
+ *                the data packet that should be freed with free().
+ * @param [out] d_size the size of d in bytes.
+ * @param [in] seq the sequence number of the packets.
+ * @param [in] pos the positions of the desired services.
+ * @param [in] count the number of positions in pos.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+craft_get_service_desc (struct sde_get_service_desc *s,
+			struct sde_get_service_desc_data **d, size_t *d_size,
+			uint32_t seq, const struct position *pos, size_t count);
+
+/**
+ * Crafts an sde_get_stats packet.
+ *
+ * @param [out] g the packet to be crafted.
+ * @param [in] seq the sequence number of the packet.
+ */
+void
+craft_get_stats (struct sde_get_stats *g, uint32_t seq);
+
+/**
+ * Checks whether or not a received response packet is at least as big as its
+ * type requires, including the data that its header announces.
+ *
+ * @param [in] p the received packet.
+ * @param [in] bytes_rcvd the number of bytes received.
+ *
+ * @return non-zero if the packet is a complete response packet or 0 if the
+ *         packet is too small or is not a response packet.
+ */
+int
+is_sde_response_complete (const struct sde_packet *p, size_t bytes_rcvd);
+
+/** The size of a buffer that any SDE response packet fits. */
+#define SDE_RECV_BUFFER_SIZE 65536
+
+/** The maximum number of outstanding requests of an sde_session. */
+#define SDE_SESSION_WINDOW 32
+
+/**
+ * The number of positions requested by each sde_get_service_desc that
+ * fetch_all_service_desc() sends so that every response fits a datagram.
+ */
+#define SDE_FETCH_BATCH 16
+
+/** An asynchronous SDE session with an AP. */
+typedef struct sde_session_impl sde_session;
+
+/** The outcome of a request given to its callback. */
+struct sde_reply
+{
+  int rc; /**< 0 if the request is answered or non-zero if it fails. */
+  const struct sde_packet *packet; /**<
+				    * The ::METADATA_DATA, ::SERVICE_DESC_DATA
+				    * or ::STATS packet answering the request
+				    * that is only valid during the callback,
+				    * or NULL if the request fails or
+				    * fetch_all_service_desc() is done.
+				    */
+  size_t size; /**< The size of packet in bytes. */
+  uint64_t sent; /**<
+		  * The time the request was first sent in nanoseconds as
+		  * given by clock_gettime() with CLOCK_MONOTONIC.
+		  */
+  int retransmissions; /**< The number of times the request was resent. */
+};
+
+/**
+ * The callback of a request.
+ *
+ * @param [in] r the outcome of the request.
+ * @param [in] arg the argument given together with the callback.
+ */
+typedef void (*sde_callback) (const struct sde_reply *r, void *arg);
+
+/** The counters of an sde_session. */
+struct sde_session_stats
+{
+  uint64_t sent; /**< Requests sent for the first time. */
+  uint64_t retransmitted; /**< Requests sent again. */
+  uint64_t completed; /**< Requests answered. */
+  uint64_t timed_out; /**< Requests given up after all retransmissions. */
+  uint64_t stale; /**< Response packets matching no outstanding request. */
+  uint64_t invalid; /**< Response packets of an incorrect size or type. */
+};
+
+/**
+ * Creates an sde_session with an AP whose requests are retransmitted up to 4
+ * times with an adaptive timeout. The session should later be destroyed with
+ * destroy_sde_session().
+ *
+ * @param [out] ss a pointer to the created session.
+ * @param [in] ap_addr the SDE address of the AP.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+create_sde_session (sde_session **ss, const struct sockaddr_in *ap_addr);
+
+/**
+ * Destroys an sde_session. The outstanding requests are dropped without
+ * calling their callbacks.
+ *
+ * @param [in,out] ss the session to be destroyed that will be set to NULL.
+ */
+void
+destroy_sde_session (sde_session **ss);
+
+/**
+ * Sets how an sde_session retransmits its requests.
+ *
+ * @param [in] ss the session to be set.
+ * @param [in] max_retransmissions the number of times a request is resent
+ *                                 before it fails with ERR_SDE_TIMEOUT.
+ * @param [in] timeout the fixed retransmission timeout in nanoseconds or 0
+ *                     to adapt the timeout to the measured round-trip time.
+ */
+void
+set_sde_session_retransmission (sde_session *ss, int max_retransmissions,
+				uint64_t timeout);
+
+/**
+ * Gets the descriptor that the event loop of the application should poll for
+ * POLLIN on behalf of an sde_session.
+ *
+ * @param [in] ss the session.
+ *
+ * @return the descriptor.
+ */
+int
+get_sde_session_fd (const sde_session *ss);
+
+/**
+ * Gets the poll() timeout within which process_sde_session() should be
+ * called to retransmit or give up a request.
+ *
+ * @param [in] ss the session.
+ *
+ * @return the timeout in milliseconds or -1 if no request is outstanding.
+ */
+int
+get_sde_session_timeout (const sde_session *ss);
+
+/**
+ * Receives the pending response packets of an sde_session without blocking,
+ * calls back the answered requests and retransmits or gives up the requests
+ * whose timeouts have passed. A callback may send new requests but must not
+ * destroy the session. Since every packet is handled before the next one is
+ * received, the sessions of a thread can share a single receive buffer as
+ * long as no callback processes another session with it.
+ *
+ * @param [in] ss the session to be processed.
+ * @param [in] buffer the buffer into which a packet is received, which should
+ *                    have SDE_RECV_BUFFER_SIZE bytes so that no packet is
+ *                    truncated.
+ * @param [in] size the size of buffer in bytes.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+process_sde_session (sde_session *ss, void *buffer, size_t size);
+
+/**
+ * Checks whether or not an sde_session has an outstanding request.
+ *
+ * @param [in] ss the session to be checked.
+ *
+ * @return non-zero if there is an outstanding request or 0 otherwise.
+ */
+int
+is_sde_session_busy (const sde_session *ss);
+
+/**
+ * Gets the counters of an sde_session.
+ *
+ * @param [in] ss the session.
+ * @param [out] stats the counters.
+ */
+void
+get_sde_session_stats (const sde_session *ss, struct sde_session_stats *stats);
+
+/**
+ * Sends an sde_get_metadata whose ::METADATA_DATA response is given to a
+ * callback.
+ *
+ * @param [in] ss the session through which the request is sent.
+ * @param [in] cb the callback.
+ * @param [in] arg the argument of the callback.
+ *
+ * @return 0 if the request is sent, ERR_SDE_BUSY if SDE_SESSION_WINDOW
+ *         requests are outstanding or another non-zero value if there is
+ *         an error.
+ */
+int
+request_metadata (sde_session *ss, sde_callback cb, void *arg);
+
+/**
+ * Sends an sde_get_service_desc whose ::SERVICE_DESC_DATA response is given
+ * to a callback.
+ *
+ * @param [in] ss the session through which the request is sent.
+ * @param [in] pos the positions of the desired services.
+ * @param [in] count the number of positions in pos.
+ * @param [in] cb the callback.
+ * @param [in] arg the argument of the callback.
+ *
+ * @return 0 if the request is sent, ERR_SDE_BUSY if SDE_SESSION_WINDOW
+ *         requests are outstanding or another non-zero value if there is
+ *         an error.
+ */
+int
+request_service_desc (sde_session *ss, const struct position *pos,
+		      size_t count, sde_callback cb, void *arg);
+
+/**
+ * Sends an sde_get_stats whose ::STATS response is given to a callback.
+ *
+ * @param [in] ss the session through which the request is sent.
+ * @param [in] cb the callback.
+ * @param [in] arg the argument of the callback.
+ *
+ * @return 0 if the request is sent, ERR_SDE_BUSY if SDE_SESSION_WINDOW
+ *         requests are outstanding or another non-zero value if there is
+ *         an error.
+ */
+int
+request_stats (sde_session *ss, sde_callback cb, void *arg);
+
+/**
+ * Fetches the metadata and then the descriptions of all services by sending
+ * the sde_get_service_desc of every SDE_FETCH_BATCH positions at once as soon
+ * as the ::METADATA_DATA arrives, so that the whole service list takes about
+ * two round trips. The callback is given the ::METADATA_DATA, then every
+ * ::SERVICE_DESC_DATA as it arrives and finally a reply whose packet is NULL
+ * and whose rc tells whether all of them have arrived. Only one fetch may be
+ * in progress in a session.
+ *
+ * @param [in] ss the session through which the requests are sent.
+ * @param [in] cb the callback.
+ * @param [in] arg the argument of the callback.
+ *
+ * @return 0 if the fetch is started or non-zero if there is an error.
+ */
+int
+fetch_all_service_desc (sde_session *ss, sde_callback cb, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SDE_CLIENT_H */
@@ -0,0 +1,325 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file sde_client_test.c
+ * @brief The test of the gadget side of an SDE session.
+ ****************************************************************************/
+
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "app_err.h"
+#include "sde_client.h"
+
+/** The number of services published by the fake AP. */
+#define AP_SERVICES 40
+
+/** The buffer receiving the response packets of a session. */
+static char recv_buffer[SDE_RECV_BUFFER_SIZE];
+
+/** The socket of the fake AP. */
+static int ap = -1;
+
+/**
+ * Makes the fake AP take the next pending request and answer it.
+ *
+ * @param [in] is_dropped non-zero to take the request without answering it.
+ *
+ * @return the type of the request or -1 if no request is pending.
+ */
+static int
+serve_request (int is_dropped)
+{
+  char buffer[512];
+  struct sde_packet *p = (struct sde_packet *) buffer;
+  struct sde_metadata_data *md = (struct sde_metadata_data *) buffer;
+  struct sde_service_desc_data *sd = (struct sde_service_desc_data *) buffer;
+  struct sde_stats *st = (struct sde_stats *) buffer;
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof (addr);
+  size_t size;
+  int type;
+
+  if (recvfrom (ap, buffer, sizeof (buffer), MSG_DONTWAIT,
+		(struct sockaddr *) &addr, &addr_len) == -1)
+    {
+      return -1;
+    }
+
+  type = ntohl (p->type);
+  if (type == GET_SERVICE_DESC)
+    {
+      assert (recv (ap, buffer, sizeof (buffer), MSG_DONTWAIT) != -1);
+      assert (ntohl (p->type) == GET_SERVICE_DESC_DATA);
+    }
+  if (is_dropped)
+    {
+      return type;
+    }
+
+  switch (type)
+    {
+    case GET_METADATA:
+      md->c.type = htonl (METADATA_DATA);
+      md->count = htonl (AP_SERVICES);
+      memset (md->data, 0, sizeof (*md->data) * AP_SERVICES);
+      size = sizeof (*md) + sizeof (*md->data) * AP_SERVICES;
+      break;
+    case GET_SERVICE_DESC:
+      sd->c.type = htonl (SERVICE_DESC_DATA);
+      sd->size = htonl (sizeof (*sd));
+      size = sizeof (*sd);
+      break;
+    default:
+      st->c.type = htonl (STATS);
+      st->size = htonl (0);
+      size = sizeof (*st);
+      break;
+    }
+  assert (sendto (ap, buffer, size, 0, (struct sockaddr *) &addr,
+		  addr_len) == size);
+
+  return type;
+}
+
+/**
+ * Waits for the next event of an SDE session and processes it.
+ *
+ * @param [in] ss the session.
+ */
+static void
+run_session (sde_session *ss)
+{
+  struct pollfd fd = {
+    .fd = get_sde_session_fd (ss),
+    .events = POLLIN,
+  };
+
+  assert (poll (&fd, 1, get_sde_session_timeout (ss)) != -1);
+  assert (process_sde_session (ss, recv_buffer, sizeof (recv_buffer))
+	  == 0);
+}
+
+/** The replies given to record_reply(). */
+struct reply_log
+{
+  int count; /**< The number of replies. */
+  int metadata; /**< The number of ::METADATA_DATA replies. */
+  int service_desc; /**< The number of ::SERVICE_DESC_DATA replies. */
+  int is_done; /**< Non-zero once a reply without a packet arrives. */
+  struct sde_reply last; /**< The last reply. */
+};
+
+static void
+record_reply (const struct sde_reply *r, void *arg)
+{
+  struct reply_log *log = arg;
+
+  log->count++;
+  log->last = *r;
+  if (r->packet == NULL)
+    {
+      log->is_done = 1;
+    }
+  else if (ntohl (r->packet->type) == METADATA_DATA)
+    {
+      log->metadata++;
+    }
+  else if (ntohl (r->packet->type) == SERVICE_DESC_DATA)
+    {
+      log->service_desc++;
+    }
+}
+
+/** Tests an sde_session against the fake AP. */
+static void
+test_session (void)
+{
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_addr.s_addr = htonl (INADDR_LOOPBACK),
+  };
+  socklen_t addr_len = sizeof (addr);
+  struct position pos[1] = {{0}};
+  struct sde_session_stats stats;
+  struct reply_log log = {0};
+  sde_session *ss;
+  int i, requests;
+
+  ap = socket (AF_INET, SOCK_DGRAM, 0);
+  assert (ap != -1);
+  assert (bind (ap, (struct sockaddr *) &addr, sizeof (addr)) == 0);
+  assert (getsockname (ap, (struct sockaddr *) &addr, &addr_len) == 0);
+
+  assert (create_sde_session (&ss, &addr) == 0);
+  assert (!is_sde_session_busy (ss));
+  assert (get_sde_session_timeout (ss) == -1);
+
+  /* A lost request is resent. */
+  set_sde_session_retransmission (ss, 4, 20000000ULL);
+  assert (request_metadata (ss, record_reply, &log) == 0);
+  assert (is_sde_session_busy (ss));
+  assert (get_sde_session_timeout (ss) <= 20);
+  assert (serve_request (1) == GET_METADATA);
+  while (log.count == 0)
+    {
+      run_session (ss);
+      serve_request (0);
+    }
+  assert (log.last.rc == 0);
+  assert (log.last.retransmissions == 1);
+  assert (log.metadata == 1);
+  assert (!is_sde_session_busy (ss));
+
+  /* A request that is never answered fails. */
+  memset (&log, 0, sizeof (log));
+  set_sde_session_retransmission (ss, 1, 10000000ULL);
+  assert (request_stats (ss, record_reply, &log) == 0);
+  while (log.count == 0)
+    {
+      run_session (ss);
+      serve_request (1);
+    }
+  assert (log.last.rc == ERR_SDE_TIMEOUT);
+  assert (log.last.packet == NULL);
+  assert (log.last.retransmissions == 1);
+
+  /* A late answer is stale. */
+  assert (request_service_desc (ss, pos, 1, record_reply, &log) == 0);
+  assert (serve_request (1) == GET_SERVICE_DESC);
+  while (log.count == 1)
+    {
+      run_session (ss);
+    }
+  assert (log.last.rc == ERR_SDE_TIMEOUT);
+  assert (serve_request (0) == GET_SERVICE_DESC);
+  run_session (ss);
+  get_sde_session_stats (ss, &stats);
+  assert (stats.sent == 3);
+  assert (stats.retransmitted == 3);
+  assert (stats.completed == 1);
+  assert (stats.timed_out == 2);
+  assert (stats.stale == 1);
+  assert (stats.invalid == 0);
+
+  /*
+   * The service descriptions are requested at once as soon as the metadata
+   * arrives.
+   */
+  memset (&log, 0, sizeof (log));
+  set_sde_session_retransmission (ss, 4, 0);
+  assert (fetch_all_service_desc (ss, record_reply, &log) == 0);
+  assert (fetch_all_service_desc (ss, record_reply, &log) == ERR_SDE_BUSY);
+  assert (serve_request (0) == GET_METADATA);
+  run_session (ss);
+  assert (log.metadata == 1);
+  requests = 0;
+  while (serve_request (0) == GET_SERVICE_DESC)
+    {
+      requests++;
+    }
+  assert (requests == (AP_SERVICES + SDE_FETCH_BATCH - 1) / SDE_FETCH_BATCH);
+  while (!log.is_done)
+    {
+      run_session (ss);
+    }
+  assert (log.last.rc == 0);
+  assert (log.service_desc == requests);
+  assert (log.count == requests + 2);
+  get_sde_session_stats (ss, &stats);
+  assert (stats.retransmitted == 3);
+
+  /* The window limits the outstanding requests. */
+  for (i = 0; i < SDE_SESSION_WINDOW; i++)
+    {
+      assert (request_metadata (ss, NULL, NULL) == 0);
+    }
+  assert (request_metadata (ss, NULL, NULL) == ERR_SDE_BUSY);
+
+  destroy_sde_session (&ss);
+  assert (ss == NULL);
+  destroy_sde_session (&ss);
+  close (ap);
+}
+
+int
+main (int argc, char **argv, char **envp)
+{
+  struct sde_get_metadata m;
+  struct sde_get_service_desc s;
+  struct sde_get_service_desc_data *d;
+  size_t d_size;
+  struct position pos[3] = {{0}, {2}, {5}};
+  char buffer[64] = {0};
+  struct sde_packet *p = (struct sde_packet *) buffer;
+  struct sde_metadata_data *md = (struct sde_metadata_data *) buffer;
+  struct sde_service_desc_data *sd = (struct sde_service_desc_data *) buffer;
+  struct sde_stats *st = (struct sde_stats *) buffer;
+
+  craft_get_metadata (&m, 7);
+  assert (ntohl (m.c.type) == GET_METADATA);
+  assert (ntohl (m.c.seq) == 7);
+
+  assert (craft_get_service_desc (&s, &d, &d_size, 9, pos, 3) == 0);
+  assert (ntohl (s.c.type) == GET_SERVICE_DESC);
+  assert (ntohl (s.c.seq) == 9);
+  assert (ntohl (s.count) == 3);
+  assert (d_size == sizeof (*d) + sizeof (pos));
+  assert (ntohl (d->c.type) == GET_SERVICE_DESC_DATA);
+  assert (ntohl (d->c.seq) == 9);
+  assert (ntohl (d->count) == 3);
+  assert (memcmp (d->data, pos, sizeof (pos)) == 0);
+  free (d);
+
+  p->type = htonl (METADATA);
+  assert (!is_sde_response_complete (p, sizeof (*p) - 1));
+  assert (!is_sde_response_complete (p, sizeof (struct sde_metadata) - 1));
+  assert (is_sde_response_complete (p, sizeof (struct sde_metadata)));
+
+  md->c.type = htonl (METADATA_DATA);
+  md->count = htonl (2);
+  assert (!is_sde_response_complete (p, sizeof (*md)
+				     + sizeof (*md->data) * 2 - 1));
+  assert (is_sde_response_complete (p, sizeof (*md) + sizeof (*md->data) * 2));
+  md->count = htonl (0xFFFFFFFF);
+  assert (!is_sde_response_complete (p, sizeof (buffer)));
+
+  sd->c.type = htonl (SERVICE_DESC_DATA);
+  sd->size = htonl (40);
+  assert (!is_sde_response_complete (p, 39));
+  assert (is_sde_response_complete (p, 40));
+  sd->size = htonl (0);
+  assert (!is_sde_response_complete (p, sizeof (*sd) - 1));
+
+  st->c.type = htonl (STATS);
+  st->size = htonl (4);
+  assert (!is_sde_response_complete (p, sizeof (*st) + 3));
+  assert (is_sde_response_complete (p, sizeof (*st) + 4));
+
+  p->type = htonl (GET_METADATA);
+  assert (!is_sde_response_complete (p, sizeof (buffer)));
+  p->type = htonl (1000);
+  assert (!is_sde_response_complete (p, sizeof (buffer)));
+
+  test_session ();
+
+  exit (EXIT_SUCCESS);
+}
@@ -0,0 +1,491 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file sde_load.c
+ * @brief The SDE load generator that simulates many gadgets requesting
+ *        metadata and service descriptions from an AP to measure the
+ *        throughput, latency and loss of the SDE daemon. Each thread owns a
+ *        set of gadgets, each of which has its own sde_session. In closed-loop
+ *        mode every gadget sends its next request as soon as the previous one
+ *        is answered or times out. In open-loop mode the requests are sent at
+ *        a fixed total rate regardless of the responses.
+ ****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "app_err.h"
+#include "logger.h"
+#include "sde.h"
+#include "sde_client.h"
+#include "sde_stats.h"
+
+GLOBAL_LOGGER;
+
+/** The interval between timeout checks in milliseconds. */
+#define EXPIRY_INTERVAL 10
+
+/** A simulated gadget. */
+struct gadget
+{
+  sde_session *session; /**< The SDE session with the AP. */
+  struct load_thread *t; /**< The thread owning the gadget. */
+};
+
+/** The results of a thread. */
+struct load_result
+{
+  uint64_t sent; /**< Requests sent. */
+  uint64_t completed; /**< Requests answered completely. */
+  uint64_t lost; /**< Requests timed out or not sent for a full window. */
+  uint64_t stale; /**< Response packets matching no outstanding request. */
+  uint64_t invalid; /**< Response packets of an incorrect size or type. */
+  uint64_t send_errors; /**< Requests that cannot be sent. */
+};
+
+/** The load to generate. */
+static struct
+{
+  struct sockaddr_in ap_addr; /**< The AP. */
+  int threads; /**< The number of threads. */
+  int gadgets; /**< The number of gadgets per thread. */
+  double rate; /**< The total requests per second or 0 for closed loop. */
+  int duration; /**< The duration in seconds. */
+  int metadata_percent; /**< The percentage of GET_METADATA requests. */
+  int positions; /**< The positions requested by GET_SERVICE_DESC. */
+  uint64_t timeout; /**< The response timeout in nanoseconds. */
+  uint64_t end; /**< The time to stop sending. */
+} load = {
+  .threads = 1,
+  .gadgets = 1,
+  .rate = 0,
+  .duration = 10,
+  .metadata_percent = 50,
+  .positions = 1,
+  .timeout = 1000000000ULL,
+};
+
+/** A thread of the load generator. */
+struct load_thread
+{
+  pthread_t id; /**< The thread. */
+  unsigned int seed; /**< The seed choosing the request types. */
+  struct gadget *gadgets; /**< The gadgets of the thread. */
+  struct position *pos; /**< The positions requested by the thread. */
+  struct load_result result; /**< The results of the thread. */
+};
+
+static void
+take_reply (const struct sde_reply *r, void *arg);
+
+/**
+ * Sends the next request of a gadget.
+ *
+ * @param [in] t the thread owning the gadget.
+ * @param [in] g the gadget sending the request.
+ */
+static void
+send_request (struct load_thread *t, struct gadget *g)
+{
+  int rc;
+
+  if (rand_r (&t->seed) % 100 < load.metadata_percent)
+    {
+      rc = request_metadata (g->session, take_reply, g);
+    }
+  else
+    {
+      rc = request_service_desc (g->session, t->pos, load.positions,
+				 take_reply, g);
+    }
+
+  if (rc == ERR_SDE_BUSY)
+    {
+      t->result.lost++;
+    }
+  else if (rc)
+    {
+      t->result.send_errors++;
+    }
+}
+
+/**
+ * Records the outcome of a request of a gadget and, in closed-loop mode,
+ * sends the next one.
+ *
+ * @param [in] r the outcome of the request.
+ * @param [in] arg the gadget of the request.
+ */
+static void
+take_reply (const struct sde_reply *r, void *arg)
+{
+  struct gadget *g = arg;
+
+  if (r->rc == ERR_SUCCESS)
+    {
+      record_sde_stage (SDE_STAGE_REQUEST, r->sent);
+    }
+
+  if (load.rate == 0 && get_sde_stats_time () < load.end)
+    {
+      send_request (g->t, g);
+    }
+}
+
+/**
+ * Generates the load of a thread until the duration elapses and the
+ * outstanding requests are answered or time out.
+ *
+ * @param [in] arg the load_thread.
+ *
+ * @return NULL.
+ */
+static void *
+generate_load (void *arg)
+{
+  struct load_thread *t = arg;
+  struct pollfd *fds = NULL;
+  void *buffer = NULL;
+  uint64_t now, interval = 0, next_send, next_expiry;
+  int i, next_gadget = 0, is_done = 0;
+
+  if (register_sde_stats_worker ())
+    {
+      l->ERR ("Too many threads");
+      return NULL;
+    }
+
+  /* The gadgets of the thread share one receive buffer */
+  fds = malloc (sizeof (*fds) * load.gadgets);
+  buffer = malloc (SDE_RECV_BUFFER_SIZE);
+  if (fds == NULL || buffer == NULL)
+    {
+      l->ERR ("Not enough memory");
+      goto out;
+    }
+
+  for (i = 0; i < load.gadgets; i++)
+    {
+      fds[i].fd = get_sde_session_fd (t->gadgets[i].session);
+      fds[i].events = POLLIN;
+    }
+
+  now = get_sde_stats_time ();
+  if (load.rate > 0)
+    {
+      interval = 1000000000.0 * load.threads / load.rate;
+    }
+  else
+    {
+      for (i = 0; i < load.gadgets; i++)
+	{
+	  send_request (t, &t->gadgets[i]);
+	}
+    }
+  next_send = now;
+  next_expiry = now + EXPIRY_INTERVAL * 1000000ULL;
+
+  while (!is_done)
+    {
+      int timeout = EXPIRY_INTERVAL, is_expiring;
+
+      now = get_sde_stats_time ();
+      if (load.rate > 0 && now < load.end)
+	{
+	  while (next_send <= now)
+	    {
+	      send_request (t, &t->gadgets[next_gadget]);
+	      next_gadget = (next_gadget + 1) % load.gadgets;
+	      next_send += interval;
+	    }
+	  /* Rounding up avoids spinning; the loop above catches up. */
+	  if ((next_send - now + 999999) / 1000000 < timeout)
+	    {
+	      timeout = (next_send - now + 999999) / 1000000;
+	    }
+	}
+
+      if (poll (fds, load.gadgets, timeout) == -1 && errno != EINTR)
+	{
+	  l->SYS_ERR ("Cannot poll gadget sockets");
+	  break;
+	}
+
+      now = get_sde_stats_time ();
+      is_expiring = (now >= next_expiry);
+      if (is_expiring)
+	{
+	  is_done = (now >= load.end);
+	  next_expiry = now + EXPIRY_INTERVAL * 1000000ULL;
+	}
+
+      for (i = 0; i < load.gadgets; i++)
+	{
+	  if (!is_expiring && !(fds[i].revents & POLLIN))
+	    {
+	      continue;
+	    }
+
+	  if (process_sde_session (t->gadgets[i].session, buffer,
+				   SDE_RECV_BUFFER_SIZE))
+	    {
+	      l->SYS_ERR ("Cannot receive SDE responses");
+	    }
+	  if (is_expiring && is_sde_session_busy (t->gadgets[i].session))
+	    {
+	      is_done = 0;
+	    }
+	}
+    }
+
+ out:
+  free (buffer);
+  free (fds);
+
+  return NULL;
+}
+
+/**
+ * Creates the SDE sessions of the gadgets of a thread.
+ *
+ * @param [out] t the thread whose gadgets are to be created.
+ *
+ * @return 0 if there is no error or -1 if there is an error.
+ */
+static int
+create_gadgets (struct load_thread *t)
+{
+  int i, rc;
+
+  t->gadgets = calloc (load.gadgets, sizeof (*t->gadgets));
+  t->pos = malloc (sizeof (*t->pos) * (load.positions ? load.positions : 1));
+  if (t->gadgets == NULL || t->pos == NULL)
+    {
+      l->ERR ("Not enough memory");
+      return -1;
+    }
+
+  for (i = 0; i < load.positions; i++)
+    {
+      t->pos[i].pos = i;
+    }
+
+  for (i = 0; i < load.gadgets; i++)
+    {
+      t->gadgets[i].t = t;
+      if ((rc = create_sde_session (&t->gadgets[i].session, &load.ap_addr)))
+	{
+	  l->APP_ERR (rc, "Cannot create SDE session");
+	  return -1;
+	}
+      /* A lost request is counted rather than resent. */
+      set_sde_session_retransmission (t->gadgets[i].session, 0,
+				      load.timeout);
+    }
+
+  return 0;
+}
+
+/**
+ * Destroys the SDE sessions of the gadgets of a thread after adding their
+ * counters to the results of the thread.
+ *
+ * @param [in] t the thread whose gadgets are to be destroyed.
+ */
+static void
+destroy_gadgets (struct load_thread *t)
+{
+  struct sde_session_stats stats;
+  int i;
+
+  if (t->gadgets != NULL)
+    {
+      for (i = 0; i < load.gadgets; i++)
+	{
+	  if (t->gadgets[i].session == NULL)
+	    {
+	      continue;
+	    }
+
+	  get_sde_session_stats (t->gadgets[i].session, &stats);
+	  t->result.sent += stats.sent;
+	  t->result.completed += stats.completed;
+	  t->result.lost += stats.timed_out;
+	  t->result.stale += stats.stale;
+	  t->result.invalid += stats.invalid;
+	  destroy_sde_session (&t->gadgets[i].session);
+	}
+      free (t->gadgets);
+      t->gadgets = NULL;
+    }
+
+  free (t->pos);
+  t->pos = NULL;
+}
+
+static void
+print_usage (const char *prog)
+{
+  fprintf (stderr,
+	   "Usage: %s [-t THREADS] [-g GADGETS_PER_THREAD] [-r RATE]"
+	   " [-d SECONDS]\n"
+	   "       [-m METADATA_PERCENT] [-p POSITIONS] [-w TIMEOUT_MS]"
+	   " AP_IP_ADDR\n"
+	   "  -r 0 (the default) runs a closed loop in which each gadget has"
+	   " one request\n"
+	   "  outstanding; otherwise RATE requests per second are sent in an"
+	   " open loop.\n"
+	   "  At most %d threads are supported.\n",
+	   prog, SDE_STATS_MAX_WORKERS - 1);
+}
+
+int
+main (int argc, char **argv, char **envp)
+{
+  struct load_thread *threads;
+  struct load_result total = {0};
+  struct sde_stats_worker sum;
+  uint64_t start, elapsed;
+  int opt, i, rc = EXIT_SUCCESS;
+
+  SETUP_LOGGER ("/dev/stderr", NULL);
+
+  while ((opt = getopt (argc, argv, "t:g:r:d:m:p:w:")) != -1)
+    {
+      switch (opt)
+	{
+	case 't':
+	  load.threads = atoi (optarg);
+	  break;
+	case 'g':
+	  load.gadgets = atoi (optarg);
+	  break;
+	case 'r':
+	  load.rate = atof (optarg);
+	  break;
+	case 'd':
+	  load.duration = atoi (optarg);
+	  break;
+	case 'm':
+	  load.metadata_percent = atoi (optarg);
+	  break;
+	case 'p':
+	  load.positions = atoi (optarg);
+	  break;
+	case 'w':
+	  load.timeout = atoi (optarg) * 1000000ULL;
+	  break;
+	default:
+	  print_usage (argv[0]);
+	  exit (EXIT_FAILURE);
+	}
+    }
+  if (optind != argc - 1
+      || load.threads < 1 || load.threads > SDE_STATS_MAX_WORKERS - 1
+      || load.gadgets < 1 || load.rate < 0 || load.duration < 1
+      || load.metadata_percent < 0 || load.metadata_percent > 100
+      || load.positions < 0 || load.positions > 256 || load.timeout == 0)
+    {
+      print_usage (argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  load.ap_addr.sin_family = AF_INET;
+  load.ap_addr.sin_port = htons (SDE_PORT);
+  if (inet_pton (AF_INET, argv[optind], &load.ap_addr.sin_addr) != 1)
+    {
+      l->ERR ("Cannot resolve AP IP address");
+      exit (EXIT_FAILURE);
+    }
+
+  threads = calloc (load.threads, sizeof (*threads));
+  if (threads == NULL)
+    {
+      l->ERR ("Not enough memory");
+      exit (EXIT_FAILURE);
+    }
+  for (i = 0; i < load.threads; i++)
+    {
+      threads[i].seed = i + 1;
+      if (create_gadgets (&threads[i]))
+	{
+	  rc = EXIT_FAILURE;
+	  goto out;
+	}
+    }
+
+  start = get_sde_stats_time ();
+  load.end = start + load.duration * 1000000000ULL;
+  for (i = 0; i < load.threads; i++)
+    {
+      if (pthread_create (&threads[i].id, NULL, generate_load, &threads[i]))
+	{
+	  l->ERR ("Cannot create thread");
+	  load.end = start;
+	  load.threads = i;
+	  rc = EXIT_FAILURE;
+	  break;
+	}
+    }
+  for (i = 0; i < load.threads; i++)
+    {
+      pthread_join (threads[i].id, NULL);
+      destroy_gadgets (&threads[i]);
+      total.sent += threads[i].result.sent;
+      total.completed += threads[i].result.completed;
+      total.lost += threads[i].result.lost;
+      total.stale += threads[i].result.stale;
+      total.invalid += threads[i].result.invalid;
+      total.send_errors += threads[i].result.send_errors;
+    }
+  elapsed = load.end - start;
+
+  sum_sde_stats (&sum);
+  printf ("Mode: %s, threads: %d, gadgets: %d, duration: %d s\n",
+	  load.rate > 0 ? "open loop" : "closed loop", load.threads,
+	  load.threads * load.gadgets, load.duration);
+  printf ("Sent: %llu, completed: %llu (%.1f req/s), lost: %llu (%.2f%%),"
+	  " stale: %llu, invalid: %llu, send errors: %llu\n",
+	  (unsigned long long) total.sent,
+	  (unsigned long long) total.completed,
+	  total.completed * 1e9 / elapsed,
+	  (unsigned long long) total.lost,
+	  total.sent ? 100.0 * total.lost / total.sent : 0.0,
+	  (unsigned long long) total.stale,
+	  (unsigned long long) total.invalid,
+	  (unsigned long long) total.send_errors);
+  printf ("Latency: p50 %.1f us, p99 %.1f us, p999 %.1f us\n",
+	  get_sde_latency_quantile (&sum, SDE_STAGE_REQUEST, 0.5) / 1e3,
+	  get_sde_latency_quantile (&sum, SDE_STAGE_REQUEST, 0.99) / 1e3,
+	  get_sde_latency_quantile (&sum, SDE_STAGE_REQUEST, 0.999) / 1e3);
+
+ out:
+  for (i = 0; i < load.threads; i++)
+    {
+      destroy_gadgets (&threads[i]);
+    }
+  free (threads);
+
+  exit (rc);
+}
@@ -0,0 +1,368 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "sde_stats.h"
+
+/** The blocks of counters of all workers. */
+static struct sde_stats_worker workers[SDE_STATS_MAX_WORKERS];
+
+/** The number of blocks taken (the first is the main thread's). */
+static volatile int worker_count = 1;
+
+__thread struct sde_stats_worker *sde_stats_self = &workers[0];
+
+/** The names of the packet type buckets in the statistics text. */
+static const char *type_names[SDE_STATS_UNKNOWN_TYPE + 1] = {
+  [GET_METADATA] = "get_metadata",
+  [METADATA] = "metadata",
+  [METADATA_DATA] = "metadata_data",
+  [GET_SERVICE_DESC] = "get_service_desc",
+  [GET_SERVICE_DESC_DATA] = "get_service_desc_data",
+  [SERVICE_DESC] = "service_desc",
+  [SERVICE_DESC_DATA] = "service_desc_data",
+  [GET_STATS] = "get_stats",
+  [STATS] = "stats",
+  [SDE_STATS_UNKNOWN_TYPE] = "unknown",
+};
+
+/** The names of the per-type packet counters in the statistics text. */
+static const char *packet_counter_names[SDE_PACKET_COUNTERS] = {
+  [SDE_PACKETS_RECEIVED] = "sde_packets_received_total",
+  [SDE_PACKETS_DROPPED] = "sde_packets_dropped_total",
+  [SDE_PACKETS_MALFORMED] = "sde_packets_malformed_total",
+};
+
+/** The names of the other counters in the statistics text. */
+static const char *counter_names[SDE_COUNTERS] = {
+  [SDE_REPLIES_SENT] = "sde_replies_sent_total",
+  [SDE_BYTES_OUT] = "sde_bytes_out_total",
+  [SDE_SEND_ERRORS] = "sde_send_errors_total",
+  [SDE_CACHE_HITS] = "sde_cache_hits_total",
+  [SDE_CACHE_MISSES] = "sde_cache_misses_total",
+  [SDE_CACHE_REBUILDS] = "sde_cache_rebuilds_total",
+  [SDE_CACHE_REBUILD_NS] = "sde_cache_rebuild_seconds_total",
+  [SDE_SQLITE_NS] = "sde_sqlite_seconds_total",
+};
+
+/** The names of the stages in the statistics text. */
+static const char *stage_names[SDE_STAGES] = {
+  [SDE_STAGE_INTAKE] = "intake",
+  [SDE_STAGE_VALIDATION] = "validation",
+  [SDE_STAGE_CACHE_CHECK] = "cache_check",
+  [SDE_STAGE_CACHE_REBUILD] = "cache_rebuild",
+  [SDE_STAGE_REPLY_BUILD] = "reply_build",
+  [SDE_STAGE_SEND] = "send",
+  [SDE_STAGE_REQUEST] = "request",
+};
+
+/** The quantiles of the latency of each stage in the statistics text. */
+static const struct
+{
+  double q; /**< The quantile. */
+  const char *name; /**< The label of the quantile. */
+} quantiles[] = {
+  {0.5, "0.5"},
+  {0.99, "0.99"},
+  {0.999, "0.999"},
+};
+
+/**
+ * Maps a latency to its histogram bucket. Latencies below
+ * ::SDE_STATS_SUB_BUCKETS have a bucket each while each higher power of two
+ * is split into ::SDE_STATS_SUB_BUCKETS equal buckets.
+ *
+ * @param [in] ns the latency in nanoseconds.
+ *
+ * @return the index of the bucket.
+ */
+static int
+get_bucket (uint64_t ns)
+{
+  int e;
+
+  if (ns < SDE_STATS_SUB_BUCKETS)
+    {
+      return ns;
+    }
+
+  e = 63 - __builtin_clzll (ns);
+  if (e > SDE_STATS_MAX_EXPONENT)
+    {
+      return SDE_STATS_BUCKETS - 1;
+    }
+
+  return ((e - SDE_STATS_SUB_BUCKET_BITS + 1) * SDE_STATS_SUB_BUCKETS
+	  + ((ns >> (e - SDE_STATS_SUB_BUCKET_BITS))
+	     & (SDE_STATS_SUB_BUCKETS - 1)));
+}
+
+/**
+ * Gives the highest latency that falls into a histogram bucket.
+ *
+ * @param [in] bucket the index of the bucket.
+ *
+ * @return the latency in nanoseconds.
+ */
+static uint64_t
+get_bucket_limit (int bucket)
+{
+  int e, sub;
+
+  if (bucket < SDE_STATS_SUB_BUCKETS)
+    {
+      return bucket;
+    }
+
+  e = bucket / SDE_STATS_SUB_BUCKETS + SDE_STATS_SUB_BUCKET_BITS - 1;
+  sub = bucket % SDE_STATS_SUB_BUCKETS;
+
+  return (((uint64_t) (SDE_STATS_SUB_BUCKETS + sub + 1)
+	   << (e - SDE_STATS_SUB_BUCKET_BITS)) - 1);
+}
+
+int
+register_sde_stats_worker (void)
+{
+  int i = __sync_fetch_and_add (&worker_count, 1);
+
+  if (i >= SDE_STATS_MAX_WORKERS)
+    {
+      __sync_fetch_and_sub (&worker_count, 1);
+      return -1;
+    }
+
+  sde_stats_self = &workers[i];
+
+  return 0;
+}
+
+uint64_t
+get_sde_stats_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t
+record_sde_stage (enum sde_stage stage, uint64_t start)
+{
+  uint64_t now = get_sde_stats_time ();
+  uint64_t ns = now - start;
+
+  sde_stats_self->latency[stage][get_bucket (ns)]++;
+  sde_stats_self->latency_ns[stage] += ns;
+
+  return now;
+}
+
+uint64_t
+get_sde_latency_quantile (const struct sde_stats_worker *sum,
+			  enum sde_stage stage, double q)
+{
+  uint64_t total = 0;
+  uint64_t rank, seen = 0;
+  double exact_rank;
+  int b;
+
+  for (b = 0; b < SDE_STATS_BUCKETS; b++)
+    {
+      total += sum->latency[stage][b];
+    }
+  if (total == 0)
+    {
+      return 0;
+    }
+
+  exact_rank = q * total;
+  rank = exact_rank;
+  if (rank < exact_rank)
+    {
+      rank++;
+    }
+  if (rank < 1)
+    {
+      rank = 1;
+    }
+  if (rank > total)
+    {
+      rank = total;
+    }
+
+  for (b = 0; b < SDE_STATS_BUCKETS; b++)
+    {
+      seen += sum->latency[stage][b];
+      if (seen >= rank)
+	{
+	  break;
+	}
+    }
+
+  return get_bucket_limit (b);
+}
+
+void
+sum_sde_stats (struct sde_stats_worker *sum)
+{
+  int i, j, k;
+  int count = worker_count;
+
+  if (count > SDE_STATS_MAX_WORKERS)
+    {
+      count = SDE_STATS_MAX_WORKERS;
+    }
+
+  memset (sum, 0, sizeof (*sum));
+  for (i = 0; i < count; i++)
+    {
+      for (j = 0; j <= SDE_STATS_UNKNOWN_TYPE; j++)
+	{
+	  for (k = 0; k < SDE_PACKET_COUNTERS; k++)
+	    {
+	      sum->packets[j][k] += workers[i].packets[j][k];
+	    }
+	}
+      for (k = 0; k < SDE_COUNTERS; k++)
+	{
+	  sum->counters[k] += workers[i].counters[k];
+	}
+      for (j = 0; j < SDE_STAGES; j++)
+	{
+	  for (k = 0; k < SDE_STATS_BUCKETS; k++)
+	    {
+	      sum->latency[j][k] += workers[i].latency[j][k];
+	    }
+	  sum->latency_ns[j] += workers[i].latency_ns[j];
+	}
+    }
+}
+
+/** Appends to a buffer like snprintf and keeps track of the whole length. */
+#define APPEND(fmt, ...)						\
+  len += snprintf (buffer + (len < size ? len : size),			\
+		   (len < size ? size - len : 0), fmt , ## __VA_ARGS__)
+
+/** Expands nanoseconds into the arguments of a "%llu.%09llu" seconds format. */
+#define SECONDS(ns)							\
+  (unsigned long long) ((ns) / 1000000000ULL),				\
+    (unsigned long long) ((ns) % 1000000000ULL)
+
+/**
+ * Appends the latency quantiles of each stage to a buffer.
+ *
+ * @param [in] sum the histograms as summed up by sum_sde_stats().
+ * @param [out] buffer the buffer receiving the NUL-terminated text.
+ * @param [in] size the size of the buffer.
+ * @param [in] len the length of the text already in the buffer.
+ *
+ * @return the length of the whole text that is truncated if it is not less
+ *         than size (i.e., like snprintf).
+ */
+static size_t
+append_latency (const struct sde_stats_worker *sum,
+		char *buffer, size_t size, size_t len)
+{
+  uint64_t count;
+  int j, k;
+
+  APPEND ("# TYPE sde_stage_latency_seconds summary\n");
+  for (j = 0; j < SDE_STAGES; j++)
+    {
+      for (k = 0; k < sizeof (quantiles) / sizeof (*quantiles); k++)
+	{
+	  APPEND ("sde_stage_latency_seconds{stage=\"%s\",quantile=\"%s\"}"
+		  " %llu.%09llu\n", stage_names[j], quantiles[k].name,
+		  SECONDS (get_sde_latency_quantile (sum, j, quantiles[k].q)));
+	}
+
+      count = 0;
+      for (k = 0; k < SDE_STATS_BUCKETS; k++)
+	{
+	  count += sum->latency[j][k];
+	}
+      APPEND ("sde_stage_latency_seconds_sum{stage=\"%s\"} %llu.%09llu\n",
+	      stage_names[j], SECONDS (sum->latency_ns[j]));
+      APPEND ("sde_stage_latency_seconds_count{stage=\"%s\"} %llu\n",
+	      stage_names[j], (unsigned long long) count);
+    }
+
+  return len;
+}
+
+size_t
+format_sde_stats (char *buffer, size_t size)
+{
+  struct sde_stats_worker sum;
+  size_t len = 0;
+  int j, k;
+
+  sum_sde_stats (&sum);
+
+  for (k = 0; k < SDE_PACKET_COUNTERS; k++)
+    {
+      APPEND ("# TYPE %s counter\n", packet_counter_names[k]);
+      for (j = 0; j <= SDE_STATS_UNKNOWN_TYPE; j++)
+	{
+	  APPEND ("%s{type=\"%s\"} %llu\n", packet_counter_names[k],
+		  type_names[j], (unsigned long long) sum.packets[j][k]);
+	}
+    }
+
+  for (k = 0; k < SDE_COUNTERS; k++)
+    {
+      APPEND ("# TYPE %s counter\n", counter_names[k]);
+      if (k == SDE_CACHE_REBUILD_NS || k == SDE_SQLITE_NS)
+	{
+	  APPEND ("%s %llu.%09llu\n", counter_names[k],
+		  SECONDS (sum.counters[k]));
+	}
+      else
+	{
+	  APPEND ("%s %llu\n", counter_names[k],
+		  (unsigned long long) sum.counters[k]);
+	}
+    }
+
+  APPEND ("# TYPE sde_workers gauge\nsde_workers %d\n",
+	  (worker_count < SDE_STATS_MAX_WORKERS
+	   ? worker_count : SDE_STATS_MAX_WORKERS));
+
+  return append_latency (&sum, buffer, size, len);
+}
+
+size_t
+format_sde_latency (char *buffer, size_t size)
+{
+  struct sde_stats_worker sum;
+
+  sum_sde_stats (&sum);
+
+  if (size > 0)
+    {
+      buffer[0] = '\0';
+    }
+
+  return append_latency (&sum, buffer, size, 0);
+}
+
+#undef SECONDS
+#undef APPEND
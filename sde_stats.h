@@ -0,0 +1,221 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file sde_stats.h
+ * @brief The statistics counters of the SDE daemon. Each worker thread counts
+ *        into its own cache-line aligned block of counters without any
+ *        synchronization, and a reader sums up the blocks of all workers.
+ *        The main thread owns the first block without registering. Any
+ *        other thread that handles SDE packets should call
+ *        register_sde_stats_worker() first. Each worker also keeps a
+ *        log-linear latency histogram per request stage, and the stage
+ *        boundaries are marked with static probe points named
+ *        <code>sde:*</code> that perf or bpftrace can attach to when the
+ *        software is compiled with <code>&lt;sys/sdt.h&gt;</code> available.
+ ****************************************************************************/
+
+#ifndef SDE_STATS_H
+#define SDE_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sde.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef SDE_STATS_MAX_WORKERS
+/** The maximum number of workers including the main thread. */
+#define SDE_STATS_MAX_WORKERS 8
+#endif
+
+/** The size of a cache line used to pad the block of each worker. */
+#define SDE_STATS_CACHE_LINE 64
+
+/** The packet type bucket for types not in enum sde_packet_type. */
+#define SDE_STATS_UNKNOWN_TYPE (STATS + 1)
+
+/** The number of bits of a latency resolved within each power of two. */
+#define SDE_STATS_SUB_BUCKET_BITS 3
+
+/** The number of linear buckets within each power of two of a histogram. */
+#define SDE_STATS_SUB_BUCKETS (1 << SDE_STATS_SUB_BUCKET_BITS)
+
+/** The highest power of two of nanoseconds resolved (about 9 minutes). */
+#define SDE_STATS_MAX_EXPONENT 39
+
+/** The number of buckets of a latency histogram. */
+#define SDE_STATS_BUCKETS ((SDE_STATS_MAX_EXPONENT - SDE_STATS_SUB_BUCKET_BITS \
+			    + 2) * SDE_STATS_SUB_BUCKETS)
+
+#if !defined (SDE_NO_PROBES) && defined (__has_include)
+#if __has_include (<sys/sdt.h>)
+#include <sys/sdt.h>
+/** Marks a static probe point sde:name taking up to 12 integer arguments. */
+#define SDE_PROBE(...) STAP_PROBEV (sde, __VA_ARGS__)
+#endif
+#endif
+
+#ifndef SDE_PROBE
+#define SDE_PROBE(...) do {} while (0)
+#endif
+
+/** The per-type packet counters. */
+enum sde_packet_counter
+  {
+    SDE_PACKETS_RECEIVED, /**< Packets received. */
+    SDE_PACKETS_DROPPED, /**< Well-formed packets that are not handled. */
+    SDE_PACKETS_MALFORMED, /**< Packets of an incorrect size. */
+    SDE_PACKET_COUNTERS, /**< The number of per-type packet counters. */
+  };
+
+/** The counters not related to a packet type. */
+enum sde_counter
+  {
+    SDE_REPLIES_SENT, /**< Reply packets sent. */
+    SDE_BYTES_OUT, /**< Bytes of the reply packets sent. */
+    SDE_SEND_ERRORS, /**< Reply packets that cannot be sent. */
+    SDE_CACHE_HITS, /**< Responses built from an up-to-date cache. */
+    SDE_CACHE_MISSES, /**< Responses that find the cache outdated. */
+    SDE_CACHE_REBUILDS, /**< Successful cache rebuilds. */
+    SDE_CACHE_REBUILD_NS, /**< Time spent rebuilding caches. */
+    SDE_SQLITE_NS, /**< Time spent in the published service DB. */
+    SDE_COUNTERS, /**< The number of counters. */
+  };
+
+/** The stages of handling a request whose latencies are recorded. */
+enum sde_stage
+  {
+    SDE_STAGE_INTAKE, /**< Taking a pending packet out of the socket. */
+    SDE_STAGE_VALIDATION, /**< Checking the sanity of a taken packet. */
+    SDE_STAGE_CACHE_CHECK, /**< Asking the DB whether the cache is outdated. */
+    SDE_STAGE_CACHE_REBUILD, /**< Rebuilding an outdated cache. */
+    SDE_STAGE_REPLY_BUILD, /**< Crafting the reply including the cache stages. */
+    SDE_STAGE_SEND, /**< Sending a reply packet. */
+    SDE_STAGE_REQUEST, /**< Handling a request from intake to the last send. */
+    SDE_STAGES, /**< The number of stages. */
+  };
+
+/** The counters of a worker. */
+struct sde_stats_worker
+{
+  uint64_t packets[SDE_STATS_UNKNOWN_TYPE + 1][SDE_PACKET_COUNTERS]; /**<
+								    * The
+								    * per-type
+								    * packet
+								    * counters.
+								    */
+  uint64_t counters[SDE_COUNTERS]; /**< The other counters. */
+  uint64_t latency[SDE_STAGES][SDE_STATS_BUCKETS]; /**< The histograms. */
+  uint64_t latency_ns[SDE_STAGES]; /**< The total latency of each stage. */
+} __attribute__ ((aligned (SDE_STATS_CACHE_LINE)));
+
+/** The counters of the calling thread. */
+extern __thread struct sde_stats_worker *sde_stats_self;
+
+/** Adds n to a counter of the calling thread. */
+#define SDE_COUNT(counter, n) (sde_stats_self->counters[counter] += (n))
+
+/** Increments a per-type packet counter of the calling thread. */
+#define SDE_COUNT_PACKET(type, counter)					\
+  (sde_stats_self->packets[(type) < SDE_STATS_UNKNOWN_TYPE		\
+			   ? (type) : SDE_STATS_UNKNOWN_TYPE][counter]++)
+
+/**
+ * Gives the calling thread its own block of counters.
+ *
+ * @return 0 if there is no error or -1 if all blocks are taken.
+ */
+int
+register_sde_stats_worker (void);
+
+/**
+ * Reads the monotonic clock to measure durations counted in nanoseconds.
+ *
+ * @return the current monotonic time in nanoseconds.
+ */
+uint64_t
+get_sde_stats_time (void);
+
+/**
+ * Records the time elapsed since the start of a stage in the histogram of the
+ * calling thread.
+ *
+ * @param [in] stage the stage that has just ended.
+ * @param [in] start the time the stage started as given by
+ *                   get_sde_stats_time().
+ *
+ * @return the current time to be used as the start of the next stage.
+ */
+uint64_t
+record_sde_stage (enum sde_stage stage, uint64_t start);
+
+/**
+ * Estimates a latency quantile from summed up histograms. The estimate is the
+ * upper bound of the bucket containing the quantile so that it never
+ * under-reports the latency by more than the bucket resolution of 1/8.
+ *
+ * @param [in] sum the histograms as summed up by sum_sde_stats().
+ * @param [in] stage the stage whose latency quantile is to be estimated.
+ * @param [in] q the quantile between 0 and 1 (e.g., 0.99 for p99).
+ *
+ * @return the estimated latency in nanoseconds or 0 if nothing is recorded.
+ */
+uint64_t
+get_sde_latency_quantile (const struct sde_stats_worker *sum,
+			  enum sde_stage stage, double q);
+
+/**
+ * Sums up the counters of all workers. The sum is not an atomic snapshot
+ * since the workers keep counting while it is taken.
+ *
+ * @param [out] sum the sum of the counters.
+ */
+void
+sum_sde_stats (struct sde_stats_worker *sum);
+
+/**
+ * Formats the sum of the counters of all workers in the Prometheus text
+ * exposition format.
+ *
+ * @param [out] buffer the buffer receiving the NUL-terminated text.
+ * @param [in] size the size of the buffer.
+ *
+ * @return the length of the whole text that is truncated if it is not less
+ *         than size (i.e., like snprintf).
+ */
+size_t
+format_sde_stats (char *buffer, size_t size);
+
+/**
+ * Works like format_sde_stats() except that only the p50, p99 and p999
+ * latencies of each stage are formatted.
+ *
+ * @param [out] buffer the buffer receiving the NUL-terminated text.
+ * @param [in] size the size of the buffer.
+ *
+ * @return the length of the whole text that is truncated if it is not less
+ *         than size (i.e., like snprintf).
+ */
+size_t
+format_sde_latency (char *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SDE_STATS_H */
@@ -0,0 +1,148 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file sde_stats_test.c
+ * @brief The test of the statistics counters of the SDE daemon.
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "sde_stats.h"
+
+#define INCREMENTS 100000
+
+static void *
+count (void *arg)
+{
+  int i;
+
+  assert (register_sde_stats_worker () == 0);
+
+  for (i = 0; i < INCREMENTS; i++)
+    {
+      SDE_COUNT_PACKET (GET_METADATA, SDE_PACKETS_RECEIVED);
+      SDE_COUNT (SDE_BYTES_OUT, 2);
+    }
+  SDE_COUNT_PACKET (1000, SDE_PACKETS_MALFORMED);
+
+  return NULL;
+}
+
+static void
+test_latency (void)
+{
+  struct sde_stats_worker sum;
+  char buffer[8192];
+  uint64_t p50, p99, p999;
+  int i;
+
+  sum_sde_stats (&sum);
+  assert (get_sde_latency_quantile (&sum, SDE_STAGE_SEND, 0.5) == 0);
+
+  for (i = 0; i < 990; i++)
+    {
+      record_sde_stage (SDE_STAGE_SEND, get_sde_stats_time () - 1000);
+    }
+  for (i = 0; i < 10; i++)
+    {
+      record_sde_stage (SDE_STAGE_SEND, get_sde_stats_time () - 1000000);
+    }
+
+  sum_sde_stats (&sum);
+  p50 = get_sde_latency_quantile (&sum, SDE_STAGE_SEND, 0.5);
+  p99 = get_sde_latency_quantile (&sum, SDE_STAGE_SEND, 0.99);
+  p999 = get_sde_latency_quantile (&sum, SDE_STAGE_SEND, 0.999);
+  assert (p50 >= 1000 && p50 < 2000);
+  assert (p99 >= 1000 && p99 < 2000);
+  assert (p999 >= 1000000 && p999 < 1200000);
+  assert (get_sde_latency_quantile (&sum, SDE_STAGE_SEND, 1) >= p999);
+  assert (sum.latency_ns[SDE_STAGE_SEND] >= 990 * 1000 + 10 * 1000000);
+
+  format_sde_latency (buffer, sizeof (buffer));
+  assert (strstr (buffer, "# TYPE sde_stage_latency_seconds summary\n"));
+  assert (strstr (buffer, "sde_stage_latency_seconds_count{stage=\"send\"}"
+		  " 1000\n"));
+  assert (strstr (buffer, "sde_stage_latency_seconds{stage=\"send\","
+		  "quantile=\"0.999\"} 0.0010"));
+  assert (strstr (buffer, "sde_stage_latency_seconds{stage=\"intake\","
+		  "quantile=\"0.5\"} 0.000000000\n"));
+  assert (!strstr (buffer, "sde_workers"));
+
+  format_sde_stats (buffer, sizeof (buffer));
+  assert (strstr (buffer, "sde_stage_latency_seconds_count{stage=\"send\"}"
+		  " 1000\n"));
+}
+
+int
+main (int argc, char **argv, char **envp)
+{
+  pthread_t threads[SDE_STATS_MAX_WORKERS - 1];
+  struct sde_stats_worker sum;
+  char buffer[16384];
+  char small_buffer[16];
+  size_t len;
+  uint64_t t;
+  int i;
+
+  assert (sizeof (struct sde_stats_worker) % SDE_STATS_CACHE_LINE == 0);
+
+  test_latency ();
+
+  SDE_COUNT_PACKET (GET_STATS, SDE_PACKETS_RECEIVED);
+  SDE_COUNT (SDE_SQLITE_NS, 1500000000ULL);
+
+  for (i = 0; i < SDE_STATS_MAX_WORKERS - 1; i++)
+    {
+      assert (pthread_create (&threads[i], NULL, count, NULL) == 0);
+    }
+  for (i = 0; i < SDE_STATS_MAX_WORKERS - 1; i++)
+    {
+      assert (pthread_join (threads[i], NULL) == 0);
+    }
+
+  assert (register_sde_stats_worker () == -1);
+
+  sum_sde_stats (&sum);
+  assert (sum.packets[GET_METADATA][SDE_PACKETS_RECEIVED]
+	  == (uint64_t) INCREMENTS * (SDE_STATS_MAX_WORKERS - 1));
+  assert (sum.counters[SDE_BYTES_OUT]
+	  == (uint64_t) 2 * INCREMENTS * (SDE_STATS_MAX_WORKERS - 1));
+  assert (sum.packets[SDE_STATS_UNKNOWN_TYPE][SDE_PACKETS_MALFORMED]
+	  == SDE_STATS_MAX_WORKERS - 1);
+  assert (sum.packets[GET_STATS][SDE_PACKETS_RECEIVED] == 1);
+  assert (sum.packets[GET_STATS][SDE_PACKETS_DROPPED] == 0);
+
+  len = format_sde_stats (buffer, sizeof (buffer));
+  assert (len == strlen (buffer));
+  assert (strstr (buffer, "# TYPE sde_packets_received_total counter\n"));
+  assert (strstr (buffer, "sde_packets_received_total{type=\"get_stats\"} 1\n"));
+  assert (strstr (buffer, "sde_packets_malformed_total{type=\"unknown\"} 7\n")
+	  || SDE_STATS_MAX_WORKERS != 8);
+  assert (strstr (buffer, "sde_sqlite_seconds_total 1.500000000\n"));
+  assert (strstr (buffer, "sde_send_errors_total 0\n"));
+
+  assert (format_sde_stats (small_buffer, sizeof (small_buffer)) == len);
+  assert (strlen (small_buffer) == sizeof (small_buffer) - 1);
+  assert (strncmp (small_buffer, buffer, sizeof (small_buffer) - 1) == 0);
+  assert (format_sde_stats (NULL, 0) == len);
+
+  t = get_sde_stats_time ();
+  assert (get_sde_stats_time () >= t);
+
+  exit (EXIT_SUCCESS);
+}
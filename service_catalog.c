@@ -0,0 +1,844 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file service_catalog.c
+ * @brief The implementation of the HTTP catalog endpoint. Every connection
+ *        carries one request and is closed once its response is sent. The
+ *        catalog and metadata documents are rendered once per version of the
+ *        cached service description and are copied into each response so
+ *        that a slow client never holds on to a cache that has been rebuilt.
+ ****************************************************************************/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include "app_err.h"
+#include "logger.h"
+#include "sde.h"
+#include "service_catalog.h"
+#include "service_inquiry.h"
+#include "tlv.h"
+
+/** The number of connections that may wait to be accepted. */
+#define CATALOG_BACKLOG 8
+
+/** The maximum size of a request line together with its headers. */
+#define CATALOG_REQUEST_MAX 2048
+
+/** The seconds a connection may take to send its request and get the reply. */
+#define CATALOG_TIMEOUT 5
+
+/** An HTTP connection of the catalog endpoint. */
+struct catalog_client
+{
+  int fd; /**< The connection or -1 if the slot is free. */
+  time_t accepted; /**< The time the connection was accepted. */
+  char request[CATALOG_REQUEST_MAX]; /**< The request received so far. */
+  size_t request_len; /**< The number of bytes in request. */
+  char *response; /**< The response or NULL while reading the request. */
+  size_t response_len; /**< The size of response in bytes. */
+  size_t response_sent; /**< The bytes of response already sent. */
+};
+
+/** A document rendered from the cached service description. */
+struct catalog_doc
+{
+  char *data; /**< The JSON document or NULL if not rendered. */
+  size_t len; /**< The size of data in bytes. */
+};
+
+/** The listening socket or -1 if the endpoint is not open. */
+static int listener = -1;
+
+static struct catalog_client clients[CATALOG_CLIENTS_MAX];
+
+/** The version of the cached service description that the docs render. */
+static uint64_t docs_mod_time = 0;
+
+static struct catalog_doc services_doc;
+
+static struct catalog_doc metadata_doc;
+
+/**
+ * Converts the byte order of 64-bits data to a host byte order.
+ *
+ * @param [in] the 64-bits data to be converted.
+ *
+ * @return the 64-bits data in host byte order.
+ */
+static uint64_t
+ntohll (uint64_t n)
+{
+  static int is_host_big_endian = -1;
+
+  if (is_host_big_endian == -1)
+    {
+      is_host_big_endian = (0xFACE == htons (0xFACE) ? 1 : 0);
+    }
+
+  if (is_host_big_endian)
+    {
+      return n;
+    }
+
+  return (((n & 0x00000000000000FFULL) << 56)
+	  | ((n & 0x000000000000FF00ULL) << 40)
+	  | ((n & 0x0000000000FF0000ULL) << 24)
+	  | ((n & 0x00000000FF000000ULL) << 8)
+	  | ((n & 0x000000FF00000000ULL) >> 8)
+	  | ((n & 0x0000FF0000000000ULL) >> 24)
+	  | ((n & 0x00FF000000000000ULL) >> 40)
+	  | ((n & 0xFF00000000000000ULL) >> 56));
+}
+
+/**
+ * Prints a string that is not NUL-terminated as a JSON string. The runs of
+ * bytes that need no escaping are written at once.
+ */
+static void
+print_json_string (FILE *f, const char *str, size_t len)
+{
+  const char *end = str + len;
+  const char *run = str;
+
+  putc ('"', f);
+  for (; str < end; str++)
+    {
+      unsigned char c = *str;
+
+      if (c >= 0x20 && c != '"' && c != '\\')
+	{
+	  continue;
+	}
+
+      fwrite (run, 1, str - run, f);
+      run = str + 1;
+      switch (c)
+	{
+	case '"':
+	  fputs ("\\\"", f);
+	  break;
+	case '\\':
+	  fputs ("\\\\", f);
+	  break;
+	case '\n':
+	  fputs ("\\n", f);
+	  break;
+	case '\r':
+	  fputs ("\\r", f);
+	  break;
+	case '\t':
+	  fputs ("\\t", f);
+	  break;
+	default:
+	  fprintf (f, "\\u%04x", c);
+	  break;
+	}
+    }
+  fwrite (run, 1, end - run, f);
+  putc ('"', f);
+}
+
+/**
+ * Gets the modification time of a service from its ::DESCRIPTION chunk.
+ *
+ * @return the modification time or 0 if the chunk has none.
+ */
+static uint64_t
+get_desc_ts (const struct tlv_chunk *desc)
+{
+  const struct tlv_chunk *itr = NULL;
+  uint64_t ts;
+
+  while ((itr = read_chunk (desc->value, ntohl (desc->length), itr)) != NULL)
+    {
+      if (ntohl (itr->type) == SERVICE_TS)
+	{
+	  memcpy (&ts, itr->value, sizeof (ts));
+	  return ntohll (ts);
+	}
+    }
+
+  return 0;
+}
+
+/**
+ * Prints a service as a JSON object from its ::DESCRIPTION chunk.
+ */
+static void
+print_service_json (FILE *f, const struct tlv_chunk *desc, unsigned int pos)
+{
+  const struct tlv_chunk *itr = NULL;
+  const struct tlv_chunk *short_desc = NULL;
+  const struct tlv_chunk *long_desc = NULL;
+  const struct tlv_chunk *uri = NULL;
+  uint32_t cat_id = 0;
+  uint64_t ts = 0;
+
+  while ((itr = read_chunk (desc->value, ntohl (desc->length), itr)) != NULL)
+    {
+      switch (ntohl (itr->type))
+	{
+	case SERVICE_TS:
+	  memcpy (&ts, itr->value, sizeof (ts));
+	  break;
+	case SERVICE_CAT_ID:
+	  memcpy (&cat_id, itr->value, sizeof (cat_id));
+	  break;
+	case SERVICE_SHORT_DESC:
+	  short_desc = itr;
+	  break;
+	case SERVICE_LONG_DESC:
+	  long_desc = itr;
+	  break;
+	case SERVICE_URI:
+	  uri = itr;
+	  break;
+	}
+    }
+
+  fprintf (f, "{\"pos\":%u,\"ts\":%llu,\"catId\":%u,\"desc\":", pos,
+	   (unsigned long long) ntohll (ts), ntohl (cat_id));
+  if (short_desc == NULL)
+    {
+      fputs ("null", f);
+    }
+  else
+    {
+      print_json_string (f, short_desc->value, ntohl (short_desc->length));
+    }
+  fputs (",\"longDesc\":", f);
+  if (long_desc == NULL)
+    {
+      fputs ("null", f);
+    }
+  else
+    {
+      print_json_string (f, long_desc->value, ntohl (long_desc->length));
+    }
+  fputs (",\"uri\":", f);
+  if (uri == NULL)
+    {
+      fputs ("null", f);
+    }
+  else
+    {
+      print_json_string (f, uri->value, ntohl (uri->length));
+    }
+  putc ('}', f);
+}
+
+/**
+ * Renders a document by calling a printer on a memory stream.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+render_doc (struct catalog_doc *doc,
+	    void (*print) (FILE *f, const struct tlv_chunk *desc,
+			   size_t desc_size, uint64_t mod_time),
+	    const struct tlv_chunk *desc, size_t desc_size, uint64_t mod_time)
+{
+  FILE *f;
+
+  free (doc->data);
+  doc->data = NULL;
+  doc->len = 0;
+
+  if ((f = open_memstream (&doc->data, &doc->len)) == NULL)
+    {
+      l->SYS_ERR ("Cannot open a memory stream for a catalog document");
+      return ERR_MEM;
+    }
+  print (f, desc, desc_size, mod_time);
+  if (fclose (f) == EOF)
+    {
+      l->SYS_ERR ("Cannot render a catalog document");
+      free (doc->data);
+      doc->data = NULL;
+      doc->len = 0;
+      return ERR_MEM;
+    }
+
+  return ERR_SUCCESS;
+}
+
+static void
+print_services_doc (FILE *f, const struct tlv_chunk *desc, size_t desc_size,
+		    uint64_t mod_time)
+{
+  const struct tlv_chunk *itr = NULL;
+  unsigned int pos = 0;
+
+  fprintf (f, "{\"modTime\":%llu,\"services\":[",
+	   (unsigned long long) mod_time);
+  while ((itr = read_chunk (desc, desc_size, itr)) != NULL)
+    {
+      if (pos != 0)
+	{
+	  putc (',', f);
+	}
+      print_service_json (f, itr, pos++);
+    }
+  fputs ("]}", f);
+}
+
+static void
+print_metadata_doc (FILE *f, const struct tlv_chunk *desc, size_t desc_size,
+		    uint64_t mod_time)
+{
+  const struct tlv_chunk *itr = NULL;
+  unsigned int count = 0;
+
+  fprintf (f, "{\"modTime\":%llu,\"ts\":[", (unsigned long long) mod_time);
+  while ((itr = read_chunk (desc, desc_size, itr)) != NULL)
+    {
+      fprintf (f, (count++ == 0 ? "%llu" : ",%llu"),
+	       (unsigned long long) get_desc_ts (itr));
+    }
+  fprintf (f, "],\"count\":%u}", count);
+}
+
+/**
+ * Renders the documents again if the cached service description has changed.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+ensure_catalog_docs (const struct tlv_chunk *desc, size_t desc_size,
+		     uint64_t mod_time)
+{
+  int rc;
+
+  if (services_doc.data != NULL && metadata_doc.data != NULL
+      && docs_mod_time == mod_time)
+    {
+      return ERR_SUCCESS;
+    }
+
+  if ((rc = render_doc (&services_doc, print_services_doc,
+			desc, desc_size, mod_time))
+      || (rc = render_doc (&metadata_doc, print_metadata_doc,
+			   desc, desc_size, mod_time)))
+    {
+      return rc;
+    }
+  docs_mod_time = mod_time;
+  l->INFO ("Catalog documents rendered for version %llu",
+	   (unsigned long long) mod_time);
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Renders the document of a single service.
+ *
+ * @return 0 if there is no error, -1 if there is no service at the position
+ *         or a positive integer if there is an error.
+ */
+static int
+render_service_doc (struct catalog_doc *doc, const struct tlv_chunk *desc,
+		    size_t desc_size, unsigned long pos)
+{
+  const struct tlv_chunk *itr = NULL;
+  unsigned long i = 0;
+  FILE *f;
+
+  while ((itr = read_chunk (desc, desc_size, itr)) != NULL && i != pos)
+    {
+      i++;
+    }
+  if (itr == NULL)
+    {
+      return -1;
+    }
+
+  if ((f = open_memstream (&doc->data, &doc->len)) == NULL)
+    {
+      l->SYS_ERR ("Cannot open a memory stream for a service document");
+      return ERR_MEM;
+    }
+  print_service_json (f, itr, pos);
+  if (fclose (f) == EOF)
+    {
+      l->SYS_ERR ("Cannot render a service document");
+      free (doc->data);
+      doc->data = NULL;
+      return ERR_MEM;
+    }
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Closes a connection and frees its slot.
+ */
+static void
+drop_client (struct catalog_client *c)
+{
+  if (close (c->fd) == -1)
+    {
+      l->SYS_ERR ("Cannot close catalog connection");
+    }
+  c->fd = -1;
+  free (c->response);
+  c->response = NULL;
+}
+
+/**
+ * Sets the response of a connection to be sent.
+ *
+ * @param [in] status the HTTP status line without the protocol version.
+ * @param [in] extra_headers the header lines specific to the response, each
+ *                           ended by CRLF, or NULL.
+ * @param [in] body the JSON body or NULL.
+ * @param [in] body_len the size of body in bytes that is also given as the
+ *                      Content-Length of a HEAD or 304 response.
+ * @param [in] is_head non-zero if only the headers are sent.
+ */
+static void
+set_response (struct catalog_client *c, const char *status,
+	      const char *extra_headers, const char *body, size_t body_len,
+	      int is_head)
+{
+  char headers[256];
+  int headers_len;
+
+  headers_len = snprintf (headers, sizeof (headers),
+			  "HTTP/1.1 %s\r\n"
+			  "Content-Type: application/json\r\n"
+			  "Content-Length: %lu\r\n"
+			  "%s"
+			  "Cache-Control: no-cache\r\n"
+			  "Connection: close\r\n"
+			  "\r\n",
+			  status, (unsigned long) body_len,
+			  (extra_headers == NULL ? "" : extra_headers));
+  if (is_head || body == NULL)
+    {
+      body_len = 0;
+    }
+
+  c->response = malloc (headers_len + body_len);
+  if (c->response == NULL)
+    {
+      l->APP_ERR (ERR_MEM, "Cannot create catalog response");
+      drop_client (c);
+      return;
+    }
+  memcpy (c->response, headers, headers_len);
+  if (body_len != 0)
+    {
+      memcpy (c->response + headers_len, body, body_len);
+    }
+  c->response_len = headers_len + body_len;
+  c->response_sent = 0;
+}
+
+/**
+ * Checks whether the If-None-Match header of a request matches an ETag.
+ *
+ * @return non-zero if the client already has the document.
+ */
+static int
+is_not_modified (const char *request, const char *etag)
+{
+  const char *line = request;
+  static const char header[] = "If-None-Match:";
+
+  while ((line = strstr (line, "\r\n")) != NULL)
+    {
+      line += 2;
+      if (strncasecmp (line, header, sizeof (header) - 1) == 0)
+	{
+	  const char *value = line + sizeof (header) - 1;
+	  const char *end = strstr (value, "\r\n");
+	  size_t etag_len = strlen (etag);
+
+	  for (; value < end; value++)
+	    {
+	      if (*value == '*'
+		  || (value + etag_len <= end
+		      && memcmp (value, etag, etag_len) == 0))
+		{
+		  return 1;
+		}
+	    }
+	  return 0;
+	}
+    }
+
+  return 0;
+}
+
+/**
+ * Sets the response of a complete request. The If-None-Match header is only
+ * checked once the path resolves to a document.
+ */
+static void
+respond (struct catalog_client *c)
+{
+  const struct tlv_chunk *desc;
+  size_t desc_size;
+  uint64_t mod_time;
+  struct catalog_doc doc = {NULL, 0};
+  const char *body;
+  size_t body_len;
+  char etag[32];
+  char etag_header[48];
+  char path[32];
+  const char *target;
+  size_t path_len;
+  int is_head;
+  int rc;
+
+  if (strncmp (c->request, "GET ", 4) == 0)
+    {
+      is_head = 0;
+      target = c->request + 4;
+    }
+  else if (strncmp (c->request, "HEAD ", 5) == 0)
+    {
+      is_head = 1;
+      target = c->request + 5;
+    }
+  else
+    {
+      set_response (c, "405 Method Not Allowed", "Allow: GET, HEAD\r\n",
+		    NULL, 0, 0);
+      return;
+    }
+  if ((path_len = strcspn (target, " ?\r\n")) >= sizeof (path))
+    {
+      set_response (c, "404 Not Found", NULL, NULL, 0, is_head);
+      return;
+    }
+  memcpy (path, target, path_len);
+  path[path_len] = '\0';
+
+  if ((rc = get_service_desc_cache (&desc, &desc_size, &mod_time))
+      || (rc = ensure_catalog_docs (desc, desc_size, mod_time)))
+    {
+      l->APP_ERR (rc, "Cannot get the catalog");
+      set_response (c, "503 Service Unavailable", NULL, NULL, 0, is_head);
+      return;
+    }
+
+  if (strcmp (path, "/services") == 0)
+    {
+      body = services_doc.data;
+      body_len = services_doc.len;
+    }
+  else if (strcmp (path, "/metadata") == 0)
+    {
+      body = metadata_doc.data;
+      body_len = metadata_doc.len;
+    }
+  else if (strncmp (path, "/services/", 10) == 0 && path[10] >= '0'
+	   && path[10] <= '9' && strspn (path + 10, "0123456789")
+	   == strlen (path + 10))
+    {
+      rc = render_service_doc (&doc, desc, desc_size,
+			       strtoul (path + 10, NULL, 10));
+      if (rc == -1)
+	{
+	  set_response (c, "404 Not Found", NULL, NULL, 0, is_head);
+	  return;
+	}
+      if (rc)
+	{
+	  set_response (c, "503 Service Unavailable", NULL, NULL, 0, is_head);
+	  return;
+	}
+      body = doc.data;
+      body_len = doc.len;
+    }
+  else
+    {
+      set_response (c, "404 Not Found", NULL, NULL, 0, is_head);
+      return;
+    }
+
+  snprintf (etag, sizeof (etag), "\"%llx\"", (unsigned long long) mod_time);
+  snprintf (etag_header, sizeof (etag_header), "ETag: %s\r\n", etag);
+  if (is_not_modified (c->request, etag))
+    {
+      set_response (c, "304 Not Modified", etag_header, body, body_len, 1);
+    }
+  else
+    {
+      set_response (c, "200 OK", etag_header, body, body_len, is_head);
+    }
+  free (doc.data);
+}
+
+/**
+ * Reads the request of a connection and sets its response once the request
+ * headers are complete.
+ */
+static void
+read_request (struct catalog_client *c)
+{
+  ssize_t len = recv (c->fd, c->request + c->request_len,
+		      sizeof (c->request) - 1 - c->request_len, 0);
+
+  if (len == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+      return;
+    }
+  if (len <= 0)
+    {
+      drop_client (c);
+      return;
+    }
+
+  c->request_len += len;
+  c->request[c->request_len] = '\0';
+  if (strstr (c->request, "\r\n\r\n") != NULL)
+    {
+      respond (c);
+    }
+  else if (c->request_len == sizeof (c->request) - 1)
+    {
+      set_response (c, "431 Request Header Fields Too Large", NULL, NULL, 0,
+		    0);
+    }
+}
+
+/**
+ * Sends the rest of the response of a connection and closes the connection
+ * once the response is sent.
+ */
+static void
+write_response (struct catalog_client *c)
+{
+  ssize_t len = send (c->fd, c->response + c->response_sent,
+		      c->response_len - c->response_sent, MSG_NOSIGNAL);
+
+  if (len == -1)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	{
+	  l->SYS_ERR ("Cannot send catalog response");
+	  drop_client (c);
+	}
+      return;
+    }
+
+  c->response_sent += len;
+  if (c->response_sent == c->response_len)
+    {
+      drop_client (c);
+    }
+}
+
+/**
+ * Accepts the pending connections while there is a free slot.
+ */
+static void
+accept_clients (void)
+{
+  int i;
+
+  for (i = 0; i < CATALOG_CLIENTS_MAX; i++)
+    {
+      struct catalog_client *c = clients + i;
+
+      if (c->fd != -1)
+	{
+	  continue;
+	}
+
+      if ((c->fd = accept (listener, NULL, NULL)) == -1)
+	{
+	  if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	    {
+	      l->SYS_ERR ("Cannot accept catalog connection");
+	    }
+	  return;
+	}
+      if (fcntl (c->fd, F_SETFL, O_NONBLOCK) == -1)
+	{
+	  l->SYS_ERR ("Cannot make catalog connection non-blocking");
+	  drop_client (c);
+	  continue;
+	}
+      c->accepted = time (NULL);
+      c->request_len = 0;
+    }
+}
+
+int
+open_catalog (uint16_t port)
+{
+  struct sockaddr_in addr = {
+    .sin_family = AF_INET,
+    .sin_addr = {INADDR_ANY},
+    .sin_port = htons (port),
+  };
+  int reuse = 1;
+  int i;
+
+  for (i = 0; i < CATALOG_CLIENTS_MAX; i++)
+    {
+      clients[i].fd = -1;
+    }
+
+  if ((listener = socket (AF_INET, SOCK_STREAM, 0)) == -1)
+    {
+      l->SYS_ERR ("Cannot create catalog socket");
+      return ERR_SOCK;
+    }
+  if (setsockopt (listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof (reuse))
+      || fcntl (listener, F_SETFL, O_NONBLOCK) == -1
+      || bind (listener, (struct sockaddr *) &addr, sizeof (addr))
+      || listen (listener, CATALOG_BACKLOG))
+    {
+      l->SYS_ERR ("Cannot listen on catalog port %hu", port);
+      close_catalog ();
+      return ERR_SOCK;
+    }
+  l->INFO ("Serving the catalog on port %hu", port);
+
+  return ERR_SUCCESS;
+}
+
+void
+close_catalog (void)
+{
+  int i;
+
+  if (listener == -1)
+    {
+      return;
+    }
+
+  for (i = 0; i < CATALOG_CLIENTS_MAX; i++)
+    {
+      if (clients[i].fd != -1)
+	{
+	  drop_client (clients + i);
+	}
+    }
+  if (close (listener) == -1)
+    {
+      l->SYS_ERR ("Cannot close catalog socket");
+    }
+  listener = -1;
+
+  free (services_doc.data);
+  services_doc.data = NULL;
+  free (metadata_doc.data);
+  metadata_doc.data = NULL;
+}
+
+nfds_t
+get_catalog_pollfds (struct pollfd *fds, int *timeout)
+{
+  int has_free_slot = 0;
+  int i;
+
+  *timeout = -1;
+  if (listener == -1)
+    {
+      return 0;
+    }
+
+  for (i = 0; i < CATALOG_CLIENTS_MAX; i++)
+    {
+      const struct catalog_client *c = clients + i;
+
+      /* poll() ignores a negative descriptor */
+      fds[1 + i].fd = c->fd;
+      fds[1 + i].events = (c->response == NULL ? POLLIN : POLLOUT);
+      fds[1 + i].revents = 0;
+      if (c->fd == -1)
+	{
+	  has_free_slot = 1;
+	}
+      else
+	{
+	  *timeout = 1000;
+	}
+    }
+
+  /* Pending connections wait in the backlog until a slot is freed */
+  fds[0].fd = listener;
+  fds[0].events = (has_free_slot ? POLLIN : 0);
+  fds[0].revents = 0;
+
+  return CATALOG_POLLFDS_MAX;
+}
+
+void
+serve_catalog (const struct pollfd *fds, nfds_t fd_count)
+{
+  time_t now = time (NULL);
+  int i;
+
+  if (fd_count != CATALOG_POLLFDS_MAX)
+    {
+      return;
+    }
+
+  for (i = 0; i < CATALOG_CLIENTS_MAX; i++)
+    {
+      struct catalog_client *c = clients + i;
+
+      if (c->fd == -1)
+	{
+	  continue;
+	}
+      if (fds[1 + i].revents & (POLLERR | POLLNVAL))
+	{
+	  drop_client (c);
+	}
+      else if (c->response == NULL
+	       && (fds[1 + i].revents & (POLLIN | POLLHUP)))
+	{
+	  read_request (c);
+	}
+      else if (c->response != NULL && (fds[1 + i].revents & POLLOUT))
+	{
+	  write_response (c);
+	}
+
+      /* The response is tried at once as it normally fits the send buffer */
+      if (c->fd != -1 && c->response != NULL && c->response_sent == 0)
+	{
+	  write_response (c);
+	}
+      if (c->fd != -1 && now - c->accepted > CATALOG_TIMEOUT)
+	{
+	  l->INFO ("Catalog connection timed out");
+	  drop_client (c);
+	}
+    }
+
+  if (fds[0].revents & POLLIN)
+    {
+      accept_clients ();
+    }
+}
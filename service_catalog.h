@@ -0,0 +1,94 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file service_catalog.h
+ * @brief The read-only HTTP/1.1 endpoint of the published services that the
+ *        service inquiry handler serves from the caches of its SDE replies
+ *        so that browsing the services neither spawns a process nor queries
+ *        the published service DB beyond checking its modification time.
+ *        The endpoint answers GET and HEAD requests for the following JSON
+ *        documents, each with an ETag of the published service list version:
+ *        <ul>
+ *          <li><tt>/services</tt>: all services ordered by position.</li>
+ *          <li><tt>/services/POS</tt>: the service at position POS.</li>
+ *          <li><tt>/metadata</tt>: the modification time of every service as
+ *              in an SDE metadata reply.</li>
+ *        </ul>
+ ****************************************************************************/
+
+#ifndef SERVICE_CATALOG_H
+#define SERVICE_CATALOG_H
+
+#include <poll.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The maximum number of HTTP connections served at once. */
+#define CATALOG_CLIENTS_MAX 8
+
+/** The number of descriptors that get_catalog_pollfds() fills. */
+#define CATALOG_POLLFDS_MAX (1 + CATALOG_CLIENTS_MAX)
+
+/**
+ * Opens the HTTP catalog endpoint on a TCP port of all interfaces.
+ *
+ * @param [in] port the TCP port in host byte order.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+open_catalog (uint16_t port);
+
+/**
+ * Closes the HTTP catalog endpoint together with its connections and frees
+ * its rendered documents. Calling this function repeatedly is safe.
+ */
+void
+close_catalog (void);
+
+/**
+ * Fills the descriptors of the catalog endpoint that the caller should give
+ * to poll() before calling serve_catalog().
+ *
+ * @param [out] fds an array of CATALOG_POLLFDS_MAX descriptors to be filled.
+ * @param [out] timeout the poll() timeout in milliseconds needed to expire
+ *                      idle connections or -1 if there is none.
+ *
+ * @return the number of descriptors filled, which is 0 if the endpoint is
+ *         not open.
+ */
+nfds_t
+get_catalog_pollfds (struct pollfd *fds, int *timeout);
+
+/**
+ * Serves the HTTP requests on the descriptors filled by get_catalog_pollfds()
+ * according to their revents and drops the connections that are idle too
+ * long.
+ *
+ * @param [in] fds the descriptors filled by get_catalog_pollfds().
+ * @param [in] fd_count the number of descriptors in fds.
+ */
+void
+serve_catalog (const struct pollfd *fds, nfds_t fd_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERVICE_CATALOG_H */
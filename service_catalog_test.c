@@ -0,0 +1,325 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *************************************************************************//**
+ * @file service_catalog_test.c
+ * @brief The test of the HTTP catalog endpoint served from the dummy service
+ *        list.
+ ****************************************************************************/
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "app_err.h"
+#include "logger.h"
+#include "service_catalog.h"
+#include "service_inquiry.h"
+#include "service_list_dummy.h"
+
+GLOBAL_LOGGER;
+
+/** The bytes of a request that fill the request buffer of a connection. */
+#define REQUEST_FULL (2048 - 1)
+
+/** The port that the catalog listens on. */
+static struct sockaddr_in catalog_addr = {
+  .sin_family = AF_INET,
+};
+
+/**
+ * Polls the catalog endpoint once and serves what is ready.
+ *
+ * @param [in] timeout the poll() timeout in milliseconds.
+ */
+static void
+serve_once (int timeout)
+{
+  struct pollfd fds[CATALOG_POLLFDS_MAX];
+  int catalog_timeout;
+  nfds_t count = get_catalog_pollfds (fds, &catalog_timeout);
+
+  assert (count == CATALOG_POLLFDS_MAX);
+  assert (poll (fds, count, timeout) != -1 || errno == EINTR);
+  serve_catalog (fds, count);
+}
+
+/**
+ * Opens a connection to the catalog.
+ *
+ * @return the connection.
+ */
+static int
+connect_catalog (void)
+{
+  int fd = socket (AF_INET, SOCK_STREAM, 0);
+
+  assert (fd != -1);
+  assert (connect (fd, (struct sockaddr *) &catalog_addr,
+		   sizeof (catalog_addr)) == 0);
+
+  return fd;
+}
+
+/**
+ * Serves the catalog until it closes a connection and collects the response.
+ *
+ * @param [in] fd the connection whose request has been sent.
+ * @param [out] response the response that is NUL-terminated.
+ * @param [in] size the size of response in bytes.
+ *
+ * @return the length of the response.
+ */
+static size_t
+read_response (int fd, char *response, size_t size)
+{
+  size_t len = 0;
+  ssize_t rcvd;
+
+  do
+    {
+      serve_once (100);
+      rcvd = recv (fd, response + len, size - 1 - len, MSG_DONTWAIT);
+      if (rcvd > 0)
+	{
+	  len += rcvd;
+	}
+    }
+  while (rcvd != 0 && (rcvd != -1 || errno == EAGAIN));
+  close (fd);
+
+  response[len] = '\0';
+
+  return len;
+}
+
+/**
+ * Sends a whole request and gets its response.
+ *
+ * @param [in] request the request.
+ * @param [out] response the response that is NUL-terminated.
+ * @param [in] size the size of response in bytes.
+ *
+ * @return the length of the response.
+ */
+static size_t
+exchange (const char *request, char *response, size_t size)
+{
+  int fd = connect_catalog ();
+
+  assert (send (fd, request, strlen (request), 0) == strlen (request));
+
+  return read_response (fd, response, size);
+}
+
+/**
+ * Gets a header value of a response.
+ *
+ * @param [in] response the response.
+ * @param [in] name the header name followed by a colon and a space.
+ *
+ * @return the header value ended by CRLF or NULL if there is none.
+ */
+static const char *
+get_header (const char *response, const char *name)
+{
+  const char *end = strstr (response, "\r\n\r\n");
+  const char *value = strstr (response, name);
+
+  if (value == NULL || value > end)
+    {
+      return NULL;
+    }
+
+  return value + strlen (name);
+}
+
+/**
+ * Gets the body of a response.
+ *
+ * @param [in] response the response.
+ *
+ * @return the body.
+ */
+static const char *
+get_body (const char *response)
+{
+  const char *end = strstr (response, "\r\n\r\n");
+
+  assert (end != NULL);
+
+  return end + 4;
+}
+
+static int
+is_status (const char *response, const char *status)
+{
+  return (strncmp (response, "HTTP/1.1 ", 9) == 0
+	  && strncmp (response + 9, status, strlen (status)) == 0);
+}
+
+int
+main (int argc, char **argv, char **envp)
+{
+  char response[16384];
+  char request[REQUEST_FULL + 1];
+  char etag[32];
+  char services[8192];
+  size_t etag_len;
+  struct pollfd fds[CATALOG_POLLFDS_MAX];
+  socklen_t addr_len = sizeof (catalog_addr);
+  int timeout;
+  time_t start;
+  int fd;
+
+  SETUP_LOGGER ("/dev/null", errtostr);
+
+  assert (get_catalog_pollfds (fds, &timeout) == 0);
+  assert (open_catalog (0) == 0);
+  assert (get_catalog_pollfds (fds, &timeout) == CATALOG_POLLFDS_MAX);
+  assert (timeout == -1);
+  assert (getsockname (fds[0].fd, (struct sockaddr *) &catalog_addr,
+		       &addr_len) == 0);
+  catalog_addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+
+  /* The whole catalog */
+  exchange ("GET /services HTTP/1.1\r\nHost: ap\r\n\r\n",
+	    response, sizeof (response));
+  assert (is_status (response, "200 OK"));
+  assert (get_header (response, "ETag: ") != NULL);
+  etag_len = strcspn (get_header (response, "ETag: "), "\r");
+  assert (etag_len < sizeof (etag));
+  memcpy (etag, get_header (response, "ETag: "), etag_len);
+  etag[etag_len] = '\0';
+  assert (etag[0] == '"' && etag[etag_len - 1] == '"');
+  assert (strtoul (get_header (response, "Content-Length: "), NULL, 10)
+	  == strlen (get_body (response)));
+  assert (strncmp (get_body (response), "{\"modTime\":", 11) == 0);
+  assert (strstr (get_body (response), "\"pos\":2") != NULL);
+  assert (strlen (get_body (response)) < sizeof (services));
+  strcpy (services, get_body (response));
+
+  /* Only the headers of the same document */
+  exchange ("HEAD /services?x=1 HTTP/1.1\r\n\r\n",
+	    response, sizeof (response));
+  assert (is_status (response, "200 OK"));
+  assert (strtoul (get_header (response, "Content-Length: "), NULL, 10)
+	  == strlen (services));
+  assert (*get_body (response) == '\0');
+
+  /* A request arriving in pieces */
+  fd = connect_catalog ();
+  assert (send (fd, "GET /meta", 9, 0) == 9);
+  serve_once (100);
+  serve_once (0);
+  assert (send (fd, "data HTTP/1.1\r\n", 15, 0) == 15);
+  serve_once (100);
+  assert (send (fd, "\r\n", 2, 0) == 2);
+  read_response (fd, response, sizeof (response));
+  assert (is_status (response, "200 OK"));
+  assert (strstr (get_body (response), "\"count\":3}") != NULL);
+
+  /* A single service */
+  exchange ("GET /services/1 HTTP/1.1\r\n\r\n", response, sizeof (response));
+  assert (is_status (response, "200 OK"));
+  assert (strncmp (get_body (response), "{\"pos\":1,", 9) == 0);
+  assert (strstr (services, get_body (response)) != NULL);
+
+  /* Paths without a document */
+  exchange ("GET /services/3 HTTP/1.1\r\n\r\n", response, sizeof (response));
+  assert (is_status (response, "404 Not Found"));
+  exchange ("GET /services/1x HTTP/1.1\r\n\r\n", response, sizeof (response));
+  assert (is_status (response, "404 Not Found"));
+  exchange ("GET /services/ HTTP/1.1\r\n\r\n", response, sizeof (response));
+  assert (is_status (response, "404 Not Found"));
+  exchange ("GET /nonexistent HTTP/1.1\r\n\r\n", response, sizeof (response));
+  assert (is_status (response, "404 Not Found"));
+  exchange ("GET /services/000000000000000000000000000000001 HTTP/1.1\r\n\r\n",
+	    response, sizeof (response));
+  assert (is_status (response, "404 Not Found"));
+
+  /* Conditional requests */
+  snprintf (request, sizeof (request),
+	    "GET /services HTTP/1.1\r\nif-none-match: \"0\", %s\r\n\r\n", etag);
+  exchange (request, response, sizeof (response));
+  assert (is_status (response, "304 Not Modified"));
+  assert (strtoul (get_header (response, "Content-Length: "), NULL, 10)
+	  == strlen (services));
+  assert (strncmp (get_header (response, "ETag: "), etag, etag_len) == 0);
+  assert (*get_body (response) == '\0');
+
+  exchange ("GET /metadata HTTP/1.1\r\nIf-None-Match: *\r\n\r\n",
+	    response, sizeof (response));
+  assert (is_status (response, "304 Not Modified"));
+
+  exchange ("GET /metadata HTTP/1.1\r\nIf-None-Match: \"0\"\r\n\r\n",
+	    response, sizeof (response));
+  assert (is_status (response, "200 OK"));
+
+  snprintf (request, sizeof (request),
+	    "GET /nonexistent HTTP/1.1\r\nIf-None-Match: %s\r\n\r\n", etag);
+  exchange (request, response, sizeof (response));
+  assert (is_status (response, "404 Not Found"));
+
+  snprintf (request, sizeof (request),
+	    "GET /services/3 HTTP/1.1\r\nIf-None-Match: %s\r\n\r\n", etag);
+  exchange (request, response, sizeof (response));
+  assert (is_status (response, "404 Not Found"));
+
+  /* A new version of the service list gets a new ETag */
+  touch_dummy_service_list ();
+  snprintf (request, sizeof (request),
+	    "GET /services HTTP/1.1\r\nIf-None-Match: %s\r\n\r\n", etag);
+  exchange (request, response, sizeof (response));
+  assert (is_status (response, "200 OK"));
+  assert (strncmp (get_header (response, "ETag: "), etag, etag_len) != 0);
+
+  /* Other methods */
+  exchange ("POST /services HTTP/1.1\r\nContent-Length: 0\r\n\r\n",
+	    response, sizeof (response));
+  assert (is_status (response, "405 Method Not Allowed"));
+  assert (get_header (response, "Allow: ") != NULL);
+  assert (strncmp (get_header (response, "Allow: "), "GET, HEAD\r\n", 11)
+	  == 0);
+
+  /* Headers that do not fit the request buffer */
+  memset (request, 'a', sizeof (request) - 1);
+  request[sizeof (request) - 1] = '\0';
+  memcpy (request, "GET /services HTTP/1.1\r\nX: ", 27);
+  exchange (request, response, sizeof (response));
+  assert (is_status (response, "431 Request Header Fields Too Large"));
+
+  /* A connection that never completes its request is dropped */
+  fd = connect_catalog ();
+  assert (send (fd, "GET /services", 13, 0) == 13);
+  start = time (NULL);
+  assert (read_response (fd, response, sizeof (response)) == 0);
+  assert (time (NULL) - start >= 5);
+
+  close_catalog ();
+  close_catalog ();
+  assert (get_catalog_pollfds (fds, &timeout) == 0);
+  destroy_sde_handler_cache ();
+
+  exit (EXIT_SUCCESS);
+}
@@ -15,38 +15,160 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
  *****************************************************************************/
 
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sqlite3.h>
 #include <string.h>
+#include <strings.h>
 #include "stack.h"
 #include "app_err.h"
 #include "logger.h"
 #include "logger_sqlite3.h"
-#include "tlv.h"
 #include "service_category.h"
 
 #define TABLE_CATEGORY_LIST "category_list"
-#define TABLE_CATEGORY_LIST_TMP "category_list_tmp"
 #define COLUMN_CAT_ID "cat_id"
 #define COLPOS_CAT_ID 0
 #define COLUMN_CAT_NAME "cat_name"
 #define COLPOS_CAT_NAME 1
 
 #define TABLE_CATEGORY_STRUCTURE "category_structure"
-#define TABLE_CATEGORY_STRUCTURE_TMP "category_structure_tmp"
 #define COLUMN_CAT_ID "cat_id"
 #define COLPOS_CAT_ID 0
 #define COLUMN_SUBCAT_ID "subcat_id"
 #define COLPOS_SUBCAT_ID 1
 
-/** The alignment of cat_list_impl::cur_cat.name size in bytes. */
-#define CUR_CAT_NAME_SIZE_ALIGNMENT 32
+/** The versions of the central category DB applied by upgrade_cat_list(). */
+#define TABLE_VERSION "category_version"
+#define COLUMN_ENDING_CAT_ID "ending_cat_id"
+#define COLUMN_VERSION "version"
 
 /**
- * The implementation of a list of categories. I don't build a linked-list from
- * the DB to be iterated. Instead, I directly iterate the categories using SQL
- * queries. Although the outside world sees the list as containing a tree like
- * the following one:
+ * The maximum length of a line of a delta file including the newline. The
+ * central category DB limits a category name to 128 characters.
+ */
+#define DELTA_LINE_MAX 512
+
+/**
+ * The single-row table whose counter is incremented every time the category
+ * tables are changed so that a cat_index can be reused until the DB is
+ * changed. Triggers count the row changes of any writer as long as the tables
+ * they are attached to exist. Dropping a table drops its triggers until
+ * open_cat_list_db() creates them again, so update_cat_list() also counts
+ * every script it runs. The counter starts from a random value so that a DB
+ * recreated from scratch does not repeat the versions of the old one.
+ */
+#define TABLE_DATA_VERSION "category_data_version"
+#define COLUMN_DATA_VERSION "data_version"
+
+/** The SQL counting a change to the category tables. */
+#define DATA_VERSION_INCREMENT						\
+  "update " TABLE_DATA_VERSION						\
+  " set " COLUMN_DATA_VERSION " = " COLUMN_DATA_VERSION " + 1;"
+
+/** The SQL creating the trigger counting a change to a category table. */
+#define DATA_VERSION_TRIGGER(table, event)				\
+  "create trigger if not exists " table "_" event			\
+  " after " event " on " table " begin "				\
+  DATA_VERSION_INCREMENT						\
+  " end;"
+
+/** The initial capacity of the growing arrays of cat_index. */
+#define CAT_INDEX_INITIAL_CAPACITY 64
+
+/**
+ * The number of unused entries above the number of categories that the
+ * direct map from category IDs to positions may have. The central category
+ * DB assigns IDs without gaps starting from 1, so a map that wastes more has
+ * been given a sparse DB and is not built.
+ */
+#define CAT_ID_MAP_SLACK 1024
+
+/** The entry of the direct map for an ID that is not in the index. */
+#define CAT_POS_NONE ((size_t) -1)
+
+/**
+ * The immutable in-memory copy of a category DB so that navigating the list is
+ * only moving an index around. The copy is shared by all category lists of the
+ * process that have been reset since the DB last changed. The categories are
+ * stored in ascending ID order, which is the order in which the SQL queries of
+ * the category DB return them, and are referred to by their position in that
+ * order. The hierarchy is stored as a compressed sparse row adjacency array:
+ * the subcategories of the category at position i are subs[sub_start[i]] to
+ * subs[sub_start[i + 1] - 1]. Since the IDs are dense, the position of a
+ * category is normally found in the direct map pos_by_id, which is indexed by
+ * the category ID.
+ */
+struct cat_index
+{
+  sqlite3_int64 version; /**< The data version of the copied DB. */
+  unsigned int refs; /**< The number of holders guarded by index_lock. */
+  size_t count; /**< The number of categories. */
+  unsigned long *ids; /**< The ID of each category. */
+  size_t *name_offsets; /**< The offset of the name of each category. */
+  char *names; /**< The NUL-terminated names of all categories. */
+  size_t *pos_by_id; /**<
+		      * The position of each ID or CAT_POS_NONE, or NULL if
+		      * the IDs are too sparse.
+		      */
+  size_t pos_by_id_len; /**< The number of entries of pos_by_id. */
+  size_t *sub_start; /**< The start of the subcategories of each category. */
+  size_t *subs; /**< The positions of the subcategories by ascending ID. */
+  size_t *top; /**< The positions of the top-level categories. */
+  size_t top_count; /**< The number of top-level categories. */
+  struct cat_closure *closure; /**<
+				* The descendants of every category built on
+				* the first query and guarded by index_lock.
+				*/
+  struct cat_search *search; /**<
+			      * The name search data built on the first search
+			      * and guarded by index_lock.
+			      */
+};
+
+/**
+ * The transitive closure of the hierarchy of a cat_index. The descendants of
+ * the category at position i are the IDs desc_ids[desc_off[i]] to
+ * desc_ids[desc_off[i] + desc_len[i] - 1] in ascending order without
+ * duplicates even if a subcategory is reachable through several paths.
+ */
+struct cat_closure
+{
+  size_t *desc_off; /**< The start of the descendants of each category. */
+  size_t *desc_len; /**< The number of descendants of each category. */
+  unsigned long *desc_ids; /**< The IDs of the descendants. */
+};
+
+/** A word of a category name in the prefix search index. */
+struct cat_word
+{
+  const char *word; /**< The word up to the end of the name in the names. */
+  size_t pos; /**< The position of the category. */
+};
+
+/**
+ * The name search data of a cat_index. Every word of every category name is
+ * sorted ignoring ASCII case so that the words starting with a prefix are
+ * adjacent. A word starts at the beginning of a name or at a letter or digit
+ * following another character, and bytes above 127 are part of words so that
+ * UTF-8 names are not split inside a letter.
+ */
+struct cat_search
+{
+  struct cat_word *words; /**< The sorted words. */
+  size_t word_count; /**< The number of words. */
+  size_t *parent; /**<
+		   * The position of the parent of each category that has the
+		   * lowest ID or CAT_POS_NONE for a top-level category.
+		   */
+};
+
+/**
+ * The implementation of a list of categories. Although the outside world sees
+ * the list as containing a tree like the following one:
  * +-- NULL (0)
  * |-- Restaurant (1)
  * |-- Schools (2)
@@ -76,44 +198,37 @@
  * | 5     | 7        |
  * |...    |...       |
  * +-------+----------+
- * Doing `select subcat_id from t where cat_id = 4' returns a subtree rooted
- * at "Private schools". But, doing `select cat_id from t where subcat_id = 6'
- * returns two parents: "Private schools" and "Public schools". This means that
- * navigation of the tree must never start from a subcategory. Therefore,
- * going to a subcategory has to record both the current category ID and its
- * iteration offset so that it is possible to go back to the parent categories.
- * For example, iterating "Schools" -> "Private schools" -> "Public schools" ->
- * "Kindergarden" causes the following vertical navigation information to be
- * stored in a stack:
- * +--------+-------------+
- * | cat_id | next_offset |
- * +--------+-------------+
- * | 2      | 3           |
- * | 7      | 2           |
- * +--------+-------------+
- *
- * In order to go back to the list containing the previous parent, the following
- * SQL should be used:
- * select cat_id, cat_name from category_list where cat_id in (
- *  select subcat_id from category_structure where cat_id = ?) limit 1 offset ?
- *
- * The first "?" should be initialized with cat_id 2 that has cat_id 7 as one of
- * its children so that the second "?" can be initialized to next_offset 2.
- *
- * If the content of the stack above is only the first entry, going to a parent
- * category is simply retrieving the list of top-level categories and selecting
- * the recorded next_offset.
+ * Following the subcategories of "Private schools" reaches "Kindergarden", but
+ * so does following those of "Public schools". This means that navigation of
+ * the tree must never start from a subcategory. Therefore, going to a
+ * subcategory has to record both the position of the current category and
+ * its iteration offset so that it is possible to go back to the parent
+ * categories. For example, iterating "Schools" -> "Private schools" ->
+ * "Public schools" -> "Kindergarden" causes the following vertical navigation
+ * information to be stored in a stack:
+ * +--------------+-------------+
+ * | position     | next_offset |
+ * +--------------+-------------+
+ * | 2 (Schools)  | 3           |
+ * | 5 (Public)   | 2           |
+ * +--------------+-------------+
+ *
+ * The categories being iterated are the subcategories of the category at the
+ * top of the stack, or the top-level categories if the stack is empty, or all
+ * categories if the list is flat.
  */
 struct cat_list_impl
 {
   /* Common */
   sqlite3 *db; /**< The category DB. */
+  struct cat_index *index; /**< The categories read by the last reset(). */
   struct cat cur_cat; /**< The category under iterator. */
-  size_t cur_cat_name_size; /**< The current capacity of cur_cat.name */
+  size_t cur_pos; /**< The position of cur_cat in index. */
   unsigned long next_offset; /**< 
-			      * The SQL offset value starting from 0 used to
-			      * fetch the next category. 0 means that the
-			      * internal iterator is not over any category.
+			      * The offset starting from 0 of the next
+			      * category in the categories being iterated. 0
+			      * means that the internal iterator is not over
+			      * any category.
 			      */
 
   /* Flat iterator only */
@@ -121,41 +236,32 @@ struct cat_list_impl
 		* 0 if the iterator is a hierarchical iterator or non-zero if
 		* the iterator is flat.
 		*/
-  sqlite3_stmt *flat_next_prev_stmt; /**<
-				      * SQL to go to the next/prev category in
-				      * a flat manner.
-				      */
 
   /* Hierarchical iterator only */
-  stack *parents_id_and_next_offset; /**<
-				      * The ID and value of next_offset at
-				      * each parent level.
-				      */
-  sqlite3_stmt *go_sub_sup_stmt; /**<
-				  * SQL to go to the subcategory/super category
-				  */
-  sqlite3_stmt *top_level_next_prev_stmt; /**<
-					   * SQL to go to the next/prev top-level
-					   * category.
-					   */
-  sqlite3_stmt *next_prev_stmt; /**<
-				 * SQL to go to the next/prev non-top-level
-				 * category at a particular depth.
-				 */
+  stack *parents_pos_and_next_offset; /**<
+				       * The position and value of
+				       * next_offset at each parent level.
+				       */
 };
 
-/** The structure of the object contained in parents_id_and_next_offset stack. */
-struct id_and_next_offset
+/** Guards shared_index and cat_index::refs. */
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** The most recently built index or NULL. It holds a reference. */
+static struct cat_index *shared_index = NULL;
+
+/** The object contained in parents_pos_and_next_offset stack. */
+struct pos_and_next_offset
 {
-  unsigned long id;
+  size_t pos;
   unsigned long next_offset;
 };
 
 static int
 is_at_top_level (const cat_list *cl)
 {
-  return (cl->parents_id_and_next_offset == NULL
-	  || is_empty (cl->parents_id_and_next_offset));
+  return (cl->parents_pos_and_next_offset == NULL
+	  || is_empty (cl->parents_pos_and_next_offset));
 }
 
 static int
@@ -186,7 +292,25 @@ open_cat_list_db (sqlite3 **db)
 		    "foreign key (" COLUMN_CAT_ID ") references "
 		    TABLE_CATEGORY_LIST " (" COLUMN_CAT_ID "),"
 		    "foreign key (" COLUMN_SUBCAT_ID ") references "
-		    TABLE_CATEGORY_LIST " (" COLUMN_CAT_ID "));",
+		    TABLE_CATEGORY_LIST " (" COLUMN_CAT_ID "));"
+
+		    "create table if not exists " TABLE_VERSION " ("
+		    COLUMN_ENDING_CAT_ID " integer not null,"
+		    COLUMN_VERSION " integer not null);"
+
+		    "create table if not exists " TABLE_DATA_VERSION " ("
+		    COLUMN_DATA_VERSION " integer not null);"
+
+		    "insert into " TABLE_DATA_VERSION
+		    " select abs (random ()) / 2 where not exists ("
+		    "  select * from " TABLE_DATA_VERSION ");"
+
+		    DATA_VERSION_TRIGGER (TABLE_CATEGORY_LIST, "insert")
+		    DATA_VERSION_TRIGGER (TABLE_CATEGORY_LIST, "update")
+		    DATA_VERSION_TRIGGER (TABLE_CATEGORY_LIST, "delete")
+		    DATA_VERSION_TRIGGER (TABLE_CATEGORY_STRUCTURE, "insert")
+		    DATA_VERSION_TRIGGER (TABLE_CATEGORY_STRUCTURE, "update")
+		    DATA_VERSION_TRIGGER (TABLE_CATEGORY_STRUCTURE, "delete"),
 
 		    NULL, NULL, &err_msg))
     {
@@ -255,577 +379,752 @@ load_cat_list (cat_list **cl)
   return ERR_SUCCESS;
 }
 
-int
-close_all_prepared_statements (cat_list *cl)
+static void
+destroy_cat_closure (struct cat_closure **closure)
 {
-  int rc = ERR_SUCCESS;
-
-  if (cl->flat_next_prev_stmt != NULL
-      && sqlite3_finalize (cl->flat_next_prev_stmt))
-    {
-      SQLITE3_ERR (cl->db, "Cannot finalize category list flat_next_prev_stmt");
-      rc = ERR_DB;
-    }
-  if (cl->go_sub_sup_stmt != NULL && sqlite3_finalize (cl->go_sub_sup_stmt))
-    {
-      SQLITE3_ERR (cl->db, "Cannot finalize category list go_sub_sup_stmt");
-      rc = ERR_DB;
-    }
-  if (cl->top_level_next_prev_stmt != NULL
-      && sqlite3_finalize (cl->top_level_next_prev_stmt))
+  if (*closure == NULL)
     {
-      SQLITE3_ERR (cl->db,
-		   "Cannot finalize category list top_level_next_prev_stmt");
-      rc = ERR_DB;
-    }
-  if (cl->next_prev_stmt != NULL && sqlite3_finalize (cl->next_prev_stmt))
-    {
-      SQLITE3_ERR (cl->db, "Cannot finalize category list next_prev_stmt");
-      rc = ERR_DB;
+      return;
     }
 
-  cl->flat_next_prev_stmt = NULL;
-  cl->go_sub_sup_stmt = NULL;
-  cl->top_level_next_prev_stmt = NULL;
-  cl->next_prev_stmt = NULL;
+  free ((*closure)->desc_off);
+  free ((*closure)->desc_len);
+  free ((*closure)->desc_ids);
 
-  return rc;
+  free ((void *) *closure);
+  *closure = NULL;
 }
 
-void
-destroy_cat_list (cat_list **cl)
+static void
+destroy_cat_search (struct cat_search **search)
 {
-  int rc;
-
-  if (*cl == NULL)
+  if (*search == NULL)
     {
       return;
     }
 
-  if ((rc = close_all_prepared_statements (*cl)))
-    {
-      l->APP_ERR (rc, "Cannot close all prepared statements to destroy cat_list");
-    }
-  if (sqlite3_close ((*cl)->db))
-    {
-      SQLITE3_ERR ((*cl)->db, "Cannot close category list DB");
-    }
-  destroy_stack (&(*cl)->parents_id_and_next_offset);
-  if ((*cl)->cur_cat.name != NULL)
-    {
-      free ((void *) (*cl)->cur_cat.name);
-    }
+  free ((*search)->words);
+  free ((*search)->parent);
 
-  free ((void *) *cl);
-  *cl = NULL;
+  free ((void *) *search);
+  *search = NULL;
 }
 
-static int
-ensure_cur_cat_name (cat_list *cl, size_t needed_capacity)
+static void
+destroy_cat_index (struct cat_index **index)
 {
-  if (cl->cur_cat.name == NULL)
+  if (*index == NULL)
     {
-      size_t padded_length = get_padded_length (needed_capacity,
-						CUR_CAT_NAME_SIZE_ALIGNMENT);
-
-      cl->cur_cat.name = malloc (padded_length);
-      if (cl->cur_cat.name == NULL)
-	{
-	  l->ERR ("Not enough memory to allocate cur_cat.name");
-	  return ERR_MEM;
-	}
-
-      cl->cur_cat_name_size = padded_length;
+      return;
     }
-  else if (cl->cur_cat_name_size < needed_capacity)
-    {
-      size_t padded_length = get_padded_length (needed_capacity,
-						CUR_CAT_NAME_SIZE_ALIGNMENT);
-      void *new_name = realloc (&cl->cur_cat.name, padded_length);
 
-      if (new_name == NULL)
-	{
-	  l->ERR ("Not enough memory to enlarge cur_cat.name");
-	  return ERR_MEM;
-	}
-
-      cl->cur_cat.name = new_name;
-      cl->cur_cat_name_size = padded_length;
-    }
+  free ((*index)->ids);
+  free ((*index)->name_offsets);
+  free ((*index)->names);
+  free ((*index)->pos_by_id);
+  free ((*index)->sub_start);
+  free ((*index)->subs);
+  free ((*index)->top);
+  destroy_cat_closure (&(*index)->closure);
+  destroy_cat_search (&(*index)->search);
 
-  return ERR_SUCCESS;
+  free ((void *) *index);
+  *index = NULL;
 }
 
-static int
-ensure_flat_next_prev_stmt (cat_list *cl)
+/**
+ * Drops a reference to an index and frees the index when it is no longer
+ * referenced.
+ *
+ * @param [in] index the index to release that may point to NULL.
+ */
+static void
+release_cat_index (struct cat_index **index)
 {
-  sqlite3_stmt *o;
+  int is_unreferenced;
 
-  if (cl->flat_next_prev_stmt != NULL)
+  if (*index == NULL)
     {
-      return ERR_SUCCESS;
+      return;
     }
 
-  if (sqlite3_prepare_v2 (cl->db,
-			  "select " COLUMN_CAT_ID ", " COLUMN_CAT_NAME
-			  " from " TABLE_CATEGORY_LIST_TMP
-			  " limit 1 offset ?",
-			  -1, &o, NULL))
+  pthread_mutex_lock (&index_lock);
+  is_unreferenced = (--(*index)->refs == 0);
+  pthread_mutex_unlock (&index_lock);
+
+  if (is_unreferenced)
     {
-      SQLITE3_ERR (cl->db, "Cannot prepare flat_next_prev_stmt");
-      return ERR_DB;
+      destroy_cat_index (index);
     }
-
-  cl->flat_next_prev_stmt = o;
-
-  return ERR_SUCCESS;
+  *index = NULL;
 }
 
-static int
-ensure_parents_id_and_next_offset_stack (cat_list *cl)
+/**
+ * Gets a reference to the shared index if it is a copy of the given version.
+ *
+ * @param [in] version the data version of the DB.
+ *
+ * @return the shared index or NULL if there is none of the version.
+ */
+static struct cat_index *
+acquire_cat_index (sqlite3_int64 version)
 {
-  int rc;
-
-  if (cl->parents_id_and_next_offset != NULL)
-    {
-      return ERR_SUCCESS;
-    }
+  struct cat_index *index = NULL;
 
-  if ((rc = create_stack (&cl->parents_id_and_next_offset,
-			  sizeof (struct id_and_next_offset))))
+  pthread_mutex_lock (&index_lock);
+  if (shared_index != NULL && shared_index->version == version)
     {
-      l->APP_ERR (rc, "Cannot create parents ID and next offset stack");
-      return rc;
+      index = shared_index;
+      index->refs++;
     }
+  pthread_mutex_unlock (&index_lock);
 
-  return ERR_SUCCESS;
+  return index;
 }
 
-static int
-ensure_go_sub_sup_stmt (cat_list *cl)
+/**
+ * Makes a newly built index the shared index unless the shared index is
+ * already a copy of the same version.
+ *
+ * @param [in] index the index whose reference is kept by the caller.
+ */
+static void
+share_cat_index (struct cat_index *index)
 {
-  sqlite3_stmt *o;
+  struct cat_index *old = NULL;
 
-  if (cl->go_sub_sup_stmt != NULL)
+  pthread_mutex_lock (&index_lock);
+  if (shared_index == NULL || shared_index->version != index->version)
     {
-      return ERR_SUCCESS;
+      old = shared_index;
+      shared_index = index;
+      index->refs++;
     }
+  pthread_mutex_unlock (&index_lock);
 
-  if (sqlite3_prepare_v2 (cl->db,
-			  "select " COLUMN_CAT_ID ", " COLUMN_CAT_NAME
-			  " from " TABLE_CATEGORY_LIST_TMP
-			  " where " COLUMN_CAT_ID " in ("
-			  "  select " COLUMN_SUBCAT_ID
-			  "  from " TABLE_CATEGORY_STRUCTURE_TMP
-			  "  where " COLUMN_CAT_ID " = ? )"
-			  " limit 1 offset ?",
-			  -1, &o, NULL))
-    {
-      SQLITE3_ERR (cl->db, "Cannot prepare go_sub_sup_stmt");
-      return ERR_DB;
-    }
+  release_cat_index (&old);
+}
+
+void
+destroy_cat_list_cache (void)
+{
+  struct cat_index *old;
 
-  cl->go_sub_sup_stmt = o;
+  pthread_mutex_lock (&index_lock);
+  old = shared_index;
+  shared_index = NULL;
+  pthread_mutex_unlock (&index_lock);
 
-  return ERR_SUCCESS;
+  release_cat_index (&old);
 }
 
-static int
-ensure_top_level_next_prev_stmt (cat_list *cl)
+void
+destroy_cat_list (cat_list **cl)
 {
-  sqlite3_stmt *o;
-
-  if (cl->top_level_next_prev_stmt != NULL)
+  if (*cl == NULL)
     {
-      return ERR_SUCCESS;
+      return;
     }
 
-  if (sqlite3_prepare_v2 (cl->db,
-			  "select " COLUMN_CAT_ID ", " COLUMN_CAT_NAME
-			  " from " TABLE_CATEGORY_LIST_TMP
-			  " where " COLUMN_CAT_ID " not in ("
-			  "  select " COLUMN_SUBCAT_ID
-			  "  from " TABLE_CATEGORY_STRUCTURE_TMP ")"
-			  " limit 1 offset ?",
-			  -1, &o, NULL))
-    {
-      SQLITE3_ERR (cl->db, "Cannot prepare top_level_next_prev_stmt");
-      return ERR_DB;
+  if (sqlite3_close ((*cl)->db))
+    {
+      SQLITE3_ERR ((*cl)->db, "Cannot close category list DB");
     }
+  destroy_stack (&(*cl)->parents_pos_and_next_offset);
+  release_cat_index (&(*cl)->index);
 
-  cl->top_level_next_prev_stmt = o;
-
-  return ERR_SUCCESS;
+  free ((void *) *cl);
+  *cl = NULL;
 }
 
+/**
+ * Enlarges a dynamically allocated array by doubling its capacity until it
+ * can hold the needed number of elements.
+ *
+ * @param [in,out] array the array that may be NULL if capacity is 0.
+ * @param [in,out] capacity the number of elements that the array can hold.
+ * @param [in] needed the number of elements that the array must hold.
+ * @param [in] element_size the size of an element in bytes.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
 static int
-ensure_next_prev_stmt (cat_list *cl)
+ensure_capacity (void **array, size_t *capacity, size_t needed,
+		 size_t element_size)
 {
-  sqlite3_stmt *o;
+  size_t new_capacity = *capacity;
+  void *new_array;
 
-  if (cl->next_prev_stmt != NULL)
+  if (needed <= *capacity)
     {
       return ERR_SUCCESS;
     }
 
-  if (sqlite3_prepare_v2 (cl->db,
-			  "select " COLUMN_CAT_ID ", " COLUMN_CAT_NAME
-			  " from " TABLE_CATEGORY_LIST_TMP
-			  " where " COLUMN_CAT_ID " in ("
-			  "  select " COLUMN_SUBCAT_ID
-			  "  from " TABLE_CATEGORY_STRUCTURE_TMP
-			  "  where " COLUMN_CAT_ID " = ?)"
-			  " limit 1 offset ?",
-			  -1, &o, NULL))
-    {
-      SQLITE3_ERR (cl->db, "Cannot prepare next_prev_stmt");
-      return ERR_DB;
+  if (new_capacity == 0)
+    {
+      new_capacity = CAT_INDEX_INITIAL_CAPACITY;
+    }
+  while (new_capacity < needed)
+    {
+      new_capacity *= 2;
+    }
+
+  new_array = realloc (*array, new_capacity * element_size);
+  if (new_array == NULL)
+    {
+      l->ERR ("Not enough memory to enlarge category index");
+      return ERR_MEM;
     }
 
-  cl->next_prev_stmt = o;
+  *array = new_array;
+  *capacity = new_capacity;
 
   return ERR_SUCCESS;
 }
 
+/**
+ * Finds the position of a category in an index.
+ *
+ * @param [in] index the index whose categories have been read.
+ * @param [in] id the ID of the category to find.
+ * @param [out] pos the position of the category.
+ *
+ * @return non-zero if the category is found or 0 if it is not.
+ */
 static int
-update_cur_cat (cat_list *cl, sqlite3_stmt *stmt)
+find_cat (const struct cat_index *index, unsigned long id, size_t *pos)
 {
-  int rc;
-  const char *cat_name = (char *) sqlite3_column_text (stmt, 1);
+  size_t low = 0, high = index->count;
 
-  if ((rc = ensure_cur_cat_name (cl, strlen (cat_name) + 1)))
+  if (index->pos_by_id != NULL)
     {
-      l->APP_ERR (rc, "Cannot update cur_cat");
-      return rc;
+      if (id >= index->pos_by_id_len || index->pos_by_id[id] == CAT_POS_NONE)
+	{
+	  return 0;
+	}
+      *pos = index->pos_by_id[id];
+      return 1;
     }
 
-  cl->cur_cat.id = sqlite3_column_int (stmt, 0);
-  strcpy ((char *) cl->cur_cat.name, cat_name);
+  while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
 
-  return ERR_SUCCESS;
+      if (index->ids[mid] < id)
+	{
+	  low = mid + 1;
+	}
+      else
+	{
+	  high = mid;
+	}
+    }
+
+  if (low < index->count && index->ids[low] == id)
+    {
+      *pos = low;
+      return 1;
+    }
+
+  return 0;
 }
 
+/**
+ * Reads the data version of the category DB.
+ *
+ * @param [in] db the category DB.
+ * @param [out] version the data version.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
 static int
-execute_next_stmt (cat_list *cl, sqlite3_stmt **stmt,
-		   int (*ensure_stmt_fn) (cat_list *cl),
-		   int (*binding_fn) (cat_list *cl, sqlite3_stmt *stmt),
-		   const char *stmt_name)
+read_data_version (sqlite3 *db, sqlite3_int64 *version)
 {
-  int rc;
-  int step_result;
+  sqlite3_stmt *stmt;
+  int rc = ERR_SUCCESS;
 
-  if ((rc = ensure_stmt_fn (cl)))
+  if (sqlite3_prepare_v2 (db,
+			  "select " COLUMN_DATA_VERSION
+			  " from " TABLE_DATA_VERSION,
+			  -1, &stmt, NULL))
     {
-      l->APP_ERR (rc, "Cannot ensure %s", stmt_name);
-      return rc;
+      SQLITE3_ERR (db, "Cannot prepare data version selection");
+      return ERR_DB;
     }
 
-  if (sqlite3_reset (*stmt))
+  if (sqlite3_step (stmt) == SQLITE_ROW)
     {
-      SQLITE3_ERR (cl->db, "Cannot reset %s", stmt_name);
-      return ERR_DB;
+      *version = sqlite3_column_int64 (stmt, 0);
+    }
+  else
+    {
+      SQLITE3_ERR (db, "Cannot select data version");
+      rc = ERR_DB;
     }
 
-  if (sqlite3_clear_bindings (*stmt))
+  if (sqlite3_finalize (stmt))
     {
-      SQLITE3_ERR (cl->db, "Cannot clear bindings of %s", stmt_name);
-      return ERR_DB;
+      SQLITE3_ERR (db, "Cannot finalize data version selection");
     }
 
-  if ((rc = binding_fn (cl, *stmt)))
+  return rc;
+}
+
+static int
+read_cats (sqlite3 *db, struct cat_index *index)
+{
+  size_t ids_capacity = 0, name_offsets_capacity = 0;
+  size_t names_capacity = 0, names_len = 0;
+  sqlite3_stmt *stmt;
+  int step_result;
+  int rc = ERR_SUCCESS;
+
+  if (sqlite3_prepare_v2 (db,
+			  "select " COLUMN_CAT_ID ", " COLUMN_CAT_NAME
+			  " from " TABLE_CATEGORY_LIST
+			  " order by " COLUMN_CAT_ID,
+			  -1, &stmt, NULL))
     {
-      return rc;
+      SQLITE3_ERR (db, "Cannot prepare category selection");
+      return ERR_DB;
     }
 
-  step_result = sqlite3_step (*stmt);
-  if (step_result == SQLITE_ROW)
+  while ((step_result = sqlite3_step (stmt)) == SQLITE_ROW)
     {
-      if ((rc = update_cur_cat (cl, *stmt)))
+      const char *cat_name = (char *) sqlite3_column_text (stmt,
+							    COLPOS_CAT_NAME);
+      size_t len = strlen (cat_name) + 1;
+
+      if ((rc = ensure_capacity ((void **) &index->ids, &ids_capacity,
+				 index->count + 1, sizeof (*index->ids))))
 	{
-	  l->APP_ERR (rc, "Cannot advance %s", stmt_name);
-	  return rc;
+	  break;
+	}
+      if ((rc = ensure_capacity ((void **) &index->name_offsets,
+				 &name_offsets_capacity, index->count + 1,
+				 sizeof (*index->name_offsets))))
+	{
+	  break;
+	}
+      if ((rc = ensure_capacity ((void **) &index->names, &names_capacity,
+				 names_len + len, 1)))
+	{
+	  break;
 	}
 
-      cl->next_offset++;
-
-      return -1;
-    }
-  else if (step_result == SQLITE_DONE)
-    {
-      return 0;
+      index->ids[index->count] = sqlite3_column_int64 (stmt, COLPOS_CAT_ID);
+      index->name_offsets[index->count] = names_len;
+      memcpy (index->names + names_len, cat_name, len);
+      names_len += len;
+      index->count++;
     }
-  else
+  if (rc == ERR_SUCCESS && step_result != SQLITE_DONE)
     {
-      SQLITE3_ERR (cl->db, "Cannot execute %s", stmt_name);
-      return ERR_DB;
+      SQLITE3_ERR (db, "Cannot select categories");
+      rc = ERR_DB;
     }
-}
 
-static int
-flat_next_prev_stmt_binder (cat_list *cl, sqlite3_stmt *stmt)
-{
-  if (sqlite3_bind_int (stmt, 1, cl->next_offset))
+  if (sqlite3_finalize (stmt))
     {
-      SQLITE3_ERR (cl->db, "Cannot bind next_offset to next_prev_stmt");
-      return ERR_DB;
+      SQLITE3_ERR (db, "Cannot finalize category selection");
     }
 
-  return ERR_SUCCESS;
+  return rc;
 }
 
+/**
+ * Builds the direct map from category IDs to positions unless the IDs are too
+ * sparse for it, in which case find_cat() falls back to a binary search.
+ *
+ * @param [in] index the index whose categories have been read.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
 static int
-top_level_next_prev_stmt_binder (cat_list *cl, sqlite3_stmt *stmt)
+map_cat_ids (struct cat_index *index)
 {
-  if (sqlite3_bind_int (stmt, 1, cl->next_offset))
+  unsigned long max_id;
+  size_t i;
+
+  if (index->count == 0)
     {
-      SQLITE3_ERR (cl->db, "Cannot bind next_offset to top_level_next_prev_stmt");
-      return ERR_DB;
+      return ERR_SUCCESS;
     }
 
-  return ERR_SUCCESS;
-}
-
-static int
-next_prev_stmt_binder (cat_list *cl, sqlite3_stmt *stmt)
-{
-  int rc;
-  struct id_and_next_offset o;
+  max_id = index->ids[index->count - 1];
+  if (max_id >= index->count + CAT_ID_MAP_SLACK)
+    {
+      l->INFO ("Category IDs up to %lu are too sparse for %lu categories",
+	       max_id, (unsigned long) index->count);
+      return ERR_SUCCESS;
+    }
 
-  if ((rc = top (&o, cl->parents_id_and_next_offset)))
+  index->pos_by_id_len = max_id + 1;
+  index->pos_by_id = malloc (index->pos_by_id_len
+			     * sizeof (*index->pos_by_id));
+  if (index->pos_by_id == NULL)
     {
-      l->APP_ERR (rc, "Cannot read top element of parents_id_and_next_offset");
-      return rc;
+      l->ERR ("Not enough memory to map category IDs");
+      return ERR_MEM;
     }
 
-  if (sqlite3_bind_int (cl->next_prev_stmt, 1, o.id))
+  for (i = 0; i < index->pos_by_id_len; i++)
     {
-      SQLITE3_ERR (cl->db, "Cannot bind id_and_next_offset.id to next_prev_stmt");
-      return ERR_DB;
+      index->pos_by_id[i] = CAT_POS_NONE;
     }
-  if (sqlite3_bind_int (cl->next_prev_stmt, 2, cl->next_offset))
+  for (i = 0; i < index->count; i++)
     {
-      SQLITE3_ERR (cl->db, "Cannot bind next_offset to next_prev_stmt");
-      return ERR_DB;
+      index->pos_by_id[index->ids[i]] = i;
     }
 
   return ERR_SUCCESS;
 }
 
-int
-next (cat_list *cl)
+static int
+read_structure (sqlite3 *db, struct cat_index *index)
 {
-  if (cl->is_flat)
+  size_t subs_capacity = 0, subs_count = 0, i;
+  char *has_parent;
+  sqlite3_stmt *stmt;
+  int step_result;
+  int rc = ERR_SUCCESS;
+
+  index->sub_start = calloc (index->count + 1, sizeof (*index->sub_start));
+  has_parent = calloc (index->count + 1, 1);
+  if (index->sub_start == NULL || has_parent == NULL)
     {
-      return execute_next_stmt (cl,
-				&cl->flat_next_prev_stmt,
-				ensure_flat_next_prev_stmt,
-				flat_next_prev_stmt_binder,
-				"flat_next_prev_stmt");
+      l->ERR ("Not enough memory to index category structure");
+      free (has_parent);
+      return ERR_MEM;
     }
-  else
+
+  /* Since the rows are ordered by the parent, the subcategories of a parent
+   * are adjacent and the parents are in the order of their positions.
+   */
+  if (sqlite3_prepare_v2 (db,
+			  "select " COLUMN_CAT_ID ", " COLUMN_SUBCAT_ID
+			  " from " TABLE_CATEGORY_STRUCTURE
+			  " order by " COLUMN_CAT_ID ", " COLUMN_SUBCAT_ID,
+			  -1, &stmt, NULL))
+    {
+      SQLITE3_ERR (db, "Cannot prepare category structure selection");
+      free (has_parent);
+      return ERR_DB;
+    }
+
+  while ((step_result = sqlite3_step (stmt)) == SQLITE_ROW)
     {
-      if (is_at_top_level (cl))
+      size_t parent, sub;
+
+      /* A subcategory missing from the category list is not listed. */
+      if (!find_cat (index, sqlite3_column_int64 (stmt, COLPOS_SUBCAT_ID),
+		     &sub))
 	{
-	  return execute_next_stmt (cl,
-				    &cl->top_level_next_prev_stmt,
-				    ensure_top_level_next_prev_stmt,
-				    top_level_next_prev_stmt_binder,
-				    "top_level_next_prev_stmt");
+	  continue;
 	}
-      else
+      /* But it is not a top-level category even if its parent is missing. */
+      has_parent[sub] = 1;
+      if (!find_cat (index, sqlite3_column_int64 (stmt, COLPOS_CAT_ID),
+		     &parent))
+	{
+	  continue;
+	}
+
+      if ((rc = ensure_capacity ((void **) &index->subs, &subs_capacity,
+				 subs_count + 1, sizeof (*index->subs))))
 	{
-	  return execute_next_stmt (cl,
-				    &cl->next_prev_stmt,
-				    ensure_next_prev_stmt,
-				    next_prev_stmt_binder,
-				    "next_prev_stmt");
+	  break;
 	}
+      index->subs[subs_count++] = sub;
+      index->sub_start[parent + 1]++;
+    }
+  if (rc == ERR_SUCCESS && step_result != SQLITE_DONE)
+    {
+      SQLITE3_ERR (db, "Cannot select category structure");
+      rc = ERR_DB;
     }
 
-  return ERR_INVALID_STATE;
-}
+  if (sqlite3_finalize (stmt))
+    {
+      SQLITE3_ERR (db, "Cannot finalize category structure selection");
+    }
 
-int
-prev (cat_list *cl)
-{
-  int rc;
-
-  /* next_offset == 0, internal iterator is not over any category.
-   * next_offset == 1, internal iterator is over the first category.
-   */
-  if (cl->next_offset < 2)
+  if (rc == ERR_SUCCESS)
     {
-      return 0;
-    }
-
-  cl->next_offset -= 2;
+      for (i = 0; i < index->count; i++)
+	{
+	  index->sub_start[i + 1] += index->sub_start[i];
+	}
 
-  rc = next (cl);
-  if (rc != 0 && rc != -1)
-    {
-      l->APP_ERR (rc, "Cannot move internal iterator to the previous location");
+      index->top = malloc ((index->count + 1) * sizeof (*index->top));
+      if (index->top == NULL)
+	{
+	  l->ERR ("Not enough memory to index top-level categories");
+	  rc = ERR_MEM;
+	}
+      else
+	{
+	  for (i = 0; i < index->count; i++)
+	    {
+	      if (!has_parent[i])
+		{
+		  index->top[index->top_count++] = i;
+		}
+	    }
+	}
     }
 
+  free (has_parent);
+
   return rc;
 }
 
+/**
+ * Reads the category DB into a new index. The data version and both tables
+ * are read in one transaction so that an update in between is not half seen.
+ *
+ * @param [in] db the category DB.
+ * @param [out] index the pointer pointing to a dynamically allocated memory
+ *                    that should be freed with release_cat_index().
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
 static int
-go_sub_sup (cat_list *cl, unsigned long from_id,
-	    unsigned long from_id_next_offset, unsigned long to_next_offset)
+create_cat_index (sqlite3 *db, struct cat_index **index)
 {
+  struct cat_index *o;
+  char *err_msg;
   int rc;
-  int step_result;
 
-  if ((rc = ensure_parents_id_and_next_offset_stack (cl)))
+  o = malloc (sizeof (*o));
+  if (o == NULL)
     {
-      l->APP_ERR (rc, "Cannot ensure parents_id_and_next_offset");
-      return rc;
+      l->ERR ("Not enough memory to create category index");
+      return ERR_MEM;
     }
+  memset (o, 0, sizeof (*o));
+  o->refs = 1;
 
-  if ((rc = ensure_go_sub_sup_stmt (cl)))
+  if (sqlite3_exec (db, "begin", NULL, NULL, &err_msg))
     {
-      l->APP_ERR (rc, "Cannot ensure go_sub_sup_stmt");
-      return rc;
+      SQLITE3_ERR_STR (err_msg, "Cannot begin reading category list");
+      free (o);
+      return ERR_DB;
     }
 
-  if (sqlite3_reset (cl->go_sub_sup_stmt))
+  if ((rc = read_data_version (db, &o->version)))
     {
-      SQLITE3_ERR (cl->db, "Cannot reset go_sub_sup_stmt");
-      return ERR_DB;
+      l->APP_ERR (rc, "Cannot read category data version");
+    }
+  else if ((rc = read_cats (db, o)))
+    {
+      l->APP_ERR (rc, "Cannot read categories");
+    }
+  else if ((rc = map_cat_ids (o)))
+    {
+      l->APP_ERR (rc, "Cannot map category IDs");
+    }
+  else if ((rc = read_structure (db, o)))
+    {
+      l->APP_ERR (rc, "Cannot read category structure");
     }
 
-  if (sqlite3_clear_bindings (cl->go_sub_sup_stmt))
+  if (sqlite3_exec (db, "commit", NULL, NULL, &err_msg))
     {
-      SQLITE3_ERR (cl->db, "Cannot clear bindings of go_sub_sup_stmt");
-      return ERR_DB;
+      SQLITE3_ERR_STR (err_msg, "Cannot end reading category list");
     }
 
-  if (sqlite3_bind_int (cl->go_sub_sup_stmt, 1, from_id))
+  if (rc)
     {
-      SQLITE3_ERR (cl->db, "Cannot bind from_id to go_sub_sup_stmt");
-      return ERR_DB;
+      destroy_cat_index (&o);
+      return rc;
     }
-  if (sqlite3_bind_int (cl->go_sub_sup_stmt, 2, to_next_offset - 1))
+
+  *index = o;
+
+  return ERR_SUCCESS;
+}
+
+static void
+set_cur_cat (cat_list *cl, size_t pos)
+{
+  cl->cur_pos = pos;
+  cl->cur_cat.id = cl->index->ids[pos];
+  cl->cur_cat.name = cl->index->names + cl->index->name_offsets[pos];
+}
+
+static int
+ensure_parents_pos_and_next_offset_stack (cat_list *cl)
+{
+  int rc;
+
+  if (cl->parents_pos_and_next_offset != NULL)
     {
-      SQLITE3_ERR (cl->db, "Cannot bind next_offset to go_sub_sup_stmt");
-      return ERR_DB;
+      return ERR_SUCCESS;
     }
 
-  step_result = sqlite3_step (cl->go_sub_sup_stmt);
-  if (step_result == SQLITE_ROW)
+  if ((rc = create_stack (&cl->parents_pos_and_next_offset,
+			  sizeof (struct pos_and_next_offset))))
     {
-      int rc;
-      struct id_and_next_offset o;
+      l->APP_ERR (rc, "Cannot create parents position and next offset stack");
+      return rc;
+    }
 
-      o.id = from_id;
-      o.next_offset = from_id_next_offset;
+  return ERR_SUCCESS;
+}
 
-      if ((rc = push (&o, cl->parents_id_and_next_offset)))
-	{
-	  l->APP_ERR (rc, "Cannot go the subcategory");
-	  return rc;
-	}
+/**
+ * Gets the categories being iterated.
+ *
+ * @param [in] cl the category list.
+ * @param [out] level the positions of the categories or NULL if all
+ *                    categories are iterated in the order of their positions.
+ * @param [out] level_len the number of categories.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+get_level (const cat_list *cl, const size_t **level, size_t *level_len)
+{
+  const struct cat_index *index = cl->index;
+  struct pos_and_next_offset parent;
+  int rc;
 
-      if ((rc = update_cur_cat (cl, cl->go_sub_sup_stmt)))
+  if (cl->is_flat)
+    {
+      *level = NULL;
+      *level_len = index->count;
+    }
+  else if (is_at_top_level (cl))
+    {
+      *level = index->top;
+      *level_len = index->top_count;
+    }
+  else
+    {
+      if ((rc = top (&parent, cl->parents_pos_and_next_offset)))
 	{
-	  int pop_rc;
-
-	  if ((pop_rc = pop (NULL, cl->parents_id_and_next_offset)))
-	    {
-	      if (pop_rc == -1)
-		{
-		  l->APP_ERR (ERR_INVALID_STATE,
-			      "parents_id_and_next_offset must not be empty");
-		}
-	      else
-		{
-		  l->APP_ERR (pop_rc, "Cannot pop parents_id_and_next_offset");
-		}
-	    }
-
+	  l->APP_ERR (rc,
+		      "Cannot read top element of parents_pos_and_next_offset");
 	  return rc;
 	}
+      *level = index->subs + index->sub_start[parent.pos];
+      *level_len = (index->sub_start[parent.pos + 1]
+		    - index->sub_start[parent.pos]);
+    }
+
+  return ERR_SUCCESS;
+}
 
-      cl->next_offset = to_next_offset;
+int
+next (cat_list *cl)
+{
+  const size_t *level;
+  size_t level_len;
+  int rc;
 
-      return -1;
-    }
-  else if (step_result == SQLITE_DONE)
+  if ((rc = get_level (cl, &level, &level_len)))
     {
-      return 0;
+      l->APP_ERR (rc, "Cannot get the categories being iterated");
+      return rc;
     }
-  else
+
+  if (cl->next_offset >= level_len)
     {
-      SQLITE3_ERR (cl->db, "Cannot execute go_sub_sup_stmt");
-      return ERR_DB;
+      return 0;
     }
+
+  set_cur_cat (cl, level == NULL ? cl->next_offset : level[cl->next_offset]);
+  cl->next_offset++;
+
+  return -1;
 }
 
 int
-go_sub (cat_list *cl)
+prev (cat_list *cl)
 {
   int rc;
 
-  if (cl->is_flat
-      || cl->next_offset == 0) /* internal iterator is not over any category. */
+  /* next_offset == 0, internal iterator is not over any category.
+   * next_offset == 1, internal iterator is over the first category.
+   */
+  if (cl->next_offset < 2)
     {
       return 0;
     }
 
-  rc = go_sub_sup (cl, cl->cur_cat.id, cl->next_offset, 1);
+  cl->next_offset -= 2;
+
+  rc = next (cl);
   if (rc != 0 && rc != -1)
     {
-      l->APP_ERR (rc, "Cannot move internal iterator to the subcategory");
+      l->APP_ERR (rc, "Cannot move internal iterator to the previous location");
     }
 
   return rc;
 }
 
 int
-go_sup (cat_list *cl)
+go_sub (cat_list *cl)
 {
-  struct id_and_next_offset parent;
-  struct id_and_next_offset grandparent;
+  const struct cat_index *index = cl->index;
+  struct pos_and_next_offset o;
   int rc;
 
   if (cl->is_flat
-      || cl->next_offset == 0 /* internal iterator is not over any category. */
-      || is_at_top_level (cl))
+      || cl->next_offset == 0) /* internal iterator is not over any category. */
     {
       return 0;
     }
 
-  if ((rc = pop (&parent, cl->parents_id_and_next_offset)))
+  if (index->sub_start[cl->cur_pos] == index->sub_start[cl->cur_pos + 1])
     {
-      l->APP_ERR (rc, "Cannot pop parent id and next offset");
-      return rc;
+      return 0;
     }
-  rc = pop (&grandparent, cl->parents_id_and_next_offset);
-  if (rc == -1)
+
+  if ((rc = ensure_parents_pos_and_next_offset_stack (cl)))
     {
-      cl->next_offset = parent.next_offset - 1;
-      rc = next (cl);
-      if (rc != 0 && rc != -1)
-	{
-	  l->APP_ERR (rc, "Cannot move internal iterator to the parent category");
-	}
+      l->APP_ERR (rc, "Cannot ensure parents_pos_and_next_offset");
       return rc;
     }
-  else if (rc == 0)
+
+  o.pos = cl->cur_pos;
+  o.next_offset = cl->next_offset;
+  if ((rc = push (&o, cl->parents_pos_and_next_offset)))
     {
-      rc = go_sub_sup (cl, grandparent.id, grandparent.next_offset,
-		       parent.next_offset);
-      if (rc != 0 && rc != -1)
-	{
-	  l->APP_ERR (rc, "Cannot move internal iterator to the parent category");
-	}
+      l->APP_ERR (rc, "Cannot go the subcategory");
       return rc;
     }
-  else
+
+  set_cur_cat (cl, index->subs[index->sub_start[cl->cur_pos]]);
+  cl->next_offset = 1;
+
+  return -1;
+}
+
+int
+go_sup (cat_list *cl)
+{
+  struct pos_and_next_offset parent;
+  int rc;
+
+  if (cl->is_flat
+      || cl->next_offset == 0 /* internal iterator is not over any category. */
+      || is_at_top_level (cl))
+    {
+      return 0;
+    }
+
+  if ((rc = pop (&parent, cl->parents_pos_and_next_offset)))
     {
-      l->APP_ERR (rc, "Cannot pop grandparent id and next offset");
+      l->APP_ERR (rc, "Cannot pop parent position and next offset");
       return rc;
     }
+
+  set_cur_cat (cl, parent.pos);
+  cl->next_offset = parent.next_offset;
+
+  return -1;
 }
 
 const struct cat *
@@ -839,92 +1138,1168 @@ get_cat (const cat_list *cl)
   return &cl->cur_cat;
 }
 
-int
-update_cat_list (const char *sql_statements)
+static int
+compare_pos (const void *a, const void *b)
 {
-  char *err_msg;
-  sqlite3 *db;
-  int rc;
+  size_t x = *(const size_t *) a, y = *(const size_t *) b;
 
-  if ((rc = open_cat_list_db (&db)))
+  return (x > y) - (x < y);
+}
+
+/**
+ * Computes the descendants of every category of an index in post-order so
+ * that the descendants of the subcategories of a category are known before
+ * the descendants of the category itself are merged from them. An edge that
+ * closes a cycle in a malformed DB is ignored.
+ *
+ * @param [in] index the index whose closure is computed.
+ * @param [out] closure the pointer pointing to a dynamically allocated memory
+ *                      that should be freed with destroy_cat_closure().
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+create_cat_closure (const struct cat_index *index,
+		    struct cat_closure **closure)
+{
+  enum {UNVISITED, VISITING, VISITED};
+  size_t n = index->count;
+  struct cat_closure *o;
+  char *state = calloc (n + 1, 1);
+  size_t *stamp = malloc ((n + 1) * sizeof (*stamp));
+  size_t *dfs_pos = malloc ((n + 1) * sizeof (*dfs_pos));
+  size_t *dfs_next = malloc ((n + 1) * sizeof (*dfs_next));
+  size_t *desc_pos = NULL;
+  size_t desc_capacity = 0, desc_count = 0, root, i;
+  int rc = ERR_SUCCESS;
+
+  o = calloc (1, sizeof (*o));
+  if (o != NULL)
     {
-      l->APP_ERR (rc, "Cannot open category list DB for update");
-      return ERR_UPDATE_CATEGORY_LIST;
+      o->desc_off = malloc ((n + 1) * sizeof (*o->desc_off));
+      o->desc_len = malloc ((n + 1) * sizeof (*o->desc_len));
     }
-
-  rc = ERR_SUCCESS;
-  if (sqlite3_exec (db,
-		    sql_statements,
-		    NULL, NULL, &err_msg))
+  if (state == NULL || stamp == NULL || dfs_pos == NULL || dfs_next == NULL
+      || o == NULL || o->desc_off == NULL || o->desc_len == NULL)
     {
-      SQLITE3_ERR_STR (err_msg, "Cannot execute update");
-      rc = ERR_UPDATE_CATEGORY_LIST;
+      l->ERR ("Not enough memory to compute category closure");
+      rc = ERR_MEM;
+      goto out;
     }
-
-  /* Data should have been safely written to the file so that a failing DB close
-   * should not affect the already stored data.
-   */
-  if (sqlite3_close (db))
+  for (i = 0; i < n; i++)
     {
-      SQLITE3_ERR (db, "Cannot close category list DB");
+      stamp[i] = (size_t) -1;
     }
 
-  return rc;
-}
+  for (root = 0; root < n; root++)
+    {
+      size_t depth = 0;
 
-int
-reset (cat_list *cl)
-{
-  int rc;
-  char *err_msg;
+      if (state[root] != UNVISITED)
+	{
+	  continue;
+	}
+      state[root] = VISITING;
+      dfs_pos[0] = root;
+      dfs_next[0] = index->sub_start[root];
 
-  if ((rc = close_all_prepared_statements (cl)))
-    {
-      l->APP_ERR (rc, "Cannot close all prepared statements for reset");
-      return rc;
-    }
+      while (1)
+	{
+	  size_t pos = dfs_pos[depth];
 
-  if (sqlite3_exec (cl->db,
+	  if (dfs_next[depth] < index->sub_start[pos + 1])
+	    {
+	      size_t sub = index->subs[dfs_next[depth]++];
 
-		    "drop table if exists " TABLE_CATEGORY_LIST_TMP ";"
-		    "drop table if exists " TABLE_CATEGORY_STRUCTURE_TMP ";"
+	      if (state[sub] == UNVISITED)
+		{
+		  state[sub] = VISITING;
+		  depth++;
+		  dfs_pos[depth] = sub;
+		  dfs_next[depth] = index->sub_start[sub];
+		}
+	      continue;
+	    }
 
-		    "create temporary table " TABLE_CATEGORY_LIST_TMP " ("
-		    COLUMN_CAT_ID " integer primary key not null,"
-		    COLUMN_CAT_NAME " text not null);"
+	  /* All subcategories are visited, so merge their descendants. */
+	  o->desc_off[pos] = desc_count;
+	  for (i = index->sub_start[pos]; i < index->sub_start[pos + 1]; i++)
+	    {
+	      size_t sub = index->subs[i], j;
 
-		    "create temporary table " TABLE_CATEGORY_STRUCTURE_TMP " ("
-		    COLUMN_CAT_ID " integer not null,"
-		    COLUMN_SUBCAT_ID " integer not null,"
-		    "primary key (" COLUMN_CAT_ID ", " COLUMN_SUBCAT_ID "),"
-		    "foreign key (" COLUMN_CAT_ID ") references "
-		    TABLE_CATEGORY_LIST_TMP " (" COLUMN_CAT_ID "),"
-		    "foreign key (" COLUMN_SUBCAT_ID ") references "
-		    TABLE_CATEGORY_LIST_TMP " (" COLUMN_CAT_ID "));"
+	      if (state[sub] != VISITED)
+		{
+		  continue; /* A cycle */
+		}
+	      if ((rc = ensure_capacity ((void **) &desc_pos, &desc_capacity,
+					 desc_count + o->desc_len[sub] + 1,
+					 sizeof (*desc_pos))))
+		{
+		  goto out;
+		}
+	      if (stamp[sub] != pos)
+		{
+		  stamp[sub] = pos;
+		  desc_pos[desc_count++] = sub;
+		}
+	      for (j = 0; j < o->desc_len[sub]; j++)
+		{
+		  size_t d = desc_pos[o->desc_off[sub] + j];
 
-		    "insert into " TABLE_CATEGORY_LIST_TMP
-		    " select * from " TABLE_CATEGORY_LIST ";"
+		  if (stamp[d] != pos)
+		    {
+		      stamp[d] = pos;
+		      desc_pos[desc_count++] = d;
+		    }
+		}
+	    }
+	  o->desc_len[pos] = desc_count - o->desc_off[pos];
+	  if (o->desc_len[pos] > 1)
+	    {
+	      qsort (desc_pos + o->desc_off[pos], o->desc_len[pos],
+		     sizeof (*desc_pos), compare_pos);
+	    }
+	  state[pos] = VISITED;
 
-		    "insert into " TABLE_CATEGORY_STRUCTURE_TMP
-		    " select * from " TABLE_CATEGORY_STRUCTURE ";",
+	  if (depth == 0)
+	    {
+	      break;
+	    }
+	  depth--;
+	}
+    }
 
-		    NULL, NULL, &err_msg))
+  o->desc_ids = malloc ((desc_count + 1) * sizeof (*o->desc_ids));
+  if (o->desc_ids == NULL)
     {
-      SQLITE3_ERR_STR (err_msg, "Cannot reset category list");
-      return ERR_DB;
+      l->ERR ("Not enough memory to store category closure");
+      rc = ERR_MEM;
+      goto out;
+    }
+  for (i = 0; i < desc_count; i++)
+    {
+      o->desc_ids[i] = index->ids[desc_pos[i]];
     }
 
-  cl->next_offset = 0;
+ out:
+  free (state);
+  free (stamp);
+  free (dfs_pos);
+  free (dfs_next);
+  free (desc_pos);
 
-  if (cl->parents_id_and_next_offset != NULL)
+  if (rc)
     {
-      while ((rc = pop (NULL, cl->parents_id_and_next_offset)));
-      if (rc != -1)
-	{
-	  l->APP_ERR (rc, "Cannot empty stack during reset of cat_list");
-	  return rc;
-	}
+      destroy_cat_closure (&o);
+      return rc;
     }
 
+  *closure = o;
+
   return ERR_SUCCESS;
 }
+
+/**
+ * Gets the closure of the data of a category list building it if this is the
+ * first query since the data were read.
+ *
+ * @param [in] cl the category list.
+ * @param [out] closure the closure that lives as long as the data.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+ensure_cat_closure (const cat_list *cl, const struct cat_closure **closure)
+{
+  struct cat_closure *built;
+  int rc;
+
+  pthread_mutex_lock (&index_lock);
+  *closure = cl->index->closure;
+  pthread_mutex_unlock (&index_lock);
+  if (*closure != NULL)
+    {
+      return ERR_SUCCESS;
+    }
+
+  if ((rc = create_cat_closure (cl->index, &built)))
+    {
+      l->APP_ERR (rc, "Cannot create category closure");
+      return rc;
+    }
+
+  /* Another list sharing the index may have been quicker. */
+  pthread_mutex_lock (&index_lock);
+  if (cl->index->closure == NULL)
+    {
+      cl->index->closure = built;
+      built = NULL;
+    }
+  *closure = cl->index->closure;
+  pthread_mutex_unlock (&index_lock);
+
+  destroy_cat_closure (&built);
+
+  return ERR_SUCCESS;
+}
+
+int
+get_cat_by_id (const cat_list *cl, unsigned long id, struct cat *c)
+{
+  size_t pos;
+
+  if (!find_cat (cl->index, id, &pos))
+    {
+      return ERR_RANGE;
+    }
+
+  c->id = id;
+  c->name = cl->index->names + cl->index->name_offsets[pos];
+
+  return ERR_SUCCESS;
+}
+
+size_t
+get_cats_by_id (const cat_list *cl, const unsigned long *ids, size_t count,
+		struct cat *cats)
+{
+  size_t resolved = 0, i;
+
+  for (i = 0; i < count; i++)
+    {
+      size_t pos;
+
+      cats[i].id = ids[i];
+      if (find_cat (cl->index, ids[i], &pos))
+	{
+	  cats[i].name = cl->index->names + cl->index->name_offsets[pos];
+	  resolved++;
+	}
+      else
+	{
+	  cats[i].name = NULL;
+	}
+    }
+
+  return resolved;
+}
+
+int
+get_descendants (const cat_list *cl, unsigned long id,
+		 const unsigned long **ids, size_t *count)
+{
+  const struct cat_closure *closure;
+  size_t pos;
+  int rc;
+
+  if (!find_cat (cl->index, id, &pos))
+    {
+      return ERR_RANGE;
+    }
+
+  if ((rc = ensure_cat_closure (cl, &closure)))
+    {
+      return rc;
+    }
+
+  *ids = closure->desc_ids + closure->desc_off[pos];
+  *count = closure->desc_len[pos];
+
+  return ERR_SUCCESS;
+}
+
+int
+is_descendant (const cat_list *cl, unsigned long id, unsigned long ancestor_id)
+{
+  const unsigned long *ids;
+  size_t count, low = 0, high;
+  int rc;
+
+  if ((rc = get_descendants (cl, ancestor_id, &ids, &count)))
+    {
+      return (rc == ERR_RANGE ? 0 : rc);
+    }
+
+  high = count;
+  while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
+
+      if (ids[mid] < id)
+	{
+	  low = mid + 1;
+	}
+      else
+	{
+	  high = mid;
+	}
+    }
+
+  return (low < count && ids[low] == id ? -1 : 0);
+}
+
+static int
+is_word_char (char c)
+{
+  return isalnum ((unsigned char) c) || (unsigned char) c > 127;
+}
+
+static int
+compare_word (const void *a, const void *b)
+{
+  const struct cat_word *x = a, *y = b;
+  int rc = strcasecmp (x->word, y->word);
+
+  if (rc != 0)
+    {
+      return rc;
+    }
+
+  return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+/**
+ * Builds the name search data of an index.
+ *
+ * @param [in] index the index whose names are searched.
+ * @param [out] search the pointer pointing to a dynamically allocated memory
+ *                     that should be freed with destroy_cat_search().
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+create_cat_search (const struct cat_index *index, struct cat_search **search)
+{
+  struct cat_search *o;
+  size_t word_capacity = 0, pos, i;
+  int rc = ERR_SUCCESS;
+
+  o = calloc (1, sizeof (*o));
+  if (o == NULL
+      || (o->parent = malloc ((index->count + 1)
+			      * sizeof (*o->parent))) == NULL)
+    {
+      l->ERR ("Not enough memory to create category search");
+      free (o);
+      return ERR_MEM;
+    }
+
+  for (pos = 0; pos < index->count; pos++)
+    {
+      const char *name = index->names + index->name_offsets[pos];
+
+      o->parent[pos] = CAT_POS_NONE;
+
+      for (i = 0; i == 0 || name[i] != '\0'; i++)
+	{
+	  if (i != 0 && !(is_word_char (name[i])
+			  && !is_word_char (name[i - 1])))
+	    {
+	      continue;
+	    }
+
+	  if ((rc = ensure_capacity ((void **) &o->words, &word_capacity,
+				     o->word_count + 1, sizeof (*o->words))))
+	    {
+	      destroy_cat_search (&o);
+	      return rc;
+	    }
+	  o->words[o->word_count].word = name + i;
+	  o->words[o->word_count].pos = pos;
+	  o->word_count++;
+
+	  if (name[i] == '\0')
+	    {
+	      break; /* An empty name */
+	    }
+	}
+    }
+  qsort (o->words, o->word_count, sizeof (*o->words), compare_word);
+
+  /* The parents are visited in ascending ID order. */
+  for (pos = 0; pos < index->count; pos++)
+    {
+      for (i = index->sub_start[pos]; i < index->sub_start[pos + 1]; i++)
+	{
+	  if (o->parent[index->subs[i]] == CAT_POS_NONE)
+	    {
+	      o->parent[index->subs[i]] = pos;
+	    }
+	}
+    }
+
+  *search = o;
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Gets the name search data of a category list building them if this is the
+ * first search since the data were read.
+ *
+ * @param [in] cl the category list.
+ * @param [out] search the search data that live as long as the data.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+ensure_cat_search (const cat_list *cl, const struct cat_search **search)
+{
+  struct cat_search *built;
+  int rc;
+
+  pthread_mutex_lock (&index_lock);
+  *search = cl->index->search;
+  pthread_mutex_unlock (&index_lock);
+  if (*search != NULL)
+    {
+      return ERR_SUCCESS;
+    }
+
+  if ((rc = create_cat_search (cl->index, &built)))
+    {
+      l->APP_ERR (rc, "Cannot create category search");
+      return rc;
+    }
+
+  /* Another list sharing the index may have been quicker. */
+  pthread_mutex_lock (&index_lock);
+  if (cl->index->search == NULL)
+    {
+      cl->index->search = built;
+      built = NULL;
+    }
+  *search = cl->index->search;
+  pthread_mutex_unlock (&index_lock);
+
+  destroy_cat_search (&built);
+
+  return ERR_SUCCESS;
+}
+
+static void
+add_match (const struct cat_index *index, size_t pos, struct cat *matches,
+	   size_t max_matches, size_t *count)
+{
+  if (*count < max_matches)
+    {
+      matches[*count].id = index->ids[pos];
+      matches[*count].name = index->names + index->name_offsets[pos];
+    }
+  (*count)++;
+}
+
+/**
+ * Finds the words of a search that start with the query.
+ *
+ * @param [in] search the search data.
+ * @param [in] query the query.
+ * @param [out] start the first word found.
+ * @param [out] end the word after the last word found.
+ */
+static void
+find_words (const struct cat_search *search, const char *query,
+	    size_t *start, size_t *end)
+{
+  size_t query_len = strlen (query);
+  size_t low = 0, high = search->word_count;
+
+  while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
+
+      if (strcasecmp (search->words[mid].word, query) < 0)
+	{
+	  low = mid + 1;
+	}
+      else
+	{
+	  high = mid;
+	}
+    }
+  *start = low;
+
+  /* The words starting with the query are followed by greater words only. */
+  high = search->word_count;
+  while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
+
+      if (strncasecmp (search->words[mid].word, query, query_len) == 0)
+	{
+	  low = mid + 1;
+	}
+      else
+	{
+	  high = mid;
+	}
+    }
+  *end = low;
+}
+
+/**
+ * Finds the categories having a word that starts with the query. Since a name
+ * may have several such words, the categories of the words found are marked
+ * to report each category once in ascending ID order.
+ */
+static int
+search_cat_prefix (const struct cat_index *index,
+		   const struct cat_search *search, const char *query,
+		   struct cat *matches, size_t max_matches, size_t *count)
+{
+  size_t start, end, shown = 0, i;
+  char *found;
+
+  find_words (search, query, &start, &end);
+  if (start == end)
+    {
+      return ERR_SUCCESS;
+    }
+
+  /* A word is mostly in one category whose name has only that word. */
+  if (end - start == 1)
+    {
+      add_match (index, search->words[start].pos, matches, max_matches,
+		 count);
+      return ERR_SUCCESS;
+    }
+
+  found = calloc (index->count, 1);
+  if (found == NULL)
+    {
+      l->ERR ("Not enough memory to collect found categories");
+      return ERR_MEM;
+    }
+  for (i = start; i < end; i++)
+    {
+      size_t pos = search->words[i].pos;
+
+      if (!found[pos])
+	{
+	  found[pos] = 1;
+	  (*count)++;
+	}
+    }
+  for (i = 0; i < index->count && shown < max_matches; i++)
+    {
+      if (found[i])
+	{
+	  add_match (index, i, matches, max_matches, &shown);
+	}
+    }
+
+  free (found);
+
+  return ERR_SUCCESS;
+}
+
+static int
+has_substring (const char *name, const char *query, size_t query_len)
+{
+  int first = tolower ((unsigned char) *query);
+
+  if (query_len == 0)
+    {
+      return 1;
+    }
+
+  for (; *name != '\0'; name++)
+    {
+      if (tolower ((unsigned char) *name) == first
+	  && strncasecmp (name + 1, query + 1, query_len - 1) == 0)
+	{
+	  return 1;
+	}
+    }
+
+  return 0;
+}
+
+int
+search_cats (const cat_list *cl, const char *query, enum cat_search_mode mode,
+	     struct cat *matches, size_t max_matches, size_t *count)
+{
+  const struct cat_search *search;
+  size_t query_len = strlen (query), pos;
+  int rc;
+
+  *count = 0;
+
+  if (mode == CAT_SEARCH_SUBSTRING)
+    {
+      for (pos = 0; pos < cl->index->count; pos++)
+	{
+	  if (has_substring (cl->index->names + cl->index->name_offsets[pos],
+			     query, query_len))
+	    {
+	      add_match (cl->index, pos, matches, max_matches, count);
+	    }
+	}
+      return ERR_SUCCESS;
+    }
+
+  if ((rc = ensure_cat_search (cl, &search)))
+    {
+      return rc;
+    }
+
+  return search_cat_prefix (cl->index, search, query, matches, max_matches,
+			    count);
+}
+
+int
+get_cat_path (const cat_list *cl, unsigned long id, struct cat *path,
+	      size_t max_len, size_t *len)
+{
+  const struct cat_search *search;
+  size_t pos, ancestor, depth = 0, i;
+  int rc;
+
+  if (!find_cat (cl->index, id, &pos))
+    {
+      return ERR_RANGE;
+    }
+
+  if ((rc = ensure_cat_search (cl, &search)))
+    {
+      return rc;
+    }
+
+  /* A cycle in a malformed DB is cut at the number of categories. */
+  for (ancestor = search->parent[pos];
+       ancestor != CAT_POS_NONE && depth < cl->index->count;
+       ancestor = search->parent[ancestor])
+    {
+      depth++;
+    }
+
+  /* The nearest ancestors are left out if the path is too long. */
+  for (ancestor = search->parent[pos], i = depth; i > max_len; i--)
+    {
+      ancestor = search->parent[ancestor];
+    }
+  for (; i > 0; i--)
+    {
+      path[i - 1].id = cl->index->ids[ancestor];
+      path[i - 1].name = cl->index->names + cl->index->name_offsets[ancestor];
+      ancestor = search->parent[ancestor];
+    }
+
+  *len = depth;
+
+  return ERR_SUCCESS;
+}
+
+int
+update_cat_list (const char *sql_statements)
+{
+  char *err_msg;
+  sqlite3 *db;
+  int rc;
+
+  if ((rc = open_cat_list_db (&db)))
+    {
+      l->APP_ERR (rc, "Cannot open category list DB for update");
+      return ERR_UPDATE_CATEGORY_LIST;
+    }
+
+  rc = ERR_SUCCESS;
+  if (sqlite3_exec (db,
+		    sql_statements,
+		    NULL, NULL, &err_msg))
+    {
+      SQLITE3_ERR_STR (err_msg, "Cannot execute update");
+      rc = ERR_UPDATE_CATEGORY_LIST;
+    }
+  /* The statements may have dropped the triggers with their tables. */
+  else if (sqlite3_exec (db, DATA_VERSION_INCREMENT, NULL, NULL, &err_msg))
+    {
+      SQLITE3_ERR_STR (err_msg, "Cannot count update");
+      rc = ERR_UPDATE_CATEGORY_LIST;
+    }
+
+  /* Data should have been safely written to the file so that a failing DB close
+   * should not affect the already stored data.
+   */
+  if (sqlite3_close (db))
+    {
+      SQLITE3_ERR (db, "Cannot close category list DB");
+    }
+
+  return rc;
+}
+
+int
+reset (cat_list *cl)
+{
+  struct cat_index *index;
+  sqlite3_int64 version;
+  int rc;
+
+  if ((rc = read_data_version (cl->db, &version)))
+    {
+      l->APP_ERR (rc, "Cannot check category data version");
+      return rc;
+    }
+
+  if (cl->index == NULL || cl->index->version != version)
+    {
+      if ((index = acquire_cat_index (version)) == NULL)
+	{
+	  if ((rc = create_cat_index (cl->db, &index)))
+	    {
+	      l->APP_ERR (rc, "Cannot reset category list");
+	      return rc;
+	    }
+	  share_cat_index (index);
+	}
+
+      release_cat_index (&cl->index);
+      cl->index = index;
+    }
+
+  cl->next_offset = 0;
+
+  if (cl->parents_pos_and_next_offset != NULL)
+    {
+      while ((rc = pop (NULL, cl->parents_pos_and_next_offset)) == 0);
+      if (rc != -1)
+	{
+	  l->APP_ERR (rc, "Cannot empty stack during reset of cat_list");
+	  return rc;
+	}
+    }
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Reads the version of the central category DB that the category DB has been
+ * upgraded to.
+ *
+ * @param [in] db the category DB.
+ * @param [out] version the version or 0 if no delta has been applied.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+read_version (sqlite3 *db, unsigned long *version)
+{
+  sqlite3_stmt *stmt;
+  int rc = ERR_SUCCESS;
+
+  if (sqlite3_prepare_v2 (db,
+			  "select coalesce (max (" COLUMN_VERSION "), 0)"
+			  " from " TABLE_VERSION,
+			  -1, &stmt, NULL))
+    {
+      SQLITE3_ERR (db, "Cannot prepare version selection");
+      return ERR_DB;
+    }
+
+  if (sqlite3_step (stmt) == SQLITE_ROW)
+    {
+      *version = sqlite3_column_int64 (stmt, 0);
+    }
+  else
+    {
+      SQLITE3_ERR (db, "Cannot select version");
+      rc = ERR_DB;
+    }
+
+  if (sqlite3_finalize (stmt))
+    {
+      SQLITE3_ERR (db, "Cannot finalize version selection");
+    }
+
+  return rc;
+}
+
+int
+get_cat_list_version (unsigned long *version)
+{
+  sqlite3 *db;
+  int rc;
+
+  if ((rc = open_cat_list_db (&db)))
+    {
+      l->APP_ERR (rc, "Cannot open category list DB to get version");
+      return rc;
+    }
+
+  rc = read_version (db, version);
+
+  if (sqlite3_close (db))
+    {
+      SQLITE3_ERR (db, "Cannot close category list DB");
+    }
+
+  return rc;
+}
+
+/** The state of applying a delta file. */
+struct delta
+{
+  sqlite3 *db; /**< The category DB in a transaction. */
+  FILE *file; /**< The delta file. */
+  const char *path; /**< The path to the delta file for logging. */
+  unsigned long line_no; /**< The number of the line being applied. */
+  unsigned long from_version; /**< The current version of the DB. */
+  unsigned long to_version; /**< 0 until the version header is applied. */
+  sqlite3_stmt *insert_cat_stmt; /**< SQL to insert a category. */
+  sqlite3_stmt *insert_structure_stmt; /**< SQL to insert a structure. */
+};
+
+/**
+ * Splits a delta record into its tab-separated fields. The last field takes
+ * the rest of the line.
+ *
+ * @param [in] line the record whose newline has been removed. The tabs are
+ *                  replaced with NUL characters.
+ * @param [out] fields the fields.
+ * @param [in] field_count the number of fields of the record.
+ *
+ * @return 0 if there is no error or non-zero if there are too few fields.
+ */
+static int
+split_delta_record (char *line, char **fields, int field_count)
+{
+  int i;
+
+  for (i = 0; i < field_count - 1; i++)
+    {
+      char *tab = strchr (line, '\t');
+
+      if (tab == NULL)
+	{
+	  return ERR_PARSE_DATA;
+	}
+      *tab = '\0';
+      fields[i] = line;
+      line = tab + 1;
+    }
+  fields[i] = line;
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Parses an unsigned decimal integer that must take the whole string.
+ *
+ * @param [in] str the string to parse.
+ * @param [out] value the parsed integer.
+ *
+ * @return 0 if there is no error or non-zero if the string is not an integer.
+ */
+static int
+parse_delta_ulong (const char *str, unsigned long *value)
+{
+  char *end;
+
+  if (*str < '0' || *str > '9')
+    {
+      return ERR_PARSE_DATA;
+    }
+
+  errno = 0;
+  *value = strtoul (str, &end, 10);
+  if (errno != 0 || *end != '\0')
+    {
+      return ERR_PARSE_DATA;
+    }
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Executes a prepared insert statement of the delta and makes it ready to be
+ * executed again.
+ *
+ * @param [in] d the delta being applied.
+ * @param [in] stmt the insert statement whose parameters have been bound.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+execute_delta_insert (struct delta *d, sqlite3_stmt *stmt)
+{
+  int step_result = sqlite3_step (stmt);
+
+  if (sqlite3_reset (stmt) || step_result != SQLITE_DONE)
+    {
+      SQLITE3_ERR (d->db, "Cannot apply delta record");
+      l->ERR ("Cannot apply line %lu of %s", d->line_no, d->path);
+      return ERR_UPGRADE_CATEGORY_LIST;
+    }
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Applies one record of a delta file. The record is one of
+ * <pre>
+ * version\tFROM\tTO
+ * category\tID\tNAME
+ * structure\tID\tSUBCAT_ID
+ * </pre>
+ * and the version header must come first, exactly once, and upgrade the
+ * current version of the DB.
+ *
+ * @param [in] d the delta being applied.
+ * @param [in] line the record whose newline has been removed. It is split in
+ *                  place.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+apply_delta_record (struct delta *d, char *line)
+{
+  char *fields[3];
+  unsigned long a, b = 0;
+
+  if (split_delta_record (line, fields, 3)
+      || (strcmp (fields[0], "category") != 0
+	  && parse_delta_ulong (fields[2], &b))
+      || parse_delta_ulong (fields[1], &a))
+    {
+      l->ERR ("Malformed line %lu of %s", d->line_no, d->path);
+      return ERR_PARSE_DATA;
+    }
+
+  if (strcmp (fields[0], "version") == 0)
+    {
+      if (d->to_version != 0)
+	{
+	  l->ERR ("Repeated version header in line %lu of %s",
+		  d->line_no, d->path);
+	  return ERR_PARSE_DATA;
+	}
+      if (a != d->from_version || b <= a)
+	{
+	  l->ERR ("%s upgrades version %lu to %lu but the DB is version %lu",
+		  d->path, a, b, d->from_version);
+	  return ERR_CATEGORY_VERSION;
+	}
+      d->to_version = b;
+      return ERR_SUCCESS;
+    }
+
+  if (d->to_version == 0)
+    {
+      l->ERR ("%s does not start with a version header", d->path);
+      return ERR_PARSE_DATA;
+    }
+
+  if (strcmp (fields[0], "category") == 0)
+    {
+      if (sqlite3_bind_int64 (d->insert_cat_stmt, 1, a)
+	  || sqlite3_bind_text (d->insert_cat_stmt, 2, fields[2], -1,
+				SQLITE_STATIC))
+	{
+	  SQLITE3_ERR (d->db, "Cannot bind delta category");
+	  return ERR_DB;
+	}
+      return execute_delta_insert (d, d->insert_cat_stmt);
+    }
+  else if (strcmp (fields[0], "structure") == 0)
+    {
+      if (sqlite3_bind_int64 (d->insert_structure_stmt, 1, a)
+	  || sqlite3_bind_int64 (d->insert_structure_stmt, 2, b))
+	{
+	  SQLITE3_ERR (d->db, "Cannot bind delta structure");
+	  return ERR_DB;
+	}
+      return execute_delta_insert (d, d->insert_structure_stmt);
+    }
+
+  l->ERR ("Unknown record in line %lu of %s", d->line_no, d->path);
+  return ERR_PARSE_DATA;
+}
+
+/**
+ * Records the version to which a delta upgrades the category DB together with
+ * the last category ID of that version.
+ *
+ * @param [in] d the applied delta.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+record_delta_version (struct delta *d)
+{
+  sqlite3_stmt *stmt;
+  int rc = ERR_SUCCESS;
+
+  if (sqlite3_prepare_v2 (d->db,
+			  "insert into " TABLE_VERSION
+			  " (" COLUMN_ENDING_CAT_ID ", " COLUMN_VERSION ")"
+			  " select coalesce (max (" COLUMN_CAT_ID "), 0), ?"
+			  " from " TABLE_CATEGORY_LIST,
+			  -1, &stmt, NULL))
+    {
+      SQLITE3_ERR (d->db, "Cannot prepare version insertion");
+      return ERR_DB;
+    }
+
+  if (sqlite3_bind_int64 (stmt, 1, d->to_version)
+      || sqlite3_step (stmt) != SQLITE_DONE)
+    {
+      SQLITE3_ERR (d->db, "Cannot record category list version");
+      rc = ERR_DB;
+    }
+
+  if (sqlite3_finalize (stmt))
+    {
+      SQLITE3_ERR (d->db, "Cannot finalize version insertion");
+    }
+
+  return rc;
+}
+
+/**
+ * Applies the records of a delta file whose DB transaction has begun.
+ *
+ * @param [in] d the delta to apply.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+apply_delta (struct delta *d)
+{
+  char line[DELTA_LINE_MAX];
+  int rc;
+
+  if ((rc = read_version (d->db, &d->from_version)))
+    {
+      l->APP_ERR (rc, "Cannot read category list version");
+      return rc;
+    }
+
+  if (sqlite3_prepare_v2 (d->db,
+			  "insert into " TABLE_CATEGORY_LIST
+			  " (" COLUMN_CAT_ID ", " COLUMN_CAT_NAME ")"
+			  " values (?, ?)",
+			  -1, &d->insert_cat_stmt, NULL)
+      || sqlite3_prepare_v2 (d->db,
+			     "insert into " TABLE_CATEGORY_STRUCTURE
+			     " (" COLUMN_CAT_ID ", " COLUMN_SUBCAT_ID ")"
+			     " values (?, ?)",
+			     -1, &d->insert_structure_stmt, NULL))
+    {
+      SQLITE3_ERR (d->db, "Cannot prepare delta insert statements");
+      return ERR_DB;
+    }
+
+  while (fgets (line, sizeof (line), d->file) != NULL)
+    {
+      size_t len = strlen (line);
+
+      d->line_no++;
+      if (len > 0 && line[len - 1] == '\n')
+	{
+	  line[--len] = '\0';
+	}
+      else if (!feof (d->file))
+	{
+	  l->ERR ("Line %lu of %s is too long", d->line_no, d->path);
+	  return ERR_PARSE_DATA;
+	}
+      if (len > 0 && line[len - 1] == '\r')
+	{
+	  line[--len] = '\0';
+	}
+
+      if (len == 0 || line[0] == '#')
+	{
+	  continue;
+	}
+
+      if ((rc = apply_delta_record (d, line)))
+	{
+	  return rc;
+	}
+    }
+  if (ferror (d->file))
+    {
+      l->SYS_ERR ("Cannot read %s", d->path);
+      return ERR_UPGRADE_CATEGORY_LIST;
+    }
+  if (d->to_version == 0)
+    {
+      l->ERR ("%s has no version header", d->path);
+      return ERR_PARSE_DATA;
+    }
+
+  return record_delta_version (d);
+}
+
+int
+upgrade_cat_list (const char *delta_path)
+{
+  struct delta d;
+  char *err_msg;
+  int rc;
+
+  memset (&d, 0, sizeof (d));
+  d.path = delta_path;
+
+  if ((d.file = fopen (delta_path, "r")) == NULL)
+    {
+      l->SYS_ERR ("Cannot open category list delta %s", delta_path);
+      return ERR_UPGRADE_CATEGORY_LIST;
+    }
+
+  if ((rc = open_cat_list_db (&d.db)))
+    {
+      l->APP_ERR (rc, "Cannot open category list DB for upgrade");
+      fclose (d.file);
+      return ERR_UPGRADE_CATEGORY_LIST;
+    }
+
+  /* Writing the whole delta in one transaction syncs the DB only once. */
+  if (sqlite3_exec (d.db, "begin immediate", NULL, NULL, &err_msg))
+    {
+      SQLITE3_ERR_STR (err_msg, "Cannot lock category list DB for upgrade");
+      rc = ERR_DB;
+    }
+  else
+    {
+      rc = apply_delta (&d);
+
+      if (d.insert_cat_stmt != NULL && sqlite3_finalize (d.insert_cat_stmt))
+	{
+	  SQLITE3_ERR (d.db, "Cannot finalize delta category insertion");
+	}
+      if (d.insert_structure_stmt != NULL
+	  && sqlite3_finalize (d.insert_structure_stmt))
+	{
+	  SQLITE3_ERR (d.db, "Cannot finalize delta structure insertion");
+	}
+
+      if (rc == ERR_SUCCESS
+	  && sqlite3_exec (d.db, "commit", NULL, NULL, &err_msg))
+	{
+	  SQLITE3_ERR_STR (err_msg, "Cannot commit category list upgrade");
+	  rc = ERR_DB;
+	}
+      if (rc != ERR_SUCCESS
+	  && sqlite3_exec (d.db, "rollback", NULL, NULL, &err_msg))
+	{
+	  SQLITE3_ERR_STR (err_msg, "Cannot roll back category list upgrade");
+	}
+    }
+
+  if (sqlite3_close (d.db))
+    {
+      SQLITE3_ERR (d.db, "Cannot close category list DB");
+    }
+  fclose (d.file);
+
+  if (rc == ERR_SUCCESS)
+    {
+      l->INFO ("Category list upgraded from version %lu to %lu",
+	       d.from_version, d.to_version);
+    }
+
+  return rc;
+}
@@ -15,29 +15,34 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
  *************************************************************************//**
  * @file service_category.h
- * @brief The service category module. This module is thread-safe and
- *        fork-safe as long as each thread and each child process load their
- *        own service list (i.e., the service list object must not be passed
- *        from one thread to another or from a parent process to its child).
- *        And, it is good to reset the category list before navigating it to
- *        get the latest update to the underlying DB. In the future, an event
- *        listener may be available to make this more efficient. The geometry
- *        of the hierarchical structure of a category list is a tree whose
- *        root is only logical and not present in the list. The children of
- *        the logical root are the top-level categories. Upon obtaining a
- *        service category list using either load_flat_cat_list() or
- *        load_cat_list(), or after resetting a service category list with
- *        reset(), the internal iterator is before the first category if the
- *        list is flat or before the first top-level category if the list is
- *        hierarchical that means that get_cat(), prev(), go_sup() and
- *        go_sub() will indicate that there is no category unless next() has
- *        been executed to move the internal iterator to the first
- *        (top-level) category.
+ * @brief The service category module. This module is thread-safe and fork-safe
+ *        as long as each thread and each child process load their own service
+ *        list (i.e., the service list object must not be passed from one
+ *        thread to another or from a parent process to its child). And, it is
+ *        good to reset the category list before navigating it to get the
+ *        latest update to the underlying DB. Resetting is cheap unless the DB
+ *        has changed since any category list of the process was last loaded or
+ *        reset because the copy of the DB is shared.
+ *        <strong>[CAUTION]</strong> When an application uses the APIs in this
+ *        file, upon exit the application should call destroy_cat_list_cache()
+ *        as a part of its memory clean up. The geometry of the hierarchical
+ *        structure of a category list is a tree whose root is only logical and
+ *        not present in the list. The children of the logical root are the
+ *        top-level categories. Upon obtaining a service category list using
+ *        either load_flat_cat_list() or load_cat_list(), or after resetting a
+ *        service category list with reset(), the internal iterator is before
+ *        the first category if the list is flat or before the first top-level
+ *        category if the list is hierarchical that means that get_cat(),
+ *        prev(), go_sup() and go_sub() will indicate that there is no category
+ *        unless next() has been executed to move the internal iterator to the
+ *        first (top-level) category.
  ****************************************************************************/
 
 #ifndef SERVICE_CATEGORY_H
 #define SERVICE_CATEGORY_H
 
+#include <stddef.h>
+
 #ifndef CATEGORY_LIST_DB
 #define CATEGORY_LIST_DB "./category_list.db"
 #endif
@@ -148,7 +153,8 @@ go_sup (cat_list *cl);
 
 /**
  * Resets the internal iterator of the given category list as well as refreshing
- * the list data by re-reading the underlying DB.
+ * the list data. The underlying DB is re-read only if it has changed since the
+ * shared copy was made.
  *
  * @param [in] cl the category list whose internal iterator will be reset.
  *
@@ -168,6 +174,140 @@ reset (cat_list *cl);
 const struct cat *
 get_cat (const cat_list *cl);
 
+/**
+ * Finds a category by its ID in the data of the given category list in
+ * constant time, for example to name the category IDs carried by SSIDs.
+ *
+ * @param [in] cl the category list whose data are queried.
+ * @param [in] id the ID of the category.
+ * @param [out] c the category whose name remains valid until the list is
+ *                reset or destroyed.
+ *
+ * @return 0 if there is no error, ERR_RANGE if the category does not exist,
+ *         or other non-zero if there is an error.
+ */
+int
+get_cat_by_id (const cat_list *cl, unsigned long id, struct cat *c);
+
+/**
+ * Finds many categories by their IDs at once like get_cat_by_id() does, for
+ * example to name the categories of all services seen in a scan.
+ *
+ * @param [in] cl the category list whose data are queried.
+ * @param [in] ids the IDs of the categories that may repeat.
+ * @param [in] count the number of IDs.
+ * @param [out] cats the array of count categories receiving the category of
+ *                   each ID in the same order. The name of a category that
+ *                   does not exist is set to NULL.
+ *
+ * @return the number of IDs whose category exists.
+ */
+size_t
+get_cats_by_id (const cat_list *cl, const unsigned long *ids, size_t count,
+		struct cat *cats);
+
+/**
+ * Gets all categories below a category (i.e., its subcategories, their
+ * subcategories and so on) in the data of the given category list. A category
+ * reachable through several paths is returned once. The descendants of every
+ * category are computed on the first such query after the list data have
+ * changed, and later queries take time proportional to the result.
+ *
+ * @param [in] cl the category list whose data are queried.
+ * @param [in] id the ID of the category.
+ * @param [out] ids the IDs of the descendants in ascending order that remain
+ *                  valid until the list is reset or destroyed.
+ * @param [out] count the number of descendants.
+ *
+ * @return 0 if there is no error, ERR_RANGE if the category does not exist,
+ *         or other non-zero if there is an error.
+ */
+int
+get_descendants (const cat_list *cl, unsigned long id,
+		 const unsigned long **ids, size_t *count);
+
+/**
+ * Checks whether a category is below another category in the data of the
+ * given category list like get_descendants() does. A category is not its own
+ * descendant.
+ *
+ * @param [in] cl the category list whose data are queried.
+ * @param [in] id the ID of the possible descendant.
+ * @param [in] ancestor_id the ID of the possible ancestor.
+ *
+ * @return 0 if the category is not a descendant or either category does not
+ *         exist, -1 if it is a descendant, or a positive integer if there is
+ *         an error.
+ */
+int
+is_descendant (const cat_list *cl, unsigned long id, unsigned long ancestor_id);
+
+/** How search_cats() matches a query with a category name. */
+enum cat_search_mode
+{
+  CAT_SEARCH_PREFIX, /**< A word of the name starts with the query. */
+  CAT_SEARCH_SUBSTRING, /**< The name contains the query anywhere. */
+};
+
+/**
+ * Finds the categories whose names match a query ignoring ASCII case in the
+ * data of the given category list, for example to jump to "Restaurants" as
+ * soon as "rest" is typed. A word of a name starts at the beginning of the
+ * name or at a letter or digit that follows another character so that "sch"
+ * finds "Private School". The words of all names are indexed on the first
+ * prefix search after the list data have changed, and later prefix searches
+ * take time logarithmic in the number of words plus the number of matches.
+ * A substring search reads every name. The parent path of a match can be
+ * obtained with get_cat_path().
+ *
+ * @param [in] cl the category list whose data are searched.
+ * @param [in] query the text to match. An empty query matches every category.
+ * @param [in] mode how to match.
+ * @param [out] matches the array receiving at most max_matches categories in
+ *                      ascending ID order whose names remain valid until the
+ *                      list is reset or destroyed.
+ * @param [in] max_matches the number of categories matches can hold.
+ * @param [out] count the number of matching categories that may be greater
+ *                    than max_matches.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+search_cats (const cat_list *cl, const char *query, enum cat_search_mode mode,
+	     struct cat *matches, size_t max_matches, size_t *count);
+
+/**
+ * Gets the ancestors of a category in the data of the given category list to
+ * show where the category is, for example "Schools > Private School" for
+ * "Kindergarden". If a category has several parents, the one with the lowest
+ * ID is followed.
+ *
+ * @param [in] cl the category list whose data are queried.
+ * @param [in] id the ID of the category.
+ * @param [out] path the array receiving the ancestors from the top-level
+ *                   category down to the parent whose names remain valid until
+ *                   the list is reset or destroyed. If there are more than
+ *                   max_len ancestors, only the top max_len are received.
+ * @param [in] max_len the number of categories path can hold.
+ * @param [out] len the number of ancestors that is 0 for a top-level category.
+ *
+ * @return 0 if there is no error, ERR_RANGE if the category does not exist,
+ *         or other non-zero if there is an error.
+ */
+int
+get_cat_path (const cat_list *cl, unsigned long id, struct cat *path,
+	      size_t max_len, size_t *len);
+
+/**
+ * Frees the copy of the underlying DB that is kept to be shared by the
+ * category lists loaded or reset later. The copies still used by existing
+ * category lists are freed when the lists are destroyed. Calling this
+ * function repeatedly is safe although loading and resetting will re-read
+ * the DB.
+ */
+void
+destroy_cat_list_cache (void);
+
 /**
  * Updates the category list database. The update will not be visible to
  * a category list that is created before the update and has not been reset.
@@ -180,6 +320,43 @@ get_cat (const cat_list *cl);
 int
 update_cat_list (const char *sql_statements);
 
+/**
+ * Upgrades the category list database with a delta file downloaded from the
+ * central category database in one transaction so that either the whole delta
+ * or nothing is applied. The file is read line by line, and so its size is
+ * not limited by the available memory. Empty lines and lines starting with
+ * '#' are ignored. The first record must be the version header, and the
+ * fields of a record are separated by a tab:
+ * <pre>
+ * version     FROM_VERSION  TO_VERSION
+ * category    CAT_ID        CAT_NAME
+ * structure   CAT_ID        SUBCAT_ID
+ * </pre>
+ * FROM_VERSION must be the current version of the database (0 for a database
+ * that has never been upgraded), and TO_VERSION must be greater than
+ * FROM_VERSION. Since categories and their structure are never deleted from
+ * the central category database, a delta only inserts them.
+ *
+ * @param [in] delta_path the path to the delta file.
+ *
+ * @return 0 if there is no error, ERR_CATEGORY_VERSION if the delta does not
+ *         start from the current version, ERR_PARSE_DATA if the delta is
+ *         malformed, or other non-zero if there is another error.
+ */
+int
+upgrade_cat_list (const char *delta_path);
+
+/**
+ * Gets the version of the category list database that is the TO_VERSION of
+ * the last delta applied with upgrade_cat_list().
+ *
+ * @param [out] version the version or 0 if no delta has been applied.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+get_cat_list_version (unsigned long *version);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,595 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file service_category_bench.c
+ * @brief The micro-benchmarks of the category list navigation used by the
+ *        gadget UI: upgrading the category DB with a delta file, loading and
+ *        resetting a category list with and without a preceding update of the
+ *        DB, walking the whole list depth-first or flat, looking categories up
+ *        by ID, querying the descendants of a top-level category and searching
+ *        category names as they are typed in synthetic category DBs of 100 to
+ *        20000 categories kept on a tmpfs. A walk visits a shared subcategory
+ *        once per path leading to it, and the iterator is moved back to the
+ *        first category before a walk outside of the timer. The allocations
+ *        made by SQLite are not counted.
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "app_err.h"
+#include "bench.h"
+#include "logger.h"
+#include "service_category.h"
+#include "service_category_gen.h"
+
+GLOBAL_LOGGER;
+
+/** The delta file applied by the upgrade benchmarks. */
+#define DELTA_PATH "/dev/shm/service_category_bench.delta"
+
+/** The number of categories visited by the last walk. */
+static unsigned long visited;
+
+/** The hierarchical category list used by the benchmarks. */
+static cat_list *cl = NULL;
+
+/** The flat category list used by the benchmarks. */
+static cat_list *flat_cl = NULL;
+
+static void
+setup_cat_list (const struct bench *b)
+{
+  struct cat_gen_param p = {
+    .count = b->arg1,
+    .fanout = b->arg2,
+    .shared_percent = b->variant,
+  };
+  char *sql;
+  int rc;
+
+  unlink (CATEGORY_LIST_DB);
+  if ((rc = gen_cat_list_sql (&sql, &p)))
+    {
+      die_bench ("gen_cat_list_sql", rc);
+    }
+  rc = update_cat_list (sql);
+  free (sql);
+  if (rc)
+    {
+      die_bench ("update_cat_list", rc);
+    }
+
+  if ((rc = load_cat_list (&cl)))
+    {
+      die_bench ("load_cat_list", rc);
+    }
+  if ((rc = load_flat_cat_list (&flat_cl)))
+    {
+      die_bench ("load_flat_cat_list", rc);
+    }
+}
+
+static void
+teardown_cat_list (const struct bench *b)
+{
+  destroy_cat_list (&cl);
+  destroy_cat_list (&flat_cl);
+}
+
+static void
+bench_load_cat_list (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      cat_list *loaded;
+      int rc;
+
+      if ((rc = load_cat_list (&loaded)))
+	{
+	  die_bench ("load_cat_list", rc);
+	}
+      bench_sink = (uintptr_t) loaded;
+      destroy_cat_list (&loaded);
+    }
+}
+
+static void
+bench_reset (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((rc = reset (cl)))
+	{
+	  die_bench ("reset", rc);
+	}
+    }
+}
+
+static void
+bench_reset_after_update (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      stop_bench_timer ();
+      if ((rc = update_cat_list ("update category_list"
+				 " set cat_name = cat_name where cat_id = 1")))
+	{
+	  die_bench ("update_cat_list", rc);
+	}
+      start_bench_timer ();
+
+      if ((rc = reset (cl)))
+	{
+	  die_bench ("reset", rc);
+	}
+    }
+}
+
+/** The number of category IDs resolved at once as in a scan. */
+#define CAT_ID_BATCH 64
+
+static void
+bench_get_cat_by_id (const struct bench *b, uint64_t n)
+{
+  struct cat c;
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((rc = get_cat_by_id (cl, 1 + i * 2654435761UL % b->arg1, &c)))
+	{
+	  die_bench ("get_cat_by_id", rc);
+	}
+      bench_sink += (uintptr_t) c.name;
+    }
+}
+
+static void
+bench_get_cats_by_id (const struct bench *b, uint64_t n)
+{
+  unsigned long ids[CAT_ID_BATCH];
+  struct cat cats[CAT_ID_BATCH];
+  uint64_t i;
+
+  for (i = 0; i < CAT_ID_BATCH; i++)
+    {
+      ids[i] = 1 + i * 2654435761UL % b->arg1;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      if (get_cats_by_id (cl, ids, CAT_ID_BATCH, cats) != CAT_ID_BATCH)
+	{
+	  die_bench ("get_cats_by_id", ERR_RANGE);
+	}
+      bench_sink += (uintptr_t) cats[i % CAT_ID_BATCH].name;
+    }
+}
+
+/** The query typed by the search benchmarks one keystroke at a time. */
+#define TYPED_QUERY "category 1234"
+
+/** The number of matches shown by a search as in the gadget UI. */
+#define MAX_MATCHES 20
+
+/**
+ * Searches every prefix of TYPED_QUERY in turn as if the query is typed so
+ * that an operation is one keystroke.
+ */
+static void
+bench_type_query (uint64_t n, enum cat_search_mode mode)
+{
+  char query[] = TYPED_QUERY;
+  struct cat matches[MAX_MATCHES];
+  size_t count;
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      size_t len = 1 + i % (sizeof (query) - 1);
+      char c = query[len];
+
+      query[len] = '\0';
+      if ((rc = search_cats (cl, query, mode, matches, MAX_MATCHES, &count)))
+	{
+	  die_bench ("search_cats", rc);
+	}
+      query[len] = c;
+      bench_sink += count;
+    }
+}
+
+static void
+bench_type_prefix (const struct bench *b, uint64_t n)
+{
+  bench_type_query (n, CAT_SEARCH_PREFIX);
+}
+
+static void
+bench_type_substring (const struct bench *b, uint64_t n)
+{
+  bench_type_query (n, CAT_SEARCH_SUBSTRING);
+}
+
+static void
+bench_search_after_update (const struct bench *b, uint64_t n)
+{
+  struct cat matches[MAX_MATCHES];
+  size_t count;
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      stop_bench_timer ();
+      if ((rc = update_cat_list ("update category_list"
+				 " set cat_name = cat_name where cat_id = 1")))
+	{
+	  die_bench ("update_cat_list", rc);
+	}
+      if ((rc = reset (cl)))
+	{
+	  die_bench ("reset", rc);
+	}
+      start_bench_timer ();
+
+      if ((rc = search_cats (cl, "c", CAT_SEARCH_PREFIX, matches,
+			     MAX_MATCHES, &count)))
+	{
+	  die_bench ("search_cats", rc);
+	}
+      bench_sink += count;
+    }
+}
+
+static void
+bench_get_cat_path (const struct bench *b, uint64_t n)
+{
+  struct cat path[MAX_MATCHES];
+  size_t len;
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((rc = get_cat_path (cl, b->arg1 - i % b->arg2, path, MAX_MATCHES,
+			      &len)))
+	{
+	  die_bench ("get_cat_path", rc);
+	}
+      bench_sink += len;
+    }
+}
+
+static void
+bench_get_descendants (const struct bench *b, uint64_t n)
+{
+  const unsigned long *ids;
+  size_t count;
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((rc = get_descendants (cl, 1, &ids, &count)))
+	{
+	  die_bench ("get_descendants", rc);
+	}
+      bench_sink += count;
+    }
+}
+
+static void
+bench_is_descendant (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((rc = is_descendant (cl, b->arg1, 1)) > 0)
+	{
+	  die_bench ("is_descendant", rc);
+	}
+      bench_sink += rc;
+    }
+}
+
+static void
+bench_closure_after_update (const struct bench *b, uint64_t n)
+{
+  const unsigned long *ids;
+  size_t count;
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      stop_bench_timer ();
+      if ((rc = update_cat_list ("update category_list"
+				 " set cat_name = cat_name where cat_id = 1")))
+	{
+	  die_bench ("update_cat_list", rc);
+	}
+      if ((rc = reset (cl)))
+	{
+	  die_bench ("reset", rc);
+	}
+      start_bench_timer ();
+
+      if ((rc = get_descendants (cl, 1, &ids, &count)))
+	{
+	  die_bench ("get_descendants", rc);
+	}
+      bench_sink += count;
+    }
+}
+
+/**
+ * Visits every category of a hierarchical list depth-first using only next(),
+ * go_sub() and go_sup().
+ *
+ * @param [in] walked the list whose internal iterator is before or over the
+ *                    first top-level category.
+ *
+ * @return the number of categories visited.
+ */
+static unsigned long
+walk_depth_first (cat_list *walked)
+{
+  unsigned long count = 0;
+  int rc = (get_cat (walked) == NULL ? next (walked) : -1);
+
+  while (1)
+    {
+      if (rc == -1)
+	{
+	  count++;
+	  bench_sink = get_cat (walked)->id;
+	  if ((rc = go_sub (walked)) == -1)
+	    {
+	      continue;
+	    }
+	  if (rc != 0)
+	    {
+	      die_bench ("go_sub", rc);
+	    }
+	  rc = next (walked);
+	}
+      else if (rc == 0)
+	{
+	  if ((rc = go_sup (walked)) == 0)
+	    {
+	      break;
+	    }
+	  if (rc != -1)
+	    {
+	      die_bench ("go_sup", rc);
+	    }
+	  rc = next (walked);
+	}
+      else
+	{
+	  die_bench ("next", rc);
+	}
+    }
+
+  return count;
+}
+
+/**
+ * Visits every category of a flat list using only next().
+ *
+ * @param [in] walked the list whose internal iterator is before or over the
+ *                    first category.
+ *
+ * @return the number of categories visited.
+ */
+static unsigned long
+walk_flat (cat_list *walked)
+{
+  unsigned long count = 0;
+  int rc = (get_cat (walked) == NULL ? next (walked) : -1);
+
+  for (; rc == -1; rc = next (walked))
+    {
+      count++;
+      bench_sink = get_cat (walked)->id;
+    }
+  if (rc != 0)
+    {
+      die_bench ("next", rc);
+    }
+
+  return count;
+}
+
+/**
+ * Moves the internal iterator of a walked list back to the first (top-level)
+ * category.
+ *
+ * @param [in] walked the list to rewind.
+ */
+static void
+rewind_walk (cat_list *walked)
+{
+  int rc;
+
+  while ((rc = go_sup (walked)) == -1);
+  if (rc != 0)
+    {
+      die_bench ("go_sup", rc);
+    }
+  while ((rc = prev (walked)) == -1);
+  if (rc != 0)
+    {
+      die_bench ("prev", rc);
+    }
+}
+
+static void
+bench_walk (const struct bench *b, uint64_t n, cat_list *walked,
+	    unsigned long (*walk) (cat_list *walked))
+{
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      stop_bench_timer ();
+      rewind_walk (walked);
+      start_bench_timer ();
+
+      visited = walk (walked);
+
+      stop_bench_timer ();
+      if (visited < b->arg1)
+	{
+	  die_bench ("walk", ERR_INVALID_STATE);
+	}
+      start_bench_timer ();
+    }
+}
+
+static void
+bench_walk_depth_first (const struct bench *b, uint64_t n)
+{
+  bench_walk (b, n, cl, walk_depth_first);
+}
+
+static void
+bench_walk_flat (const struct bench *b, uint64_t n)
+{
+  bench_walk (b, n, flat_cl, walk_flat);
+}
+
+static void
+setup_delta (const struct bench *b)
+{
+  struct cat_gen_param p = {
+    .count = b->arg1,
+    .fanout = b->arg2,
+    .shared_percent = b->variant,
+  };
+  FILE *out;
+  int rc;
+
+  if ((out = fopen (DELTA_PATH, "w")) == NULL)
+    {
+      die_bench ("fopen", ERR_UPGRADE_CATEGORY_LIST);
+    }
+  rc = write_cat_list_delta (out, &p);
+  if (fclose (out) || rc)
+    {
+      die_bench ("write_cat_list_delta", ERR_UPGRADE_CATEGORY_LIST);
+    }
+}
+
+static void
+teardown_delta (const struct bench *b)
+{
+  unlink (DELTA_PATH);
+}
+
+static void
+bench_upgrade_cat_list (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      stop_bench_timer ();
+      unlink (CATEGORY_LIST_DB);
+      start_bench_timer ();
+
+      if ((rc = upgrade_cat_list (DELTA_PATH)))
+	{
+	  die_bench ("upgrade_cat_list", rc);
+	}
+    }
+}
+
+/** Declares a benchmark of a synthetic category DB with 10% shared. */
+#define CAT_LIST_BENCH(name, run, count, fanout)		\
+  {name "/cats=" #count "/fanout=" #fanout, setup_cat_list, run,	\
+   count, fanout, 10, teardown_cat_list}
+
+/** Declares a benchmark of applying a synthetic delta with 10% shared. */
+#define DELTA_BENCH(name, run, count, fanout)			\
+  {name "/cats=" #count "/fanout=" #fanout, setup_delta, run,		\
+   count, fanout, 10, teardown_delta}
+
+/** The benchmarks. */
+static const struct bench benches[] = {
+  DELTA_BENCH ("UpgradeCatList", bench_upgrade_cat_list, 1000, 8),
+  DELTA_BENCH ("UpgradeCatList", bench_upgrade_cat_list, 4000, 8),
+  CAT_LIST_BENCH ("LoadCatList", bench_load_cat_list, 100, 8),
+  CAT_LIST_BENCH ("LoadCatList", bench_load_cat_list, 1000, 8),
+  CAT_LIST_BENCH ("LoadCatList", bench_load_cat_list, 4000, 8),
+  CAT_LIST_BENCH ("Reset", bench_reset, 100, 8),
+  CAT_LIST_BENCH ("Reset", bench_reset, 1000, 8),
+  CAT_LIST_BENCH ("Reset", bench_reset, 4000, 8),
+  CAT_LIST_BENCH ("ResetAfterUpdate", bench_reset_after_update, 100, 8),
+  CAT_LIST_BENCH ("ResetAfterUpdate", bench_reset_after_update, 1000, 8),
+  CAT_LIST_BENCH ("ResetAfterUpdate", bench_reset_after_update, 4000, 8),
+  CAT_LIST_BENCH ("WalkDepthFirst", bench_walk_depth_first, 100, 8),
+  CAT_LIST_BENCH ("WalkDepthFirst", bench_walk_depth_first, 1000, 8),
+  CAT_LIST_BENCH ("WalkDepthFirst", bench_walk_depth_first, 4000, 8),
+  CAT_LIST_BENCH ("WalkDepthFirst", bench_walk_depth_first, 4000, 64),
+  CAT_LIST_BENCH ("WalkDepthFirst", bench_walk_depth_first, 1000, 1),
+  CAT_LIST_BENCH ("WalkFlat", bench_walk_flat, 100, 8),
+  CAT_LIST_BENCH ("WalkFlat", bench_walk_flat, 1000, 8),
+  CAT_LIST_BENCH ("WalkFlat", bench_walk_flat, 4000, 8),
+  CAT_LIST_BENCH ("GetCatById", bench_get_cat_by_id, 4000, 8),
+  CAT_LIST_BENCH ("GetCatsById", bench_get_cats_by_id, 4000, 8),
+  CAT_LIST_BENCH ("TypePrefix", bench_type_prefix, 4000, 8),
+  CAT_LIST_BENCH ("TypePrefix", bench_type_prefix, 20000, 8),
+  CAT_LIST_BENCH ("TypeSubstring", bench_type_substring, 4000, 8),
+  CAT_LIST_BENCH ("TypeSubstring", bench_type_substring, 20000, 8),
+  CAT_LIST_BENCH ("SearchAfterUpdate", bench_search_after_update, 4000, 8),
+  CAT_LIST_BENCH ("SearchAfterUpdate", bench_search_after_update, 20000, 8),
+  CAT_LIST_BENCH ("GetCatPath", bench_get_cat_path, 20000, 8),
+  CAT_LIST_BENCH ("ClosureAfterUpdate", bench_closure_after_update, 1000, 8),
+  CAT_LIST_BENCH ("ClosureAfterUpdate", bench_closure_after_update, 4000, 8),
+  CAT_LIST_BENCH ("GetDescendants", bench_get_descendants, 1000, 8),
+  CAT_LIST_BENCH ("GetDescendants", bench_get_descendants, 4000, 8),
+  CAT_LIST_BENCH ("IsDescendant", bench_is_descendant, 4000, 8),
+};
+
+int
+main (int argc, char **argv, char **envp)
+{
+  SETUP_LOGGER ("/dev/stderr", errtostr);
+  set_log_level (LOG_LEVEL_ERR);
+
+  run_benches (benches, sizeof (benches) / sizeof (*benches), argc, argv);
+
+  destroy_cat_list_cache ();
+  unlink (CATEGORY_LIST_DB);
+
+  exit (EXIT_SUCCESS);
+}
@@ -0,0 +1,165 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file service_category_gen.c
+ * @brief The implementation of the synthetic category DB generator.
+ ****************************************************************************/
+
+#include <stdlib.h>
+#include "app_err.h"
+#include "logger.h"
+#include "service_category_gen.h"
+
+/**
+ * Gets the primary parent of a non-top-level category. The children of
+ * category P are the categories P * fanout + 1 to P * fanout + fanout, and
+ * the top-level categories are 1 to fanout.
+ *
+ * @param [in] id the ID of the category.
+ * @param [in] fanout the number of subcategories of a non-leaf category.
+ *
+ * @return the ID of the parent.
+ */
+static unsigned long
+get_parent (unsigned long id, unsigned long fanout)
+{
+  return (id - 1) / fanout;
+}
+
+/**
+ * Decides whether a category has a second parent. The decision is a hash of
+ * the ID so that the same DB is always generated.
+ *
+ * @param [in] id the ID of the category.
+ * @param [in] shared_percent the percentage of shared categories.
+ *
+ * @return non-zero if the category has a second parent.
+ */
+static int
+is_shared (unsigned long id, unsigned int shared_percent)
+{
+  return (id * 2654435761UL) % 4294967296UL % 100 < shared_percent;
+}
+
+/** The formats of the records of a synthetic category DB. */
+struct cat_gen_format
+{
+  const char *header; /**< The text before the records. */
+  const char *cat; /**< The format of a category record (ID, ID). */
+  const char *structure; /**< The format of a structure record. */
+  const char *footer; /**< The text after the records. */
+};
+
+/** The SQL statements for update_cat_list(). */
+static const struct cat_gen_format sql_format = {
+  "begin;\n"
+  "delete from category_structure;\n"
+  "delete from category_list;\n",
+  "insert into category_list values (%lu, 'Category %lu');\n",
+  "insert into category_structure values (%lu, %lu);\n",
+  "commit;\n",
+};
+
+/** The delta file for upgrade_cat_list(). */
+static const struct cat_gen_format delta_format = {
+  "version\t0\t1\n",
+  "category\t%lu\tCategory %lu\n",
+  "structure\t%lu\t%lu\n",
+  "",
+};
+
+static int
+write_cat_list (FILE *out, const struct cat_gen_param *p,
+		const struct cat_gen_format *f)
+{
+  unsigned long id;
+
+  if (p->count == 0 || p->fanout == 0)
+    {
+      l->APP_ERR (ERR_RANGE, "Invalid synthetic category DB shape");
+      return ERR_RANGE;
+    }
+
+  fputs (f->header, out);
+
+  for (id = 1; id <= p->count; id++)
+    {
+      fprintf (out, f->cat, id, id);
+    }
+
+  for (id = p->fanout + 1; id <= p->count; id++)
+    {
+      unsigned long parent = get_parent (id, p->fanout);
+
+      fprintf (out, f->structure, parent, id);
+
+      /* The next category of the parent level is the second parent. */
+      if (parent + 1 < id && is_shared (id, p->shared_percent))
+	{
+	  fprintf (out, f->structure, parent + 1, id);
+	}
+    }
+
+  fputs (f->footer, out);
+
+  if (ferror (out))
+    {
+      l->ERR ("Cannot write synthetic category DB");
+      return ERR_MEM;
+    }
+
+  return ERR_SUCCESS;
+}
+
+int
+write_cat_list_sql (FILE *out, const struct cat_gen_param *p)
+{
+  return write_cat_list (out, p, &sql_format);
+}
+
+int
+write_cat_list_delta (FILE *out, const struct cat_gen_param *p)
+{
+  return write_cat_list (out, p, &delta_format);
+}
+
+int
+gen_cat_list_sql (char **sql, const struct cat_gen_param *p)
+{
+  size_t sql_size;
+  FILE *out;
+  int rc;
+
+  if ((out = open_memstream (sql, &sql_size)) == NULL)
+    {
+      l->SYS_ERR ("Cannot open memory stream");
+      return ERR_MEM;
+    }
+
+  rc = write_cat_list_sql (out, p);
+
+  if (fclose (out))
+    {
+      l->SYS_ERR ("Cannot close memory stream");
+      rc = ERR_MEM;
+    }
+  if (rc)
+    {
+      free (*sql);
+      *sql = NULL;
+    }
+
+  return rc;
+}
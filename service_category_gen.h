@@ -0,0 +1,94 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file service_category_gen.h
+ * @brief The generator of synthetic category DBs for tests and benchmarks.
+ *        The categories form a tree in which every non-leaf category has the
+ *        same number of subcategories, and some categories are also reused
+ *        as a subcategory by a second parent (like "Kindergarden" below both
+ *        "Private schools" and "Public schools") so that the same subtree is
+ *        reachable through several paths. The generated data are either SQL
+ *        statements that can be given to update_cat_list() or to the sqlite3
+ *        shell or a delta file that can be given to upgrade_cat_list().
+ ****************************************************************************/
+
+#ifndef SERVICE_CATEGORY_GEN_H
+#define SERVICE_CATEGORY_GEN_H
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The shape of a synthetic category DB. */
+struct cat_gen_param
+{
+  unsigned long count; /**< The number of categories. */
+  unsigned long fanout; /**<
+			 * The number of top-level categories and of the
+			 * subcategories of a non-leaf category.
+			 */
+  unsigned int shared_percent; /**<
+				* The percentage of the non-top-level
+				* categories that have a second parent.
+				*/
+};
+
+/**
+ * Writes the SQL statements that replace the content of a category DB with
+ * synthetic categories. The categories have IDs 1 to count and are named
+ * "Category ID". The parent of a category always has a smaller ID than the
+ * category so that the structure has no cycle.
+ *
+ * @param [in] out where the SQL statements are written.
+ * @param [in] p the shape of the category DB whose count and fanout must not
+ *               be 0.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+write_cat_list_sql (FILE *out, const struct cat_gen_param *p);
+
+/**
+ * Works like write_cat_list_sql() except that a delta file upgrading an empty
+ * category DB from version 0 to version 1 is written instead.
+ *
+ * @param [in] out where the delta file is written.
+ * @param [in] p the shape of the category DB.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+write_cat_list_delta (FILE *out, const struct cat_gen_param *p);
+
+/**
+ * Works like write_cat_list_sql() except that the SQL statements are
+ * returned as a string.
+ *
+ * @param [out] sql a pointer to a dynamically allocated string that should be
+ *                  freed with free().
+ * @param [in] p the shape of the category DB.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+gen_cat_list_sql (char **sql, const struct cat_gen_param *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERVICE_CATEGORY_GEN_H */
@@ -19,6 +19,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "app_err.h"
 #include "logger.h"
 #include "service_category.h"
@@ -32,9 +33,230 @@
 #define TABLE_CATEGORY_STRUCTURE "category_structure"
 #define COLUMN_CAT_ID "cat_id"
 #define COLUMN_SUBCAT_ID "subcat_id"
+#define TABLE_VERSION "category_version"
+
+/** The delta file given to upgrade_cat_list(). */
+#define DELTA_PATH "./service_category_test.delta"
 
 GLOBAL_LOGGER;
 
+static void
+write_delta (const char *content)
+{
+  FILE *f = fopen (DELTA_PATH, "w");
+
+  assert (f != NULL);
+  assert (fputs (content, f) >= 0);
+  assert (fclose (f) == 0);
+}
+
+static int
+count_flat_cat (void)
+{
+  cat_list *flat_cl;
+  int count = 0;
+
+  assert (load_flat_cat_list (&flat_cl) == 0);
+  while (next (flat_cl) == -1)
+    {
+      count++;
+    }
+  destroy_cat_list (&flat_cl);
+
+  return count;
+}
+
+static void
+test_lookup (const cat_list *cl)
+{
+  unsigned long ids[] = {7, 10, 0, 7, 9};
+  struct cat cats[5];
+  struct cat c;
+
+  assert (get_cat_by_id (cl, 0, &c) == 0);
+  assert (c.id == 0);
+  assert (strcmp (c.name, "NULL") == 0);
+  assert (get_cat_by_id (cl, 9, &c) == 0);
+  assert (c.id == 9);
+  assert (strcmp (c.name, "Card Games") == 0);
+  assert (get_cat_by_id (cl, 10, &c) == ERR_RANGE);
+
+  assert (get_cats_by_id (cl, ids, 5, cats) == 4);
+  assert (cats[0].id == 7 && strcmp (cats[0].name, "Public School") == 0);
+  assert (cats[1].id == 10 && cats[1].name == NULL);
+  assert (cats[2].id == 0 && strcmp (cats[2].name, "NULL") == 0);
+  assert (cats[3].id == 7 && cats[3].name == cats[0].name);
+  assert (cats[4].id == 9 && strcmp (cats[4].name, "Card Games") == 0);
+  assert (get_cats_by_id (cl, ids, 0, cats) == 0);
+}
+
+static void
+test_search (const cat_list *cl)
+{
+  struct cat matches[10];
+  size_t count;
+
+  assert (search_cats (cl, "eat", CAT_SEARCH_PREFIX, matches, 10, &count)
+	  == 0);
+  assert (count == 1);
+  assert (matches[0].id == 1);
+  assert (strcmp (matches[0].name, "Eateries") == 0);
+
+  assert (search_cats (cl, "sch", CAT_SEARCH_PREFIX, matches, 10, &count)
+	  == 0);
+  assert (count == 4);
+  assert (matches[0].id == 2 && matches[1].id == 5 && matches[2].id == 6
+	  && matches[3].id == 7);
+  assert (strcmp (matches[2].name, "Private School") == 0);
+
+  /* the count goes beyond the matches received */
+  assert (search_cats (cl, "GAMES", CAT_SEARCH_PREFIX, matches, 2, &count)
+	  == 0);
+  assert (count == 3);
+  assert (matches[0].id == 3 && matches[1].id == 8);
+
+  assert (search_cats (cl, "ool", CAT_SEARCH_PREFIX, matches, 10, &count)
+	  == 0);
+  assert (count == 0);
+  assert (search_cats (cl, "ool", CAT_SEARCH_SUBSTRING, matches, 10, &count)
+	  == 0);
+  assert (count == 4);
+  assert (matches[0].id == 2 && matches[3].id == 7);
+  assert (search_cats (cl, "DEN", CAT_SEARCH_SUBSTRING, matches, 10, &count)
+	  == 0);
+  assert (count == 1);
+  assert (matches[0].id == 4);
+
+  assert (search_cats (cl, "", CAT_SEARCH_PREFIX, matches, 0, &count) == 0);
+  assert (count == 10);
+  assert (search_cats (cl, "", CAT_SEARCH_SUBSTRING, matches, 0, &count)
+	  == 0);
+  assert (count == 10);
+
+  /* the parent with the lowest ID is followed */
+  assert (get_cat_path (cl, 4, matches, 10, &count) == 0);
+  assert (count == 2);
+  assert (matches[0].id == 2 && matches[1].id == 6);
+  assert (strcmp (matches[1].name, "Private School") == 0);
+  assert (get_cat_path (cl, 5, matches, 1, &count) == 0);
+  assert (count == 2);
+  assert (matches[0].id == 2);
+  assert (get_cat_path (cl, 2, matches, 10, &count) == 0);
+  assert (count == 0);
+  assert (get_cat_path (cl, 10, matches, 10, &count) == ERR_RANGE);
+}
+
+static void
+test_closure (const cat_list *cl)
+{
+  const unsigned long *ids;
+  size_t count;
+
+  assert (get_descendants (cl, 2, &ids, &count) == 0);
+  assert (count == 4);
+  assert (ids[0] == 4 && ids[1] == 5 && ids[2] == 6 && ids[3] == 7);
+  assert (get_descendants (cl, 6, &ids, &count) == 0);
+  assert (count == 2);
+  assert (ids[0] == 4 && ids[1] == 5);
+  assert (get_descendants (cl, 4, &ids, &count) == 0);
+  assert (count == 0);
+  assert (get_descendants (cl, 10, &ids, &count) == ERR_RANGE);
+
+  assert (is_descendant (cl, 4, 2) == -1);
+  assert (is_descendant (cl, 5, 7) == -1);
+  assert (is_descendant (cl, 2, 4) == 0);
+  assert (is_descendant (cl, 8, 2) == 0);
+  assert (is_descendant (cl, 2, 2) == 0);
+  assert (is_descendant (cl, 10, 2) == 0);
+  assert (is_descendant (cl, 4, 10) == 0);
+}
+
+static void
+test_upgrade (void)
+{
+  unsigned long version;
+  cat_list *cl;
+  const struct cat *cur_cat;
+  struct cat c;
+
+  update_cat_list ("delete from " TABLE_CATEGORY_LIST ";"
+		   "delete from " TABLE_CATEGORY_STRUCTURE ";"
+		   "delete from " TABLE_VERSION ";");
+  assert (get_cat_list_version (&version) == 0);
+  assert (version == 0);
+
+  /* a delta must start with the version header */
+  write_delta ("category\t1\tRestaurants\n");
+  assert (upgrade_cat_list (DELTA_PATH) == ERR_PARSE_DATA);
+  assert (count_flat_cat () == 0);
+
+  write_delta ("# initial categories\n"
+	       "version\t0\t1\n"
+	       "\n"
+	       "category\t1\tRestaurants\n"
+	       "category\t2\tSchools\n"
+	       "category\t3\tKindergarden\r\n"
+	       "structure\t2\t3\n");
+  assert (upgrade_cat_list (DELTA_PATH) == 0);
+  assert (get_cat_list_version (&version) == 0);
+  assert (version == 1);
+
+  assert (load_cat_list (&cl) == 0);
+  assert (next (cl) == -1);
+  assert (next (cl) == -1);
+  assert (go_sub (cl) == -1);
+  cur_cat = get_cat (cl);
+  assert (cur_cat->id == 3);
+  assert (strcmp (cur_cat->name, "Kindergarden") == 0);
+  destroy_cat_list (&cl);
+
+  /* out-of-order deltas are rejected */
+  assert (upgrade_cat_list (DELTA_PATH) == ERR_CATEGORY_VERSION);
+  write_delta ("version\t2\t3\n"
+	       "category\t4\tGames\n");
+  assert (upgrade_cat_list (DELTA_PATH) == ERR_CATEGORY_VERSION);
+  assert (count_flat_cat () == 3);
+
+  /* a failing delta is not applied at all */
+  write_delta ("version\t1\t2\n"
+	       "category\t4\tGames\n"
+	       "structure\t4\tfive\n");
+  assert (upgrade_cat_list (DELTA_PATH) == ERR_PARSE_DATA);
+  write_delta ("version\t1\t2\n"
+	       "category\t4\tGames\n"
+	       "category\t1\tRestaurants\n");
+  assert (upgrade_cat_list (DELTA_PATH) == ERR_UPGRADE_CATEGORY_LIST);
+  assert (count_flat_cat () == 3);
+  assert (get_cat_list_version (&version) == 0);
+  assert (version == 1);
+
+  write_delta ("version\t1\t2\n"
+	       "category\t4\tGames\n");
+  assert (upgrade_cat_list (DELTA_PATH) == 0);
+  assert (count_flat_cat () == 4);
+  assert (get_cat_list_version (&version) == 0);
+  assert (version == 2);
+
+  /* too sparse IDs are still found */
+  write_delta ("version\t2\t3\n"
+	       "category\t100000\tSparse\n"
+	       "structure\t4\t100000\n");
+  assert (upgrade_cat_list (DELTA_PATH) == 0);
+  assert (load_cat_list (&cl) == 0);
+  assert (get_cat_by_id (cl, 100000, &c) == 0);
+  assert (strcmp (c.name, "Sparse") == 0);
+  assert (get_cat_by_id (cl, 3, &c) == 0);
+  assert (strcmp (c.name, "Kindergarden") == 0);
+  assert (get_cat_by_id (cl, 5, &c) == ERR_RANGE);
+  assert (is_descendant (cl, 100000, 4) == -1);
+  destroy_cat_list (&cl);
+
+  assert (upgrade_cat_list ("./nonexistent.delta")
+	  == ERR_UPGRADE_CATEGORY_LIST);
+
+  unlink (DELTA_PATH);
+}
+
 int
 main (int argc, char **argv, char **envp)
 {
@@ -298,8 +520,78 @@ main (int argc, char **argv, char **envp)
   assert (cur_cat->id == i);
   assert (strcmp (cur_cat->name, expected_categories[i]) == 0);
 
+  /* reset from a subcategory goes back before the first top-level category */
+  assert (prev (cl) == -1);
+  assert (go_sub (cl) == -1);
+  assert (go_sub (cl) == -1);
+  cur_cat = get_cat (cl);
+  i = 4;
+  assert (cur_cat->id == i);
+  assert (reset (cl) == 0);
+  assert (get_cat (cl) == NULL);
+  assert (!go_sup (cl));
+  assert (next (cl) == -1);
+  cur_cat = get_cat (cl);
+  i = 0;
+  assert (cur_cat->id == i);
+  assert (strcmp (cur_cat->name, expected_categories[i]) == 0);
+
+  /* an update is seen by every list upon reset but not before */
+  update_cat_list ("update " TABLE_CATEGORY_LIST
+		   " set " COLUMN_CAT_NAME " = 'Eateries'"
+		   " where " COLUMN_CAT_ID " = 1;");
+  assert (next (cl) == -1);
+  cur_cat = get_cat (cl);
+  assert (strcmp (cur_cat->name, expected_categories[1]) == 0);
+  assert (reset (cl) == 0);
+  assert (next (cl) == -1);
+  assert (next (cl) == -1);
+  cur_cat = get_cat (cl);
+  assert (strcmp (cur_cat->name, "Eateries") == 0);
+  assert (reset (flat_cl) == 0);
+  assert (next (flat_cl) == -1);
+  assert (next (flat_cl) == -1);
+  cur_cat = get_cat (flat_cl);
+  assert (strcmp (cur_cat->name, "Eateries") == 0);
+
+  /* a reset without an update keeps the data */
+  assert (reset (cl) == 0);
+  assert (next (cl) == -1);
+  assert (next (cl) == -1);
+  cur_cat = get_cat (cl);
+  assert (strcmp (cur_cat->name, "Eateries") == 0);
+
+  test_lookup (cl);
+  test_lookup (flat_cl);
+  test_closure (cl);
+  test_closure (flat_cl);
+  test_search (cl);
+  test_search (flat_cl);
+
+  /* recreating a table, which drops its triggers, is seen upon reset */
+  assert (update_cat_list ("create temporary table old_list as"
+			   " select * from " TABLE_CATEGORY_LIST ";"
+			   "drop table " TABLE_CATEGORY_LIST ";"
+			   "create table " TABLE_CATEGORY_LIST " ("
+			   COLUMN_CAT_ID " integer primary key not null,"
+			   COLUMN_CAT_NAME " text not null);"
+			   "insert into " TABLE_CATEGORY_LIST
+			   " select " COLUMN_CAT_ID ", case " COLUMN_CAT_ID
+			   " when 1 then 'Diners' else " COLUMN_CAT_NAME
+			   " end from old_list;"
+			   "drop table old_list;") == 0);
+  assert (reset (cl) == 0);
+  assert (next (cl) == -1);
+  assert (next (cl) == -1);
+  cur_cat = get_cat (cl);
+  assert (strcmp (cur_cat->name, "Diners") == 0);
+
   destroy_cat_list (&flat_cl);
   destroy_cat_list (&cl);
 
+  test_upgrade ();
+
+  destroy_cat_list_cache ();
+
   exit (EXIT_SUCCESS);
 }
@@ -25,6 +25,7 @@
 #include "logger.h"
 #include "service_list.h"
 #include "service_inquiry.h"
+#include "sde_stats.h"
 
 /**
  * Converts the byte order of 64-bits data to a network byte order.
@@ -70,30 +71,39 @@ static service_list *sl = NULL;
  * @param [out] curr_mod_time the time of the latest DB update (equals to
  *                            last_mod_time unless the DB has since been
  *                            updated)
+ * @param [out] checked the time the DB update was checked as given by
+ *                      get_sde_stats_time() to time a cache rebuild.
  *
  * @return NULL if the DB has since not been updated or the updated service list.
  */
 static service_list *
-get_service_list (uint64_t last_mod_time, uint64_t *curr_mod_time)
+get_service_list (uint64_t last_mod_time, uint64_t *curr_mod_time,
+		  uint64_t *checked)
 {
   int rc;
+  uint64_t start = get_sde_stats_time ();
 
   if (sl == NULL)
     {
       if ((rc = load_service_list (&sl)))
 	{
+	  SDE_COUNT (SDE_SQLITE_NS, get_sde_stats_time () - start);
 	  l->APP_ERR (rc, "Cannot load service list");
 	  return NULL;
 	}
     }
 
   *curr_mod_time = get_last_modification_time (sl);
+  *checked = record_sde_stage (SDE_STAGE_CACHE_CHECK, start);
+  SDE_PROBE (cache__checked, last_mod_time, *curr_mod_time);
 
   if (last_mod_time != *curr_mod_time)
     {
       last_mod_time = *curr_mod_time;
 
-      if ((rc = reload_service_list (sl)))
+      rc = reload_service_list (sl);
+      SDE_COUNT (SDE_SQLITE_NS, get_sde_stats_time () - start);
+      if (rc)
 	{
 	  l->APP_ERR (rc, "Cannot reload service list");
 	  return NULL;
@@ -102,6 +112,7 @@ get_service_list (uint64_t last_mod_time, uint64_t *curr_mod_time)
       return sl;
     }
 
+  SDE_COUNT (SDE_SQLITE_NS, get_sde_stats_time () - start);
   return NULL;
 }
 
@@ -172,12 +183,16 @@ get_metadata_response (uint32_t seq,
   struct sde_metadata_data *ptr_d;
   size_t ptr_d_size;
   uint64_t curr_mod_time;
-  service_list *sl = get_service_list (last_mod_time, &curr_mod_time);
+  uint64_t start = get_sde_stats_time ();
+  uint64_t checked;
+  service_list *sl = get_service_list (last_mod_time, &curr_mod_time,
+				       &checked);
   if (sl != NULL)
     {
       int rc;
 
       l->INFO ("Cache miss");
+      SDE_COUNT (SDE_CACHE_MISSES, 1);
 
       last_mod_time = curr_mod_time;
       if (metadata != NULL)
@@ -190,10 +205,15 @@ get_metadata_response (uint32_t seq,
 	  l->APP_ERR (rc, "Cannot get metadata from service list");
 	  return ERR_GET_METADATA_PACKETS;
 	}
+      SDE_COUNT (SDE_CACHE_REBUILDS, 1);
+      SDE_COUNT (SDE_CACHE_REBUILD_NS, get_sde_stats_time () - start);
+      record_sde_stage (SDE_STAGE_CACHE_REBUILD, checked);
+      SDE_PROBE (metadata__rebuilt, metadata_size);
     }
   else
     {
       l->INFO ("Cache hit");
+      SDE_COUNT (SDE_CACHE_HITS, 1);
     }
 
   ptr_m = malloc (sizeof (*ptr_m));
@@ -415,30 +435,34 @@ copy_req_service_desc (void *dst, const struct tlv_chunk *service_desc,
 /**< The cached service description. */
 static struct tlv_chunk *service_desc = NULL;
 
-int
-get_service_desc_response (uint32_t seq,
-			   struct sde_service_desc **p1,
-			   size_t *p1_size,
-			   struct sde_service_desc_data **p2,
-			   size_t *p2_size,
-			   const struct position *pos, uint32_t pos_len)
-{
-  static uint64_t last_mod_time = 0;
-  static size_t service_desc_size = 0;
+/**< The size in bytes of the cached service description. */
+static size_t service_desc_size = 0;
 
-  struct sde_service_desc *ptr_s;
-  struct sde_service_desc_data *ptr_d;
-  size_t req_service_desc_size;
-  size_t ptr_d_size;
+/**< The last modification time of the service list in the cache. */
+static uint64_t service_desc_mod_time = 0;
+
+/**
+ * Rebuilds the cached service description if the published service DB has
+ * been updated since the cache was last built.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+ensure_service_desc_cache (void)
+{
   uint64_t curr_mod_time;
-  service_list *sl = get_service_list (last_mod_time, &curr_mod_time);
+  uint64_t start = get_sde_stats_time ();
+  uint64_t checked;
+  service_list *sl = get_service_list (service_desc_mod_time, &curr_mod_time,
+				       &checked);
   if (sl != NULL)
     {
       int rc;
 
       l->INFO ("Cache miss");
+      SDE_COUNT (SDE_CACHE_MISSES, 1);
 
-      last_mod_time = curr_mod_time;
+      service_desc_mod_time = curr_mod_time;
       if (service_desc != NULL)
 	{
 	  free (service_desc);
@@ -450,33 +474,90 @@ get_service_desc_response (uint32_t seq,
 	  l->APP_ERR (rc, "Cannot get service description from service list");
 	  return ERR_GET_SERVICE_DESC_PACKETS;
 	}
+      SDE_COUNT (SDE_CACHE_REBUILDS, 1);
+      SDE_COUNT (SDE_CACHE_REBUILD_NS, get_sde_stats_time () - start);
+      record_sde_stage (SDE_STAGE_CACHE_REBUILD, checked);
+      SDE_PROBE (service_desc__rebuilt, service_desc_size);
     }
   else
     {
       l->INFO ("Cache hit");
+      SDE_COUNT (SDE_CACHE_HITS, 1);
     }
 
-  ptr_s = malloc (sizeof (*ptr_s));
+  return ERR_SUCCESS;
+}
+
+/**
+ * Creates the SERVICE_DESC packet announcing a SERVICE_DESC_DATA packet.
+ *
+ * @param [in] seq the sequence number of the sde_get_service_desc packet.
+ * @param [in] data_size the size in bytes of the SERVICE_DESC_DATA packet.
+ * @param [out] p1 a pointer to a dynamically allocated memory space containing
+ *                the SERVICE_DESC packet.
+ * @param [out] p1_size the size of p1 in bytes.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+get_service_desc_announcement (uint32_t seq, size_t data_size,
+			       struct sde_service_desc **p1, size_t *p1_size)
+{
+  struct sde_service_desc *ptr_s = malloc (sizeof (*ptr_s));
+
   if (ptr_s == NULL)
     {
       return ERR_MEM;
     }
+
+  ptr_s->c.type = htonl (SERVICE_DESC);
+  ptr_s->c.seq = htonl (seq);
+  ptr_s->size = htonl (data_size);
+  l->INFO ("SERVICE_DESC #%u packet crafted announcing %u bytes of data packet",
+	   ntohl (ptr_s->c.seq), ntohl (ptr_s->size));
+
+  *p1 = ptr_s;
+  *p1_size = sizeof (*ptr_s);
+
+  return ERR_SUCCESS;
+}
+
+int
+get_service_desc_response (uint32_t seq,
+			   struct sde_service_desc **p1,
+			   size_t *p1_size,
+			   struct sde_service_desc_data **p2,
+			   size_t *p2_size,
+			   const struct position *pos, uint32_t pos_len)
+{
+  struct sde_service_desc *ptr_s;
+  struct sde_service_desc_data *ptr_d;
+  size_t req_service_desc_size;
+  size_t ptr_s_size;
+  size_t ptr_d_size;
+  int rc;
+
+  if ((rc = ensure_service_desc_cache ()))
+    {
+      return rc;
+    }
+
   req_service_desc_size = get_req_service_desc_size (service_desc,
 						     service_desc_size,
 						     pos, pos_len);
   ptr_d_size = sizeof (*ptr_d) + req_service_desc_size;
+  if ((rc = get_service_desc_announcement (seq, ptr_d_size,
+					   &ptr_s, &ptr_s_size)))
+    {
+      return rc;
+    }
   ptr_d = malloc (ptr_d_size);
   if (ptr_d == NULL)
     {
+      free (ptr_s);
       return ERR_MEM;
     }
 
-  ptr_s->c.type = htonl (SERVICE_DESC);
-  ptr_s->c.seq = htonl (seq);
-  ptr_s->size = htonl (ptr_d_size);
-  l->INFO ("SERVICE_DESC #%u packet crafted announcing %u bytes of data packet",
-	   ntohl (ptr_s->c.seq), ntohl (ptr_s->size));
-
   ptr_d->c.type = htonl (SERVICE_DESC_DATA);
   ptr_d->c.seq = ptr_s->c.seq;
   ptr_d->size = ptr_s->size;
@@ -486,13 +567,161 @@ get_service_desc_response (uint32_t seq,
 	   ntohl (ptr_d->c.seq), ntohl (ptr_d->size));
 
   *p1 = ptr_s;
-  *p1_size = sizeof (*ptr_s);
+  *p1_size = ptr_s_size;
   *p2 = ptr_d;
   *p2_size = ptr_d_size;
 
   return ERR_SUCCESS;
 }
 
+/**
+ * Appends selected TLV chunks to a tlv_vec by referencing their values in
+ * the cache.
+ *
+ * @param [out] dst the tlv_vec to be appended.
+ * @param [in] service_desc the complete TLV chunks from which selections
+ *                          will be made.
+ * @param [in] service_desc_size the size in bytes of service_desc.
+ * @param [in] pos the selected positions.
+ * @param [in] pos_len the number of positions to be selected.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+ref_req_service_desc (struct tlv_vec *dst, const struct tlv_chunk *service_desc,
+		      size_t service_desc_size, const struct position *pos,
+		      uint32_t pos_len)
+{
+  uint32_t i = 0, j = 0;
+  const struct tlv_chunk *itr = NULL;
+
+  while ((itr = read_chunk (service_desc, service_desc_size, itr)) != NULL)
+    {
+      if (i == pos[j].pos)
+	{
+	  if (create_vec_chunk (ntohl (itr->type), ntohl (itr->length),
+				itr->value, 0, dst))
+	    {
+	      return ERR_MEM;
+	    }
+
+	  j++;
+	  if (j == pos_len)
+	    {
+	      break;
+	    }
+	}
+
+      i++;
+    }
+
+  return ERR_SUCCESS;
+}
+
+int
+get_service_desc_vec_response (uint32_t seq,
+			       struct sde_service_desc **p1,
+			       size_t *p1_size,
+			       struct tlv_vec *p2,
+			       const struct position *pos, uint32_t pos_len)
+{
+  struct sde_service_desc *ptr_s;
+  struct sde_service_desc_data d;
+  size_t ptr_s_size;
+  size_t d_size;
+  int rc;
+
+  if ((rc = ensure_service_desc_cache ()))
+    {
+      return rc;
+    }
+
+  d_size = sizeof (d) + get_req_service_desc_size (service_desc,
+						   service_desc_size,
+						   pos, pos_len);
+  if ((rc = get_service_desc_announcement (seq, d_size, &ptr_s, &ptr_s_size)))
+    {
+      return rc;
+    }
+
+  d.c.type = htonl (SERVICE_DESC_DATA);
+  d.c.seq = ptr_s->c.seq;
+  d.size = ptr_s->size;
+
+  init_vec (p2);
+  if (create_vec_raw (sizeof (d), &d, 1, p2)
+      || ref_req_service_desc (p2, service_desc, service_desc_size, pos,
+			       pos_len))
+    {
+      destroy_vec (p2);
+      free (ptr_s);
+      return ERR_MEM;
+    }
+  l->INFO ("SERVICE_DESC_DATA #%u packet crafted having %u bytes of data",
+	   ntohl (d.c.seq), ntohl (d.size));
+
+  *p1 = ptr_s;
+  *p1_size = ptr_s_size;
+
+  return ERR_SUCCESS;
+}
+
+int
+get_service_desc_cache (const struct tlv_chunk **desc, size_t *desc_size,
+			uint64_t *mod_time)
+{
+  int rc;
+
+  if ((rc = ensure_service_desc_cache ()))
+    {
+      return rc;
+    }
+
+  *desc = service_desc;
+  *desc_size = (service_desc == NULL ? 0 : service_desc_size);
+  *mod_time = service_desc_mod_time;
+
+  return ERR_SUCCESS;
+}
+
+int
+get_stats_response (uint32_t seq, struct sde_stats **p, size_t *p_size)
+{
+  struct sde_stats *ptr;
+  size_t text_size = 8192;
+  size_t text_len;
+
+  do
+    {
+      ptr = malloc (sizeof (*ptr) + text_size);
+      if (ptr == NULL)
+	{
+	  return ERR_MEM;
+	}
+
+      /* The counters may grow in between so the length is checked again */
+      text_len = format_sde_stats (ptr->data, text_size);
+      if (text_len >= text_size)
+	{
+	  free (ptr);
+	  text_size = text_len + 1;
+	  ptr = NULL;
+	}
+    }
+  while (ptr == NULL);
+
+  ptr->c.type = htonl (STATS);
+  ptr->c.seq = htonl (seq);
+  ptr->size = htonl (text_len);
+  l->INFO ("STATS #%u packet crafted containing %u bytes",
+	   ntohl (ptr->c.seq), ntohl (ptr->size));
+
+  *p = ptr;
+  *p_size = sizeof (*ptr) + text_len;
+
+  return ERR_SUCCESS;
+}
+
 void
 destroy_sde_handler_cache (void)
 {
@@ -506,6 +735,7 @@ destroy_sde_handler_cache (void)
     {
       free (service_desc);
       service_desc = NULL;
+      service_desc_size = 0;
     }
 
   if (sl != NULL)
@@ -84,6 +84,62 @@ get_service_desc_response (uint32_t seq,
 			   size_t *p2_size,
 			   const struct position *pos, uint32_t pos_len);
 
+/**
+ * Works like get_service_desc_response() except that the second response
+ * packet is created as a tlv_vec whose TLV chunk values are referenced from
+ * the cache instead of being copied. <strong>[CAUTION]</strong> The tlv_vec
+ * must be sent before another response is created or the cache is destroyed.
+ *
+ * @param [in] seq the sequence number of the sde_get_service_desc packet.
+ * @param [out] p1 a pointer to a dynamically allocated memory space containing
+ *                the response packet to be sent first.
+ * @param [out] p1_size the size of p1 in bytes.
+ * @param [out] p2 the response packet to be sent after p1 that must be freed
+ *                 with destroy_vec().
+ * @param [in] pos the position data contained in the corresponding
+ *                 sde_get_service_desc_data packet. <strong>[CAUTION]</strong>
+ *                 The caller must sort pos.
+ * @param [in] pos_len the number of positions in pos.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+get_service_desc_vec_response (uint32_t seq,
+			       struct sde_service_desc **p1,
+			       size_t *p1_size,
+			       struct tlv_vec *p2,
+			       const struct position *pos, uint32_t pos_len);
+
+/**
+ * Gets the cached service description from which the SDE replies are made,
+ * rebuilding it first if the published service list has since been updated.
+ * <strong>[CAUTION]</strong> The cache is only valid until the next call to
+ * a function in this file.
+ *
+ * @param [out] desc the ::DESCRIPTION TLV chunks ordered by position or NULL
+ *                   if no service is published.
+ * @param [out] desc_size the size of desc in bytes.
+ * @param [out] mod_time the last modification time of the cached service list.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+get_service_desc_cache (const struct tlv_chunk **desc, size_t *desc_size,
+			uint64_t *mod_time);
+
+/**
+ * Creates the response packet for an sde_get_stats.
+ *
+ * @param [in] seq the sequence number of the sde_get_stats packet.
+ * @param [out] p a pointer to a dynamically allocated memory space containing
+ *                the response packet.
+ * @param [out] p_size the size of p in bytes.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+get_stats_response (uint32_t seq, struct sde_stats **p, size_t *p_size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,6 +16,7 @@
  *****************************************************************************/
 
 #include <errno.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -27,7 +28,10 @@
 #include "app_err.h"
 #include "logger.h"
 #include "sde.h"
+#include "service_catalog.h"
 #include "service_inquiry.h"
+#include "sde_stats.h"
+#include "tlv.h"
 
 /** The socket through which SDE packets are exchanged. */
 static int s = -1;
@@ -81,6 +85,8 @@ next_sde_packet_info (enum sde_packet_type *packet_type, int *packet_size)
 
   if (bytes_rcvd < sizeof (packet))
     {
+      SDE_COUNT_PACKET (SDE_STATS_UNKNOWN_TYPE, SDE_PACKETS_RECEIVED);
+      SDE_COUNT_PACKET (SDE_STATS_UNKNOWN_TYPE, SDE_PACKETS_MALFORMED);
       l->INFO ("Packet too small for an SDE packet");
       if (remove_packet ())
 	{
@@ -99,6 +105,7 @@ next_sde_packet_info (enum sde_packet_type *packet_type, int *packet_size)
       return -1;
     }
 
+  SDE_COUNT_PACKET (*packet_type, SDE_PACKETS_RECEIVED);
   l->INFO ("An SDE packet received");
 
   return 1;
@@ -124,11 +131,36 @@ is_sde_packet (enum sde_packet_type packet_type, int packet_size)
       return packet_size >= sizeof (struct sde_get_service_desc);
     case GET_SERVICE_DESC_DATA:
       return packet_size >= sizeof (struct sde_get_service_desc_data);
+    case GET_STATS:
+      return packet_size >= sizeof (struct sde_get_stats);
     default:
       return 0;
     }
 }
 
+/**
+ * Tells how a packet that is not an SDE packet is counted.
+ *
+ * @param [in] packet_type the type of the packet.
+ *
+ * @return ::SDE_PACKETS_MALFORMED if the type is a request type or
+ *         ::SDE_PACKETS_DROPPED if the type is not expected by the AP.
+ */
+static enum sde_packet_counter
+get_rejection_counter (enum sde_packet_type packet_type)
+{
+  switch (packet_type)
+    {
+    case GET_METADATA:
+    case GET_SERVICE_DESC:
+    case GET_SERVICE_DESC_DATA:
+    case GET_STATS:
+      return SDE_PACKETS_MALFORMED;
+    default:
+      return SDE_PACKETS_DROPPED;
+    }
+}
+
 /**
  * Checks whether or not a packet size is correct with regard to a
  * recognized type.
@@ -161,6 +193,8 @@ is_sde_packet_sane (struct sde_packet *packet, int packet_size)
 	{
 	  return 0;
 	}
+    case GET_STATS:
+      return packet_size >= sizeof (struct sde_get_stats);
     default:
       return 0;
     }
@@ -208,6 +242,30 @@ take_sde_packet (struct sde_packet **packet, int packet_size,
   return ERR_SUCCESS;
 }
 
+/**
+ * Counts and times a reply packet that has been sent or that cannot be sent.
+ *
+ * @param [in] bytes_sent the result of sending the packet.
+ * @param [in] start the time right before sending the packet as given by
+ *                   get_sde_stats_time().
+ */
+static void
+count_reply (ssize_t bytes_sent, uint64_t start)
+{
+  record_sde_stage (SDE_STAGE_SEND, start);
+  SDE_PROBE (reply__sent, bytes_sent);
+
+  if (bytes_sent == -1)
+    {
+      SDE_COUNT (SDE_SEND_ERRORS, 1);
+    }
+  else
+    {
+      SDE_COUNT (SDE_REPLIES_SENT, 1);
+      SDE_COUNT (SDE_BYTES_OUT, bytes_sent);
+    }
+}
+
 /**
  * Sends back sde_metadata and sde_metadata_data to the sender through the SDE
  * socket.
@@ -225,19 +283,26 @@ send_metadata (struct sockaddr_in *sender_addr, uint32_t seq)
   struct sde_metadata_data *metadata_data;
   size_t metadata_data_len;
   ssize_t bytes_sent;
+  uint64_t start;
 
   l->INFO ("Responding to GET_METADATA packet #%u", seq);
 
-  if ((rc = get_metadata_response (seq, &metadata, &metadata_len,
-				   &metadata_data, &metadata_data_len)))
+  start = get_sde_stats_time ();
+  rc = get_metadata_response (seq, &metadata, &metadata_len,
+			      &metadata_data, &metadata_data_len);
+  record_sde_stage (SDE_STAGE_REPLY_BUILD, start);
+  SDE_PROBE (reply__built, GET_METADATA, seq, rc);
+  if (rc)
     {
       l->APP_ERR (rc, "Cannot get metadata packets");
     }
 
   l->INFO ("Sending METADATA #%u packet to %s:%hu", seq,
 	   inet_ntoa (sender_addr->sin_addr), ntohs (sender_addr->sin_port));
+  start = get_sde_stats_time ();
   bytes_sent = sendto (s, metadata, metadata_len, 0,
 		       (struct sockaddr *) sender_addr, sizeof (*sender_addr));
+  count_reply (bytes_sent, start);
   if (bytes_sent == -1)
     {
       l->SYS_ERR ("Cannot send metadata packet");
@@ -245,8 +310,10 @@ send_metadata (struct sockaddr_in *sender_addr, uint32_t seq)
 
   l->INFO ("Sending METADATA_DATA #%u packet to %s:%hu", seq,
 	   inet_ntoa (sender_addr->sin_addr), ntohs (sender_addr->sin_port));
+  start = get_sde_stats_time ();
   bytes_sent = sendto (s, metadata_data, metadata_data_len, 0,
 		       (struct sockaddr *) sender_addr, sizeof (*sender_addr));
+  count_reply (bytes_sent, start);
   if (bytes_sent == -1)
     {
       l->SYS_ERR ("Cannot send metadata data packet");
@@ -291,25 +358,36 @@ send_service_desc (struct sockaddr_in *sender_addr, uint32_t seq,
   int rc;
   struct sde_service_desc *service_desc;
   size_t service_desc_len;
-  struct sde_service_desc_data *service_desc_data;
-  size_t service_desc_data_len;
+  struct tlv_vec service_desc_data;
+  struct msghdr msg = {
+    .msg_name = sender_addr,
+    .msg_namelen = sizeof (*sender_addr),
+  };
+  int iovcnt;
   ssize_t bytes_sent;
+  uint64_t start;
 
   l->INFO ("Responding to GET_SERVICE_DESC packet #%u", seq);
 
+  start = get_sde_stats_time ();
   qsort (pos, pos_len, sizeof (*pos), compare_service_position);
 
-  if ((rc = get_service_desc_response (seq, &service_desc, &service_desc_len,
-				       &service_desc_data, &service_desc_data_len,
-				       pos, pos_len)))
+  rc = get_service_desc_vec_response (seq, &service_desc, &service_desc_len,
+				      &service_desc_data, pos, pos_len);
+  record_sde_stage (SDE_STAGE_REPLY_BUILD, start);
+  SDE_PROBE (reply__built, GET_SERVICE_DESC_DATA, seq, rc);
+  if (rc)
     {
       l->APP_ERR (rc, "Cannot get service description packets");
+      return;
     }
 
   l->INFO ("Sending SERVICE_DESC #%u packet to %s:%hu", seq,
 	   inet_ntoa (sender_addr->sin_addr), ntohs (sender_addr->sin_port));
+  start = get_sde_stats_time ();
   bytes_sent = sendto (s, service_desc, service_desc_len, 0,
 		       (struct sockaddr *) sender_addr, sizeof (*sender_addr));
+  count_reply (bytes_sent, start);
   if (bytes_sent == -1)
     {
       l->SYS_ERR ("Cannot send service description packet");
@@ -317,15 +395,75 @@ send_service_desc (struct sockaddr_in *sender_addr, uint32_t seq,
 
   l->INFO ("Sending SERVICE_DESC_DATA #%u packet to %s:%hu", seq,
 	   inet_ntoa (sender_addr->sin_addr), ntohs (sender_addr->sin_port));
-  bytes_sent = sendto (s, service_desc_data, service_desc_data_len, 0,
+  msg.msg_iov = (struct iovec *) get_vec (&service_desc_data, &iovcnt);
+  msg.msg_iovlen = iovcnt;
+  if (msg.msg_iov == NULL)
+    {
+      l->APP_ERR (ERR_MEM, "Cannot describe service description data packet");
+    }
+  else
+    {
+      start = get_sde_stats_time ();
+      bytes_sent = sendmsg (s, &msg, 0);
+      count_reply (bytes_sent, start);
+      if (bytes_sent == -1)
+	{
+	  l->SYS_ERR ("Cannot send service description data packet");
+	}
+    }
+
+  free (service_desc);
+  destroy_vec (&service_desc_data);
+}
+
+/**
+ * Sends back sde_stats to the sender through the SDE socket if the sender is
+ * the AP itself.
+ *
+ * @param [in] sender_addr the sender of the replied sde_get_stats.
+ * @param [in] seq the sequence number of the replied sde_get_stats.
+ */
+static void
+send_stats (struct sockaddr_in *sender_addr, uint32_t seq)
+{
+  int rc;
+  struct sde_stats *stats;
+  size_t stats_len;
+  ssize_t bytes_sent;
+  uint64_t start;
+
+  if ((ntohl (sender_addr->sin_addr.s_addr) >> 24) != IN_LOOPBACKNET)
+    {
+      l->INFO ("Dropping GET_STATS packet #%u from %s", seq,
+	       inet_ntoa (sender_addr->sin_addr));
+      SDE_COUNT_PACKET (GET_STATS, SDE_PACKETS_DROPPED);
+      return;
+    }
+
+  l->INFO ("Responding to GET_STATS packet #%u", seq);
+
+  start = get_sde_stats_time ();
+  rc = get_stats_response (seq, &stats, &stats_len);
+  record_sde_stage (SDE_STAGE_REPLY_BUILD, start);
+  SDE_PROBE (reply__built, GET_STATS, seq, rc);
+  if (rc)
+    {
+      l->APP_ERR (rc, "Cannot get stats packet");
+      return;
+    }
+
+  l->INFO ("Sending STATS #%u packet to %s:%hu", seq,
+	   inet_ntoa (sender_addr->sin_addr), ntohs (sender_addr->sin_port));
+  start = get_sde_stats_time ();
+  bytes_sent = sendto (s, stats, stats_len, 0,
 		       (struct sockaddr *) sender_addr, sizeof (*sender_addr));
+  count_reply (bytes_sent, start);
   if (bytes_sent == -1)
     {
-      l->SYS_ERR ("Cannot send service description data packet");
+      l->SYS_ERR ("Cannot send stats packet");
     }
 
-  free (service_desc);
-  free (service_desc_data);
+  free (stats);
 }
 
 /**
@@ -353,11 +491,50 @@ handle_sde_packet (struct sde_packet *packet, int packet_size,
       send_service_desc (sender_addr, ntohl (d->c.seq),
 			 d->data, ntohl (d->count));
       break;
+    case GET_STATS:
+      send_stats (sender_addr, ntohl (packet->seq));
+      break;
     default:
+      SDE_COUNT_PACKET (ntohl (packet->type), SDE_PACKETS_DROPPED);
       break;
     }
 }
 
+/**
+ * Waits for the next SDE packet while serving the HTTP catalog endpoint.
+ *
+ * @return 0 if no packet pending, -1 if there is an error or 1 if there is
+ *         an SDE packet to be peeked at.
+ */
+static int
+wait_sde_packet (void)
+{
+  struct pollfd fds[1 + CATALOG_POLLFDS_MAX];
+  nfds_t fd_count;
+  int timeout;
+
+  fds[0].fd = s;
+  fds[0].events = POLLIN;
+  fds[0].revents = 0;
+  fd_count = 1 + get_catalog_pollfds (fds + 1, &timeout);
+
+  if (poll (fds, fd_count, timeout) == -1)
+    {
+      if (errno == EINTR)
+	{
+	  l->INFO ("Interrupted listening");
+	  return 0;
+	}
+
+      l->SYS_ERR ("Cannot wait for the next SDE packet");
+      return -1;
+    }
+
+  serve_catalog (fds + 1, fd_count - 1);
+
+  return (fds[0].revents != 0);
+}
+
 /**
  * Destroys the SDE socket.
  */
@@ -374,9 +551,9 @@ destroy_socket (void)
 }
 
 int
-run_inquiry_handler (int (*is_stopped) (void))
+run_inquiry_handler (int (*is_stopped) (void), uint16_t catalog_port)
 {
-#define cleanly destroy_socket (),
+#define cleanly close_catalog (), destroy_socket (),
 
   struct sockaddr_in handler_addr = {
     .sin_family = AF_INET,
@@ -399,6 +576,11 @@ run_inquiry_handler (int (*is_stopped) (void))
     }
   l->INFO ("Listening on port %hu", SDE_PORT);
 
+  if (catalog_port != 0 && open_catalog (catalog_port))
+    {
+      return cleanly ERR_SOCK;
+    }
+
   while (!is_stopped ())
     {
       struct sde_packet *packet;
@@ -406,8 +588,18 @@ run_inquiry_handler (int (*is_stopped) (void))
       struct sockaddr_in sender_addr;
       int packet_size;
       int rc;
+      int is_sane;
+      uint64_t start, now;
 
       l->INFO ("Waiting for SDE packet");
+      if (catalog_port != 0 && (rc = wait_sde_packet ()) != 1)
+	{
+	  if (rc == -1)
+	    {
+	      return cleanly ERR_GET_SDE_INFO;
+	    }
+	  continue;
+	}
       rc = next_sde_packet_info (&packet_type, &packet_size);
       if (rc == -1)
 	{
@@ -417,6 +609,8 @@ run_inquiry_handler (int (*is_stopped) (void))
 	{
 	  continue;
 	}
+      start = get_sde_stats_time ();
+      SDE_PROBE (packet__peeked, packet_type, packet_size);
 
       if (is_sde_packet (packet_type, packet_size))
 	{
@@ -425,23 +619,31 @@ run_inquiry_handler (int (*is_stopped) (void))
 	      l->APP_ERR (rc, "Cannot take an SDE packet");
 	      return cleanly ERR_TAKE_SDE_PACKET;
 	    }
+	  now = record_sde_stage (SDE_STAGE_INTAKE, start);
+	  SDE_PROBE (packet__taken, packet_type, packet_size);
 	  l->INFO ("The SDE packet has the correct minimum size");
 	}
       else
 	{
 	  l->INFO ("The SDE packet is insane");
+	  SDE_COUNT_PACKET (packet_type, get_rejection_counter (packet_type));
 	  if ((rc = remove_packet ()))
 	    {
 	      l->APP_ERR (rc, "Cannot remove an SDE packet");
 	      return cleanly ERR_REMOVE_SDE_PACKET;
 	    }
 
+	  record_sde_stage (SDE_STAGE_INTAKE, start);
+	  SDE_PROBE (packet__removed, packet_type, packet_size);
 	  l->INFO ("The SDE packet has an incorrect minimum size");
 
 	  continue;
 	}
 
-      if (is_sde_packet_sane (packet, packet_size))
+      is_sane = is_sde_packet_sane (packet, packet_size);
+      record_sde_stage (SDE_STAGE_VALIDATION, now);
+      SDE_PROBE (packet__validated, packet_type, is_sane);
+      if (is_sane)
 	{
 	  l->INFO ("The SDE packet is sane");
 
@@ -450,8 +652,12 @@ run_inquiry_handler (int (*is_stopped) (void))
       else
 	{
 	  l->INFO ("The SDE packet is insane");
+	  SDE_COUNT_PACKET (packet_type, SDE_PACKETS_MALFORMED);
 	}
       free (packet);
+
+      now = record_sde_stage (SDE_STAGE_REQUEST, start);
+      SDE_PROBE (request__done, packet_type, now - start);
     }
 
   return cleanly ERR_SUCCESS;
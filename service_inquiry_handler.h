@@ -21,6 +21,8 @@
 #ifndef SERVICE_INQUIRY_HANDLER_H
 #define SERVICE_INQUIRY_HANDLER_H
 
+#include <stdint.h>
+
 #ifdef __cpluplus
 extern "C" {
 #endif
@@ -30,11 +32,14 @@ extern "C" {
  *
  * @param [in] is_stopped a callback function called by the handler to decide
  *                        whether or not to handler should return.
+ * @param [in] catalog_port the TCP port of the HTTP catalog endpoint (see
+ *                          service_catalog.h) served by the handler or 0 to
+ *                          serve SDE packets only.
  *
  * @return 0 if there is no error or non-zero if there is an error.
  */
 int
-run_inquiry_handler (int (*is_stopped) (void));
+run_inquiry_handler (int (*is_stopped) (void), uint16_t catalog_port);
 
 #ifdef __cplusplus
 }
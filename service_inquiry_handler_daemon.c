@@ -20,15 +20,34 @@
 #include <stdlib.h>
 #include "app_err.h"
 #include "logger.h"
+#include "sde_stats.h"
 #include "service_inquiry.h"
 #include "service_inquiry_handler.h"
 #include "service_list.h"
 
 static int stop_signal = 0;
 
+static volatile sig_atomic_t dump_signal = 0;
+
+static void
+dump_latency (void)
+{
+  static char buffer[4096];
+
+  format_sde_latency (buffer, sizeof (buffer));
+  fputs (buffer, stderr);
+  fflush (stderr);
+}
+
 static int
 is_stopped ()
 {
+  if (dump_signal)
+    {
+      dump_signal = 0;
+      dump_latency ();
+    }
+
   return stop_signal;
 }
 
@@ -39,6 +58,18 @@ signal_handler (int signum)
   stop_signal = 1;
 }
 
+static void
+dump_signal_handler (int signum)
+{
+  dump_signal = 1;
+}
+
+static void
+log_level_signal_handler (int signum)
+{
+  set_log_level (l->level >= LOG_LEVEL_INFO ? LOG_LEVEL_ERR : LOG_LEVEL_INFO);
+}
+
 GLOBAL_LOGGER;
 
 int
@@ -47,15 +78,29 @@ main (int argc, char **argv, char **envp)
   struct sigaction act = {
     .sa_handler = signal_handler,
   };
+  struct sigaction log_level_act = {
+    .sa_handler = log_level_signal_handler,
+  };
+  struct sigaction dump_act = {
+    .sa_handler = dump_signal_handler,
+  };
+  unsigned long catalog_port = 0;
   int rc;
 
-  if (argc != 2)
+  if (argc != 2 && argc != 3)
     {
-      fprintf (stderr, "Usage: %s LOG_FILE\n", argv[0]);
+      fprintf (stderr, "Usage: %s LOG_FILE [CATALOG_PORT]\n", argv[0]);
+      exit (EXIT_FAILURE);
+    }
+  if (argc == 3
+      && ((catalog_port = strtoul (argv[2], NULL, 10)) == 0
+	  || catalog_port > 65535))
+    {
+      fprintf (stderr, "Invalid CATALOG_PORT %s\n", argv[2]);
       exit (EXIT_FAILURE);
     }
 
-  SETUP_LOGGER (argv[1], errtostr);
+  SETUP_LOGGER_MODE (argv[1], errtostr, LOGGER_ASYNC);
 
   publish_services ();
 
@@ -74,8 +119,22 @@ main (int argc, char **argv, char **envp)
     }
   l->INFO ("Signal handler registered");
 
+  if (sigaction (SIGUSR2, &log_level_act, NULL))
+    {
+      l->SYS_ERR ("Cannot install log level toggler");
+      exit (EXIT_FAILURE);
+    }
+  l->INFO ("Log level toggler registered (send SIGUSR2 to toggle INFO)");
+
+  if (sigaction (SIGUSR1, &dump_act, NULL))
+    {
+      l->SYS_ERR ("Cannot install latency dumper");
+      exit (EXIT_FAILURE);
+    }
+  l->INFO ("Latency dumper registered (send SIGUSR1 to dump to stderr)");
+
   l->INFO ("Running inquiry handler");
-  if ((rc = run_inquiry_handler (is_stopped)))
+  if ((rc = run_inquiry_handler (is_stopped, catalog_port)))
     {
       l->APP_ERR (rc, "Error in inquiry handler");
       rc = EXIT_FAILURE;
@@ -108,6 +108,9 @@ struct service_list_impl
   sqlite3_stmt *inc_dec_pos; /**<
 			      * Increment/decrement the position of a service.
 			      */
+  sqlite3_stmt *get_services; /**<
+			       * Select all services ordered by their positions.
+			       */
 };
 
 int
@@ -300,6 +303,13 @@ destroy_service_list (service_list **sl)
 	  SQLITE3_ERR ((*sl)->db, "Cannot finalize statement inc dec pos");
 	}
     }
+  if ((*sl)->get_services != NULL)
+    {
+      if (sqlite3_finalize ((*sl)->get_services))
+	{
+	  SQLITE3_ERR ((*sl)->db, "Cannot finalize statement get services");
+	}
+    }
 
   if (sqlite3_close ((*sl)->db))
     {
@@ -1057,24 +1067,80 @@ get_service_at (service_list *sl, struct service **s, unsigned int idx)
 }
 
 int
-insert_service_at (service_list *sl, const struct service *s, unsigned int idx)
+for_each_service (service_list *sl,
+		  int (*visit) (const struct service *s, void *arg), void *arg)
 {
-  char number_cat_id[32];
-  char *err_msg;
+  struct service s;
+  int step;
   int rc;
 
-  if (idx > count_service (sl))
+  /* Preparation */
+  if ((rc = ensure_tmp_table (sl)))
     {
-      return ERR_RANGE;
+      l->APP_ERR (rc, "Service list is not readable");
+      return ERR_GET_SERVICE;
     }
 
-  /* Preparation */
-  if ((rc = ensure_tmp_table (sl)))
+  if (sl->get_services == NULL)
     {
-      l->APP_ERR (rc, "Service list is not writable");
-      return ERR_INSERT_SERVICE;
+      if (sqlite3_prepare_v2 (sl->db,
+			      "select * from " TABLE_SERVICE_LIST_TMP
+			      " order by " COLUMN_POSITION,
+			      -1, &sl->get_services, NULL))
+	{
+	  SQLITE3_ERR (sl->db, "Cannot prepare statement get services");
+	  return ERR_GET_SERVICE;
+	}
+    }
+
+  /* Obtaining */
+  while ((step = sqlite3_step (sl->get_services)) == SQLITE_ROW)
+    {
+      s.ro.pos = sqlite3_column_int (sl->get_services, COLPOS_POSITION);
+      s.ro.mod_time = strtoull ((const char *)
+				sqlite3_column_text (sl->get_services,
+						     COLPOS_MOD_TIME),
+				NULL, 10);
+      s.cat_id = strtoul ((const char *)
+			  sqlite3_column_text (sl->get_services,
+					       COLPOS_CAT_ID),
+			  NULL, 10);
+      s.desc = (char *) sqlite3_column_text (sl->get_services, COLPOS_DESC);
+      s.long_desc = (char *) sqlite3_column_text (sl->get_services,
+						  COLPOS_LONG_DESC);
+      s.uri = (char *) sqlite3_column_text (sl->get_services, COLPOS_URI);
+
+      if ((rc = visit (&s, arg)))
+	{
+	  break;
+	}
     }
+  if (rc == ERR_SUCCESS && step != SQLITE_DONE)
+    {
+      SQLITE3_ERR (sl->db, "Cannot execute get services");
+      rc = ERR_GET_SERVICE;
+    }
+
+  if (sqlite3_reset (sl->get_services) && rc == ERR_SUCCESS)
+    {
+      SQLITE3_ERR (sl->db, "Cannot reset statement get services");
+      rc = ERR_GET_SERVICE;
+    }
+
+  return rc;
+}
 
+/**
+ * Prepares the statement inserting a service into the tmp table at a position
+ * and binds the service to it.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+bind_insert_service_at (service_list *sl, const struct service *s,
+			unsigned int idx, char *number_cat_id,
+			size_t number_cat_id_size)
+{
   if (sl->insert_service_at == NULL)
     {
       if (sqlite3_prepare_v2 (sl->db,
@@ -1117,7 +1183,7 @@ insert_service_at (service_list *sl, const struct service *s, unsigned int idx)
 		      " insert service at");
       return ERR_INSERT_SERVICE;
     }
-  snprintf (number_cat_id, sizeof (number_cat_id), "%lu", s->cat_id);
+  snprintf (number_cat_id, number_cat_id_size, "%lu", s->cat_id);
   if (sqlite3_bind_text (sl->insert_service_at, 2, number_cat_id, -1,
 			 SQLITE_STATIC))
     {
@@ -1170,6 +1236,34 @@ insert_service_at (service_list *sl, const struct service *s, unsigned int idx)
 	}
     }
 
+  return ERR_SUCCESS;
+}
+
+int
+insert_service_at (service_list *sl, const struct service *s, unsigned int idx)
+{
+  char number_cat_id[32];
+  char *err_msg;
+  int rc;
+
+  if (idx > count_service (sl))
+    {
+      return ERR_RANGE;
+    }
+
+  /* Preparation */
+  if ((rc = ensure_tmp_table (sl)))
+    {
+      l->APP_ERR (rc, "Service list is not writable");
+      return ERR_INSERT_SERVICE;
+    }
+
+  if ((rc = bind_insert_service_at (sl, s, idx, number_cat_id,
+				    sizeof (number_cat_id))))
+    {
+      return rc;
+    }
+
   /* Inserting */
   if (sqlite3_exec (sl->db, "begin", NULL, NULL, &err_msg))
     {
@@ -1205,6 +1299,70 @@ insert_service_at (service_list *sl, const struct service *s, unsigned int idx)
   return ERR_SUCCESS;
 }
 
+int
+append_services (service_list *sl,
+		 int (*next_service) (struct service *s, void *arg), void *arg)
+{
+  char number_cat_id[32];
+  char *err_msg;
+  struct service s;
+  unsigned int idx;
+  int rc;
+
+  if ((rc = ensure_tmp_table (sl)))
+    {
+      l->APP_ERR (rc, "Service list is not writable");
+      return ERR_ADD_SERVICE_LAST;
+    }
+
+  idx = count_service (sl);
+
+  /* One transaction for all services instead of one per service */
+  if (sqlite3_exec (sl->db, "begin", NULL, NULL, &err_msg))
+    {
+      SQLITE3_ERR_STR (err_msg, "Cannot lock tmp service list");
+      return ERR_ADD_SERVICE_LAST;
+    }
+
+  while (1)
+    {
+      memset (&s, 0, sizeof (s));
+      if ((rc = next_service (&s, arg)) == -1)
+	{
+	  break;
+	}
+      if (rc == ERR_SUCCESS)
+	{
+	  if ((rc = bind_insert_service_at (sl, &s, idx, number_cat_id,
+					    sizeof (number_cat_id))) == 0
+	      && sqlite3_step (sl->insert_service_at) != SQLITE_DONE)
+	    {
+	      SQLITE3_ERR (sl->db, "Cannot execute insert service at");
+	      rc = ERR_ADD_SERVICE_LAST;
+	    }
+	}
+      if (rc)
+	{
+	  l->APP_ERR (rc, "Cannot append service at position %u", idx);
+	  if (sqlite3_exec (sl->db, "rollback", NULL, NULL, &err_msg))
+	    {
+	      SQLITE3_ERR_STR (err_msg,
+			       "Cannot unlock (rollback) tmp service list");
+	    }
+	  return rc;
+	}
+      idx++;
+    }
+
+  if (sqlite3_exec (sl->db, "commit", NULL, NULL, &err_msg))
+    {
+      SQLITE3_ERR_STR (err_msg, "Cannot unlock (commit) tmp service list");
+      return ERR_ADD_SERVICE_LAST;
+    }
+
+  return ERR_SUCCESS;
+}
+
 int
 replace_service_at (service_list *sl, const struct service *s, unsigned int idx)
 {
@@ -202,6 +202,23 @@ add_service_last (service_list *sl, const struct service *s);
 int
 get_service_at (service_list *sl, struct service **s, unsigned int idx);
 
+/**
+ * Visits every service in the service list in order with a single query,
+ * which is much cheaper than calling get_service_at() for each position.
+ *
+ * @param [in] sl the service list whose services are to be visited.
+ * @param [in] visit the callback called with each service and arg. The
+ *                   service and its strings are only valid during the call.
+ *                   It returns 0 to continue or non-zero to stop visiting.
+ * @param [in] arg the argument passed to every call of visit.
+ *
+ * @return 0 if there is no error, the non-zero value returned by visit or
+ *         another non-zero value if there is an error.
+ */
+int
+for_each_service (service_list *sl,
+		  int (*visit) (const struct service *s, void *arg), void *arg);
+
 /** 
  * Inserts a new service at the specified index in the service list.
  * It is an error to insert a service outside the range [0, count_service()].
@@ -215,6 +232,27 @@ get_service_at (service_list *sl, struct service **s, unsigned int idx);
 int
 insert_service_at (service_list *sl, const struct service *s, unsigned int idx);
 
+/**
+ * Appends the services produced by a callback to the end of the service list
+ * in a single transaction. This is much cheaper than calling
+ * add_service_last() once per service when a whole list is loaded. If either
+ * the callback or an insertion fails, none of the services is appended.
+ *
+ * @param [in] sl the service list that will contain the new services.
+ * @param [in] next_service the callback that fills in the next service to
+ *                          append. It returns 0 if s has been filled in, -1
+ *                          if there is no more service or a positive error
+ *                          code to abort. The strings in s only need to stay
+ *                          valid until the callback is called again.
+ * @param [in] arg the argument passed to every call of next_service.
+ *
+ * @return 0 if there is no error or non-zero if there is an error. When the
+ *         callback aborts, its error code is returned.
+ */
+int
+append_services (service_list *sl,
+		 int (*next_service) (struct service *s, void *arg), void *arg);
+
 /** 
  * Replaces a service at the specified index in the service list.
  * 
@@ -0,0 +1,370 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file service_list_bench.c
+ * @brief The micro-benchmarks of the service list storage used by the
+ *        service publisher: loading, reading, editing, saving and reloading
+ *        lists of 10 to 1024 services in a DB kept on a tmpfs so that the
+ *        cost of SQLite rather than that of the disk is measured. The
+ *        insertion and deletion benchmarks show the shifting of the positions
+ *        of the services after the edited one while the first read, save and
+ *        reload benchmarks show the copying of the whole table. An insertion
+ *        is undone and a deletion is prepared outside of the timer to keep the
+ *        number of services constant. The allocations made by SQLite are not
+ *        counted.
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "app_err.h"
+#include "bench.h"
+#include "logger.h"
+#include "service_list.h"
+
+GLOBAL_LOGGER;
+
+/** The position at which a service is inserted or deleted. */
+enum edit_pos
+  {
+    EDIT_POS_HEAD,
+    EDIT_POS_MIDDLE,
+    EDIT_POS_TAIL,
+  };
+
+/** The service list used by the benchmarks. */
+static service_list *sl = NULL;
+
+/** The service inserted by the insertion and deletion benchmarks. */
+static struct service *inserted = NULL;
+
+static void
+setup_service_list (const struct bench *b)
+{
+  char uri[64];
+  size_t i;
+  int rc;
+
+  unlink (SERVICE_LIST_DB);
+  if ((rc = load_service_list (&sl)))
+    {
+      die_bench ("load_service_list", rc);
+    }
+  for (i = 0; i < b->arg1; i++)
+    {
+      struct service *s;
+
+      snprintf (uri, sizeof (uri), "http://example.org/service/%zu", i);
+      if ((rc = create_service (&s, i, NULL, strdup ("A benchmark service"),
+				 strdup (uri))))
+	{
+	  die_bench ("create_service", rc);
+	}
+      rc = add_service_last (sl, s);
+      destroy_service (&s);
+      if (rc)
+	{
+	  die_bench ("add_service_last", rc);
+	}
+    }
+  if ((rc = save_service_list (sl)))
+    {
+      die_bench ("save_service_list", rc);
+    }
+  destroy_service_list (&sl);
+
+  /* Starts every benchmark with a loaded list that has been read once. */
+  if ((rc = load_service_list (&sl)))
+    {
+      die_bench ("load_service_list", rc);
+    }
+  if (count_service (sl) != b->arg1)
+    {
+      die_bench ("count_service", ERR_RANGE);
+    }
+  if (b->arg1 > 0)
+    {
+      struct service *s;
+
+      if ((rc = get_service_at (sl, &s, 0)))
+	{
+	  die_bench ("get_service_at", rc);
+	}
+      destroy_service (&s);
+    }
+}
+
+static void
+teardown_service_list (const struct bench *b)
+{
+  destroy_service_list (&sl);
+}
+
+static void
+bench_load_service_list (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      service_list *loaded;
+      int rc;
+
+      if ((rc = load_service_list (&loaded)))
+	{
+	  die_bench ("load_service_list", rc);
+	}
+      bench_sink = (uintptr_t) loaded;
+      destroy_service_list (&loaded);
+    }
+}
+
+static void
+bench_first_read (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      service_list *loaded;
+      struct service *s;
+      int rc;
+
+      if ((rc = load_service_list (&loaded)))
+	{
+	  die_bench ("load_service_list", rc);
+	}
+      if ((rc = get_service_at (loaded, &s, 0)))
+	{
+	  die_bench ("get_service_at", rc);
+	}
+      destroy_service (&s);
+      destroy_service_list (&loaded);
+    }
+}
+
+static void
+bench_count_service (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+  unsigned int sum = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      sum += count_service (sl);
+    }
+  bench_sink = sum;
+}
+
+static void
+bench_get_service_at (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      struct service *s;
+      int rc;
+
+      if ((rc = get_service_at (sl, &s, i % b->arg1)))
+	{
+	  die_bench ("get_service_at", rc);
+	}
+      bench_sink = s->cat_id;
+      destroy_service (&s);
+    }
+}
+
+static int
+sum_cat_id (const struct service *s, void *arg)
+{
+  *((unsigned long *) arg) += s->cat_id;
+  return 0;
+}
+
+static void
+bench_for_each_service (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+  unsigned long sum = 0;
+
+  for (i = 0; i < n; i++)
+    {
+      int rc;
+
+      if ((rc = for_each_service (sl, sum_cat_id, &sum)))
+	{
+	  die_bench ("for_each_service", rc);
+	}
+    }
+  bench_sink = sum;
+}
+
+/**
+ * Gets the index at which the insertion and deletion benchmarks edit the
+ * service list.
+ *
+ * @param [in] b the benchmark whose variant is an edit_pos.
+ *
+ * @return the index of the inserted service.
+ */
+static unsigned int
+get_edit_idx (const struct bench *b)
+{
+  switch (b->variant)
+    {
+    case EDIT_POS_HEAD:
+      return 0;
+    case EDIT_POS_MIDDLE:
+      return b->arg1 / 2;
+    default:
+      return b->arg1;
+    }
+}
+
+static void
+bench_insert_service_at (const struct bench *b, uint64_t n)
+{
+  unsigned int idx = get_edit_idx (b);
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((rc = insert_service_at (sl, inserted, idx)))
+	{
+	  die_bench ("insert_service_at", rc);
+	}
+
+      stop_bench_timer ();
+      if ((rc = del_service_at (sl, idx)))
+	{
+	  die_bench ("del_service_at", rc);
+	}
+      start_bench_timer ();
+    }
+}
+
+static void
+bench_del_service_at (const struct bench *b, uint64_t n)
+{
+  unsigned int idx = get_edit_idx (b);
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      stop_bench_timer ();
+      if ((rc = insert_service_at (sl, inserted, idx)))
+	{
+	  die_bench ("insert_service_at", rc);
+	}
+      start_bench_timer ();
+
+      if ((rc = del_service_at (sl, idx)))
+	{
+	  die_bench ("del_service_at", rc);
+	}
+    }
+}
+
+static void
+bench_save_service_list (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((rc = save_service_list (sl)))
+	{
+	  die_bench ("save_service_list", rc);
+	}
+    }
+}
+
+static void
+bench_reload_service_list (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((rc = reload_service_list (sl)))
+	{
+	  die_bench ("reload_service_list", rc);
+	}
+    }
+}
+
+/** Declares a benchmark of a service list of the given size. */
+#define SERVICE_LIST_BENCH(name, run, size, variant)			\
+  {name, setup_service_list, run, size, 0, variant, teardown_service_list}
+
+/** Declares a benchmark for each service list size. */
+#define SERVICE_LIST_BENCHES(name, run, variant)			\
+  SERVICE_LIST_BENCH (name "/services=10", run, 10, variant),		\
+    SERVICE_LIST_BENCH (name "/services=64", run, 64, variant),		\
+    SERVICE_LIST_BENCH (name "/services=255", run, 255, variant),	\
+    SERVICE_LIST_BENCH (name "/services=1024", run, 1024, variant)
+
+/** The benchmarks. */
+static const struct bench benches[] = {
+  SERVICE_LIST_BENCHES ("LoadServiceList", bench_load_service_list, 0),
+  SERVICE_LIST_BENCHES ("FirstRead", bench_first_read, 0),
+  SERVICE_LIST_BENCHES ("CountService", bench_count_service, 0),
+  SERVICE_LIST_BENCHES ("GetServiceAt", bench_get_service_at, 0),
+  SERVICE_LIST_BENCHES ("ForEachService", bench_for_each_service, 0),
+  SERVICE_LIST_BENCHES ("InsertServiceAt/pos=head", bench_insert_service_at,
+			EDIT_POS_HEAD),
+  SERVICE_LIST_BENCHES ("InsertServiceAt/pos=middle", bench_insert_service_at,
+			EDIT_POS_MIDDLE),
+  SERVICE_LIST_BENCHES ("InsertServiceAt/pos=tail", bench_insert_service_at,
+			EDIT_POS_TAIL),
+  SERVICE_LIST_BENCHES ("DelServiceAt/pos=head", bench_del_service_at,
+			EDIT_POS_HEAD),
+  SERVICE_LIST_BENCHES ("DelServiceAt/pos=middle", bench_del_service_at,
+			EDIT_POS_MIDDLE),
+  SERVICE_LIST_BENCHES ("DelServiceAt/pos=tail", bench_del_service_at,
+			EDIT_POS_TAIL),
+  SERVICE_LIST_BENCHES ("SaveServiceList", bench_save_service_list, 0),
+  SERVICE_LIST_BENCHES ("ReloadServiceList", bench_reload_service_list, 0),
+};
+
+int
+main (int argc, char **argv, char **envp)
+{
+  int rc;
+
+  SETUP_LOGGER ("/dev/stderr", errtostr);
+  set_log_level (LOG_LEVEL_ERR);
+
+  if ((rc = create_service (&inserted, 9999, NULL,
+			    strdup ("An inserted service"),
+			    strdup ("http://example.org/service/inserted"))))
+    {
+      die_bench ("create_service", rc);
+    }
+
+  run_benches (benches, sizeof (benches) / sizeof (*benches), argc, argv);
+
+  destroy_service (&inserted);
+  unlink (SERVICE_LIST_DB);
+
+  exit (EXIT_SUCCESS);
+}
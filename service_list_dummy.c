@@ -15,11 +15,13 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
  ****************************************************************************/
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "app_err.h"
 #include "logger.h"
 #include "service_list.h"
+#include "service_list_dummy.h"
 
 /** The implementation of service list. */
 struct service_list_impl
@@ -27,6 +29,68 @@ struct service_list_impl
   int unused;
 };
 
+/** The number of synthetic services or 0 for the fixed services. */
+static size_t synthetic_count = 0;
+
+/** The long description shared by the synthetic services or NULL. */
+static char *synthetic_long_desc = NULL;
+
+/** The short descriptions of the synthetic services. */
+static char synthetic_desc[DUMMY_SERVICE_MAX][16];
+
+/** The URIs of the synthetic services. */
+static char synthetic_uri[DUMMY_SERVICE_MAX][32];
+
+/** The last modification time of the dummy service list. */
+static uint64_t last_mod_time = 83828299ULL;
+
+int
+set_dummy_service_list (size_t count, size_t long_desc_len)
+{
+  size_t i;
+
+  if (count > DUMMY_SERVICE_MAX)
+    {
+      return ERR_RANGE;
+    }
+
+  if (synthetic_long_desc != NULL)
+    {
+      free (synthetic_long_desc);
+      synthetic_long_desc = NULL;
+    }
+  if (count > 0 && long_desc_len > 0)
+    {
+      synthetic_long_desc = malloc (long_desc_len + 1);
+      if (synthetic_long_desc == NULL)
+	{
+	  synthetic_count = 0;
+	  return ERR_MEM;
+	}
+      memset (synthetic_long_desc, 'L', long_desc_len);
+      synthetic_long_desc[long_desc_len] = '\0';
+    }
+
+  for (i = 0; i < count; i++)
+    {
+      snprintf (synthetic_desc[i], sizeof (synthetic_desc[i]),
+		"Service %u", (unsigned) i);
+      snprintf (synthetic_uri[i], sizeof (synthetic_uri[i]),
+		"http://192.168.1.1/%u", (unsigned) i);
+    }
+  synthetic_count = count;
+
+  touch_dummy_service_list ();
+
+  return ERR_SUCCESS;
+}
+
+void
+touch_dummy_service_list (void)
+{
+  last_mod_time++;
+}
+
 int
 create_service (struct service **s,
 		unsigned long cat_id,
@@ -113,7 +177,7 @@ count_service (const service_list *sl)
 {
   l->INFO ("Services counted"); 
 
-  return 3;
+  return synthetic_count > 0 ? synthetic_count : 3;
 }
 
 int
@@ -158,6 +222,24 @@ get_service_at (service_list *sl, struct service **s, unsigned int idx)
 
   l->INFO ("Get service at %u", idx);
 
+  if (synthetic_count > 0)
+    {
+      if (idx >= synthetic_count)
+	{
+	  return ERR_RANGE;
+	}
+      if (create_service (s,
+			  idx,
+			  synthetic_desc[idx],
+			  synthetic_long_desc,
+			  synthetic_uri[idx]))
+	{
+	  l->ERR ("Cannot create service");
+	  return ERR_GET_SERVICE;
+	}
+      return ERR_SUCCESS;
+    }
+
   switch (idx)
     {
     case 0:
@@ -233,9 +315,7 @@ del_service_all (service_list *sl)
 uint64_t
 get_last_modification_time (service_list *sl)
 {
-  uint64_t result = 83828299ULL;
-
   l->INFO ("Last mod time calculated");
 
-  return result;
+  return last_mod_time;
 }
@@ -0,0 +1,61 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file service_list_dummy.h
+ * @brief The controls of the dummy service list that replaces the published
+ *        service DB in tests and benchmarks. By default, the dummy list has
+ *        three fixed services. It can instead be filled with synthetic
+ *        services whose position is their index and whose category ID is
+ *        also their index.
+ ****************************************************************************/
+
+#ifndef SERVICE_LIST_DUMMY_H
+#define SERVICE_LIST_DUMMY_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** The maximum number of synthetic services (positions are 1 byte). */
+#define DUMMY_SERVICE_MAX 255
+
+/**
+ * Fills the dummy service list with synthetic services and marks the list as
+ * modified so that any cache built from the list is rebuilt.
+ *
+ * @param [in] count the number of synthetic services up to
+ *                   ::DUMMY_SERVICE_MAX or 0 to restore the fixed services.
+ * @param [in] long_desc_len the length of the long description of each
+ *                           synthetic service or 0 to omit it.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+set_dummy_service_list (size_t count, size_t long_desc_len);
+
+/**
+ * Marks the dummy service list as modified so that any cache built from the
+ * list is rebuilt.
+ */
+void
+touch_dummy_service_list (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SERVICE_LIST_DUMMY_H */
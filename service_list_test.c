@@ -101,6 +101,36 @@ service_factory (unsigned long cat_id,
   return s;
 }
 
+/** Yields the services of a NULL-terminated array then fails if asked. */
+static int
+next_test_service (struct service *s, void *arg)
+{
+  struct service ***itr = arg;
+
+  if (**itr == NULL)
+    {
+      return -1;
+    }
+  if ((**itr)->cat_id == 0)
+    {
+      return ERR_PARSE_DATA;
+    }
+
+  *s = ***itr;
+  (*itr)++;
+  return ERR_SUCCESS;
+}
+
+/** Records the category IDs of the visited services and stops at ID 7. */
+static int
+record_cat_id (const struct service *s, void *arg)
+{
+  unsigned long **itr = arg;
+
+  *(*itr)++ = s->cat_id;
+  return (s->cat_id == 7 ? ERR_GET_SERVICE : ERR_SUCCESS);
+}
+
 int
 main (int argc, char **argv, char **envp)
 {
@@ -255,6 +285,45 @@ main (int argc, char **argv, char **envp)
   assert (s->cat_id == 1);
   destroy_service (&s);
 
+  /* test append services */
+  {
+    struct service s7 = {.cat_id = 7, .desc = "short7", .uri = "uri7"};
+    struct service s8 = {.cat_id = 8, .long_desc = "long8", .uri = "uri8"};
+    struct service bad = {.cat_id = 0, .uri = "bad"};
+    struct service *appended[] = {&s7, &s8, NULL};
+    struct service *failed[] = {&s7, &bad, NULL};
+    struct service **itr = appended;
+
+    assert (0 == append_services (sl, next_test_service, &itr));
+    assert (4 == count_service (sl));
+    assert (0 == get_service_at (sl, &s, 2));
+    assert (s->cat_id == 7);
+    assert (strcmp (s->desc, "short7") == 0);
+    assert (s->long_desc == NULL);
+    destroy_service (&s);
+    assert (0 == get_service_at (sl, &s, 3));
+    assert (s->cat_id == 8);
+    assert (strcmp (s->long_desc, "long8") == 0);
+    assert (strcmp (s->uri, "uri8") == 0);
+    destroy_service (&s);
+
+    /* test visiting the services in order */
+    {
+      unsigned long cat_ids[4] = {0};
+      unsigned long *cat_id_itr = cat_ids;
+
+      assert (ERR_GET_SERVICE == for_each_service (sl, record_cat_id,
+						   &cat_id_itr));
+      assert (cat_id_itr == cat_ids + 3);
+      assert (cat_ids[0] == 6 && cat_ids[1] == 1 && cat_ids[2] == 7);
+    }
+
+    /* test that a failing callback appends nothing */
+    itr = failed;
+    assert (ERR_PARSE_DATA == append_services (sl, next_test_service, &itr));
+    assert (4 == count_service (sl));
+  }
+
   /* test delete all */
   assert (0 == del_service_all (sl));
   assert (0 == get_service_at (sl, &s, 0));
@@ -16,10 +16,20 @@
  *****************************************************************************/
 
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <ctype.h>
 #include "app_err.h"
@@ -35,401 +45,1073 @@
 #define SERVICE_PUBLISHER_LOG_FILE "./service_publisher.log"
 #endif
 
+/** The maximum size of the headers of an SCGI request. */
+#define SCGI_HEADERS_MAX 65536
+
+/** The number of SCGI connections that may wait to be accepted. */
+#define SCGI_BACKLOG 8
+
+/**
+ * The seconds that a single read or write of an SCGI connection may block so
+ * that a stalled client cannot hold up the requests queued behind it.
+ */
+#define SCGI_TIMEOUT 5
+
+/** The QUERY_STRING of a request for the service data only. */
+#define DATA_QUERY "data"
+
+/**
+ * The end of the UI page that loads the service data with a separate request
+ * so that the page itself can be cached by the browser.
+ */
+#define UI_PAGE_END \
+  "<script type=\"text/javascript\" src=\"?" DATA_QUERY "\"></script>" \
+  "</body></html>"
+
+/** The size of the chunks in which POST data are read. */
+#define POST_CHUNK_SIZE 512
+
+/** The maximum size of the decoded fields of a posted service. */
+#define POST_SERVICE_MAX 16384
+
+/**
+ * The state of decoding the services posted by UI.html in a single pass over
+ * fixed-size chunks so that the POST data are never held in memory entirely.
+ */
+struct post_decoder
+{
+  FILE *in; /**< The POST data. */
+  unsigned long remaining; /**< The POST data not yet read into chunk. */
+  char chunk[POST_CHUNK_SIZE]; /**< The POST data being decoded. */
+  size_t chunk_pos; /**< The next byte to decode in chunk. */
+  size_t chunk_len; /**< The number of bytes in chunk. */
+  int pending; /**< A decoded byte to return next or EOF. */
+  int has_cr; /**< A decoded '\r' is held back to collapse CRLF. */
+  int is_value_end; /**< The POST value has been fully decoded. */
+  int is_service_started; /**< The next service's header has been read. */
+  char values[POST_SERVICE_MAX]; /**< The fields of the decoded service. */
+  const char *err_msg; /**< The reason decoding fails or NULL. */
+};
+
+/** The size of the buffer of a response so that it is written at once. */
+#define OUT_BUFFER_SIZE 65536
+
+/** The CGI meta-variables of a request that the service publisher uses. */
+struct request
+{
+  const char *method; /**< REQUEST_METHOD or NULL. */
+  const char *content_length; /**< CONTENT_LENGTH or NULL. */
+  const char *query_string; /**< QUERY_STRING or NULL. */
+  const char *if_none_match; /**< HTTP_IF_NONE_MATCH or NULL. */
+  const char *if_modified_since; /**< HTTP_IF_MODIFIED_SINCE or NULL. */
+};
+
 GLOBAL_LOGGER;
 
-static int should_close_html = 0;
 static const char *err_msg = NULL;
 static service_list *sl = NULL;
+static int is_list_posted = 0; /* sl holds the list of the POST request. */
+static FILE *out = NULL; /* The response of the request being served. */
+static char out_buffer[OUT_BUFFER_SIZE];
+static char *ui = NULL; /* The UI template mapped or kept across requests. */
+static size_t ui_size = 0;
+static int is_ui_mapped = 0;
+static char ui_etag[64]; /* The validators of the UI page. */
+static char ui_last_modified[64];
+static volatile sig_atomic_t is_stopped = 0;
 
 void
 print_categories (void)
 {
 }
 
-void
-print_published_services (void)
+/**
+ * Prints a string as a double-quoted JavaScript string literal that is also a
+ * valid JSON string and is safe inside an inline script. Runs of bytes that
+ * need no escaping are found with strcspn() and copied in one go so that a
+ * long description costs a few copies into the output buffer instead of a
+ * stdio call per character. A NULL string is printed as null.
+ */
+static void
+print_js_string (const char *str)
 {
-  unsigned int i;
-  size_t service_count;
-  struct service *s;
-
-  printf ("services = new Array();");
+  /* The control characters and the characters of markup and quoting */
+  static const char unsafe[] =
+    "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+    "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f"
+    "\"'\\<>&\x7f\xe2";
+  size_t len;
 
-  if (sl == NULL && load_service_list (&sl))
+  if (str == NULL)
     {
-      err_msg = "Cannot load service list for reading";
+      fputs ("null", out);
       return;
     }
 
-  service_count = count_service (sl);
-  for (i = 0; i < service_count; i++)
+  putc ('"', out);
+  while (1)
     {
-      if (get_service_at (sl, &s, i))
-	{
-	  err_msg = "Cannot read a service from the list";
-	  return;
-	}
-
-      printf ("services[%u] = new Service(%lu, '%s'",
-	      i, s->cat_id, s->uri);
-
-      if (s->desc)
-	{
-	  printf (", '%s'", s->desc);
-	}
-      else
-	{
-	  printf (", null");
-	}
+      len = strcspn (str, unsafe);
+      fwrite (str, 1, len, out);
+      str += len;
 
-      if (s->long_desc)
+      switch (*str)
 	{
-	  char *ptr = s->long_desc;
-
-	  printf (", \"");
-	  while (*ptr != '\0')
+	case '\0':
+	  putc ('"', out);
+	  return;
+	case '\n':
+	  fputs ("\\n", out);
+	  break;
+	case '\r':
+	  fputs ("\\r", out);
+	  break;
+	case '\t':
+	  fputs ("\\t", out);
+	  break;
+	case '"':
+	  fputs ("\\\"", out);
+	  break;
+	case '\\':
+	  fputs ("\\\\", out);
+	  break;
+	case '\xe2':
+	  /* U+2028 and U+2029 end a line inside a JavaScript string */
+	  if (str[1] == '\x80' && (str[2] == '\xa8' || str[2] == '\xa9'))
 	    {
-	      if (*ptr == '\n')
-		{
-		  printf ("\\n");
-		}
-	      else
-		{
-		  printf ("%c", *ptr);
-		}
-
-	      ptr++;
+	      fprintf (out, "\\u%04x", (str[2] == '\xa8' ? 0x2028 : 0x2029));
+	      str += 2;
 	    }
-	  printf ("\"");
-	}
-      else
-	{
-	  printf (", null");
+	  else
+	    {
+	      putc (*str, out);
+	    }
+	  break;
+	default:
+	  fprintf (out, "\\u%04x", (unsigned char) *str);
+	  break;
 	}
+      str++;
+    }
+}
 
-      printf (");\n");
+/**
+ * Prints a service of the list as a JavaScript statement. This is the callback
+ * of for_each_service().
+ */
+static int
+print_service (const struct service *s, void *arg)
+{
+  unsigned int *i = arg;
 
-      destroy_service (&s);
-    }
+  fprintf (out, "services[%u] = new Service(%lu, ", (*i)++, s->cat_id);
+  print_js_string (s->uri);
+  fputs (", ", out);
+  print_js_string (s->desc);
+  fputs (", ", out);
+  print_js_string (s->long_desc);
+  fputs (");\n", out);
 
-  destroy_service_list (&sl);
+  return 0;
 }
 
 void
-close_html (void)
+print_published_services (void)
 {
-  if (!should_close_html)
+  unsigned int i = 0;
+
+  fprintf (out, "services = new Array();");
+
+  /* The list is kept loaded to reuse its DB connection across requests. */
+  if (!is_list_posted
+      && (sl == NULL ? load_service_list (&sl) : reload_service_list (sl)))
     {
+      err_msg = "Cannot load service list for reading";
       return;
     }
 
-  printf ("<script type=\"text/javascript\">\n");
-  if (sl != NULL || err_msg == NULL)
+  if (for_each_service (sl, print_service, &i))
+    {
+      err_msg = "Cannot read a service from the list";
+    }
+}
+
+/**
+ * Prints the JavaScript statements that set the service data used by UI.html.
+ */
+void
+print_data (void)
+{
+  if (is_list_posted || err_msg == NULL)
     {
       print_categories ();
       print_published_services ();
     }
 
-  if (err_msg != NULL)
+  fputs ("errorMsg = ", out);
+  print_js_string (err_msg);
+  putc (';', out);
+}
+
+void
+close_html (void)
+{
+  fprintf (out, "<script type=\"text/javascript\">\n");
+  print_data ();
+  fprintf (out, "</script></body></html>");
+}
+
+/**
+ * Reads the next raw byte of the POST data, refilling the chunk from the input
+ * when it has been consumed.
+ *
+ * @return the byte or EOF if all POST data have been read or cannot be read.
+ */
+static int
+read_post_byte (struct post_decoder *d)
+{
+  if (d->chunk_pos == d->chunk_len)
     {
-      printf ("errorMsg = '%s';", err_msg);
+      size_t len = (d->remaining < sizeof (d->chunk)
+		    ? d->remaining : sizeof (d->chunk));
+
+      if (len == 0)
+	{
+	  return EOF;
+	}
+      if (fread (d->chunk, len, 1, d->in) == 0)
+	{
+	  l->SYS_ERR ("Cannot read POST data");
+	  d->err_msg = "POST data cannot be read";
+	  d->remaining = 0;
+	  return EOF;
+	}
+      d->remaining -= len;
+      d->chunk_pos = 0;
+      d->chunk_len = len;
     }
 
-  printf ("</script></body></html>");
+  return (unsigned char) d->chunk[d->chunk_pos++];
 }
 
 /**
- * Only decodes up to the first '&' or end of data buffer.
+ * URL-decodes the next byte of the POST value up to the first '&' or the end
+ * of the POST data. A CRLF pair is decoded as LF to undo the line break
+ * conversion of a form's textarea.
  *
- * @return the decoded data length excluding '&' if it exists (i.e., next
- *         decoding should start from data_buffer + decoded_data_length + 1
- *         if '&' presents in data buffer).
+ * @return the decoded byte or EOF if the value has been fully decoded.
  */
-static size_t
-url_decode (char *data_buffer, const char *buffer_end)
+static int
+decode_post_byte (struct post_decoder *d)
 {
-  const char *itr;
-  char *decoder = data_buffer;
-  char hexcode[3] = {0};
-  int hexcode_idx = 0;
-  int is_reading_hexcode = 0;
+  int c;
+
+  if (d->pending != EOF)
+    {
+      c = d->pending;
+      d->pending = EOF;
+      return c;
+    }
+  if (d->is_value_end)
+    {
+      return EOF;
+    }
 
-  for (itr = data_buffer; itr < buffer_end; itr++)
+  while (1)
     {
-      if (*itr == '&')
+      c = read_post_byte (d);
+      if (c == EOF || c == '&')
 	{
-	  break;
+	  d->is_value_end = 1;
+	  if (d->has_cr)
+	    {
+	      d->has_cr = 0;
+	      return '\r';
+	    }
+	  return EOF;
 	}
-      if (is_reading_hexcode)
+      if (c == '+')
 	{
-	  hexcode[hexcode_idx++] = *itr;
+	  c = ' ';
+	}
+      else if (c == '%')
+	{
+	  char hexcode[3] = {0};
+	  int hi = read_post_byte (d);
+	  int lo = read_post_byte (d);
 
-	  if (hexcode_idx == sizeof (hexcode) - 1)
+	  if (hi == EOF || lo == EOF)
 	    {
-	      is_reading_hexcode = 0;
-	      *decoder = (char) strtoul (hexcode, NULL, 16);
-if (decoder[0] == '\n' && decoder[-1] == '\r')
-{
-decoder[-1] = '\n';
-decoder--;
-}
-	      decoder++;
+	      d->is_value_end = 1;
+	      d->has_cr = 0;
+	      return EOF;
 	    }
+	  hexcode[0] = hi;
+	  hexcode[1] = lo;
+	  c = (unsigned char) strtoul (hexcode, NULL, 16);
 	}
-      else
+
+      if (d->has_cr)
 	{
-	  if (*itr == '%')
+	  if (c == '\n')
+	    {
+	      d->has_cr = 0;
+	      return c;
+	    }
+	  if (c != '\r')
 	    {
-	      is_reading_hexcode = 1;
-	      hexcode_idx = 0;
-	      continue;
+	      d->has_cr = 0;
+	      d->pending = c;
 	    }
+	  return '\r';
+	}
+      if (c != '\r')
+	{
+	  return c;
+	}
+      d->has_cr = 1;
+    }
+}
+
+/**
+ * Parses a decimal number of a TLV record up to its terminating ':'.
+ *
+ * @param [in] c the first byte of the number that has been decoded.
+ * @param [out] number the parsed number.
+ *
+ * @return 0 if there is no error or ERR_PARSE_DATA if the number is invalid.
+ */
+static int
+parse_post_number (struct post_decoder *d, int c, unsigned long *number)
+{
+  int digit_count = 0;
+
+  *number = 0;
+  for (; c != ':'; c = decode_post_byte (d))
+    {
+      if (c == EOF || !isdigit (c) || *number > POST_SERVICE_MAX)
+	{
+	  return ERR_PARSE_DATA;
+	}
+      *number = *number * 10 + (c - '0');
+      digit_count++;
+    }
 
-	  *decoder = ((*itr == '+') ? ' ' : *itr);
-	  decoder++;
+  return (digit_count == 0 ? ERR_PARSE_DATA : ERR_SUCCESS);
+}
+
+/**
+ * Consumes the key of the POST data that UI.html sends.
+ *
+ * @return 0 if the key is present or non-zero if the POST data are invalid.
+ */
+static int
+match_post_key (struct post_decoder *d)
+{
+  const char *key = "serializedServices=";
+
+  for (; *key != '\0'; key++)
+    {
+      if (read_post_byte (d) != (unsigned char) *key)
+	{
+	  return -1;
 	}
     }
 
-  return decoder - data_buffer;
+  return 0;
 }
 
 /**
- * Parses the TLV data as sent by UI.html. The first call to this function
- * with respect to the given iterator will initialize the iterator and no
- * data are parsed. The subsequent call to the same iterator, however, will
- * return the desired data.
+ * Decodes the next service in the TLV data as serialized by UI.html, where
+ * every service starts with a DESCRIPTION record followed by its fields.
+ * The strings of the service are kept in the decoder and stay valid until
+ * the next call. This is the callback of append_services().
  *
- * @return -1 if no data is parsed after the iterator has been initialized,
- *         0 if there is no error and data is parsed, or positive integer
- *         for other errors.
+ * @return 0 if a service is decoded, -1 if there is no more service or
+ *         a positive integer if there is an error.
  */
 static int
-parse_next_service (char **itr, const char *end_ptr, struct service *s)
+next_posted_service (struct service *s, void *arg)
 {
-  char *ptr = *itr;
+  struct post_decoder *d = arg;
+  int has_service = d->is_service_started;
+  size_t value_used = 0;
+
+  d->is_service_started = 0;
 
-  while (ptr < end_ptr)
+  while (1)
     {
       unsigned long type;
       unsigned long length;
-      char *colon;
+      unsigned long i;
+      char *value;
+      int c = decode_post_byte (d);
+
+      if (c == EOF)
+	{
+	  if (d->err_msg != NULL)
+	    {
+	      return ERR_PARSE_DATA;
+	    }
+	  return (has_service ? ERR_SUCCESS : -1);
+	}
 
-      /* Get type */
-      if ((colon = memchr (ptr, ':', end_ptr - ptr)) == NULL)
+      if (parse_post_number (d, c, &type)
+	  || parse_post_number (d, decode_post_byte (d), &length))
 	{
-	  return -1; /* no more data to parse */
+	  l->APP_ERR (ERR_PARSE_DATA, "Missing or corrupted type or length");
+	  goto error;
 	}
-      *colon = '\0';
-      type = strtoul (ptr, NULL, 10);
-      ptr = colon + 1;
 
-      /* Get length */
-      if (ptr >= end_ptr)
+      /* The nested length is not needed as the fields are decoded in turn */
+      if (type == DESCRIPTION)
 	{
-	  l->APP_ERR (ERR_PARSE_DATA, "Missing length");
-	  return ERR_PARSE_DATA;
+	  if (has_service)
+	    {
+	      d->is_service_started = 1;
+	      return ERR_SUCCESS;
+	    }
+	  has_service = 1;
+	  continue;
 	}
-      if ((colon = memchr (ptr, ':', end_ptr - ptr)) == NULL)
+
+      if (!has_service)
 	{
-	  l->APP_ERR (ERR_PARSE_DATA, "Cannot find length's ':'");
-	  return ERR_PARSE_DATA;
+	  l->APP_ERR (ERR_PARSE_DATA, "Field %lu precedes its service", type);
+	  goto error;
 	}
-      *colon = '\0';
-      length = strtoul (ptr, NULL, 10);
-      ptr = colon + 1;
-      
-      /* Get value */
-      if (ptr >= end_ptr || ptr + length > end_ptr)
+      if (length >= sizeof (d->values) - value_used)
 	{
-	  l->APP_ERR (ERR_PARSE_DATA, "Missing or corrupted value");
-	  return ERR_PARSE_DATA;
+	  l->APP_ERR (ERR_PARSE_DATA, "Service is longer than %u bytes",
+		      POST_SERVICE_MAX);
+	  goto error;
 	}
+
+      value = d->values + value_used;
+      for (i = 0; i < length; i++)
+	{
+	  if ((c = decode_post_byte (d)) == EOF)
+	    {
+	      l->APP_ERR (ERR_PARSE_DATA, "Missing or corrupted value");
+	      goto error;
+	    }
+	  value[i] = c;
+	}
+      value[length] = '\0';
+      value_used += length + 1;
+
       switch (type)
 	{
-	case DESCRIPTION:
-	  *itr = ptr;
-	  return ERR_SUCCESS;
 	case SERVICE_CAT_ID:
-	  ptr[length] = '\0';
-	  s->cat_id = strtoul (ptr, NULL, 10);
+	  s->cat_id = strtoul (value, NULL, 10);
 	  break;
 	case SERVICE_URI:
-	  ptr[length] = '\0';
-	  s->uri = ptr;
+	  s->uri = value;
 	  break;
 	case SERVICE_DESC:
-	  ptr[length] = '\0';
-	  s->desc = ptr;
+	  s->desc = value;
 	  break;
 	case SERVICE_LONG_DESC:
-	  ptr[length] = '\0';
-	  s->long_desc = ptr;
+	  s->long_desc = value;
 	  break;
 	default:
 	  l->APP_ERR (ERR_PARSE_DATA, "Unexpected type %lu", type);
-	  return ERR_PARSE_DATA;
+	  goto error;
+	}
+
+      /* The last record may end without its separator */
+      if ((c = decode_post_byte (d)) != ':' && c != EOF)
+	{
+	  l->APP_ERR (ERR_PARSE_DATA, "Missing separator after type %lu",
+		      type);
+	  goto error;
 	}
-      ptr += length + 1;
     }
 
-  *itr = ptr;
-  return ERR_SUCCESS;
+ error:
+  if (d->err_msg == NULL)
+    {
+      d->err_msg = "Cannot parse the next service";
+    }
+  return ERR_PARSE_DATA;
 }
 
-int
-main (int argc, char **argv, char **envp)
+/**
+ * Makes the UI template available in memory and computes its validators. The
+ * template is mapped for a CGI request that uses it once, but it is copied
+ * when it is kept across requests so that replacing the file in place cannot
+ * pull the pages from under the server.
+ *
+ * @param [in] is_resident non-zero if the template is kept across requests.
+ *
+ * @return 0 if there is no error or -1 if there is an error.
+ */
+static int
+read_ui (int is_resident)
 {
-  char *request_method = getenv ("REQUEST_METHOD");
-  FILE *ui_file;
-  char *buffer;
+  int ui_fd;
   struct stat ui_file_stat;
+  struct tm mtime;
 
-  SETUP_LOGGER (SERVICE_PUBLISHER_LOG_FILE, errtostr);
-
-  if (atexit (close_html))
+  if ((ui_fd = open (UI_FILE, O_RDONLY)) == -1)
     {
-      l->ERR ("Cannot register close_html at exit");
-      exit (EXIT_FAILURE);
+      l->SYS_ERR ("Cannot open " UI_FILE);
+      return -1;
     }
 
-  if ((ui_file = fopen (UI_FILE, "r")) == NULL)
+  if (fstat (ui_fd, &ui_file_stat) == -1)
     {
-      l->SYS_ERR ("Cannot open " UI_FILE);
-      exit (EXIT_FAILURE);
+      l->SYS_ERR ("Cannot stat " UI_FILE);
+      close (ui_fd);
+      return -1;
     }
+  ui_size = ui_file_stat.st_size;
 
-  if (fstat (fileno (ui_file), &ui_file_stat) == -1)
+  if (ui_size == 0)
     {
-      l->SYS_ERR ("Cannot allocate buffer to stat " UI_FILE);
-      exit (EXIT_FAILURE);
+      ui = NULL;
     }
-
-  buffer = malloc (ui_file_stat.st_size);
-  if (buffer == NULL)
+  else if (!is_resident)
     {
-      l->SYS_ERR ("Cannot allocate buffer to read " UI_FILE);
-      exit (EXIT_FAILURE);
+      ui = mmap (NULL, ui_size, PROT_READ, MAP_PRIVATE, ui_fd, 0);
+      if (ui == MAP_FAILED)
+	{
+	  l->SYS_ERR ("Cannot map " UI_FILE);
+	  ui = NULL;
+	  close (ui_fd);
+	  return -1;
+	}
+      is_ui_mapped = 1;
     }
-
-  if (fread (buffer, ui_file_stat.st_size, 1, ui_file) == 0)
+  else
     {
-      l->ERR ("Cannot read " UI_FILE);
-      exit (EXIT_FAILURE);
+      size_t read_size = 0;
+
+      ui = malloc (ui_size);
+      if (ui == NULL)
+	{
+	  l->SYS_ERR ("Cannot allocate buffer to read " UI_FILE);
+	  close (ui_fd);
+	  return -1;
+	}
+      while (read_size < ui_size)
+	{
+	  ssize_t rc = read (ui_fd, ui + read_size, ui_size - read_size);
+
+	  if (rc <= 0)
+	    {
+	      l->SYS_ERR ("Cannot read " UI_FILE);
+	      free (ui);
+	      ui = NULL;
+	      close (ui_fd);
+	      return -1;
+	    }
+	  read_size += rc;
+	}
     }
-  if (fclose (ui_file) == -1)
+  if (close (ui_fd) == -1)
     {
       l->SYS_ERR ("Cannot close " UI_FILE);
     }
 
-  should_close_html = 1;
-  printf ("Content-type: text/html\n\n");
-  fwrite (buffer, ui_file_stat.st_size, 1, stdout);
-  free (buffer);
-  buffer = NULL;
-
-  if (strcmp (request_method, "POST") == 0)
+  snprintf (ui_etag, sizeof (ui_etag), "\"%lx-%lx\"",
+	    (unsigned long) ui_file_stat.st_mtime, (unsigned long) ui_size);
+  if (gmtime_r (&ui_file_stat.st_mtime, &mtime) == NULL
+      || strftime (ui_last_modified, sizeof (ui_last_modified),
+		   "%a, %d %b %Y %H:%M:%S GMT", &mtime) == 0)
     {
-      char key[] = "serializedServices=";
-      unsigned long data_len = strtoul (getenv ("CONTENT_LENGTH"), NULL, 10);
-      char *data_buffer = malloc (data_len);
+      ui_last_modified[0] = '\0';
+    }
 
-      if (data_buffer == NULL)
+  return 0;
+}
+
+static void
+free_ui (void)
+{
+  if (is_ui_mapped)
+    {
+      if (munmap (ui, ui_size) == -1)
 	{
-	  l->APP_ERR (ERR_MEM, "Cannot read POST data");
-	  err_msg = "Not enough memory to read POST data";
-	  exit (EXIT_SUCCESS);
+	  l->SYS_ERR ("Cannot unmap " UI_FILE);
 	}
+    }
+  else
+    {
+      free (ui);
+    }
+  ui = NULL;
+}
+
+/**
+ * Checks the validators sent by a browser that has cached the UI page.
+ *
+ * @return non-zero if the cached page is still the current one.
+ */
+static int
+is_ui_not_modified (const struct request *r)
+{
+  if (r->if_none_match != NULL)
+    {
+      return (strstr (r->if_none_match, ui_etag) != NULL
+	      || strcmp (r->if_none_match, "*") == 0);
+    }
+
+  return (r->if_modified_since != NULL && ui_last_modified[0] != '\0'
+	  && strcmp (r->if_modified_since, ui_last_modified) == 0);
+}
 
-      if (fread (data_buffer, data_len, 1, stdin) == 0)
+/**
+ * Replaces the published service list with the one posted by UI.html. The
+ * outcome is reported through err_msg and is_list_posted.
+ */
+static void
+handle_post (const char *content_length, FILE *in)
+{
+  struct post_decoder *d = malloc (sizeof (*d));
+  int rc;
+
+  if (d == NULL)
+    {
+      l->APP_ERR (ERR_MEM, "Cannot read POST data");
+      err_msg = "Not enough memory to read POST data";
+      return;
+    }
+  memset (d, 0, sizeof (*d));
+  d->in = in;
+  d->remaining = (content_length == NULL
+		  ? 0 : strtoul (content_length, NULL, 10));
+  d->pending = EOF;
+
+  if (match_post_key (d))
+    {
+      err_msg = (d->err_msg == NULL ? "Invalid POST data" : d->err_msg);
+    }
+  else if (sl == NULL ? load_service_list (&sl) : reload_service_list (sl))
+    {
+      err_msg = "Cannot load service list for writing";
+    }
+  else if (del_service_all (sl))
+    {
+      err_msg = "Cannot empty service list";
+    }
+  else
+    {
+      if (append_services (sl, next_posted_service, d))
 	{
-	  err_msg = "POST data cannot be read";
-	  exit (EXIT_SUCCESS);
+	  err_msg = (d->err_msg == NULL ? "Cannot add service" : d->err_msg);
 	}
-
-      if (strncmp (data_buffer, key, strlen (key)) == 0)
+      if (err_msg == NULL)
 	{
-	  if (load_service_list (&sl))
+	  /* The posted list is shown again to be corrected if it is too long. */
+	  if ((rc = save_service_list (sl)) == ERR_SSID_TOO_LONG)
+	    {
+	      err_msg =
+		"Services do not fit into the SSID (try to reduce"
+		" the character count of the descriptions or the"
+		" number of services)";
+	      is_list_posted = 1;
+	    }
+	  else if (rc != 0)
 	    {
-	      err_msg = "Cannot load service list for writing";
+	      err_msg = "Error in saving the service list";
 	    }
 	  else
 	    {
-	      if (del_service_all (sl))
-		{
-		  err_msg = "Cannot empty service list";
-		}
-	      else
-		{
-		  int rc;
-		  struct service s;
-		  char *itr = data_buffer + strlen (key);
-		  const char *itr_end = data_buffer + data_len;
-
-		  data_len = url_decode (itr, itr_end);
-		  if (parse_next_service (&itr, itr_end, &s) > 0)
-		    {
-		      err_msg = "Cannot initialize POST data iterator";
-		    }
-		  else
-		    {
-		      while (itr < itr_end)
-			{
-			  memset (&s, 0, sizeof (s));
-			  rc = parse_next_service (&itr, itr_end, &s);
-			  if (rc > 0)
-			    {
-			      err_msg = "Cannot parse the next service";
-			      break;
-			    }
-			  if (add_service_last (sl, &s))
-			    {
-			      err_msg = "Cannot add service";
-			      break;
-			    }
-			  if (rc == -1)
-			    {
-			      break;
-			    }
-			}
-		    }
-		  if (err_msg == NULL)
-		    {
-		      if ((rc = save_service_list (sl)) == ERR_SSID_TOO_LONG)
-			{
-			  err_msg =
-			    "Services do not fit into the SSID (try to reduce"
-			    " the character count of the descriptions or the"
-			    " number of services)";
-			  free (data_buffer);
-			  exit (EXIT_FAILURE);
-			}
-		      else if (rc != 0)
-			{
-			  err_msg = "Error in saving the service list";
-			}
-		      else
-			{
-			  free (data_buffer);
-			  exit (EXIT_SUCCESS);
-			}
-		    }
-		}
+	      is_list_posted = 1;
 	    }
+	}
+    }
+
+  /* The rest of the request is consumed before responding to it. */
+  while (read_post_byte (d) != EOF)
+    {
+      d->chunk_pos = d->chunk_len;
+    }
+  free (d);
+}
 
-	  destroy_service_list (&sl);
+/**
+ * Serves a request by writing the response to out. A GET of the UI page is
+ * answered with the static page that browsers revalidate with its ETag and
+ * Last-Modified so that an unchanged page is not sent again, and the page
+ * fetches the service data with a GET or POST of the DATA_QUERY. A POST
+ * without the query comes from a browser that cannot post the data by
+ * itself and is answered with the page and the data together.
+ *
+ * @param [in] r the request.
+ * @param [in] in the body of the request.
+ */
+static void
+serve_request (const struct request *r, FILE *in)
+{
+  int is_data = (r->query_string != NULL
+		 && strcmp (r->query_string, DATA_QUERY) == 0);
+  int is_get = (r->method != NULL && strcmp (r->method, "GET") == 0);
+  int is_post = (r->method != NULL && strcmp (r->method, "POST") == 0);
+
+  err_msg = NULL;
+  is_list_posted = 0;
+
+  if (is_get && !is_data)
+    {
+      if (is_ui_not_modified (r))
+	{
+	  fprintf (out, "Status: 304 Not Modified\n"
+		   "ETag: %s\n\n", ui_etag);
+	  return;
 	}
-      else
+
+      fprintf (out,
+	       "Content-type: text/html\n"
+	       "Cache-Control: no-cache\n"
+	       "ETag: %s\n", ui_etag);
+      if (ui_last_modified[0] != '\0')
 	{
-	  err_msg = "Invalid POST data";
+	  fprintf (out, "Last-Modified: %s\n", ui_last_modified);
 	}
+      fprintf (out, "\n");
+      fwrite (ui, ui_size, 1, out);
+      fputs (UI_PAGE_END, out);
+      return;
+    }
 
-      free (data_buffer);
+  if (is_data)
+    {
+      fprintf (out,
+	       "Content-type: text/javascript\n"
+	       "Cache-Control: no-store\n\n");
+    }
+  else
+    {
+      fprintf (out, "Content-type: text/html\n\n");
+      fwrite (ui, ui_size, 1, out);
+    }
+
+  if (is_post)
+    {
+      handle_post (r->content_length, in);
     }
-  else if (strcmp (request_method, "GET") != 0)
+  else if (!is_get)
     {
       err_msg = "Invalid request method (not GET nor POST)";
     }
 
-  exit (EXIT_SUCCESS);
+  if (is_data)
+    {
+      print_data ();
+    }
+  else
+    {
+      close_html ();
+    }
 }
 
+/**
+ * Reads the headers of an SCGI request, which are a netstring of
+ * NUL-terminated names and values, and serves the request. A request that
+ * does not arrive within SCGI_TIMEOUT is treated as malformed.
+ *
+ * @param [in] conn the connected socket that is closed when the request has
+ *                  been served.
+ */
+static void
+serve_scgi_connection (int conn)
+{
+  FILE *in, *conn_out;
+  unsigned long headers_len;
+  char *headers = NULL, *itr;
+  struct request r = {0};
+  const struct timeval timeout = {
+    .tv_sec = SCGI_TIMEOUT,
+    .tv_usec = 0,
+  };
+  int conn_dup;
+
+  if (setsockopt (conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout))
+      == -1
+      || setsockopt (conn, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+		     sizeof (timeout)) == -1)
+    {
+      l->SYS_ERR ("Cannot set SCGI connection timeout");
+      close (conn);
+      return;
+    }
+
+  if ((conn_dup = dup (conn)) == -1)
+    {
+      l->SYS_ERR ("Cannot duplicate SCGI connection");
+      close (conn);
+      return;
+    }
+  if ((in = fdopen (conn, "r")) == NULL)
+    {
+      l->SYS_ERR ("Cannot read SCGI connection");
+      close (conn);
+      close (conn_dup);
+      return;
+    }
+  if ((conn_out = fdopen (conn_dup, "w")) == NULL)
+    {
+      l->SYS_ERR ("Cannot write SCGI connection");
+      fclose (in);
+      close (conn_dup);
+      return;
+    }
+  setvbuf (conn_out, out_buffer, _IOFBF, sizeof (out_buffer));
+
+  if (fscanf (in, "%lu", &headers_len) != 1 || ferror (in)
+      || fgetc (in) != ':'
+      || headers_len == 0 || headers_len > SCGI_HEADERS_MAX)
+    {
+      l->ERR ("Malformed SCGI headers length");
+      goto finish;
+    }
+  headers = malloc (headers_len);
+  if (headers == NULL)
+    {
+      l->APP_ERR (ERR_MEM, "Cannot read SCGI headers");
+      goto finish;
+    }
+  if (fread (headers, headers_len, 1, in) == 0 || fgetc (in) != ','
+      || headers[headers_len - 1] != '\0')
+    {
+      l->ERR ("Malformed SCGI headers");
+      goto finish;
+    }
+
+  for (itr = headers; itr < headers + headers_len; )
+    {
+      const char *name = itr;
+      const char *value = name + strlen (name) + 1;
+
+      if (value >= headers + headers_len)
+	{
+	  l->ERR ("SCGI header %s has no value", name);
+	  goto finish;
+	}
+      if (strcmp (name, "REQUEST_METHOD") == 0)
+	{
+	  r.method = value;
+	}
+      else if (strcmp (name, "CONTENT_LENGTH") == 0)
+	{
+	  r.content_length = value;
+	}
+      else if (strcmp (name, "QUERY_STRING") == 0)
+	{
+	  r.query_string = value;
+	}
+      else if (strcmp (name, "HTTP_IF_NONE_MATCH") == 0)
+	{
+	  r.if_none_match = value;
+	}
+      else if (strcmp (name, "HTTP_IF_MODIFIED_SINCE") == 0)
+	{
+	  r.if_modified_since = value;
+	}
+      itr = (char *) value + strlen (value) + 1;
+    }
+
+  out = conn_out;
+  serve_request (&r, in);
+
+ finish:
+  free (headers);
+  fclose (in);
+  if (fclose (conn_out) == EOF)
+    {
+      l->SYS_ERR ("Cannot send SCGI response");
+    }
+  out = NULL;
+}
+
+static void
+stop (int signum)
+{
+  is_stopped = 1;
+}
+
+/**
+ * Serves SCGI requests one at a time until SIGTERM or SIGINT is received.
+ *
+ * @param [in] sock the listening socket.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+run_scgi_server (int sock)
+{
+  struct sigaction stop_action = {
+    .sa_handler = stop,
+  };
+
+  /* A client that goes away must not kill the server. */
+  signal (SIGPIPE, SIG_IGN);
+  sigemptyset (&stop_action.sa_mask);
+  if (sigaction (SIGTERM, &stop_action, NULL) == -1
+      || sigaction (SIGINT, &stop_action, NULL) == -1)
+    {
+      l->SYS_ERR ("Cannot handle stop signals");
+      return ERR_SOCK;
+    }
+
+  if (listen (sock, SCGI_BACKLOG) == -1)
+    {
+      l->SYS_ERR ("Cannot listen for SCGI connections");
+      return ERR_SOCK;
+    }
+
+  while (!is_stopped)
+    {
+      int conn = accept (sock, NULL, NULL);
+
+      if (conn == -1)
+	{
+	  if (errno != EINTR && errno != ECONNABORTED)
+	    {
+	      l->SYS_ERR ("Cannot accept SCGI connection");
+	      return ERR_SOCK;
+	    }
+	  continue;
+	}
+
+      serve_scgi_connection (conn);
+    }
+
+  l->INFO ("SCGI server stopped");
+
+  return ERR_SUCCESS;
+}
+
+/**
+ * Creates the listening socket of the SCGI mode.
+ *
+ * @param [in] port the TCP port on the loopback interface or 0 to use path.
+ * @param [in] path the path of the UNIX domain socket that replaces any
+ *                  stale socket or NULL to use port.
+ * @param [out] sock the socket.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+static int
+create_scgi_socket (unsigned short port, const char *path, int *sock)
+{
+  struct sockaddr_in in_addr = {
+    .sin_family = AF_INET,
+    .sin_addr = {htonl (INADDR_LOOPBACK)},
+    .sin_port = htons (port),
+  };
+  struct sockaddr_un un_addr = {
+    .sun_family = AF_UNIX,
+  };
+  int reuse = 1;
+
+  if (path != NULL)
+    {
+      if (strlen (path) >= sizeof (un_addr.sun_path))
+	{
+	  l->ERR ("SCGI socket path %s is too long", path);
+	  return ERR_SOCK;
+	}
+      strcpy (un_addr.sun_path, path);
+      unlink (path);
+    }
+
+  *sock = socket (path != NULL ? AF_UNIX : AF_INET, SOCK_STREAM, 0);
+  if (*sock == -1)
+    {
+      l->SYS_ERR ("Cannot create SCGI socket");
+      return ERR_SOCK;
+    }
+
+  if (path == NULL
+      && setsockopt (*sock, SOL_SOCKET, SO_REUSEADDR, &reuse,
+		     sizeof (reuse)) == -1)
+    {
+      l->SYS_ERR ("Cannot reuse SCGI port");
+    }
+
+  if ((path != NULL
+       ? bind (*sock, (struct sockaddr *) &un_addr, sizeof (un_addr))
+       : bind (*sock, (struct sockaddr *) &in_addr, sizeof (in_addr))) == -1)
+    {
+      l->SYS_ERR ("Cannot name SCGI socket");
+      close (*sock);
+      return ERR_SOCK;
+    }
+
+  return ERR_SUCCESS;
+}
+
+static void
+print_usage (const char *prog)
+{
+  fprintf (stderr,
+	   "Usage: %s [-p PORT | -s SOCKET_PATH]\n"
+	   "  Without an option, serves one request as a CGI program.\n"
+	   "  -p PORT serves SCGI requests on the TCP port of 127.0.0.1.\n"
+	   "  -s SOCKET_PATH serves SCGI requests on a UNIX domain socket.\n",
+	   prog);
+}
+
+int
+main (int argc, char **argv, char **envp)
+{
+  unsigned long port = 0;
+  const char *path = NULL;
+  int opt, sock, rc = EXIT_SUCCESS;
+
+  while ((opt = getopt (argc, argv, "p:s:")) != -1)
+    {
+      switch (opt)
+	{
+	case 'p':
+	  port = strtoul (optarg, NULL, 10);
+	  break;
+	case 's':
+	  path = optarg;
+	  break;
+	default:
+	  print_usage (argv[0]);
+	  exit (EXIT_FAILURE);
+	}
+    }
+  if (optind != argc || port > 65535 || (port != 0 && path != NULL))
+    {
+      print_usage (argv[0]);
+      exit (EXIT_FAILURE);
+    }
+
+  SETUP_LOGGER (SERVICE_PUBLISHER_LOG_FILE, errtostr);
+
+  if (read_ui (port != 0 || path != NULL))
+    {
+      exit (EXIT_FAILURE);
+    }
+
+  if (port == 0 && path == NULL)
+    {
+      struct request r = {
+	.method = getenv ("REQUEST_METHOD"),
+	.content_length = getenv ("CONTENT_LENGTH"),
+	.query_string = getenv ("QUERY_STRING"),
+	.if_none_match = getenv ("HTTP_IF_NONE_MATCH"),
+	.if_modified_since = getenv ("HTTP_IF_MODIFIED_SINCE"),
+      };
+
+      out = stdout;
+      setvbuf (out, out_buffer, _IOFBF, sizeof (out_buffer));
+      serve_request (&r, stdin);
+    }
+  else if (create_scgi_socket (port, path, &sock)
+	   || run_scgi_server (sock))
+    {
+      rc = EXIT_FAILURE;
+    }
+
+  destroy_service_list (&sl);
+  free_ui ();
+
+  exit (rc);
+}
@@ -27,8 +27,13 @@
 extern "C" {
 #endif
 
-/** The maximum size in bytes of an SSID. */
+#ifndef SSID_MAX_LEN
+/**
+ * The maximum size in bytes of an SSID. A benchmark may define a larger one to
+ * save more services than an SSID can advertise.
+ */
 #define SSID_MAX_LEN 32
+#endif
 
 /**
  * Sets the SSID.
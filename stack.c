@@ -21,17 +21,30 @@
 #include "logger.h"
 #include "stack.h"
 
-/** The number of new elements to be accommodated when the stack is enlarged. */
-#define STACK_INCREMENT 10
+/**
+ * The number of bytes stored inside the stack object itself so that a
+ * shallow stack, like the parents of the category under a category list
+ * iterator, needs no other allocation.
+ */
+#define STACK_INLINE_SIZE 128
+
+/** The number of elements of the first heap storage of a stack. */
+#define STACK_INITIAL_CAPACITY 16
 
 /** The implementation of stack of objects. */
 struct stack_impl
 {
-  void *base; /**< The pointer to the stack. */
-  void *end; /**< The end of the stack. */
+  char *base; /**< The pointer to the stack. */
+  unsigned long capacity; /**< The number of elements the stack can hold. */
   unsigned long next_idx; /**< The push index of the next element. */
-  int is_empty; /**< 0 if the stack is not empty but 1 if it is. */
   unsigned long element_size; /**< The size in bytes of an element. */
+  union
+  {
+    char bytes[STACK_INLINE_SIZE]; /**< The storage. */
+    long double align_ld; /**< The alignment for floating-point elements. */
+    void *align_ptr; /**< The alignment for pointer elements. */
+    long long align_ll; /**< The alignment for integral elements. */
+  } inline_storage; /**< The storage used until the stack grows beyond it. */
 };
 
 int
@@ -46,23 +59,23 @@ create_stack (stack **s, unsigned long element_size)
       return ERR_MEM;
     }
   memset (p, 0, sizeof (*p));
-  p->is_empty = 1;
   p->element_size = element_size;
-
-  p->base = malloc (STACK_INCREMENT * element_size);
-  if (p->base == NULL)
-    {
-      l->ERR ("No memory to store data in stack");
-      free (p);
-      return ERR_MEM;
-    }
-  p->end = p->base + STACK_INCREMENT * element_size;
+  p->base = p->inline_storage.bytes;
+  /* Objects of no size never need storage. */
+  p->capacity = (element_size == 0
+		 ? (unsigned long) -1 : STACK_INLINE_SIZE / element_size);
 
   *s = p;
 
   return ERR_SUCCESS;
 }
 
+static int
+is_inline (const stack *s)
+{
+  return s->base == s->inline_storage.bytes;
+}
+
 void
 destroy_stack (stack **s)
 {
@@ -71,27 +84,109 @@ destroy_stack (stack **s)
       return;
     }
 
-  free ((*s)->base);
+  if (!is_inline (*s))
+    {
+      free ((*s)->base);
+    }
   free ((void *) *s);
 
   *s = NULL;
 }
 
+/**
+ * Moves the elements of a stack to a heap storage of the given capacity that
+ * must be able to hold them.
+ */
 static int
-enlarge_stack (stack *s)
+resize_stack (stack *s, unsigned long new_capacity)
 {
-  size_t cur_element_count = s->next_idx;
-  size_t new_element_count = cur_element_count + STACK_INCREMENT;
-  void *resized_stack = realloc (s->base, new_element_count * s->element_size);
+  char *resized_stack;
+
+  if (is_inline (s))
+    {
+      resized_stack = malloc (new_capacity * s->element_size);
+      if (resized_stack != NULL)
+	{
+	  memcpy (resized_stack, s->base, s->next_idx * s->element_size);
+	}
+    }
+  else
+    {
+      resized_stack = realloc (s->base, new_capacity * s->element_size);
+    }
 
   if (resized_stack == NULL)
     {
-      l->ERR ("Cannot enlarge stack");
+      l->ERR ("Cannot resize stack to %lu elements", new_capacity);
       return ERR_MEM;
     }
 
   s->base = resized_stack;
-  s->end = s->base + new_element_count * s->element_size;
+  s->capacity = new_capacity;
+
+  return ERR_SUCCESS;
+}
+
+int
+reserve_stack (unsigned long count, stack *s)
+{
+  unsigned long new_capacity;
+
+  if (count <= s->capacity)
+    {
+      return ERR_SUCCESS;
+    }
+
+  if (count > (unsigned long) -1 / 2 / s->element_size)
+    {
+      l->ERR ("Cannot reserve %lu elements in stack", count);
+      return ERR_MEM;
+    }
+
+  /* Doubling makes the copying amortized constant per pushed element. */
+  new_capacity = (s->capacity < STACK_INITIAL_CAPACITY
+		  ? STACK_INITIAL_CAPACITY : s->capacity);
+  while (new_capacity < count)
+    {
+      new_capacity *= 2;
+    }
+
+  return resize_stack (s, new_capacity);
+}
+
+int
+shrink_stack (stack *s)
+{
+  char *shrunk_stack;
+
+  if (is_inline (s))
+    {
+      return ERR_SUCCESS;
+    }
+
+  if (s->next_idx * s->element_size <= STACK_INLINE_SIZE)
+    {
+      memcpy (s->inline_storage.bytes, s->base,
+	      s->next_idx * s->element_size);
+      free (s->base);
+      s->base = s->inline_storage.bytes;
+      s->capacity = STACK_INLINE_SIZE / s->element_size;
+      return ERR_SUCCESS;
+    }
+
+  if (s->next_idx == s->capacity)
+    {
+      return ERR_SUCCESS;
+    }
+
+  shrunk_stack = realloc (s->base, s->next_idx * s->element_size);
+  if (shrunk_stack == NULL)
+    {
+      l->ERR ("Cannot shrink stack");
+      return ERR_MEM;
+    }
+  s->base = shrunk_stack;
+  s->capacity = s->next_idx;
 
   return ERR_SUCCESS;
 }
@@ -99,11 +194,11 @@ enlarge_stack (stack *s)
 int
 push (void *e, stack *s)
 {
-  if (s->end - s->base == s->next_idx * s->element_size)
+  if (s->next_idx == s->capacity)
     {
       int rc;
 
-      if ((rc = enlarge_stack (s)))
+      if ((rc = reserve_stack (s->next_idx + 1, s)))
 	{
 	  l->APP_ERR (rc, "Cannot push into stack");
 	  return rc;
@@ -113,18 +208,39 @@ push (void *e, stack *s)
   memcpy (s->base + s->next_idx * s->element_size, e, s->element_size);
   s->next_idx++;
 
-  if (s->is_empty)
+  return ERR_SUCCESS;
+}
+
+int
+push_n (const void *e, unsigned long count, stack *s)
+{
+  if (count > s->capacity - s->next_idx)
     {
-      s->is_empty = 0;
+      int rc;
+
+      if (count > (unsigned long) -1 - s->next_idx)
+	{
+	  l->ERR ("Cannot push %lu elements into stack", count);
+	  return ERR_MEM;
+	}
+      if ((rc = reserve_stack (s->next_idx + count, s)))
+	{
+	  l->APP_ERR (rc, "Cannot push into stack");
+	  return rc;
+	}
     }
 
+  memcpy (s->base + s->next_idx * s->element_size, e,
+	  count * s->element_size);
+  s->next_idx += count;
+
   return ERR_SUCCESS;
 }
 
 int
 pop (void *e, stack *s)
 {
-  if (s->is_empty)
+  if (s->next_idx == 0)
     {
       return -1;
     }
@@ -136,9 +252,23 @@ pop (void *e, stack *s)
       memcpy (e, s->base + s->next_idx * s->element_size, s->element_size);
     }
 
-  if (s->next_idx == 0)
+  return ERR_SUCCESS;
+}
+
+int
+pop_n (void *e, unsigned long count, stack *s)
+{
+  if (count > s->next_idx)
     {
-      s->is_empty = 1;
+      return -1;
+    }
+
+  s->next_idx -= count;
+
+  if (e != NULL)
+    {
+      memcpy (e, s->base + s->next_idx * s->element_size,
+	      count * s->element_size);
     }
 
   return ERR_SUCCESS;
@@ -147,7 +277,7 @@ pop (void *e, stack *s)
 int
 top (void *e, const stack *s)
 {
-  if (s->is_empty)
+  if (s->next_idx == 0)
     {
       return -1;
     }
@@ -160,5 +290,11 @@ top (void *e, const stack *s)
 int
 is_empty (const stack *s)
 {
-  return s->is_empty;
+  return s->next_idx == 0;
+}
+
+unsigned long
+get_stack_size (const stack *s)
+{
+  return s->next_idx;
 }
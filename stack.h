@@ -15,7 +15,10 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
  *************************************************************************//**
  * @file stack.h
- * @brief A stack data structure.
+ * @brief A stack data structure. A stack holds its first few elements inside
+ *        itself and moves them to the heap only when they do not fit, and its
+ *        storage is doubled when it is full so that pushing is amortized
+ *        constant time.
  ****************************************************************************/
 
 #ifndef STACK_H
@@ -62,6 +65,20 @@ destroy_stack (stack **s);
 int
 push (void *e, stack *s);
 
+/**
+ * Pushes several objects to the top of the stack at once as if they are
+ * pushed one by one from the first to the last.
+ *
+ * @param [in] e the array of objects to push.
+ * @param [in] count the number of objects in the array.
+ * @param [in] s the stack to store the objects.
+ *
+ * @return 0 if there is no error or non-zero if there is an error in which
+ *         case nothing is pushed.
+ */
+int
+push_n (const void *e, unsigned long count, stack *s);
+
 /**
  * Pops an object from the top of the stack.
  *
@@ -75,6 +92,22 @@ push (void *e, stack *s);
 int
 pop (void *e, stack *s);
 
+/**
+ * Pops several objects from the top of the stack at once. The popped objects
+ * are stored in the order in which they were pushed so that popping what
+ * push_n() has pushed gives back the same array.
+ *
+ * @param [in] e a pointer to a space for count objects to contain the popped
+ *               objects (pass NULL to not store the popped objects).
+ * @param [in] count the number of objects to pop.
+ * @param [in] s the stack to be popped.
+ *
+ * @return 0 if there is no error or -1 if the stack has fewer than count
+ *         objects in which case nothing is popped.
+ */
+int
+pop_n (void *e, unsigned long count, stack *s);
+
 /**
  * Reads the top element of a stack.
  *
@@ -97,6 +130,39 @@ top (void *e, const stack *s);
 int
 is_empty (const stack *s);
 
+/**
+ * Gets the number of objects in the stack.
+ *
+ * @param [in] s the stack to be checked.
+ *
+ * @return the number of objects.
+ */
+unsigned long
+get_stack_size (const stack *s);
+
+/**
+ * Makes the stack able to hold the given number of objects without allocating
+ * memory, for example before pushing many objects one by one.
+ *
+ * @param [in] count the number of objects to hold.
+ * @param [in] s the stack to be enlarged.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+reserve_stack (unsigned long count, stack *s);
+
+/**
+ * Frees the memory that the stack does not need to hold its objects, for
+ * example after a deep stack has been popped and will stay shallow.
+ *
+ * @param [in] s the stack to be shrunk.
+ *
+ * @return 0 if there is no error or non-zero if there is an error.
+ */
+int
+shrink_stack (stack *s);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,173 @@
+/*****************************************************************************
+ * Copyright (C) 2010  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ * @file stack_bench.c
+ * @brief The micro-benchmarks of the stack used to remember the parents of
+ *        the category under a category list iterator: descending to a depth
+ *        and ascending back with a new stack as a category list does on its
+ *        first go_sub(), with a reused stack and with the bulk operations.
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "app_err.h"
+#include "bench.h"
+#include "logger.h"
+#include "stack.h"
+
+GLOBAL_LOGGER;
+
+/** An element as large as the one pushed by a category list. */
+struct parent
+{
+  size_t pos; /**< The position of the parent category. */
+  unsigned long next_offset; /**< The position in the parent level. */
+};
+
+/** The stack reused by the benchmarks. */
+static stack *s = NULL;
+
+/** The elements pushed and popped by the bulk benchmarks. */
+static struct parent *parents = NULL;
+
+static void
+setup_stack (const struct bench *b)
+{
+  size_t i;
+  int rc;
+
+  if ((rc = create_stack (&s, sizeof (struct parent))))
+    {
+      die_bench ("create_stack", rc);
+    }
+
+  parents = malloc (b->arg1 * sizeof (*parents));
+  if (parents == NULL)
+    {
+      die_bench ("malloc", ERR_MEM);
+    }
+  for (i = 0; i < b->arg1; i++)
+    {
+      parents[i].pos = i;
+      parents[i].next_offset = i + 1;
+    }
+}
+
+static void
+teardown_stack (const struct bench *b)
+{
+  destroy_stack (&s);
+  free (parents);
+  parents = NULL;
+}
+
+static void
+descend_and_ascend (stack *walked, size_t depth)
+{
+  struct parent p;
+  size_t i;
+  int rc;
+
+  for (i = 0; i < depth; i++)
+    {
+      p.pos = i;
+      p.next_offset = i + 1;
+      if ((rc = push (&p, walked)))
+	{
+	  die_bench ("push", rc);
+	}
+    }
+  while (pop (&p, walked) == 0)
+    {
+      bench_sink += p.pos;
+    }
+}
+
+static void
+bench_navigate (const struct bench *b, uint64_t n)
+{
+  stack *walked;
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((rc = create_stack (&walked, sizeof (struct parent))))
+	{
+	  die_bench ("create_stack", rc);
+	}
+      descend_and_ascend (walked, b->arg1);
+      destroy_stack (&walked);
+    }
+}
+
+static void
+bench_push_pop (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+
+  for (i = 0; i < n; i++)
+    {
+      descend_and_ascend (s, b->arg1);
+    }
+}
+
+static void
+bench_push_n_pop_n (const struct bench *b, uint64_t n)
+{
+  uint64_t i;
+  int rc;
+
+  for (i = 0; i < n; i++)
+    {
+      if ((rc = push_n (parents, b->arg1, s)))
+	{
+	  die_bench ("push_n", rc);
+	}
+      if ((rc = pop_n (parents, b->arg1, s)))
+	{
+	  die_bench ("pop_n", rc);
+	}
+      bench_sink += parents[0].pos;
+    }
+}
+
+/** Declares a benchmark of a stack of the given depth. */
+#define STACK_BENCH(name, run, depth)					\
+  {name "/depth=" #depth, setup_stack, run, depth, 0, 0, teardown_stack}
+
+/** The benchmarks. */
+static const struct bench benches[] = {
+  STACK_BENCH ("Navigate", bench_navigate, 4),
+  STACK_BENCH ("Navigate", bench_navigate, 64),
+  STACK_BENCH ("Navigate", bench_navigate, 4096),
+  STACK_BENCH ("PushPop", bench_push_pop, 4),
+  STACK_BENCH ("PushPop", bench_push_pop, 64),
+  STACK_BENCH ("PushPop", bench_push_pop, 4096),
+  STACK_BENCH ("PushNPopN", bench_push_n_pop_n, 4),
+  STACK_BENCH ("PushNPopN", bench_push_n_pop_n, 64),
+  STACK_BENCH ("PushNPopN", bench_push_n_pop_n, 4096),
+};
+
+int
+main (int argc, char **argv, char **envp)
+{
+  SETUP_LOGGER ("/dev/stderr", errtostr);
+  set_log_level (LOG_LEVEL_ERR);
+
+  run_benches (benches, sizeof (benches) / sizeof (*benches), argc, argv);
+
+  exit (EXIT_SUCCESS);
+}
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include "app_err.h"
 #include "logger.h"
 #include "stack.h"
@@ -74,7 +75,66 @@ main (int argc, char **argv, char **envp)
     }
   assert (i == 0);
   assert (is_empty (s));
+  assert (shrink_stack (s) == 0);
+  assert (get_stack_size (s) == 0);
 
+  /* bulk operations keep the order of the pushed elements */
+  int elements[100], popped[100];
+  for (i = 0; i < 100; i++)
+    {
+      elements[i] = i;
+    }
+  assert (reserve_stack (5, s) == 0);
+  assert (push_n (elements, 5, s) == 0);
+  assert (push_n (elements + 5, 95, s) == 0);
+  assert (get_stack_size (s) == 100);
+  assert (top (&top_element, s) == 0);
+  assert (top_element == 99);
+  assert (pop_n (popped, 101, s) == -1);
+  assert (get_stack_size (s) == 100);
+  assert (pop_n (popped + 60, 40, s) == 0);
+  assert (pop (&top_element, s) == 0);
+  assert (top_element == 59);
+  assert (pop_n (popped, 59, s) == 0);
+  assert (is_empty (s));
+  for (i = 0; i < 100; i++)
+    {
+      assert (i == 59 || popped[i] == i);
+    }
+  assert (pop_n (NULL, 0, s) == 0);
+  assert (pop_n (NULL, 1, s) == -1);
+
+  /* shrinking keeps the elements */
+  assert (reserve_stack (10000, s) == 0);
+  assert (push_n (elements, 100, s) == 0);
+  assert (shrink_stack (s) == 0);
+  assert (get_stack_size (s) == 100);
+  assert (pop_n (NULL, 97, s) == 0);
+  assert (shrink_stack (s) == 0);
+  assert (pop_n (popped, 3, s) == 0);
+  assert (popped[0] == 0 && popped[1] == 1 && popped[2] == 2);
+  assert (push (&an_integer, s) == 0);
+  assert (top (&top_element, s) == 0);
+  assert (top_element == 20);
+
+  destroy_stack (&s);
+
+  /* elements too large to be held inside the stack */
+  struct
+  {
+    char bytes[200];
+  } large, large_top;
+  assert (create_stack (&s, sizeof (large)) == 0);
+  for (i = 0; i < 3; i++)
+    {
+      memset (&large, i, sizeof (large));
+      assert (push (&large, s) == 0);
+    }
+  assert (pop (&large_top, s) == 0);
+  assert (large_top.bytes[0] == 2 && large_top.bytes[199] == 2);
+  assert (shrink_stack (s) == 0);
+  assert (top (&large_top, s) == 0);
+  assert (large_top.bytes[0] == 1 && large_top.bytes[199] == 1);
   destroy_stack (&s);
 
   exit (EXIT_SUCCESS);
@@ -105,3 +105,491 @@ read_chunk (const void *data,
 
   return ptr;
 }
+
+/** The initial capacity in bytes of tlv_vec::hdr. */
+#define VEC_HDR_INITIAL_SIZE 64
+
+/** The initial capacity of tlv_vec::seg. */
+#define VEC_SEG_INITIAL_SIZE 8
+
+/** A contiguous part of a tlv_vec packet. */
+struct tlv_vec_seg
+{
+  const char *ref; /**<
+		    * The referenced bytes or NULL if the bytes are in
+		    * tlv_vec::hdr.
+		    */
+  uint32_t offset; /**< The offset in tlv_vec::hdr if tlv_vec_seg::ref is NULL. */
+  uint32_t len; /**< The length of the segment in bytes. */
+};
+
+void
+init_vec (struct tlv_vec *v)
+{
+  memset (v, 0, sizeof (*v));
+}
+
+void
+destroy_vec (struct tlv_vec *v)
+{
+  free (v->hdr);
+  free (v->seg);
+  free (v->iov);
+  init_vec (v);
+}
+
+static struct tlv_vec_seg *
+new_vec_seg (struct tlv_vec *v)
+{
+  if (v->seg_count == v->seg_size)
+    {
+      int new_size = (v->seg_size == 0
+		      ? VEC_SEG_INITIAL_SIZE : v->seg_size * 2);
+      struct tlv_vec_seg *ptr = realloc (v->seg, new_size * sizeof (*ptr));
+
+      if (ptr == NULL)
+	{
+	  return NULL;
+	}
+      v->seg = ptr;
+      v->seg_size = new_size;
+    }
+
+  return &v->seg[v->seg_count++];
+}
+
+/**
+ * Reserves space at the end of tlv_vec::hdr and accounts for it in the
+ * segments of the packet.
+ *
+ * @return the reserved space or NULL if there is an insufficient memory.
+ */
+static char *
+reserve_vec_hdr (struct tlv_vec *v, uint32_t len)
+{
+  struct tlv_vec_seg *last;
+  char *ptr;
+
+  if (v->hdr_len + len > v->hdr_size)
+    {
+      uint32_t new_size = (v->hdr_size == 0
+			   ? VEC_HDR_INITIAL_SIZE : v->hdr_size * 2);
+
+      while (new_size < v->hdr_len + len)
+	{
+	  new_size *= 2;
+	}
+      ptr = realloc (v->hdr, new_size);
+      if (ptr == NULL)
+	{
+	  return NULL;
+	}
+      v->hdr = ptr;
+      v->hdr_size = new_size;
+    }
+
+  last = (v->seg_count == 0 ? NULL : &v->seg[v->seg_count - 1]);
+  if (last == NULL || last->ref != NULL
+      || last->offset + last->len != v->hdr_len)
+    {
+      if ((last = new_vec_seg (v)) == NULL)
+	{
+	  return NULL;
+	}
+      last->ref = NULL;
+      last->offset = v->hdr_len;
+      last->len = 0;
+    }
+  last->len += len;
+
+  ptr = v->hdr + v->hdr_len;
+  v->hdr_len += len;
+  v->len += len;
+
+  return ptr;
+}
+
+static int
+append_vec (uint32_t length, const void *data, int is_copied,
+	    struct tlv_vec *v)
+{
+  struct tlv_vec_seg *seg;
+  char *ptr;
+
+  if (length == 0)
+    {
+      return 0;
+    }
+
+  if (is_copied)
+    {
+      if ((ptr = reserve_vec_hdr (v, length)) == NULL)
+	{
+	  return -1;
+	}
+      memcpy (ptr, data, length);
+
+      return 0;
+    }
+
+  if ((seg = new_vec_seg (v)) == NULL)
+    {
+      return -1;
+    }
+  seg->ref = data;
+  seg->offset = 0;
+  seg->len = length;
+  v->len += length;
+
+  return 0;
+}
+
+int
+create_vec_raw (uint32_t length, const void *data, int is_copied,
+		struct tlv_vec *v)
+{
+  return append_vec (length, data, is_copied, v);
+}
+
+int
+create_vec_chunk (uint32_t type, uint32_t length, const void *value,
+		  int is_copied, struct tlv_vec *v)
+{
+  struct tlv_chunk hdr;
+  uint32_t padding = get_padded_length (length, VALUE_ALIGNMENT) - length;
+  char *ptr;
+
+  hdr.type = htonl (type);
+  hdr.length = htonl (length);
+  if (append_vec (sizeof (hdr), &hdr, 1, v)
+      || append_vec (length, value, is_copied, v))
+    {
+      return -1;
+    }
+
+  if (padding != 0)
+    {
+      if ((ptr = reserve_vec_hdr (v, padding)) == NULL)
+	{
+	  return -1;
+	}
+      memset (ptr, 0, padding);
+    }
+
+  return 0;
+}
+
+int
+open_vec_chunk (uint32_t type, struct tlv_vec *v, struct tlv_vec_mark *mark)
+{
+  struct tlv_chunk hdr;
+
+  mark->hdr_offset = v->hdr_len;
+  mark->len = v->len;
+
+  hdr.type = htonl (type);
+  hdr.length = 0;
+
+  return append_vec (sizeof (hdr), &hdr, 1, v);
+}
+
+void
+close_vec_chunk (const struct tlv_vec_mark *mark, struct tlv_vec *v)
+{
+  struct tlv_chunk *hdr = (struct tlv_chunk *) (v->hdr + mark->hdr_offset);
+
+  hdr->length = htonl (v->len - mark->len - sizeof (*hdr));
+}
+
+const struct iovec *
+get_vec (struct tlv_vec *v, int *iovcnt)
+{
+  struct iovec *iov;
+  int i;
+
+  iov = realloc (v->iov, (v->seg_count == 0 ? 1 : v->seg_count) * sizeof (*iov));
+  if (iov == NULL)
+    {
+      return NULL;
+    }
+  v->iov = iov;
+
+  for (i = 0; i < v->seg_count; i++)
+    {
+      const struct tlv_vec_seg *seg = &v->seg[i];
+
+      iov[i].iov_base = (void *) (seg->ref != NULL
+				  ? seg->ref : v->hdr + seg->offset);
+      iov[i].iov_len = seg->len;
+    }
+
+  *iovcnt = v->seg_count;
+
+  return iov;
+}
+
+/** The part of a TLV chunk that a tlv_parser is reading. */
+enum tlv_parser_state
+  {
+    READING_HEADER, /**< Reading the type and the length. */
+    READING_VALUE, /**< Reading an opaque value. */
+    SKIPPING_PADDING, /**< Skipping the padding after a value. */
+  };
+
+/** A nested chunk whose value is being parsed. */
+struct tlv_parser_level
+{
+  uint32_t type; /**< The type of the nested chunk in host byte order. */
+  uint32_t length; /**< The length of the nested chunk in host byte order. */
+  uint64_t end; /**< The packet offset where the nested value ends. */
+  uint32_t padding; /**< The padding after the nested value. */
+};
+
+/** The implementation of an incremental TLV packet parser. */
+struct tlv_parser_impl
+{
+  tlv_is_nested_fn is_nested; /**< Decides which chunks are nested. */
+  tlv_chunk_fn on_chunk; /**< Receives the parsed chunks. */
+  void *arg; /**< The argument to the callbacks. */
+  uint64_t total_len; /**< The packet length or 0 if it is unknown. */
+  uint64_t offset; /**< The number of packet bytes consumed so far. */
+  enum tlv_parser_state state; /**< What is being read. */
+  enum tlv_parser_status status; /**< The last status of the parser. */
+  struct tlv_chunk header; /**< The header being read. */
+  uint32_t header_len; /**< The bytes of tlv_parser_impl::header read. */
+  uint32_t type; /**< The type of the opaque chunk in host byte order. */
+  uint32_t length; /**< The length of the opaque chunk in host byte order. */
+  uint32_t value_len; /**< The bytes of tlv_parser_impl::value read. */
+  uint32_t padding; /**< The padding bytes left to be skipped. */
+  uint32_t max_value_len; /**< The capacity of tlv_parser_impl::value. */
+  unsigned int depth; /**< The number of used tlv_parser_impl::level. */
+  struct tlv_parser_level level[TLV_PARSER_MAX_DEPTH]; /**< The nesting. */
+  char value[0]; /**< The opaque value being read. */
+};
+
+int
+create_tlv_parser (tlv_parser **p, uint32_t max_value_len, uint32_t total_len,
+		   tlv_is_nested_fn is_nested, tlv_chunk_fn on_chunk, void *arg)
+{
+  struct tlv_parser_impl *o = malloc (sizeof (*o) + max_value_len);
+
+  if (o == NULL)
+    {
+      return -1;
+    }
+  memset (o, 0, sizeof (*o));
+
+  o->is_nested = is_nested;
+  o->on_chunk = on_chunk;
+  o->arg = arg;
+  o->total_len = total_len;
+  o->max_value_len = max_value_len;
+  o->state = READING_HEADER;
+  o->status = TLV_PARSER_NEED_MORE;
+
+  *p = o;
+
+  return 0;
+}
+
+void
+destroy_tlv_parser (tlv_parser **p)
+{
+  if (*p == NULL)
+    {
+      return;
+    }
+
+  free (*p);
+  *p = NULL;
+}
+
+int
+is_tlv_parser_at_boundary (const tlv_parser *p)
+{
+  return (p->state == READING_HEADER && p->header_len == 0 && p->depth == 0);
+}
+
+/**
+ * Handles a completely read chunk header.
+ *
+ * @return ::TLV_PARSER_NEED_MORE if the header is acceptable or another
+ *         status if it is not.
+ */
+static enum tlv_parser_status
+start_chunk (tlv_parser *p)
+{
+  uint32_t type = ntohl (p->header.type);
+  uint32_t length = ntohl (p->header.length);
+  uint64_t padded_length = length + ((VALUE_ALIGNMENT
+				      - (length % VALUE_ALIGNMENT))
+				     % VALUE_ALIGNMENT);
+  uint64_t limit = (p->depth > 0 ? p->level[p->depth - 1].end
+		    : (p->total_len ? p->total_len : UINT64_MAX));
+
+  p->header_len = 0;
+
+  /* The header itself may cross the end of its container.  */
+  if (p->offset > limit || padded_length > limit - p->offset)
+    {
+      return TLV_PARSER_CORRUPT;
+    }
+
+  if (p->is_nested != NULL && p->is_nested (type, p->depth, p->arg))
+    {
+      struct tlv_parser_level *level;
+
+      if (p->depth == TLV_PARSER_MAX_DEPTH)
+	{
+	  return TLV_PARSER_CORRUPT;
+	}
+
+      level = &p->level[p->depth++];
+      level->type = type;
+      level->length = length;
+      level->end = p->offset + length;
+      level->padding = padded_length - length;
+
+      return TLV_PARSER_NEED_MORE;
+    }
+
+  if (length > p->max_value_len)
+    {
+      return TLV_PARSER_TOO_BIG;
+    }
+
+  p->type = type;
+  p->length = length;
+  p->value_len = 0;
+  p->padding = padded_length - length;
+  p->state = READING_VALUE;
+
+  return TLV_PARSER_NEED_MORE;
+}
+
+/**
+ * Reports every nested chunk whose value has been completely parsed.
+ *
+ * @return non-zero if a callback asks the parser to stop or zero otherwise.
+ */
+static int
+end_nested_chunks (tlv_parser *p)
+{
+  while (p->state == READING_HEADER && p->header_len == 0 && p->depth > 0
+	 && p->offset == p->level[p->depth - 1].end)
+    {
+      struct tlv_parser_level *level = &p->level[--p->depth];
+
+      if (p->on_chunk (level->type, level->length, NULL, p->depth, p->arg))
+	{
+	  return -1;
+	}
+
+      if (level->padding != 0)
+	{
+	  p->padding = level->padding;
+	  p->state = SKIPPING_PADDING;
+	}
+    }
+
+  return 0;
+}
+
+static enum tlv_parser_status
+feed (tlv_parser *p, const char *data, uint32_t len)
+{
+  while (1)
+    {
+      uint32_t n;
+
+      if (end_nested_chunks (p))
+	{
+	  return TLV_PARSER_ABORTED;
+	}
+
+      if (is_tlv_parser_at_boundary (p)
+	  && p->total_len != 0 && p->offset == p->total_len)
+	{
+	  return (len == 0 ? TLV_PARSER_DONE : TLV_PARSER_CORRUPT);
+	}
+
+      switch (p->state)
+	{
+	case READING_HEADER:
+	  if (len == 0)
+	    {
+	      return TLV_PARSER_NEED_MORE;
+	    }
+	  n = sizeof (p->header) - p->header_len;
+	  n = (n < len ? n : len);
+	  memcpy ((char *) &p->header + p->header_len, data, n);
+	  p->header_len += n;
+	  p->offset += n;
+	  data += n;
+	  len -= n;
+
+	  if (p->header_len == sizeof (p->header))
+	    {
+	      enum tlv_parser_status status = start_chunk (p);
+
+	      if (status != TLV_PARSER_NEED_MORE)
+		{
+		  return status;
+		}
+	    }
+	  break;
+	case READING_VALUE:
+	  n = p->length - p->value_len;
+	  if (n != 0 && len == 0)
+	    {
+	      return TLV_PARSER_NEED_MORE;
+	    }
+	  n = (n < len ? n : len);
+	  memcpy (p->value + p->value_len, data, n);
+	  p->value_len += n;
+	  p->offset += n;
+	  data += n;
+	  len -= n;
+
+	  if (p->value_len == p->length)
+	    {
+	      p->state = SKIPPING_PADDING;
+	      if (p->on_chunk (p->type, p->length, p->value, p->depth, p->arg))
+		{
+		  return TLV_PARSER_ABORTED;
+		}
+	    }
+	  break;
+	case SKIPPING_PADDING:
+	  n = p->padding;
+	  if (n != 0 && len == 0)
+	    {
+	      return TLV_PARSER_NEED_MORE;
+	    }
+	  n = (n < len ? n : len);
+	  p->padding -= n;
+	  p->offset += n;
+	  data += n;
+	  len -= n;
+
+	  if (p->padding == 0)
+	    {
+	      p->state = READING_HEADER;
+	    }
+	  break;
+	}
+    }
+}
+
+enum tlv_parser_status
+feed_tlv_parser (tlv_parser *p, const void *data, uint32_t len)
+{
+  if (p->status != TLV_PARSER_NEED_MORE)
+    {
+      return p->status;
+    }
+
+  p->status = feed (p, data, len);
+
+  return p->status;
+}
@@ -22,6 +22,9 @@
  *        been created, the created inner part can be freed since the chunks
  *        have been copied into the enclosing part. See tlv_test.c for a
  *        demonstration on how to create a nested TLV packet.
+ *        Alternatively, a TLV packet can be created as a tlv_vec whose
+ *        values are referenced instead of copied so that big values can go
+ *        to a socket with writev() or sendmsg() without being copied first.
  * @example tlv_test.c
  ****************************************************************************/
 
@@ -29,6 +32,7 @@
 #define TLV_H
 
 #include <stdint.h>
+#include <sys/uio.h>
 
 #ifdef __cpluplus
 extern "C" {
@@ -37,6 +41,9 @@ extern "C" {
 /** The alignment of the value of a TLV chunk. */
 #define VALUE_ALIGNMENT (sizeof (uint32_t))
 
+/** The maximum nesting depth of TLV chunks that a tlv_parser can follow. */
+#define TLV_PARSER_MAX_DEPTH 8
+
 /** A TLV chunk. */
 struct tlv_chunk
 {
@@ -48,6 +55,37 @@ struct tlv_chunk
   char value[0]; /**< The value of a TLV chunk. */
 } __attribute__ ((packed));
 
+struct tlv_vec_seg;
+
+/**
+ * A TLV packet whose chunk values are referenced instead of copied. Only the
+ * chunk headers, the paddings and the values that the creator asks to be
+ * copied are stored in tlv_vec::hdr while the referenced values stay where
+ * they are. The packet is then obtained as an iovec array with get_vec() so
+ * that it can be given directly to writev() or sendmsg(). A tlv_vec must be
+ * zeroed (e.g., with init_vec()) before use and freed with destroy_vec().
+ * <strong>[CAUTION]</strong> A referenced value must stay unchanged in memory
+ * until the iovec array returned by get_vec() is no longer used.
+ */
+struct tlv_vec
+{
+  char *hdr; /**< The headers, paddings and copied values. */
+  uint32_t hdr_len; /**< The used bytes of tlv_vec::hdr. */
+  uint32_t hdr_size; /**< The capacity of tlv_vec::hdr in bytes. */
+  struct tlv_vec_seg *seg; /**< The segments making up the packet. */
+  int seg_count; /**< The number of used segments. */
+  int seg_size; /**< The capacity of tlv_vec::seg. */
+  struct iovec *iov; /**< The iovec array built by get_vec(). */
+  uint32_t len; /**< The total length in bytes of the packet. */
+};
+
+/** The position of a nested chunk opened with open_vec_chunk(). */
+struct tlv_vec_mark
+{
+  uint32_t hdr_offset; /**< The offset of the chunk header in tlv_vec::hdr. */
+  uint32_t len; /**< The value of tlv_vec::len before the chunk is opened. */
+};
+
 /**
  * This function wraps the pointer arithmetic, the dynamic memory allocation
  * and byte-order conversions for tlv_chunk fields.
@@ -107,6 +145,204 @@ read_chunk (const void *data,
 uint32_t
 get_padded_length (uint32_t length, uint32_t aligned_at);
 
+/**
+ * Prepares a tlv_vec to be used by the other *_vec* functions.
+ *
+ * @param [out] v the tlv_vec to be initialized.
+ */
+void
+init_vec (struct tlv_vec *v);
+
+/**
+ * Frees the memory used by a tlv_vec (but not the referenced values) and
+ * re-initializes it so that it can be reused.
+ *
+ * @param [in] v the tlv_vec to be freed.
+ */
+void
+destroy_vec (struct tlv_vec *v);
+
+/**
+ * Appends a chunk to a tlv_vec. The chunk header and the padding are
+ * written into tlv_vec::hdr. The value is either referenced or copied into
+ * tlv_vec::hdr. Copying is the right choice for small values (e.g., a
+ * timestamp held in a local variable) while referencing is the right choice
+ * for big values that outlive the tlv_vec (e.g., a long description).
+ *
+ * @param [in] type the type of the TLV chunk in host byte order.
+ * @param [in] length the length of the value in bytes in host byte order.
+ * @param [in] value the value of the TLV chunk.
+ * @param [in] is_copied non-zero if the value is to be copied or zero if the
+ *                       value is to be referenced.
+ * @param [in] v the tlv_vec to be appended.
+ *
+ * @return 0 if there is no error or -1 if there is an insufficient memory.
+ */
+int
+create_vec_chunk (uint32_t type, uint32_t length, const void *value,
+		  int is_copied, struct tlv_vec *v);
+
+/**
+ * Appends raw bytes that are not a TLV chunk (e.g., the header of a packet
+ * carrying the TLV chunks) to a tlv_vec. No padding is added.
+ *
+ * @param [in] length the number of bytes to be appended.
+ * @param [in] data the bytes to be appended.
+ * @param [in] is_copied non-zero if the data are to be copied or zero if the
+ *                       data are to be referenced.
+ * @param [in] v the tlv_vec to be appended.
+ *
+ * @return 0 if there is no error or -1 if there is an insufficient memory.
+ */
+int
+create_vec_raw (uint32_t length, const void *data, int is_copied,
+		struct tlv_vec *v);
+
+/**
+ * Starts a chunk whose value consists of the chunks appended until the
+ * matching close_vec_chunk() (i.e., a nested TLV chunk). Nested chunks can be
+ * opened inside nested chunks.
+ *
+ * @param [in] type the type of the TLV chunk in host byte order.
+ * @param [in] v the tlv_vec to be appended.
+ * @param [out] mark the position of the chunk to be given to
+ *                   close_vec_chunk().
+ *
+ * @return 0 if there is no error or -1 if there is an insufficient memory.
+ */
+int
+open_vec_chunk (uint32_t type, struct tlv_vec *v, struct tlv_vec_mark *mark);
+
+/**
+ * Ends a chunk started with open_vec_chunk() by filling in its length.
+ *
+ * @param [in] mark the position obtained from the matching open_vec_chunk().
+ * @param [in] v the tlv_vec containing the chunk.
+ */
+void
+close_vec_chunk (const struct tlv_vec_mark *mark, struct tlv_vec *v);
+
+/**
+ * Builds the iovec array describing the whole packet in a tlv_vec. The array
+ * is owned by the tlv_vec and stays valid until the tlv_vec is appended or
+ * destroyed.
+ *
+ * @param [in] v the tlv_vec whose packet is to be described.
+ * @param [out] iovcnt the number of elements in the returned array.
+ *
+ * @return the iovec array or NULL if there is an insufficient memory.
+ */
+const struct iovec *
+get_vec (struct tlv_vec *v, int *iovcnt);
+
+/** An incremental TLV packet parser. */
+typedef struct tlv_parser_impl tlv_parser;
+
+/** The result of feeding bytes to a tlv_parser. */
+enum tlv_parser_status
+  {
+    TLV_PARSER_NEED_MORE, /**<
+			   * All fed bytes are consumed and more bytes are
+			   * needed to complete the packet.
+			   */
+    TLV_PARSER_DONE, /**<
+		      * The packet whose total length was given to
+		      * create_tlv_parser() has been completely parsed.
+		      */
+    TLV_PARSER_CORRUPT, /**<
+			 * A chunk does not fit into its enclosing chunk or
+			 * packet, or the nesting is too deep.
+			 */
+    TLV_PARSER_TOO_BIG, /**< A value is bigger than the parser can hold. */
+    TLV_PARSER_ABORTED, /**< A callback asks the parser to stop. */
+  };
+
+/**
+ * The callback deciding whether or not a chunk contains nested chunks.
+ *
+ * @param [in] type the type of the chunk in host byte order.
+ * @param [in] depth the nesting depth of the chunk (0 for the outermost).
+ * @param [in] arg the argument given to create_tlv_parser().
+ *
+ * @return non-zero if the value of the chunk consists of TLV chunks or zero if
+ *         the value is opaque.
+ */
+typedef int (*tlv_is_nested_fn) (uint32_t type, unsigned int depth, void *arg);
+
+/**
+ * The callback receiving a completely parsed chunk.
+ *
+ * @param [in] type the type of the chunk in host byte order.
+ * @param [in] length the length of the value in bytes in host byte order.
+ * @param [in] value the value of an opaque chunk that is only valid during
+ *                   the call, or NULL for a chunk containing nested chunks
+ *                   (the nested chunks have been given to this callback
+ *                   before).
+ * @param [in] depth the nesting depth of the chunk (0 for the outermost).
+ * @param [in] arg the argument given to create_tlv_parser().
+ *
+ * @return 0 to continue parsing or non-zero to stop parsing.
+ */
+typedef int (*tlv_chunk_fn) (uint32_t type, uint32_t length, const void *value,
+			     unsigned int depth, void *arg);
+
+/**
+ * Creates a parser that can be fed with a TLV packet piece by piece as the
+ * packet arrives. The parser never holds more than one opaque value so that
+ * its memory usage is bounded by max_value_len. The created parser should be
+ * freed later with destroy_tlv_parser().
+ *
+ * @param [out] p the resulting parser.
+ * @param [in] max_value_len the maximum length of an opaque value.
+ * @param [in] total_len the total length of the packet or 0 if the packet
+ *                       length is unknown.
+ * @param [in] is_nested the function deciding which chunks are nested (NULL
+ *                       if no chunk is nested).
+ * @param [in] on_chunk the function receiving the parsed chunks.
+ * @param [in] arg the argument given to is_nested and on_chunk.
+ *
+ * @return 0 if there is no error or -1 if there is an insufficient memory.
+ */
+int
+create_tlv_parser (tlv_parser **p, uint32_t max_value_len, uint32_t total_len,
+		   tlv_is_nested_fn is_nested, tlv_chunk_fn on_chunk, void *arg);
+
+/**
+ * Frees the memory allocated through create_tlv_parser() and sets the pointer
+ * to NULL as a safe guard. Passing a pointer to NULL is okay but not a NULL
+ * pointer.
+ *
+ * @param [in] p the parser to be freed.
+ */
+void
+destroy_tlv_parser (tlv_parser **p);
+
+/**
+ * Feeds the next bytes of a TLV packet to a parser. Once the parser returns
+ * anything other than ::TLV_PARSER_NEED_MORE, the parser must not be fed
+ * anymore.
+ *
+ * @param [in] p the parser to be fed.
+ * @param [in] data the next bytes of the packet.
+ * @param [in] len the number of bytes in data.
+ *
+ * @return the status of the parser.
+ */
+enum tlv_parser_status
+feed_tlv_parser (tlv_parser *p, const void *data, uint32_t len);
+
+/**
+ * Checks whether or not a parser has stopped exactly at the end of a chunk
+ * that is not nested in another chunk. This is useful to tell a complete
+ * packet of unknown length from a truncated one.
+ *
+ * @param [in] p the parser to be checked.
+ *
+ * @return non-zero if the parser is at a chunk boundary or zero if it is not.
+ */
+int
+is_tlv_parser_at_boundary (const tlv_parser *p);
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,57 @@ enum tlv_type
     TYPE_123,
   };
 
+/** What a tlv_parser has reported. */
+struct parsed
+{
+  int count; /**< The number of reported chunks. */
+  uint32_t types[16]; /**< The types of the reported chunks. */
+  unsigned int depths[16]; /**< The depths of the reported chunks. */
+  int has_values[16]; /**< Non-zero if a value is reported. */
+};
+
+static int
+is_nested (uint32_t type, unsigned int depth, void *arg)
+{
+  return type == TYPE_123;
+}
+
+static int
+on_chunk (uint32_t type, uint32_t length, const void *value,
+	  unsigned int depth, void *arg)
+{
+  struct parsed *result = arg;
+
+  assert (result->count < 16);
+  result->types[result->count] = type;
+  result->depths[result->count] = depth;
+  result->has_values[result->count] = (value != NULL);
+  result->count++;
+
+  if (type == TYPE_2)
+    {
+      assert (strcmp (value, "I am here, ain't I?") == 0);
+    }
+
+  return 0;
+}
+
+static void
+check_parsed (const struct parsed *result)
+{
+  int i;
+
+  assert (result->count == 8);
+  for (i = 0; i < 8; i += 4)
+    {
+      assert (result->types[i] == TYPE_1 && result->depths[i] == 1);
+      assert (result->types[i + 1] == TYPE_2 && result->depths[i + 1] == 1);
+      assert (result->types[i + 2] == TYPE_3 && result->depths[i + 2] == 1);
+      assert (result->types[i + 3] == TYPE_123 && result->depths[i + 3] == 0);
+      assert (result->has_values[i] && !result->has_values[i + 3]);
+    }
+}
+
 int
 main (int argc, char **argv, char **envp)
 {
@@ -130,6 +181,146 @@ main (int argc, char **argv, char **envp)
       assert (itr == NULL);
     }
 
+  /* Parsing a nested TLV packet as it arrives byte by byte */
+  tlv_parser *parser;
+  struct parsed result;
+  uint32_t k;
+
+  memset (&result, 0, sizeof (result));
+  assert (create_tlv_parser (&parser, 32, larger_data_len, is_nested, on_chunk,
+			     &result) == 0);
+  for (k = 0; k < larger_data_len - 1; k++)
+    {
+      assert (feed_tlv_parser (parser, (char *) larger_data + k, 1)
+	      == TLV_PARSER_NEED_MORE);
+    }
+  assert (!is_tlv_parser_at_boundary (parser));
+  assert (feed_tlv_parser (parser, (char *) larger_data + k, 1)
+	  == TLV_PARSER_DONE);
+  check_parsed (&result);
+  destroy_tlv_parser (&parser);
+  assert (parser == NULL);
+
+  /* Parsing in uneven pieces without knowing the packet length */
+  memset (&result, 0, sizeof (result));
+  assert (create_tlv_parser (&parser, 32, 0, is_nested, on_chunk,
+			     &result) == 0);
+  assert (feed_tlv_parser (parser, larger_data, 13) == TLV_PARSER_NEED_MORE);
+  assert (feed_tlv_parser (parser, (char *) larger_data + 13, 30)
+	  == TLV_PARSER_NEED_MORE);
+  assert (feed_tlv_parser (parser, (char *) larger_data + 43,
+			   larger_data_len - 43) == TLV_PARSER_NEED_MORE);
+  assert (is_tlv_parser_at_boundary (parser));
+  check_parsed (&result);
+  destroy_tlv_parser (&parser);
+
+  /* A truncated packet needs more data */
+  memset (&result, 0, sizeof (result));
+  assert (create_tlv_parser (&parser, 32, larger_data_len, is_nested, on_chunk,
+			     &result) == 0);
+  assert (feed_tlv_parser (parser, larger_data, larger_data_len - 4)
+	  == TLV_PARSER_NEED_MORE);
+  assert (result.count == 6);
+  destroy_tlv_parser (&parser);
+
+  /* A value that is bigger than the parser can hold */
+  memset (&result, 0, sizeof (result));
+  assert (create_tlv_parser (&parser, 8, larger_data_len, is_nested, on_chunk,
+			     &result) == 0);
+  assert (feed_tlv_parser (parser, larger_data, larger_data_len)
+	  == TLV_PARSER_TOO_BIG);
+  destroy_tlv_parser (&parser);
+
+  /* A chunk that does not fit into its enclosing chunk is corrupt */
+  memset (&result, 0, sizeof (result));
+  ((struct tlv_chunk *) larger_data)->value[4 + 3] += 64; /* TYPE_1 length */
+  assert (create_tlv_parser (&parser, 32, larger_data_len, is_nested, on_chunk,
+			     &result) == 0);
+  assert (feed_tlv_parser (parser, larger_data, larger_data_len)
+	  == TLV_PARSER_CORRUPT);
+  assert (result.count == 0);
+  destroy_tlv_parser (&parser);
+  ((struct tlv_chunk *) larger_data)->value[4 + 3] -= 64;
+
+  /* A nested chunk header that crosses the end of its enclosing chunk */
+  uint32_t crossing[4] = { htonl (TYPE_123), htonl (4), htonl (TYPE_1), 0 };
+
+  memset (&result, 0, sizeof (result));
+  assert (create_tlv_parser (&parser, 32, sizeof (crossing), is_nested,
+			     on_chunk, &result) == 0);
+  assert (feed_tlv_parser (parser, crossing, sizeof (crossing))
+	  == TLV_PARSER_CORRUPT);
+  assert (result.count == 0);
+  destroy_tlv_parser (&parser);
+
+  /* A chunk header that crosses the end of the packet */
+  memset (&result, 0, sizeof (result));
+  assert (create_tlv_parser (&parser, 32, 4, is_nested, on_chunk,
+			     &result) == 0);
+  assert (feed_tlv_parser (parser, crossing + 2, 8) == TLV_PARSER_CORRUPT);
+  assert (result.count == 0);
+  destroy_tlv_parser (&parser);
+
+  /* Creating the same nested TLV packet with referenced values */
+  struct tlv_vec v;
+  struct tlv_vec_mark mark;
+  const struct iovec *iov;
+  int iovcnt;
+  char *flattened;
+  uint32_t flattened_len = 0;
+  int j;
+
+  init_vec (&v);
+  for (j = 0; j < 2; j++)
+    {
+      assert (open_vec_chunk (TYPE_123, &v, &mark) == 0);
+      assert (create_vec_chunk (TYPE_1, sizeof (value1), &value1, 1, &v) == 0);
+      assert (create_vec_chunk (TYPE_2, strlen (value2) + 1, value2, 0,
+				&v) == 0);
+      assert (create_vec_chunk (TYPE_3, sizeof (value3), &value3, 1, &v) == 0);
+      close_vec_chunk (&mark, &v);
+    }
+  assert (v.len == larger_data_len);
+
+  iov = get_vec (&v, &iovcnt);
+  assert (iov != NULL);
+  flattened = malloc (v.len);
+  assert (flattened != NULL);
+  for (j = 0; j < iovcnt; j++)
+    {
+      memcpy (flattened + flattened_len, iov[j].iov_base, iov[j].iov_len);
+      flattened_len += iov[j].iov_len;
+    }
+  assert (flattened_len == larger_data_len);
+  assert (memcmp (flattened, larger_data, larger_data_len) == 0);
+
+  /* The referenced value is not copied */
+  for (j = 0; j < iovcnt; j++)
+    {
+      if (iov[j].iov_base == value2)
+	{
+	  break;
+	}
+    }
+  assert (j < iovcnt);
+
+  free (flattened);
+  destroy_vec (&v);
+
+  /* Raw data precede the chunks */
+  init_vec (&v);
+  assert (create_vec_raw (sizeof (value1), &value1, 1, &v) == 0);
+  assert (create_vec_chunk (TYPE_2, strlen (value2) + 1, value2, 0, &v) == 0);
+  iov = get_vec (&v, &iovcnt);
+  assert (iov != NULL);
+  assert (iovcnt == 2); /* the raw data and the header are coalesced */
+  assert (*((int *) iov[0].iov_base) == value1);
+  assert (iov[0].iov_len == sizeof (value1) + sizeof (struct tlv_chunk));
+  assert (iov[1].iov_base == value2);
+  assert (v.len == sizeof (value1) + sizeof (struct tlv_chunk)
+	  + get_padded_length (strlen (value2) + 1, VALUE_ALIGNMENT));
+  destroy_vec (&v);
+
   free (larger_data);
 
   exit (EXIT_SUCCESS);